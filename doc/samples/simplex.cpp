@@ -28,7 +28,7 @@ int main(int argc, char **argv)
 {
     UNUSED(argc, argv);
 
-    srand(time(nullptr));
+    rand_engine::get_thread().seed((uint64_t)time(nullptr));
 
     /* Create an image */
     image img(size);
@@ -40,6 +40,24 @@ public:
         return m_commands[i].m1;
     }
 
+    //Hash of the commands and their arguments, 64-bit FNV-1a
+    static uint64_t HashBytes(void const *data, size_t bytes, uint64_t h)
+    {
+        for (size_t i = 0; i < bytes; ++i)
+            h = (h ^ ((uint8_t const *)data)[i]) * 0x100000001b3ull;
+        return h;
+    }
+    uint64_t GetHash(uint64_t h = 0xcbf29ce484222325ull) const
+    {
+        for (int i = 0; i < m_commands.count(); ++i)
+        {
+            int cmd[3] = { m_commands[i].m1, m_commands[i].m2, m_commands[i].m3 };
+            h = HashBytes(cmd, sizeof(cmd), h);
+        }
+        h = HashBytes(m_floats.data(), m_floats.count() * sizeof(float), h);
+        return HashBytes(m_ints.data(), m_ints.count() * sizeof(int), h);
+    }
+
     //cmd storage
     void    AddCmd(int cmd) { m_commands.push(cmd, m_floats.count(), m_ints.count()); }
 
@@ -45,12 +45,14 @@ void DebugStats::TickGame(float seconds)
 {
     Entity::TickGame(seconds);
 
-    fprintf(data->fp, "%i %f %f %f %f\n",
+    fprintf(data->fp, "%i %f %f %f %f %f %f\n",
             Ticker::GetFrameNum(),
             Profiler::GetAvg(Profiler::STAT_TICK_GAME),
             Profiler::GetAvg(Profiler::STAT_TICK_DRAW),
             Profiler::GetAvg(Profiler::STAT_TICK_BLIT),
-            Profiler::GetAvg(Profiler::STAT_TICK_FRAME));
+            Profiler::GetAvg(Profiler::STAT_TICK_FRAME),
+            Profiler::GetAvg(Profiler::STAT_DRAW_UNIFORMS),
+            Profiler::GetAvg(Profiler::STAT_DRAW_UNIFORMS_SKIPPED));
 }
 
 DebugStats::~DebugStats()
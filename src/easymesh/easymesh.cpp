@@ -20,7 +20,12 @@ namespace lol
 
 //-----------------------------------------------------------------------------
 EasyMesh::EasyMesh()
-  : m_build_data(nullptr)
+  : m_optimize_cache(true),
+    m_optimize_overdraw(false),
+    m_lod_centre(0.f),
+    m_lod_radius(0.f),
+    m_lod_pixel_error(1.f),
+    m_build_data(nullptr)
 {
     m_cursors.push(0, 0);
     m_state = MeshRender::NeedData;
@@ -32,6 +37,13 @@ EasyMesh::EasyMesh(const EasyMesh& em)
     m_indices = em.m_indices;
     m_vert = em.m_vert;
     m_cursors = em.m_cursors;
+    m_optimize_cache = em.m_optimize_cache;
+    m_optimize_overdraw = em.m_optimize_overdraw;
+    m_lod_indices = em.m_lod_indices;
+    m_lod_errors = em.m_lod_errors;
+    m_lod_centre = em.m_lod_centre;
+    m_lod_radius = em.m_lod_radius;
+    m_lod_pixel_error = em.m_lod_pixel_error;
     m_build_data = nullptr;
     if (em.m_build_data)
         m_build_data = new EasyMeshBuildData(*em.m_build_data);
@@ -77,6 +77,14 @@ protected:
 };
 typedef SafeEnum<MeshTransformBase> MeshTransform;
 
+//VertexCacheStats ------------------------------------------------------------
+/* Vertex shader runs of an index buffer with a post-transform cache */
+struct VertexCacheStats
+{
+    float acmr; /* per triangle: 3 at worst, around 0.6 for good meshes */
+    float atvr; /* per vertex: 1 at best */
+};
+
 class EasyMesh : public Mesh
 {
     friend class EasyMeshParser;
@@ -93,13 +101,61 @@ public:
     //-------------------------------------------------------------------------
     void MeshConvert();
 
+    /* Reorder triangles for the vertex cache, and vertices in the order
+     * they are used, when converting. With overdraw, triangle clusters
+     * facing outwards are also drawn first. Only the former is on by
+     * default. */
+    void SetRenderOptimization(bool vertex_cache, bool overdraw = false);
+    /* Run the above now, optionally reporting statistics before and after */
+    void OptimizeForRender(bool overdraw, VertexCacheStats *before = nullptr,
+                           VertexCacheStats *after = nullptr);
+    VertexCacheStats GetVertexCacheStats(int cache_size = 16) const;
+
+    //-------------------------------------------------------------------------
+    //Level of detail operations
+    //-------------------------------------------------------------------------
+    /* Build simplified index lists with about ratios[i] of the triangles,
+     * to be used instead of the full mesh when their error is smaller
+     * than pixel_error on screen. Call after the mesh is built. */
+    void GenerateLods(array<float> const &ratios, float pixel_error = 1.f);
+    /* 0 for the full mesh, i for the level made with ratios[i - 1] */
+    int SelectLod(mat4 const &model, mat4 const &view, mat4 const &proj,
+                  float screen_height) const;
+    int GetLodCount() const { return m_lod_indices.count(); }
+    /* Collapse edges until at most target_count indices remain, keeping
+     * the vertices of borders and seams. Return the geometric error. */
+    static float Simplify(array<VertexData> const &vert,
+                          array<uint32_t> &indices, int target_count);
+
+    virtual void Render(Scene &scene, mat4 const &matrix);
+    virtual void Render(Scene &scene, array<mat4> const &matrices);
+protected:
+    /* Only the full mesh, not its levels of detail */
+    virtual int GetDrawnSubMeshCount() const;
+public:
+
     //-------------------------------------------------------------------------
     //Command-build (lua now) operations
     //-------------------------------------------------------------------------
     bool Compile(char const *command, bool Execute = true);
     void ExecuteCmdStack(bool ExecAllStack = true);
 
+    //-------------------------------------------------------------------------
+    //Build cache operations
+    //-------------------------------------------------------------------------
+    /* Store meshes built by ExecuteCmdStack() in this directory, and load
+     * them back instead of building them again. Empty disables the cache. */
+    static void SetCacheDir(std::string const &dir);
+    static void GetCacheStats(int &hits, int &misses, float &saved_seconds);
+    /* Hash of the command stack and build state, or 0 without a cache */
+    uint64_t GetCacheKey();
+
 private:
+    void OptimizeOnConvert();
+
+    bool LoadCache(uint64_t key);
+    void SaveCache(uint64_t key, float build_time);
+
     void UpdateVertexDict(array< int, int > &vertex_dict);
 
     //-------------------------------------------------------------------------
@@ -271,6 +327,13 @@ public:
     void BendZY(float t, float toff=0.f);
 private:
     void DoMeshTransform(MeshTransform ct, Axis axis0, Axis axis1, float n0, float n1, float noff, bool absolute=false);
+    /* Transform positions by m and normals by normal_matrix, renormalising
+     * them if asked, for all vertices after the cursor */
+    void DoAffineTransform(mat4 const &m, mat3 const &normal_matrix,
+                           bool renormalize, bool flip_winding);
+    /* Execute a run of Translate, Rotate and Scale commands as a single
+     * transform. Returns false if the current command is not one. */
+    bool ExecuteAffineCmds();
 public:
     /* [cmd:s/sx/sy/sz] Scale vertices
         - s : scale quantity.
@@ -424,6 +487,12 @@ public:
     array<int, int>     m_cursors;
 
     MeshRender          m_state;
+    bool                m_optimize_cache, m_optimize_overdraw;
+
+    array<array<uint16_t>> m_lod_indices;
+    array<float>        m_lod_errors;
+    vec3                m_lod_centre;
+    float               m_lod_radius, m_lod_pixel_error;
 
 public:
     inline EasyMeshBuildData* BD()
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cstring> /* for memcpy */
 #include <map>
 
 // Vertex building operations
@@ -34,6 +35,8 @@ struct MeshBuildOperationBase : public StructSafeEnum
         IgnoreQuadWeighting = (1 << 4),
         PostBuildComputeNormals = (1 << 5),
         PreventVertCleanup = (1 << 6),
+        //When this flag is up, vertices at the same position share normals.
+        SmoothSplitVertices = (1 << 7),
 
         All = 0xffff,
     };
@@ -47,6 +50,7 @@ protected:
         enum_map[IgnoreQuadWeighting] = "IgnoreQuadWeighting";
         enum_map[PostBuildComputeNormals] = "PostBuildComputeNormals";
         enum_map[PreventVertCleanup] = "PreventVertCleanup";
+        enum_map[SmoothSplitVertices] = "SmoothSplitVertices";
         enum_map[All] = "All";
         return true;
     }
@@ -272,6 +276,18 @@ protected:
 };
 typedef SafeEnum<TexCoordPosBase> TexCoordPos;
 
+//EasyMeshPositionHash -- Hash of exact vertex positions ----------------------
+struct EasyMeshPositionHash
+{
+    size_t operator()(vec3 const &v) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, &v, sizeof(bits));
+        return (size_t)(bits[0] * 0x9e3779b1u ^ bits[1] * 0x85ebca77u
+                         ^ bits[2] * 0xc2b2ae3du);
+    }
+};
+
 class EasyMeshBuildData
 {
 public:
@@ -500,6 +516,12 @@ public:
     uint32_t            m_texcoord_build_type[MeshType::MAX];
     uint32_t            m_texcoord_build_type2[MeshType::MAX];
     uint32_t            m_build_flags = MeshBuildOperation::PreventVertCleanup;
+
+    /* ComputeNormals() scratch storage, kept across calls so that
+     * computing the normals of each new triangle does not allocate */
+    array<int>          m_normal_slots;
+    array<vec3>         m_normal_sums;
+    hash_map<vec3, int, EasyMeshPositionHash> m_normal_positions;
 };
 
 //VDictType -- A safe enum for VertexDictionnary operations. ------------------
@@ -0,0 +1,385 @@
+//
+//  EasyMesh-Cache: The code belonging to the build cache
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <cstring>
+
+#if defined _WIN32
+#   define WIN32_LEAN_AND_MEAN 1
+#   include <windows.h>
+#   undef WIN32_LEAN_AND_MEAN
+#elif defined HAVE_SYS_MMAN_H
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace lol
+{
+
+/*
+ * Built meshes are saved in a file named after a hash of the command
+ * stack and of the build state it starts from. Positions, bone indices,
+ * cursors and indices are stored as is; normals, colours, texture
+ * coordinates and bone weights are stored as halves.
+ */
+
+namespace
+{
+
+char const cache_magic[4] = { 'L', 'o', 'l', 'm' };
+uint32_t const cache_version = 1;
+
+struct cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t vert_count, index_count, cursor_count;
+    uint16_t index_size, flags;
+    float build_time;
+    uint32_t reserved;
+    vec4 color_a, color_b;
+};
+
+enum
+{
+    /* Bone data is only stored when one vertex uses it */
+    has_bones = 1 << 0,
+};
+
+size_t vertex_bytes(uint16_t flags)
+{
+    return 3 * sizeof(float) + 11 * sizeof(half)
+         + (flags & has_bones ? 4 * sizeof(int32_t) + 4 * sizeof(half) : 0);
+}
+
+/* A read-only view of a whole file, memory-mapped where possible */
+class mapped_file
+{
+public:
+    mapped_file(std::string const &path)
+      : m_data(nullptr),
+        m_size(0)
+    {
+#if defined _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                                0, 0, nullptr);
+            if (mapping)
+            {
+                m_data = (uint8_t const *)MapViewOfFile(mapping, FILE_MAP_READ,
+                                                        0, 0, 0);
+                m_size = m_data ? (size_t)size.QuadPart : 0;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#elif defined HAVE_SYS_MMAN_H
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ,
+                           MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                m_data = (uint8_t const *)p;
+                m_size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+#else
+        File f;
+        f.Open(path, FileAccess::Read, true);
+        if (!f.IsValid())
+            return;
+        m_copy = f.ReadString();
+        f.Close();
+        m_data = (uint8_t const *)m_copy.data();
+        m_size = m_copy.length();
+#endif
+    }
+
+    ~mapped_file()
+    {
+#if defined _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+#elif defined HAVE_SYS_MMAN_H
+        if (m_data)
+            munmap((void *)m_data, m_size);
+#endif
+    }
+
+    uint8_t const *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    uint8_t const *m_data;
+    size_t m_size;
+#if !defined _WIN32 && !defined HAVE_SYS_MMAN_H
+    std::string m_copy;
+#endif
+};
+
+std::string cache_dir;
+int cache_hits = 0, cache_misses = 0;
+float cache_saved_time = 0.f;
+
+std::string cache_path(uint64_t key)
+{
+    return cache_dir + format("%016llx.mesh", (unsigned long long)key);
+}
+
+} /* namespace */
+
+//-----------------------------------------------------------------------------
+void EasyMesh::SetCacheDir(std::string const &dir)
+{
+    cache_dir = dir;
+    if (dir.length() && dir.back() != '/' && dir.back() != '\\')
+        cache_dir += '/';
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::GetCacheStats(int &hits, int &misses, float &saved_seconds)
+{
+    hits = cache_hits;
+    misses = cache_misses;
+    saved_seconds = cache_saved_time;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t EasyMesh::GetCacheKey()
+{
+    if (!cache_dir.length())
+        return 0;
+
+    EasyMeshBuildData *bd = BD();
+    auto mix = [](uint64_t h, void const *data, size_t bytes)
+    {
+        return CommandStack::HashBytes(data, bytes, h);
+    };
+
+    /* Recording and execution flags do not change the result */
+    uint32_t flags = bd->m_build_flags
+                   & ~(uint32_t)(MeshBuildOperation::CommandRecording
+                                  | MeshBuildOperation::CommandExecution);
+
+    uint64_t h = bd->CmdStack().GetHash();
+    h = mix(h, &cache_version, sizeof(cache_version));
+    h = mix(h, &flags, sizeof(flags));
+    h = mix(h, &bd->m_color_a, sizeof(bd->m_color_a));
+    h = mix(h, &bd->m_color_b, sizeof(bd->m_color_b));
+    h = mix(h, &bd->m_texcoord_offset, sizeof(bd->m_texcoord_offset));
+    h = mix(h, &bd->m_texcoord_offset2, sizeof(bd->m_texcoord_offset2));
+    h = mix(h, &bd->m_texcoord_scale, sizeof(bd->m_texcoord_scale));
+    h = mix(h, &bd->m_texcoord_scale2, sizeof(bd->m_texcoord_scale2));
+    h = mix(h, bd->m_texcoord_build_type, sizeof(bd->m_texcoord_build_type));
+    h = mix(h, bd->m_texcoord_build_type2, sizeof(bd->m_texcoord_build_type2));
+    for (int i = 0; i < MeshType::MAX; ++i)
+    {
+        for (auto const &tc : bd->m_texcoord_custom_build[i])
+            h = mix(mix(h, &tc.m1, sizeof(vec2)), &tc.m2, sizeof(vec2));
+        for (auto const &tc : bd->m_texcoord_custom_build2[i])
+            h = mix(mix(h, &tc.m1, sizeof(vec2)), &tc.m2, sizeof(vec2));
+    }
+
+    /* Zero means “no key” to the caller */
+    return h ? h : 1;
+}
+
+//-----------------------------------------------------------------------------
+bool EasyMesh::LoadCache(uint64_t key)
+{
+    timer t;
+    mapped_file file(cache_path(key));
+
+    cache_header header;
+    if (file.size() < sizeof(header))
+    {
+        ++cache_misses;
+        return false;
+    }
+
+    memcpy((void *)&header, file.data(), sizeof(header));
+    size_t const index_size = sizeof(m_indices[0]);
+    size_t const n = header.vert_count;
+    if (memcmp(header.magic, cache_magic, sizeof(cache_magic))
+         || header.version != cache_version || header.key != key
+         || header.index_size != index_size
+         || file.size() != sizeof(header) + n * vertex_bytes(header.flags)
+                         + header.cursor_count * 2 * sizeof(int32_t)
+                         + header.index_count * index_size)
+    {
+        ++cache_misses;
+        return false;
+    }
+
+    /* Fixed-size attributes come first, halves last so that every block
+     * stays aligned. */
+    uint8_t const *p = file.data() + sizeof(header);
+    m_vert.resize((int)n);
+
+    for (size_t i = 0; i < n; ++i, p += sizeof(vec3))
+        memcpy((void *)&m_vert[(int)i].m_coord, p, sizeof(vec3));
+
+    if (header.flags & has_bones)
+        for (size_t i = 0; i < n; ++i, p += sizeof(ivec4))
+            memcpy((void *)&m_vert[(int)i].m_bone_id, p, sizeof(ivec4));
+
+    m_cursors.resize((int)header.cursor_count);
+    for (auto &c : m_cursors)
+    {
+        int32_t cursor[2];
+        memcpy(cursor, p, sizeof(cursor));
+        p += sizeof(cursor);
+        c.m1 = cursor[0];
+        c.m2 = cursor[1];
+    }
+
+    m_indices.resize((int)header.index_count);
+    memcpy(m_indices.data(), p, header.index_count * index_size);
+    p += header.index_count * index_size;
+
+    /* Expand each half stream with the bulk converter, then spread it */
+    array<float> tmp;
+    tmp.resize((int)(4 * n));
+    auto read_halves = [&](int components, size_t offset)
+    {
+        size_t count = components * n;
+        (void)half::convert(tmp.data(), (half const *)p, count);
+        p += count * sizeof(half);
+        for (size_t i = 0; i < n; ++i)
+            memcpy((uint8_t *)&m_vert[(int)i] + offset,
+                   tmp.data() + components * i, components * sizeof(float));
+    };
+    read_halves(3, offsetof(VertexData, m_normal));
+    read_halves(4, offsetof(VertexData, m_color));
+    read_halves(4, offsetof(VertexData, m_texcoord));
+    if (header.flags & has_bones)
+        read_halves(4, offsetof(VertexData, m_bone_weight));
+
+    /* Leave the build data as a full build would */
+    BD()->ColorA() = header.color_a;
+    BD()->ColorB() = header.color_b;
+    BD()->Cmdi() = BD()->CmdStack().GetCmdNb();
+    BD()->Disable(MeshBuildOperation::PostBuildComputeNormals);
+    BD()->Disable(MeshBuildOperation::PreventVertCleanup);
+    m_state = MeshRender::NeedConvert;
+
+    float load_time = t.get();
+    ++cache_hits;
+    cache_saved_time += header.build_time - load_time;
+    msg::debug("loaded mesh %016llx from cache in %.3fms instead of %.3fms\n",
+               (unsigned long long)key, 1e3f * load_time,
+               1e3f * header.build_time);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::SaveCache(uint64_t key, float build_time)
+{
+    cache_header header = {};
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.key = key;
+    header.vert_count = (uint32_t)m_vert.count();
+    header.index_count = (uint32_t)m_indices.count();
+    header.cursor_count = (uint32_t)m_cursors.count();
+    header.index_size = (uint16_t)sizeof(m_indices[0]);
+    header.build_time = build_time;
+    header.color_a = BD()->ColorA();
+    header.color_b = BD()->ColorB();
+
+    for (auto const &v : m_vert)
+        if (v.m_bone_id != ivec4(0) || v.m_bone_weight != vec4(0.f))
+        {
+            header.flags |= has_bones;
+            break;
+        }
+
+    size_t const n = header.vert_count;
+    array<uint8_t> data;
+    data.resize((int)(sizeof(header) + n * vertex_bytes(header.flags)
+                       + header.cursor_count * 2 * sizeof(int32_t)
+                       + header.index_count * header.index_size));
+
+    uint8_t *p = data.data();
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    for (auto const &v : m_vert)
+    {
+        memcpy(p, &v.m_coord, sizeof(vec3));
+        p += sizeof(vec3);
+    }
+
+    if (header.flags & has_bones)
+        for (auto const &v : m_vert)
+        {
+            memcpy(p, &v.m_bone_id, sizeof(ivec4));
+            p += sizeof(ivec4);
+        }
+
+    for (auto const &c : m_cursors)
+    {
+        int32_t cursor[2] = { c.m1, c.m2 };
+        memcpy(p, cursor, sizeof(cursor));
+        p += sizeof(cursor);
+    }
+
+    memcpy(p, m_indices.data(), header.index_count * header.index_size);
+    p += header.index_count * header.index_size;
+
+    array<float> tmp;
+    tmp.resize((int)(4 * n));
+    auto write_halves = [&](int components, size_t offset)
+    {
+        for (size_t i = 0; i < n; ++i)
+            memcpy(tmp.data() + components * i,
+                   (uint8_t const *)&m_vert[(int)i] + offset,
+                   components * sizeof(float));
+        size_t count = components * n;
+        (void)half::convert((half *)p, tmp.data(), count);
+        p += count * sizeof(half);
+    };
+    write_halves(3, offsetof(VertexData, m_normal));
+    write_halves(4, offsetof(VertexData, m_color));
+    write_halves(4, offsetof(VertexData, m_texcoord));
+    if (header.flags & has_bones)
+        write_halves(4, offsetof(VertexData, m_bone_weight));
+
+    File f;
+    f.Open(cache_path(key), FileAccess::Write, true);
+    if (!f.IsValid())
+        return;
+    f.Write(data.data(), data.count());
+    f.Close();
+}
+
+} /* namespace lol */
+
@@ -12,6 +12,8 @@
 
 #include <lol/engine-internal.h>
 
+#include <cmath>
+
 namespace lol
 {
 
@@ -118,42 +120,134 @@ void EasyMesh::AddTriangle(int i1, int i2, int i3, int base, bool duplicate)
 }
 
 //-----------------------------------------------------------------------------
-void EasyMesh::ComputeNormals(int start, int vcount)
+namespace
 {
 
+/* Below this many triangles per job, threads cost more than they save */
+int const normal_parallel_threshold = 16384;
+
+/* Up to this many vertices, shared positions are found without hashing */
+int const normal_small_span = 16;
+
+} /* namespace */
+
+/* Each triangle adds its unit normal to its three vertices, weighted by
+ * the triangle's angle at that vertex. Coplanar neighbours then weigh
+ * the same however a face was triangulated, which is what the previous
+ * duplicate removal was for. With SmoothSplitVertices, vertices sharing
+ * a position share one sum. */
+void EasyMesh::ComputeNormals(int start, int vcount)
+{
     if (BD()->IsEnabled(MeshBuildOperation::CommandExecution) &&
         BD()->IsEnabled(MeshBuildOperation::PostBuildComputeNormals))
         return;
 
-    array< array<vec3> > normals;
-    normals.resize(m_vert.count());
-    for (int i = 0; i < vcount; i += 3)
-    {
-        vec3 v0 = m_vert[m_indices[start + i + 2]].m_coord
-                - m_vert[m_indices[start + i + 0]].m_coord;
-        vec3 v1 = m_vert[m_indices[start + i + 1]].m_coord
-                - m_vert[m_indices[start + i + 0]].m_coord;
-        vec3 n = normalize(cross(v1, v0));
+    if (vcount < 3)
+        return;
 
-        for (int j = 0; j < 3; j++)
-            normals[m_indices[start + i + j]] << n;
+    /* Only the vertices referenced by the range need accumulators */
+    int lo = m_indices[start], hi = lo;
+    for (int i = start; i < start + vcount; ++i)
+    {
+        lo = min(lo, (int)m_indices[i]);
+        hi = max(hi, (int)m_indices[i]);
     }
+    int const span = hi - lo + 1;
+
+    thread_pool &pool = thread_pool::get();
+    int const tcount = vcount / 3;
+    int jobs = 1;
+    while (jobs * 2 <= pool.count()
+            && jobs < 16 && tcount / (jobs * 2) >= normal_parallel_threshold)
+        jobs *= 2;
+
+    array<int> &slot = BD()->m_normal_slots;
+    slot.resize(span);
+    if (BD()->IsEnabled(MeshBuildOperation::SmoothSplitVertices)
+         && span <= normal_small_span)
+    {
+        /* Single triangles from the CSG code: clearing a hash map that
+         * grew on a large mesh would cost more than a linear search */
+        for (int i = 0; i < span; ++i)
+        {
+            vec3 p = m_vert[lo + i].m_coord;
+            slot[i] = i;
+            for (int j = 0; j < i; ++j)
+                if (m_vert[lo + j].m_coord == p)
+                {
+                    slot[i] = j;
+                    break;
+                }
+        }
+    }
+    else if (BD()->IsEnabled(MeshBuildOperation::SmoothSplitVertices))
+    {
+        auto &first = BD()->m_normal_positions;
+        first.clear();
+        first.reserve(span);
+        for (int i = 0; i < span; ++i)
+        {
+            /* Adding zero turns -0.f into 0.f for hashing */
+            vec3 p = m_vert[lo + i].m_coord + vec3(0.f);
+            slot[i] = first.insert(std::make_pair(p, i)).first->second;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < span; ++i)
+            slot[i] = i;
+    }
+
+    /* Each job gets its own run of accumulators, summed at the end */
+    array<vec3> &sum = BD()->m_normal_sums;
+    sum.empty();
+    sum.resize(span * jobs, vec3(0.f));
 
-    for (int i = 0; i < normals.count(); i++)
+    VertexData const *vert = m_vert.data();
+    uint16_t const *indices = m_indices.data() + start;
+    int const *slots = slot.data();
+    vec3 *sums = sum.data();
+    auto accumulate = [vert, indices, slots, sums, span, lo, tcount, jobs](int job)
     {
-        if (normals[i].count() > 0)
+        vec3 *dst = sums + job * span;
+        int a = (int)((int64_t)tcount * job / jobs);
+        int b = (int)((int64_t)tcount * (job + 1) / jobs);
+        for (int t = a; t < b; ++t)
         {
-            //remove doubles
-            for (int j = 0; j < normals[i].count(); ++j)
-                for (int k = j + 1; k < normals[i].count(); ++k)
-                    if (1.f - dot(normals[i][k], normals[i][j]) < .00001f)
-                        normals[i].remove(k--);
-
-            vec3 newv = vec3::zero;
-            for (int j = 0; j < normals[i].count(); ++j)
-                newv += normals[i][j];
-            m_vert[i].m_normal = normalize(newv / (float)normals[i].count());
+            int i0 = indices[3 * t], i1 = indices[3 * t + 1], i2 = indices[3 * t + 2];
+            vec3 p0 = vert[i0].m_coord, p1 = vert[i1].m_coord, p2 = vert[i2].m_coord;
+            vec3 e01 = p1 - p0, e12 = p2 - p1, e20 = p0 - p2;
+            vec3 n = cross(e01, -e20);
+            float len = length(n);
+            if (!len)
+                continue;
+            n /= len;
+
+            /* atan2 of |a×b| and a·b stays accurate for thin triangles */
+            float w0 = std::atan2(length(cross(e01, e20)), -dot(e01, e20));
+            float w1 = std::atan2(length(cross(e12, e01)), -dot(e12, e01));
+            float w2 = std::atan2(length(cross(e20, e12)), -dot(e20, e12));
+            dst[slots[i0 - lo]] += w0 * n;
+            dst[slots[i1 - lo]] += w1 * n;
+            dst[slots[i2 - lo]] += w2 * n;
         }
+    };
+
+    if (jobs == 1)
+        accumulate(0);
+    else
+        pool.run(jobs, accumulate);
+
+    for (int j = 1; j < jobs; ++j)
+        for (int i = 0; i < span; ++i)
+            sum[i] += sum[j * span + i];
+
+    /* Vertices of degenerate triangles only keep their previous normal */
+    for (int i = 0; i < span; ++i)
+    {
+        vec3 n = sum[slot[i]];
+        if (n != vec3(0.f))
+            m_vert[lo + i].m_normal = normalize(n);
     }
 }
 
@@ -0,0 +1,412 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// EasyMesh-Lod — The code belonging to level of detail generation
+
+namespace lol
+{
+
+namespace
+{
+
+/* Sum of squared distances to planes, as pᵀAp + 2b·p + c, and the total
+ * weight of these planes */
+struct quadric
+{
+    static quadric plane(vec3 const &n, float d, float w)
+    {
+        quadric q;
+        q.a00 = w * n.x * n.x; q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z;
+        q.a11 = w * n.y * n.y; q.a12 = w * n.y * n.z; q.a22 = w * n.z * n.z;
+        q.b = w * d * n;
+        q.c = w * d * d;
+        q.w = w;
+        return q;
+    }
+
+    inline quadric &operator +=(quadric const &q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b += q.b;
+        c += q.c;
+        w += q.w;
+        return *this;
+    }
+
+    inline quadric operator +(quadric const &q) const
+    {
+        quadric ret = *this;
+        return ret += q;
+    }
+
+    /* Mean squared distance of p to the planes */
+    inline float error(vec3 const &p) const
+    {
+        float e = p.x * (a00 * p.x + a01 * p.y + a02 * p.z)
+                + p.y * (a01 * p.x + a11 * p.y + a12 * p.z)
+                + p.z * (a02 * p.x + a12 * p.y + a22 * p.z)
+                + 2.f * dot(b, p) + c;
+        return w > 0.f ? max(e, 0.f) / w : 0.f;
+    }
+
+    float a00 = 0.f, a01 = 0.f, a02 = 0.f, a11 = 0.f, a12 = 0.f, a22 = 0.f;
+    vec3 b = vec3(0.f);
+    float c = 0.f, w = 0.f;
+};
+
+/* Vertices that only differ by their normal can be welded */
+struct weld_key
+{
+    vec3 coord;
+    vec4 texcoord, color;
+
+    bool operator ==(weld_key const &k) const
+    {
+        return coord == k.coord && texcoord == k.texcoord && color == k.color;
+    }
+};
+
+template<typename T>
+struct bytes_hash
+{
+    size_t operator()(T const &x) const
+    {
+        return (size_t)CommandStack::HashBytes(&x, sizeof(x), 0xcbf29ce484222325ull);
+    }
+};
+
+struct collapse_candidate
+{
+    int from, to;
+    float cost;
+};
+
+} /* namespace */
+
+//-----------------------------------------------------------------------------
+/* Repeated passes of half-edge collapses: each pass sorts the candidate
+ * collapses by quadric error and applies the cheapest ones that touch
+ * disjoint triangle fans. Vertices on borders and on UV or colour seams
+ * are locked, so the collapses only ever move into existing vertices
+ * and all levels of detail can share one vertex buffer. */
+float EasyMesh::Simplify(array<VertexData> const &vert,
+                         array<uint32_t> &indices, int target_count)
+{
+    /* Weld vertices that only differ by their normal */
+    array<int> weld, rep;
+    weld.resize(vert.count());
+    {
+        hash_map<weld_key, int, bytes_hash<weld_key>> ids;
+        ids.reserve(vert.count());
+        for (int i = 0; i < vert.count(); ++i)
+        {
+            /* Adding zero turns -0.f into 0.f for hashing */
+            weld_key k = { vert[i].m_coord + vec3(0.f),
+                           vert[i].m_texcoord + vec4(0.f),
+                           vert[i].m_color + vec4(0.f) };
+            auto ret = ids.insert(std::make_pair(k, rep.count()));
+            if (ret.second)
+                rep.push(i);
+            weld[i] = ret.first->second;
+        }
+    }
+    int const wcount = rep.count();
+
+    array<vec3> pos;
+    pos.resize(wcount);
+    for (int w = 0; w < wcount; ++w)
+        pos[w] = vert[rep[w]].m_coord;
+
+    array<int> tris;
+    tris.reserve(indices.count());
+    for (int i = 0; i + 2 < indices.count(); i += 3)
+    {
+        int a = weld[indices[i]], b = weld[indices[i + 1]], c = weld[indices[i + 2]];
+        if (a != b && b != c && c != a)
+            tris << a << b << c;
+    }
+
+    /* Lock seams, where welded vertices still share a position, and
+     * borders, where an edge has no opposite edge */
+    array<uint8_t> locked;
+    locked.resize(wcount, 0);
+    {
+        hash_map<vec3, int, bytes_hash<vec3>> first;
+        first.reserve(wcount);
+        for (int w = 0; w < wcount; ++w)
+        {
+            auto ret = first.insert(std::make_pair(pos[w] + vec3(0.f), w));
+            if (!ret.second)
+                locked[w] = locked[ret.first->second] = 1;
+        }
+
+        hash_map<uint64_t, int> edges;
+        edges.reserve(tris.count());
+        for (int i = 0; i < tris.count(); ++i)
+        {
+            uint64_t a = (uint32_t)tris[i], b = (uint32_t)tris[i / 3 * 3 + (i + 1) % 3];
+            edges[a << 32 | b] = 1;
+        }
+        for (int i = 0; i < tris.count(); ++i)
+        {
+            uint64_t a = (uint32_t)tris[i], b = (uint32_t)tris[i / 3 * 3 + (i + 1) % 3];
+            if (!edges.count(b << 32 | a))
+                locked[a] = locked[b] = 1;
+        }
+    }
+
+    /* Area-weighted plane quadrics */
+    array<quadric> q;
+    q.resize(wcount);
+    for (int i = 0; i < tris.count(); i += 3)
+    {
+        vec3 p0 = pos[tris[i]], p1 = pos[tris[i + 1]], p2 = pos[tris[i + 2]];
+        vec3 n = cross(p1 - p0, p2 - p0);
+        float len = length(n);
+        if (!len)
+            continue;
+        n /= len;
+        quadric plane = quadric::plane(n, -dot(n, p0), 0.5f * len);
+        for (int k = 0; k < 3; ++k)
+            q[tris[i + k]] += plane;
+    }
+
+    array<int> collapse, offsets, adjacency;
+    array<uint8_t> touched;
+    array<collapse_candidate> candidates;
+    collapse.resize(wcount);
+    offsets.resize(wcount + 1);
+    touched.resize(wcount);
+    for (int w = 0; w < wcount; ++w)
+        collapse[w] = w;
+
+    /* Would moving from to to turn any remaining triangle over? */
+    auto flips = [&](int from, int to)
+    {
+        for (int j = offsets[from]; j < offsets[from + 1]; ++j)
+        {
+            int const *t = tris.data() + 3 * adjacency[j];
+            if (t[0] == to || t[1] == to || t[2] == to)
+                continue;
+            int k = t[0] == from ? 0 : t[1] == from ? 1 : 2;
+            vec3 b = pos[t[(k + 1) % 3]], c = pos[t[(k + 2) % 3]];
+            vec3 n0 = cross(b - pos[from], c - pos[from]);
+            vec3 n1 = cross(b - pos[to], c - pos[to]);
+            if (dot(n0, n1) <= 0.25f * length(n0) * length(n1))
+                return true;
+        }
+        return false;
+    };
+
+    float max_error = 0.f;
+    int const target_tris = max(target_count, 0) / 3;
+    while (tris.count() / 3 > target_tris)
+    {
+        int const tri_count = tris.count() / 3;
+
+        /* Triangles around each vertex */
+        for (auto &o : offsets)
+            o = 0;
+        for (int i : tris)
+            ++offsets[i + 1];
+        for (int w = 0; w < wcount; ++w)
+            offsets[w + 1] += offsets[w];
+        adjacency.resize(tris.count());
+        for (int i = 0; i < tris.count(); ++i)
+            adjacency[offsets[tris[i]]++] = i / 3;
+        for (int w = wcount; w > 0; --w)
+            offsets[w] = offsets[w - 1];
+        offsets[0] = 0;
+
+        /* Each edge appears once in each direction, in its two triangles */
+        candidates.empty();
+        for (int i = 0; i < tris.count(); ++i)
+        {
+            int from = tris[i], to = tris[i / 3 * 3 + (i + 1) % 3];
+            if (!locked[from])
+                candidates.push({ from, to, (q[from] + q[to]).error(pos[to]) });
+        }
+        std::sort(candidates.data(), candidates.data() + candidates.count(),
+                  [](collapse_candidate const &a, collapse_candidate const &b)
+        {
+            return a.cost < b.cost;
+        });
+
+        for (auto &t : touched)
+            t = 0;
+        int removed = 0, collapses = 0;
+        for (auto const &c : candidates)
+        {
+            if (tri_count - removed <= target_tris)
+                break;
+            if (touched[c.from] || touched[c.to] || flips(c.from, c.to))
+                continue;
+
+            collapse[c.from] = c.to;
+            q[c.to] += q[c.from];
+            max_error = max(max_error, c.cost);
+            ++collapses;
+
+            /* The fan of the removed vertex waits for the next pass */
+            for (int j = offsets[c.from]; j < offsets[c.from + 1]; ++j)
+            {
+                int const *t = tris.data() + 3 * adjacency[j];
+                removed += t[0] == c.to || t[1] == c.to || t[2] == c.to;
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = 1;
+            }
+        }
+
+        if (!collapses)
+            break;
+
+        int n = 0;
+        for (int i = 0; i < tris.count(); i += 3)
+        {
+            int a = collapse[tris[i]], b = collapse[tris[i + 1]], c = collapse[tris[i + 2]];
+            if (a != b && b != c && c != a)
+            {
+                tris[n++] = a;
+                tris[n++] = b;
+                tris[n++] = c;
+            }
+        }
+        tris.resize(n);
+    }
+
+    indices.resize(tris.count());
+    for (int i = 0; i < tris.count(); ++i)
+        indices[i] = (uint32_t)rep[tris[i]];
+    return std::sqrt(max_error);
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::GenerateLods(array<float> const &ratios, float pixel_error)
+{
+    m_lod_indices.empty();
+    m_lod_errors.empty();
+    m_lod_pixel_error = pixel_error;
+
+    /* Bounding sphere, for the distance to the camera */
+    vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (auto const &v : m_vert)
+    {
+        lo = min(lo, v.m_coord);
+        hi = max(hi, v.m_coord);
+    }
+    m_lod_centre = 0.5f * (lo + hi);
+    m_lod_radius = 0.f;
+    for (auto const &v : m_vert)
+        m_lod_radius = max(m_lod_radius, distance(v.m_coord, m_lod_centre));
+
+    /* Each level starts from the previous one, so errors add up */
+    array<uint32_t> indices;
+    for (auto i : m_indices)
+        indices << i;
+    float error = 0.f;
+    for (float ratio : ratios)
+    {
+        error += Simplify(m_vert, indices, (int)(ratio * m_indices.count()));
+        m_lod_indices.push(array<uint16_t>());
+        for (auto i : indices)
+            m_lod_indices.last() << (uint16_t)i;
+        m_lod_errors << error;
+    }
+}
+
+//-----------------------------------------------------------------------------
+int EasyMesh::SelectLod(mat4 const &model, mat4 const &view, mat4 const &proj,
+                        float screen_height) const
+{
+    /* Largest scale of the model matrix */
+    float scale = max(max(length(model[0].xyz), length(model[1].xyz)),
+                      length(model[2].xyz));
+
+    /* Pixels per world unit at the closest point of the bounding sphere;
+     * orthographic projections have no perspective division */
+    float pixels = 0.5f * screen_height * proj[1][1];
+    if (proj[3][3] == 0.f)
+    {
+        vec4 centre = view * model * vec4(m_lod_centre, 1.f);
+        float dist = -centre.z - scale * m_lod_radius;
+        if (dist <= 0.f)
+            return 0;
+        pixels /= dist;
+    }
+
+    int lod = 0;
+    for (int i = 0; i < m_lod_errors.count(); ++i)
+        if (m_lod_errors[i] * scale * pixels <= m_lod_pixel_error)
+            lod = i + 1;
+    return lod;
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::Render(Scene &scene, mat4 const &matrix)
+{
+    int const lods = m_lod_indices.count() + 1;
+    if (lods == 1 || m_submeshes.count() < lods)
+    {
+        Mesh::Render(scene, matrix);
+        return;
+    }
+
+    /* MeshConvert() appended one submesh per level of detail */
+    Camera *camera = scene.GetCamera();
+    int lod = camera ? SelectLod(matrix, camera->GetView(), camera->GetProjection(),
+                                 (float)Video::GetSize().y) : 0;
+    SubMesh *submesh = m_submeshes[m_submeshes.count() - lods + lod];
+    scene.AddPrimitiveRenderer(this, new PrimitiveMesh(submesh, matrix));
+}
+
+void EasyMesh::Render(Scene &scene, array<mat4> const &matrices)
+{
+    int const lods = m_lod_indices.count() + 1;
+    if (m_submeshes.count() < lods)
+    {
+        Mesh::Render(scene, matrices);
+        return;
+    }
+
+    /* All levels share the shader and vertex buffer, so every copy goes
+     * into the same batch, with one draw per level in use. */
+    Camera *camera = lods > 1 ? scene.GetCamera() : nullptr;
+    mat4 view = camera ? camera->GetView() : mat4(1.f);
+    mat4 proj = camera ? camera->GetProjection() : mat4(1.f);
+    float height = (float)Video::GetSize().y;
+
+    PrimitiveMeshBatch *batch = new PrimitiveMeshBatch();
+    for (mat4 const &matrix : matrices)
+    {
+        int lod = camera ? SelectLod(matrix, view, proj, height) : 0;
+        batch->Add(m_submeshes[m_submeshes.count() - lods + lod], matrix);
+    }
+    scene.AddPrimitiveRenderer(this, batch);
+}
+
+int EasyMesh::GetDrawnSubMeshCount() const
+{
+    /* The levels MeshConvert() appended come last */
+    int const lods = m_lod_indices.count();
+    if (m_submeshes.count() <= lods)
+        return m_submeshes.count();
+    return m_submeshes.count() - lods;
+}
+
+} /* namespace lol */
+
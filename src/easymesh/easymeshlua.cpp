@@ -251,6 +251,17 @@ void EasyMesh::ExecuteCmdStack(bool ExecAllStack)
         case EasyMeshCmdType::MESH_CMD:     \
     { EZM_CALL_FUNC FUNC_PARAMS; break; }
 
+    /* Only whole builds of an empty mesh can come from the cache */
+    uint64_t cache_key = 0;
+    if (ExecAllStack && BD()->CmdExecNb() < 0
+         && !m_vert.count() && !m_indices.count())
+    {
+        cache_key = GetCacheKey();
+        if (cache_key && LoadCache(cache_key))
+            return;
+    }
+    timer t;
+
     BD()->Enable(MeshBuildOperation::CommandExecution);
     if (ExecAllStack)
         BD()->Cmdi() = 0;
@@ -260,6 +271,10 @@ void EasyMesh::ExecuteCmdStack(bool ExecAllStack)
         if (BD()->CmdExecNb() > 0)
             --BD()->CmdExecNb();
 
+        /* Consecutive affine commands are applied in a single pass */
+        if (ExecuteAffineCmds())
+            continue;
+
         switch (BD()->CmdStack().GetCmd(BD()->Cmdi()))
         {
             DO_EXEC_CMD(MeshCsg, (MeshCsg, CSGUsage))
@@ -312,5 +327,8 @@ void EasyMesh::ExecuteCmdStack(bool ExecAllStack)
 
     if (BD()->CmdExecNb() > 0)
         BD()->CmdExecNb() = -1;
+
+    if (cache_key)
+        SaveCache(cache_key, t.get());
 }
 
@@ -0,0 +1,414 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <algorithm>
+#include <cmath>
+
+// EasyMesh-Optimize — The code belonging to render optimisation
+
+namespace lol
+{
+
+namespace
+{
+
+/* Size of the LRU cache that triangle scores assume; larger than most
+ * hardware caches, which only makes the order more robust */
+int const score_cache_size = 32;
+
+/* Clusters may cost this much more in vertex shading than the order
+ * they come from, in exchange for a better drawing order */
+float const overdraw_threshold = 1.05f;
+
+/* Tom Forsyth's vertex score: vertices of the last triangle get a fixed
+ * score, the others decay with their cache position, and vertices with
+ * few triangles left get a boost so that no lone triangle is left behind */
+struct vertex_scorer
+{
+    vertex_scorer()
+    {
+        for (int i = 0; i < score_cache_size; ++i)
+            cache[i] = i < 3 ? 0.75f : std::pow(1.f - (float)(i - 3)
+                                          / (score_cache_size - 3), 1.5f);
+        for (int i = 1; i < valence_size; ++i)
+            valence[i] = 2.f * std::pow((float)i, -0.5f);
+        valence[0] = 0.f;
+    }
+
+    inline float operator()(int cache_pos, int remaining) const
+    {
+        if (!remaining)
+            return -1.f;
+        float score = cache_pos < 0 ? 0.f : cache[cache_pos];
+        return score + (remaining < valence_size ? valence[remaining]
+                                 : 2.f * std::pow((float)remaining, -0.5f));
+    }
+
+    static int const valence_size = 32;
+    float cache[score_cache_size];
+    float valence[valence_size];
+};
+
+/* Emit triangles greedily, always picking the best scored triangle among
+ * those using a cached vertex. This is linear in the triangle count. */
+void optimize_vertex_cache(array<uint16_t> &indices, int vert_count)
+{
+    static vertex_scorer const score;
+    int const tri_count = indices.count() / 3;
+
+    /* Triangles using each vertex, as offsets into a single array */
+    array<int> remaining, offsets, adjacency;
+    remaining.resize(vert_count, 0);
+    offsets.resize(vert_count + 1, 0);
+    adjacency.resize(tri_count * 3);
+    for (int i = 0; i < tri_count * 3; ++i)
+        ++remaining[indices[i]];
+    for (int v = 0; v < vert_count; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    {
+        array<int> fill;
+        fill.resize(vert_count, 0);
+        for (int i = 0; i < tri_count * 3; ++i)
+        {
+            int v = indices[i];
+            adjacency[offsets[v] + fill[v]++] = i / 3;
+        }
+    }
+
+    array<int> cache_pos;
+    array<float> vert_score, tri_score;
+    array<uint8_t> emitted;
+    cache_pos.resize(vert_count, -1);
+    vert_score.resize(vert_count);
+    tri_score.resize(tri_count, 0.f);
+    emitted.resize(tri_count, 0);
+    for (int v = 0; v < vert_count; ++v)
+        vert_score[v] = score(-1, remaining[v]);
+    for (int i = 0; i < tri_count * 3; ++i)
+        tri_score[i / 3] += vert_score[indices[i]];
+
+    int cache[score_cache_size + 3], cache_count = 0;
+    array<uint16_t> out;
+    out.reserve(tri_count * 3);
+    int best = -1, next_unused = 0;
+
+    for (int n = 0; n < tri_count; ++n)
+    {
+        /* When no cached vertex has triangles left, start from the next
+         * unused triangle in the original order */
+        if (best < 0)
+        {
+            while (emitted[next_unused])
+                ++next_unused;
+            best = next_unused;
+        }
+
+        emitted[best] = 1;
+        int tri[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            int v = tri[k] = indices[3 * best + k];
+            out.push(v);
+
+            /* Remove the triangle from the vertex's list */
+            int *list = adjacency.data() + offsets[v];
+            for (int j = 0; j < remaining[v]; ++j)
+                if (list[j] == best)
+                {
+                    list[j] = list[--remaining[v]];
+                    break;
+                }
+        }
+
+        /* Move the triangle's vertices to the front of the cache */
+        int new_cache[score_cache_size + 3], new_count = 0;
+        for (int k = 0; k < 3; ++k)
+            new_cache[new_count++] = tri[k];
+        for (int j = 0; j < cache_count; ++j)
+        {
+            int v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                new_cache[new_count++] = v;
+        }
+
+        /* Update the scores of all vertices that moved, including the
+         * ones that just left the cache, and of their triangles */
+        for (int j = 0; j < new_count; ++j)
+        {
+            int v = new_cache[j];
+            cache_pos[v] = j < score_cache_size ? j : -1;
+            float s = score(cache_pos[v], remaining[v]);
+            float delta = s - vert_score[v];
+            vert_score[v] = s;
+
+            int const *list = adjacency.data() + offsets[v];
+            for (int t = 0; t < remaining[v]; ++t)
+                tri_score[list[t]] += delta;
+        }
+
+        cache_count = min(new_count, score_cache_size);
+        best = -1;
+        float best_score = -1.f;
+        for (int j = 0; j < cache_count; ++j)
+        {
+            int v = cache[j] = new_cache[j];
+            int const *list = adjacency.data() + offsets[v];
+            for (int t = 0; t < remaining[v]; ++t)
+                if (tri_score[list[t]] > best_score)
+                {
+                    best = list[t];
+                    best_score = tri_score[list[t]];
+                }
+        }
+    }
+
+    indices = out;
+}
+
+/* FIFO cache simulation. A vertex is cached if fewer than cache_size
+ * misses happened since it was last loaded, so flushing is O(1). */
+struct fifo_cache
+{
+    fifo_cache(int vert_count, int cache_size)
+      : m_size(cache_size),
+        m_time(cache_size + 1)
+    {
+        m_stamps.resize(vert_count, 0);
+    }
+
+    /* Return the number of misses for one triangle */
+    inline int add(uint16_t const *tri)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (m_time - m_stamps[tri[k]] > m_size)
+            {
+                m_stamps[tri[k]] = m_time++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    inline void flush() { m_time += m_size + 1; }
+
+    inline bool was_used(int v) const { return m_stamps[v] != 0; }
+
+private:
+    array<int> m_stamps;
+    int m_size, m_time;
+};
+
+/* Split the triangle order into clusters, which are then sorted so that
+ * clusters facing away from the mesh centre are drawn first and hide the
+ * ones behind them. Clusters start where the cache would be cold anyway,
+ * and also wherever restarting keeps the cost below the threshold. */
+void optimize_overdraw(array<uint16_t> &indices, array<VertexData> const &vert)
+{
+    int const tri_count = indices.count() / 3;
+    int const cache_size = 16;
+
+    /* Hard boundaries: triangles with three misses */
+    array<int> hard, misses;
+    misses.resize(tri_count);
+    fifo_cache fifo(vert.count(), cache_size);
+    for (int i = 0; i < tri_count; ++i)
+    {
+        misses[i] = fifo.add(indices.data() + 3 * i);
+        if (!i || misses[i] == 3)
+            hard.push(i);
+    }
+    hard.push(tri_count);
+
+    /* Soft boundaries inside each hard cluster */
+    array<int> clusters;
+    for (int h = 0; h + 1 < hard.count(); ++h)
+    {
+        int start = hard[h], end = hard[h + 1];
+        int total = 0;
+        for (int i = start; i < end; ++i)
+            total += misses[i];
+        float limit = overdraw_threshold * total / (end - start);
+
+        int cluster_start = start, cluster_misses = 0;
+        clusters.push(start);
+        fifo.flush();
+        for (int i = start; i + 1 < end; ++i)
+        {
+            cluster_misses += fifo.add(indices.data() + 3 * i);
+            int done = i + 1 - cluster_start;
+            if (done >= 8 && cluster_misses <= limit * done)
+            {
+                /* The next triangle starts with a cold cache */
+                cluster_start = i + 1;
+                cluster_misses = 0;
+                clusters.push(cluster_start);
+                fifo.flush();
+            }
+        }
+    }
+    clusters.push(tri_count);
+
+    /* Area-weighted centroid of the whole mesh */
+    vec3 centre(0.f);
+    float area = 0.f;
+    for (int i = 0; i < tri_count; ++i)
+    {
+        vec3 p0 = vert[indices[3 * i]].m_coord;
+        vec3 p1 = vert[indices[3 * i + 1]].m_coord;
+        vec3 p2 = vert[indices[3 * i + 2]].m_coord;
+        float a = length(cross(p1 - p0, p2 - p0));
+        centre += a * (p0 + p1 + p2);
+        area += 3.f * a;
+    }
+    if (area > 0.f)
+        centre /= area;
+
+    /* Sort clusters by how much their average normal points outwards */
+    int const cluster_count = clusters.count() - 1;
+    array<float> sort_key;
+    array<int> order;
+    sort_key.resize(cluster_count);
+    order.resize(cluster_count);
+    for (int c = 0; c < cluster_count; ++c)
+    {
+        vec3 normal(0.f), mid(0.f);
+        float weight = 0.f;
+        for (int i = clusters[c]; i < clusters[c + 1]; ++i)
+        {
+            vec3 p0 = vert[indices[3 * i]].m_coord;
+            vec3 p1 = vert[indices[3 * i + 1]].m_coord;
+            vec3 p2 = vert[indices[3 * i + 2]].m_coord;
+            vec3 n = cross(p1 - p0, p2 - p0);
+            float a = length(n);
+            normal += n;
+            mid += a * (p0 + p1 + p2);
+            weight += 3.f * a;
+        }
+        if (weight > 0.f)
+            mid /= weight;
+        /* Clusters whose normals cancel out face no particular way;
+         * normalize() would return NaN and break the sort ordering */
+        float len = length(normal);
+        sort_key[c] = len > 0.f ? dot(mid - centre, normal / len) : 0.f;
+        order[c] = c;
+    }
+    std::stable_sort(order.data(), order.data() + order.count(), [&sort_key](int a, int b)
+    {
+        return sort_key[a] > sort_key[b];
+    });
+
+    array<uint16_t> out;
+    out.reserve(indices.count());
+    for (int c : order)
+        for (int i = 3 * clusters[c]; i < 3 * clusters[c + 1]; ++i)
+            out.push(indices[i]);
+    indices = out;
+}
+
+} /* namespace */
+
+//-----------------------------------------------------------------------------
+void EasyMesh::SetRenderOptimization(bool vertex_cache, bool overdraw)
+{
+    m_optimize_cache = vertex_cache;
+    m_optimize_overdraw = vertex_cache && overdraw;
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::OptimizeForRender(bool overdraw, VertexCacheStats *before,
+                                 VertexCacheStats *after)
+{
+    if (before)
+        *before = GetVertexCacheStats();
+
+    if (m_indices.count() >= 3)
+    {
+        optimize_vertex_cache(m_indices, m_vert.count());
+        if (overdraw)
+            optimize_overdraw(m_indices, m_vert);
+
+        /* Store vertices in the order the triangles first use them, and
+         * unused vertices last */
+        array<int> remap;
+        remap.resize(m_vert.count(), -1);
+        array<VertexData> old_vert = m_vert;
+        int next = 0;
+        for (auto &i : m_indices)
+        {
+            if (remap[i] < 0)
+            {
+                remap[i] = next;
+                m_vert[next++] = old_vert[i];
+            }
+            i = (uint16_t)remap[i];
+        }
+        for (int i = 0; i < old_vert.count(); ++i)
+            if (remap[i] < 0)
+            {
+                remap[i] = next;
+                m_vert[next++] = old_vert[i];
+            }
+
+        /* Levels of detail share the vertices, but get their own order */
+        for (auto &lod : m_lod_indices)
+        {
+            for (auto &i : lod)
+                i = (uint16_t)remap[i];
+            optimize_vertex_cache(lod, m_vert.count());
+        }
+    }
+
+    if (after)
+        *after = GetVertexCacheStats();
+}
+
+//-----------------------------------------------------------------------------
+VertexCacheStats EasyMesh::GetVertexCacheStats(int cache_size) const
+{
+    VertexCacheStats ret = { 0.f, 0.f };
+    int const tri_count = m_indices.count() / 3;
+    if (!tri_count)
+        return ret;
+
+    fifo_cache fifo(m_vert.count(), cache_size);
+    int misses = 0;
+    for (int i = 0; i < tri_count; ++i)
+        misses += fifo.add(m_indices.data() + 3 * i);
+
+    int used = 0;
+    for (int v = 0; v < m_vert.count(); ++v)
+        used += fifo.was_used(v) ? 1 : 0;
+
+    ret.acmr = (float)misses / tri_count;
+    ret.atvr = (float)misses / used;
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+void EasyMesh::OptimizeOnConvert()
+{
+    if (!m_optimize_cache)
+        return;
+
+    VertexCacheStats before, after;
+    OptimizeForRender(m_optimize_overdraw, &before, &after);
+    msg::debug("easymesh: %d triangles, ACMR %.3f → %.3f, ATVR %.3f → %.3f\n",
+               m_indices.count() / 3, before.acmr, after.acmr,
+               before.atvr, after.atvr);
+}
+
+} /* namespace lol */
+
@@ -24,12 +24,16 @@ LOLFX_RESOURCE_DECLARE(easymesh_shinydebuglighting);
 LOLFX_RESOURCE_DECLARE(easymesh_shinydebugnormal);
 LOLFX_RESOURCE_DECLARE(easymesh_shinydebugUV);
 LOLFX_RESOURCE_DECLARE(easymesh_shiny_SK);
+LOLFX_RESOURCE_DECLARE(easymesh_shinyinstanced);
 
 //-----------------------------------------------------------------------------
 void EasyMesh::MeshConvert()
 {
-    /* Default material */
+    /* Default material, and its variant for drawing many copies */
     Shader *shader = Shader::Create(LOLFX_RESOURCE_NAME(easymesh_shiny));
+    Shader *instance_shader = Shader::Create(LOLFX_RESOURCE_NAME(easymesh_shinyinstanced));
+
+    OptimizeOnConvert();
 
     /* Push index buffer to GPU */
     IndexBuffer *ibo = new IndexBuffer(m_indices.count() * sizeof(uint16_t));
@@ -65,9 +69,23 @@ void EasyMesh::MeshConvert()
 
     /* Reference our new data in our submesh */
     m_submeshes.push(new SubMesh(shader, vdecl));
+    m_submeshes.last()->SetInstanceShader(instance_shader);
     m_submeshes.last()->SetIndexBuffer(ibo);
     m_submeshes.last()->SetVertexBuffer(0, vbo);
 
+    /* Levels of detail only need their own index buffer */
+    for (auto const &lod : m_lod_indices)
+    {
+        ibo = new IndexBuffer(lod.bytes());
+        memcpy(ibo->Lock(0, 0), lod.data(), lod.bytes());
+        ibo->Unlock();
+
+        m_submeshes.push(new SubMesh(shader, vdecl));
+        m_submeshes.last()->SetInstanceShader(instance_shader);
+        m_submeshes.last()->SetIndexBuffer(ibo);
+        m_submeshes.last()->SetVertexBuffer(0, vbo);
+    }
+
     m_state = MeshRender::CanRender;
 }
 
@@ -159,15 +177,8 @@ DefaultShaderData::DefaultShaderData(uint16_t vert_decl_flags, Shader* shader, b
     SetupDefaultData(with_UV);
 }
 
-static std::string const DefaultUniforms[8] =
+static std::string const DefaultUniforms[1] =
 {
-    "u_lights",
-    "u_model",
-    "u_modelview",
-    "u_view",
-    "u_inv_view",
-    "u_proj",
-    "u_normalmat",
     "u_damage",
 };
 
@@ -180,41 +191,19 @@ void DefaultShaderData::StoreUniformNames()
 void DefaultShaderData::SetupDefaultData(bool with_UV)
 {
     UNUSED(with_UV);
-    for (int i = 0; i < 7; i++)
+    for (int i = 0; i < 1; i++)
         AddUniform(DefaultUniforms[i]);
 }
 
 //-----------------------------------------------------------------------------
 void DefaultShaderData::SetupShaderDatas(mat4 const &model)
 {
-    Scene& scene = Scene::GetScene();
-    mat4 proj = scene.GetCamera()->GetProjection();
-    mat4 view = scene.GetCamera()->GetView();
-    mat4 modelview = view * model;
-    mat3 normalmat = transpose(inverse(mat3(modelview)));
-    /* FIXME: this should be hidden in the shader */
-    array<Light *> const &lights = scene.GetLights();
-    array<vec4> light_data;
+    /* Camera and lights come from the per-frame scene data */
+    m_shader->SetModelMatrix(model);
+
     //This is not very nice, but necessary for emscripten WebGL generation.
     float f = 0.f;
-
-    /* FIXME: the 4th component of the position can be used for other things */
-    /* FIXME: GetUniform("blabla") is costly */
-    for (int i = 0; i < lights.count(); ++i)
-        light_data << vec4(lights[i]->GetPosition(), (float)lights[i]->GetType()) << lights[i]->GetColor();
-    while (light_data.count() < LOL_MAX_LIGHT_COUNT)
-        light_data << vec4::zero << vec4::zero;
-
-    int i = 0;
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), light_data);
-
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), model);
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), modelview);
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), view);
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), inverse(view));
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), proj);
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), normalmat);
-    m_shader->SetUniform(*GetUniform(DefaultUniforms[i++]), f);
+    m_shader->SetUniform(m_shader_uniform[0].m2, f);
 }
 
 //-----------------------------------------------------------------------------
@@ -261,6 +250,10 @@ void GpuEasyMeshData::AddGpuData(GpuShaderData* gpudata, EasyMesh* src_mesh)
     if (has_color)      gpudata->AddAttribute(VertexUsage::Color, 0);
     if (has_texcoord)   gpudata->AddAttribute(VertexUsage::TexCoord, 0);
 
+    /* Optimise before the first vertex or index buffer is made */
+    if (!m_ibo && !m_vdatas.count())
+        src_mesh->OptimizeOnConvert();
+
     SetupVertexData(gpudata->m_vert_decl_flags, src_mesh);
 
     if (!m_ibo)
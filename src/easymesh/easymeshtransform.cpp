@@ -14,11 +14,157 @@
 
 #include <lol/engine-internal.h>
 
+#include <cfloat>
+
+#include "simd.h"
+
 // EasyMesh-Transform — The code belonging to transform operations
 
 namespace lol
 {
 
+namespace
+{
+
+/* Vertex attributes are interleaved, so the kernels below gather the
+ * same field of four vertices into SIMD lanes and scatter it back. */
+ptrdiff_t const vertex_stride = sizeof(VertexData) / sizeof(float);
+
+/* Below this many vertices per job, threads cost more than they save */
+int const parallel_threshold = 16384;
+
+/* Run a block kernel over vertices [start, end). Large ranges are split
+ * across the shared thread pool, on multiples of four so that no SIMD
+ * block straddles two jobs. */
+template<typename K>
+void run_kernel(array<VertexData> &vert, int start, int end, K const &kernel)
+{
+    VertexData *data = vert.data();
+    auto range = [data, &kernel](int a, int b)
+    {
+        int i = a;
+#if LOL_FEATURE_SSE2
+        for ( ; i + lane4::width <= b; i += lane4::width)
+            kernel.template run<lane4>(data + i);
+#endif
+        for ( ; i < b; ++i)
+            kernel.template run<lane1>(data + i);
+    };
+
+    thread_pool &pool = thread_pool::get();
+    int const count = end - start;
+    int jobs = 1;
+    while (jobs * 2 <= pool.count()
+            && jobs < 16 && count / (jobs * 2) >= parallel_threshold)
+        jobs *= 2;
+
+    if (jobs == 1)
+    {
+        range(start, end);
+        return;
+    }
+
+    pool.run(jobs, [&range, start, end, count, jobs](int i)
+    {
+        int a = start + ((int)((int64_t)count * i / jobs) & ~3);
+        int b = i + 1 < jobs ? start + ((int)((int64_t)count * (i + 1) / jobs) & ~3)
+                             : end;
+        range(a, b);
+    });
+}
+
+struct affine_kernel
+{
+    template<typename F>
+    inline void run(VertexData *v) const
+    {
+        float *p = &v->m_coord[0];
+        F x = F::gather(p, vertex_stride);
+        F y = F::gather(p + 1, vertex_stride);
+        F z = F::gather(p + 2, vertex_stride);
+        for (int k = 0; k < 3; ++k)
+            (F(m[0][k]) * x + F(m[1][k]) * y + F(m[2][k]) * z + F(m[3][k]))
+                .scatter(p + k, vertex_stride);
+
+        float *n = &v->m_normal[0];
+        x = F::gather(n, vertex_stride);
+        y = F::gather(n + 1, vertex_stride);
+        z = F::gather(n + 2, vertex_stride);
+        F nx = F(nm[0][0]) * x + F(nm[1][0]) * y + F(nm[2][0]) * z;
+        F ny = F(nm[0][1]) * x + F(nm[1][1]) * y + F(nm[2][1]) * z;
+        F nz = F(nm[0][2]) * x + F(nm[1][2]) * y + F(nm[2][2]) * z;
+        if (renormalize)
+        {
+            /* Zero normals stay zero, like normalize() does */
+            F norm = lane_max(lane_sqrt(nx * nx + ny * ny + nz * nz), F(FLT_MIN));
+            nx = nx / norm;
+            ny = ny / norm;
+            nz = nz / norm;
+        }
+        nx.scatter(n, vertex_stride);
+        ny.scatter(n + 1, vertex_stride);
+        nz.scatter(n + 2, vertex_stride);
+    }
+
+    mat4 m;
+    mat3 nm;
+    bool renormalize;
+};
+
+struct deform_kernel
+{
+    template<typename F>
+    inline void run(VertexData *v) const
+    {
+        float *p = &v->m_coord[0];
+        F c[3] = { F::gather(p, vertex_stride),
+                   F::gather(p + 1, vertex_stride),
+                   F::gather(p + 2, vertex_stride) };
+        F value = absolute ? lane_abs(c[axis]) : c[axis];
+        int const a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+
+        switch (type)
+        {
+        case MeshTransform::Taper:
+            c[a1] = c[a1] * lane_max(F(0.f), F(1.f) + (F(n0) * value + F(noff)));
+            c[a2] = c[a2] * lane_max(F(0.f), F(1.f) + (F(n1) * value + F(noff)));
+            break;
+        case MeshTransform::Shear:
+            c[a1] = c[a1] + (F(n0) * value + F(noff));
+            c[a2] = c[a2] + (F(n1) * value + F(noff));
+            break;
+        case MeshTransform::Twist:
+        case MeshTransform::Bend:
+        {
+            /* Rotate around rot_axis by an angle that depends on the
+             * position along axis; there is no SIMD sine, though. */
+            float angle[F::width], sine[F::width], cosine[F::width];
+            (F(F_PI / 180.0f) * (F(n0) * c[axis] + F(noff))).store(angle);
+            for (int k = 0; k < F::width; ++k)
+            {
+                sine[k] = std::sin(angle[k]);
+                cosine[k] = std::cos(angle[k]);
+            }
+            F st = F::load(sine), ct = F::load(cosine);
+            int const r1 = (rot_axis + 1) % 3, r2 = (rot_axis + 2) % 3;
+            F u = c[r1], w = c[r2];
+            c[r1] = ct * u - st * w;
+            c[r2] = st * u + ct * w;
+            break;
+        }
+        }
+
+        for (int k = 0; k < 3; ++k)
+            c[k].scatter(p + k, vertex_stride);
+    }
+
+    int type, axis, rot_axis;
+    float n0, n1, noff;
+    bool absolute;
+};
+
+} /* namespace */
+
 //-----------------------------------------------------------------------------
 void EasyMesh::TranslateX(float t) { Translate(vec3(t, 0.f, 0.f)); }
 void EasyMesh::TranslateY(float t) { Translate(vec3(0.f, t, 0.f)); }
@@ -34,8 +180,7 @@ void EasyMesh::Translate(vec3 const &v)
         return;
     }
 
-    for (int i = m_cursors.last().m1; i < m_vert.count(); i++)
-        m_vert[i].m_coord += v;
+    DoAffineTransform(mat4::translate(v), mat3(1.f), false, false);
 }
 
 //-----------------------------------------------------------------------------
@@ -54,11 +199,7 @@ void EasyMesh::Rotate(float degrees, vec3 const &axis)
     }
 
     mat3 m = mat3::rotate(radians(degrees), axis);
-    for (int i = m_cursors.last().m1; i < m_vert.count(); i++)
-    {
-        m_vert[i].m_coord  = m * m_vert[i].m_coord;
-        m_vert[i].m_normal = m * m_vert[i].m_normal;
-    }
+    DoAffineTransform(mat4(m), m, false, false);
 }
 
 //-----------------------------------------------------------------------------
@@ -148,46 +289,25 @@ void EasyMesh::DoMeshTransform(MeshTransform ct, Axis axis0, Axis axis1, float n
         return;
     }
 
-    for (int i = m_cursors.last().m1; i < m_vert.count(); i++)
+    /* Twist rotates around the axis it reads, Bend around the other one.
+     * Stretch is not implemented yet:
+     *   value = abs(coord[axis0])
+     *   coord[(axis0 + 1) % 3] += pow(value, n0) + noff
+     *   coord[(axis0 + 2) % 3] += pow(value, n1) + noff */
+    if (ct != MeshTransform::Stretch)
     {
-        switch (ct.ToScalar())
-        {
-            case MeshTransform::Taper:
-            {
-                float value = m_vert[i].m_coord[axis0.ToScalar()];
-                if (absolute) value = abs(value);
-                m_vert[i].m_coord[(axis0.ToScalar() + 1) % 3] *= max(0.f, 1.f + (n0 * value + noff));
-                m_vert[i].m_coord[(axis0.ToScalar() + 2) % 3] *= max(0.f, 1.f + (n1 * value + noff));
-                break;
-            }
-            case MeshTransform::Twist:
-            {
-                vec3 rotaxis = vec3(1.f); rotaxis[(axis0.ToScalar() + 1) % 3] = .0f; rotaxis[(axis0.ToScalar() + 2) % 3] = .0f;
-                m_vert[i].m_coord = mat3::rotate(radians(m_vert[i].m_coord[axis0.ToScalar()] * n0 + noff), rotaxis) * m_vert[i].m_coord;
-                break;
-            }
-            case MeshTransform::Shear:
-            {
-                float value = m_vert[i].m_coord[axis0.ToScalar()];
-                if (absolute) value = abs(value);
-                m_vert[i].m_coord[(axis0.ToScalar() + 1) % 3] += (n0 * value + noff);
-                m_vert[i].m_coord[(axis0.ToScalar() + 2) % 3] += (n1 * value + noff);
-                break;
-            }
-            case MeshTransform::Stretch:
-            {
-                //float value = abs(m_vert[i].m1[axis0.ToScalar()]);
-                //m_vert[i].m1[(axis0.ToScalar() + 1) % 3] += (lol::pow(value, n0) + noff);
-                //m_vert[i].m1[(axis0.ToScalar() + 2) % 3] += (lol::pow(value, n1) + noff);
-                break;
-            }
-            case MeshTransform::Bend:
-            {
-                vec3 rotaxis = vec3(1.f); rotaxis[(axis1.ToScalar() + 1) % 3] = .0f; rotaxis[(axis1.ToScalar() + 2) % 3] = .0f;
-                m_vert[i].m_coord = mat3::rotate(radians(m_vert[i].m_coord[axis0.ToScalar()] * n0 + noff), rotaxis) * m_vert[i].m_coord;
-                break;
-            }
-        }
+        deform_kernel kernel;
+        kernel.type = ct.ToScalar();
+        kernel.axis = axis0.ToScalar();
+        kernel.rot_axis = ct == MeshTransform::Bend ? axis1.ToScalar()
+                                                    : axis0.ToScalar();
+        kernel.n0 = n0;
+        kernel.n1 = n1;
+        kernel.noff = noff;
+        /* Only Taper and Shear ever used the absolute value */
+        kernel.absolute = absolute && (ct == MeshTransform::Taper
+                                        || ct == MeshTransform::Shear);
+        run_kernel(m_vert, m_cursors.last().m1, m_vert.count(), kernel);
     }
     ComputeNormals(m_cursors.last().m2, m_indices.count() - m_cursors.last().m2);
 }
@@ -206,16 +326,23 @@ void EasyMesh::Scale(vec3 const &s)
         return;
     }
 
-    vec3 const invs = vec3(1) / s;
+    /* Flip winding if the scaling involves mirroring */
+    bool flip = !BD()->IsEnabled(MeshBuildOperation::ScaleWinding)
+                 && s.x * s.y * s.z < 0;
+    DoAffineTransform(mat4::scale(s), mat3::scale(vec3(1) / s), true, flip);
+}
 
-    for (int i = m_cursors.last().m1; i < m_vert.count(); i++)
-    {
-        m_vert[i].m_coord *= s;
-        m_vert[i].m_normal = normalize(m_vert[i].m_normal * invs);
-    }
+//-----------------------------------------------------------------------------
+void EasyMesh::DoAffineTransform(mat4 const &m, mat3 const &normal_matrix,
+                                 bool renormalize, bool flip_winding)
+{
+    affine_kernel kernel;
+    kernel.m = m;
+    kernel.nm = normal_matrix;
+    kernel.renormalize = renormalize;
+    run_kernel(m_vert, m_cursors.last().m1, m_vert.count(), kernel);
 
-    /* Flip winding if the scaling involves mirroring */
-    if (!BD()->IsEnabled(MeshBuildOperation::ScaleWinding) && s.x * s.y * s.z < 0)
+    if (flip_winding)
     {
         for (int i = m_cursors.last().m2; i < m_indices.count(); i += 3)
         {
@@ -226,6 +353,61 @@ void EasyMesh::Scale(vec3 const &s)
     }
 }
 
+//-----------------------------------------------------------------------------
+bool EasyMesh::ExecuteAffineCmds()
+{
+    CommandStack &stack = BD()->CmdStack();
+    mat4 m(1.f);
+    mat3 nm(1.f);
+    bool renormalize = false, flip = false;
+    int count = 0;
+
+    for (int cmd = stack.GetCmd(BD()->Cmdi()); ; )
+    {
+        if (cmd == EasyMeshCmdType::Translate)
+        {
+            m = mat4::translate(stack.V3()) * m;
+        }
+        else if (cmd == EasyMeshCmdType::Rotate)
+        {
+            float degrees = stack.F();
+            mat3 r = mat3::rotate(radians(degrees), stack.V3());
+            m = mat4(r) * m;
+            nm = r * nm;
+        }
+        else if (cmd == EasyMeshCmdType::Scale)
+        {
+            vec3 s = stack.V3();
+            m = mat4::scale(s) * m;
+            nm = mat3::scale(vec3(1) / s) * nm;
+            renormalize = true;
+            flip ^= !BD()->IsEnabled(MeshBuildOperation::ScaleWinding)
+                     && s.x * s.y * s.z < 0;
+        }
+        else
+            break;
+        ++count;
+
+        /* Look at the next command, but stop when single-stepping */
+        int next = BD()->Cmdi() + 1;
+        if (next >= stack.GetCmdNb() || BD()->CmdExecNb() == 0)
+            break;
+        cmd = stack.GetCmd(next);
+        if (cmd != EasyMeshCmdType::Translate && cmd != EasyMeshCmdType::Rotate
+             && cmd != EasyMeshCmdType::Scale)
+            break;
+        ++BD()->Cmdi();
+        if (BD()->CmdExecNb() > 0)
+            --BD()->CmdExecNb();
+    }
+
+    if (!count)
+        return false;
+
+    DoAffineTransform(m, nm, renormalize, flip);
+    return true;
+}
+
 //-----------------------------------------------------------------------------
 void EasyMesh::MirrorX() { DupAndScale(vec3(-1, 1, 1)); }
 void EasyMesh::MirrorY() { DupAndScale(vec3(1, -1, 1)); }
@@ -21,15 +21,9 @@ class EmitterData
 {
     friend class Emitter;
 
-    static const int MAX_PARTICLES = 1000;
-
 private:
     TileSet *tileset;
-    vec3 gravity;
-    int particles[MAX_PARTICLES];
-    vec3 positions[MAX_PARTICLES];
-    vec3 velocities[MAX_PARTICLES];
-    int nparticles;
+    ParticleSystem particles;
 };
 
 /*
@@ -40,26 +34,13 @@ Emitter::Emitter(TileSet *tileset, vec3 gravity)
   : data(new EmitterData())
 {
     data->tileset = tileset;
-    data->gravity = gravity;
-    data->nparticles = 0;
+    data->particles.SetGravity(gravity);
+    data->particles.SetKillHeight(-100.f);
 }
 
 void Emitter::TickGame(float seconds)
 {
-    for (int i = 0; i < data->nparticles; i++)
-    {
-        vec3 oldvelocity = data->velocities[i];
-        data->velocities[i] += seconds * data->gravity;
-        data->positions[i] += seconds * 0.5f
-                                      * (oldvelocity + data->velocities[i]);
-        if (data->positions[i].y < -100)
-        {
-            data->particles[i] = data->particles[data->nparticles - 1];
-            data->positions[i] = data->positions[data->nparticles - 1];
-            data->velocities[i] = data->velocities[data->nparticles - 1];
-            data->nparticles--;
-        }
-    }
+    data->particles.Update(seconds);
 
     Entity::TickGame(seconds);
 }
@@ -68,20 +49,17 @@ void Emitter::TickDraw(float seconds, Scene &scene)
 {
     Entity::TickDraw(seconds, scene);
 
-    for (int i = 0; i < data->nparticles; i++)
-        scene.AddTile(data->tileset, data->particles[i],
-                      data->positions[i], vec2(1.0f), 0.0f);
+    data->particles.Render(scene, data->tileset);
 }
 
 void Emitter::AddParticle(int id, vec3 pos, vec3 vel)
 {
-    if (data->nparticles >= EmitterData::MAX_PARTICLES)
-        return;
+    data->particles.Emit(id, pos, vel);
+}
 
-    data->particles[data->nparticles] = id;
-    data->positions[data->nparticles] = pos;
-    data->velocities[data->nparticles] = vel;
-    data->nparticles++;
+ParticleSystem &Emitter::GetParticles()
+{
+    return data->particles;
 }
 
 Emitter::~Emitter()
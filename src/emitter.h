@@ -13,10 +13,13 @@
 //
 // The Emitter class
 // -----------------
+// An entity that updates and draws a particle system, with one tile per
+// particle.
 //
 
 #include "engine/entity.h"
 #include "tileset.h"
+#include "particlesystem.h"
 
 namespace lol
 {
@@ -31,6 +34,9 @@ public:
 
     void AddParticle(int id, vec3 pos, vec3 vel);
 
+    /* For drag, lifetimes and other settings */
+    ParticleSystem &GetParticles();
+
 protected:
     virtual void TickGame(float seconds);
     virtual void TickDraw(float seconds, Scene &scene);
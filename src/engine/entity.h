@@ -20,6 +20,8 @@
 // Ticker class for the ticking logic and the linked list implementation.
 //
 
+#include <lol/math/geometry.h>
+
 #include <stdint.h>
 
 namespace lol
@@ -59,6 +61,14 @@ protected:
 
     inline int  IsDestroying() { return m_destroy; }
 
+    /* Opt into frustum culling: the draw tick is skipped whenever these
+     * world space bounds are outside the view of the scene camera. */
+    inline void SetDrawBounds(box3 const *bounds)
+    {
+        m_draw_bounds = bounds;
+        m_culled = false;
+    }
+
     virtual void InitGame();
     virtual void InitDraw();
 
@@ -147,7 +157,14 @@ private:
 
 private:
     int m_ref, m_autorelease, m_destroy;
+    /* One bit per scene that draws this entity, see Scene::Link() */
     uint64_t m_scene_mask = 0;
+    /* Positions in the ticker lists, so that removal is a swap with the
+     * last element; -1 when not in the list. */
+    int m_autolist_slot = -1, m_gamelist_slot = -1, m_drawlist_slot = -1;
+    bool m_release_queued = false;
+    box3 const *m_draw_bounds = nullptr;
+    bool m_culled = false;
 };
 
 } /* namespace lol */
@@ -0,0 +1,251 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include "simd.h"
+
+namespace lol
+{
+
+/*
+ * MotionStore implementation
+ */
+
+MotionStore::MotionStore()
+  : m_free(-1)
+{
+}
+
+int MotionStore::Alloc()
+{
+    int handle = m_free;
+    if (handle < 0)
+    {
+        handle = m_entries.count();
+        m_entries.push(0);
+    }
+    else
+        m_free = m_entries[handle];
+
+    m_entries[handle] = m_handles.count();
+    m_handles.push(handle);
+    m_outputs.push(nullptr);
+    for (int c = 0; c < COMPONENT_COUNT; ++c)
+        m_data[c].push(c == QW ? 1.f : 0.f);
+    return handle;
+}
+
+void MotionStore::Release(int handle)
+{
+    /* Move the last entry into the released one to keep the arrays
+     * compact, and point its handle to its new location. */
+    int index = m_entries[handle];
+    for (int c = 0; c < COMPONENT_COUNT; ++c)
+        m_data[c].remove_swap(index);
+    m_outputs.remove_swap(index);
+    m_handles.remove_swap(index);
+    if (index < m_handles.count())
+        m_entries[m_handles[index]] = index;
+
+    m_entries[handle] = m_free;
+    m_free = handle;
+}
+
+void MotionStore::Integrate(float seconds)
+{
+    int const count = m_handles.count();
+    int i = 0;
+
+#if LOL_FEATURE_SSE2
+    for ( ; i + lane4::width <= count; i += lane4::width)
+        IntegrateBlock<lane4>(i, seconds);
+#endif
+    for ( ; i < count; ++i)
+        IntegrateBlock<lane1>(i, seconds);
+
+    for (i = 0; i < count; ++i)
+        if (m_outputs[i])
+            *m_outputs[i] = GetAABB(m_handles[i]);
+}
+
+template<typename F>
+void MotionStore::IntegrateBlock(int index, float seconds)
+{
+    auto load = [this, index](int c) { return F::load(m_data[c].data() + index); };
+    auto store = [this, index](int c, F x) { x.store(m_data[c].data() + index); };
+
+    F const dt(seconds), h(0.5f * seconds);
+
+    store(PX, load(PX) + load(VX) * dt);
+    store(PY, load(PY) + load(VY) * dt);
+    store(PZ, load(PZ) + load(VZ) * dt);
+
+    /* q += ½·(0,ω)·q·dt, then renormalise */
+    F qw = load(QW), qx = load(QX), qy = load(QY), qz = load(QZ);
+    F wx = load(WX) * h, wy = load(WY) * h, wz = load(WZ) * h;
+
+    F nw = qw - (wx * qx + wy * qy + wz * qz);
+    F nx = qx + (qw * wx + wy * qz - wz * qy);
+    F ny = qy + (qw * wy + wz * qx - wx * qz);
+    F nz = qz + (qw * wz + wx * qy - wy * qx);
+    F inv = F(1.f) / lane_sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+
+    store(QW, nw * inv);
+    store(QX, nx * inv);
+    store(QY, ny * inv);
+    store(QZ, nz * inv);
+
+    RefreshBlock<F>(index);
+}
+
+template<typename F>
+void MotionStore::RefreshBlock(int index)
+{
+    auto load = [this, index](int c) { return F::load(m_data[c].data() + index); };
+    auto store = [this, index](int c, F x) { x.store(m_data[c].data() + index); };
+
+    F const one(1.f), two(2.f);
+
+    /* Rotation matrix of the unit quaternion */
+    F qw = load(QW), qx = load(QX), qy = load(QY), qz = load(QZ);
+    F xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    F xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    F wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+    F r00 = one - two * (yy + zz), r01 = two * (xy - wz), r02 = two * (xz + wy);
+    F r10 = two * (xy + wz), r11 = one - two * (xx + zz), r12 = two * (yz - wx);
+    F r20 = two * (xz - wy), r21 = two * (yz + wx), r22 = one - two * (xx + yy);
+
+    /* Transform the local box centre, and bound its rotated extents
+     * with the absolute values of the matrix coefficients. */
+    F cx = load(CX), cy = load(CY), cz = load(CZ);
+    F hx = load(HX), hy = load(HY), hz = load(HZ);
+
+    F x = load(PX) + r00 * cx + r01 * cy + r02 * cz;
+    F y = load(PY) + r10 * cx + r11 * cy + r12 * cz;
+    F z = load(PZ) + r20 * cx + r21 * cy + r22 * cz;
+    F ex = lane_abs(r00) * hx + lane_abs(r01) * hy + lane_abs(r02) * hz;
+    F ey = lane_abs(r10) * hx + lane_abs(r11) * hy + lane_abs(r12) * hz;
+    F ez = lane_abs(r20) * hx + lane_abs(r21) * hy + lane_abs(r22) * hz;
+
+    store(AX, x - ex);
+    store(AY, y - ey);
+    store(AZ, z - ez);
+    store(BX, x + ex);
+    store(BY, y + ey);
+    store(BZ, z + ez);
+}
+
+void MotionStore::Refresh(int index)
+{
+    RefreshBlock<lane1>(index);
+    if (m_outputs[index])
+        *m_outputs[index] = GetAABB(m_handles[index]);
+}
+
+vec3 MotionStore::GetPosition(int handle) const
+{
+    int i = m_entries[handle];
+    return vec3(m_data[PX][i], m_data[PY][i], m_data[PZ][i]);
+}
+
+void MotionStore::SetPosition(int handle, vec3 const &position)
+{
+    int i = m_entries[handle];
+    m_data[PX][i] = position.x;
+    m_data[PY][i] = position.y;
+    m_data[PZ][i] = position.z;
+    Refresh(i);
+}
+
+vec3 MotionStore::GetVelocity(int handle) const
+{
+    int i = m_entries[handle];
+    return vec3(m_data[VX][i], m_data[VY][i], m_data[VZ][i]);
+}
+
+void MotionStore::SetVelocity(int handle, vec3 const &velocity)
+{
+    int i = m_entries[handle];
+    m_data[VX][i] = velocity.x;
+    m_data[VY][i] = velocity.y;
+    m_data[VZ][i] = velocity.z;
+}
+
+quat MotionStore::GetRotation(int handle) const
+{
+    int i = m_entries[handle];
+    return quat(m_data[QW][i], m_data[QX][i], m_data[QY][i], m_data[QZ][i]);
+}
+
+void MotionStore::SetRotation(int handle, quat const &rotation)
+{
+    int i = m_entries[handle];
+    m_data[QW][i] = rotation.w;
+    m_data[QX][i] = rotation.x;
+    m_data[QY][i] = rotation.y;
+    m_data[QZ][i] = rotation.z;
+    Refresh(i);
+}
+
+vec3 MotionStore::GetRotationVelocity(int handle) const
+{
+    int i = m_entries[handle];
+    return vec3(m_data[WX][i], m_data[WY][i], m_data[WZ][i]);
+}
+
+void MotionStore::SetRotationVelocity(int handle, vec3 const &velocity)
+{
+    int i = m_entries[handle];
+    m_data[WX][i] = velocity.x;
+    m_data[WY][i] = velocity.y;
+    m_data[WZ][i] = velocity.z;
+}
+
+box3 MotionStore::GetLocalAABB(int handle) const
+{
+    int i = m_entries[handle];
+    vec3 c(m_data[CX][i], m_data[CY][i], m_data[CZ][i]);
+    vec3 h(m_data[HX][i], m_data[HY][i], m_data[HZ][i]);
+    return box3(c - h, c + h);
+}
+
+void MotionStore::SetLocalAABB(int handle, box3 const &aabb)
+{
+    int i = m_entries[handle];
+    vec3 c = aabb.center(), h = 0.5f * aabb.extent();
+    m_data[CX][i] = c.x;
+    m_data[CY][i] = c.y;
+    m_data[CZ][i] = c.z;
+    m_data[HX][i] = h.x;
+    m_data[HY][i] = h.y;
+    m_data[HZ][i] = h.z;
+    Refresh(i);
+}
+
+box3 MotionStore::GetAABB(int handle) const
+{
+    int i = m_entries[handle];
+    return box3(vec3(m_data[AX][i], m_data[AY][i], m_data[AZ][i]),
+                vec3(m_data[BX][i], m_data[BY][i], m_data[BZ][i]));
+}
+
+void MotionStore::SetAABBOutput(int handle, box3 *output)
+{
+    int i = m_entries[handle];
+    m_outputs[i] = output;
+    Refresh(i);
+}
+
+} /* namespace lol */
+
@@ -0,0 +1,94 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// The MotionStore class
+// ---------------------
+// Transform and motion data for many objects, stored as one contiguous
+// array per component. Entries are addressed by stable handles, and
+// integrating all of them is a single pass over the arrays, four
+// entries at a time when SSE2 is available.
+//
+
+#include <lol/base/array.h>
+#include <lol/math/geometry.h>
+#include <lol/math/transform.h>
+
+namespace lol
+{
+
+class MotionStore
+{
+public:
+    MotionStore();
+
+    /* Handles stay valid until released, even when other entries are
+     * released and the arrays get compacted. */
+    int Alloc();
+    void Release(int handle);
+    inline int GetCount() const { return m_handles.count(); }
+
+    /* Advance all positions and rotations by their velocities, then
+     * recompute the world space bounding boxes. */
+    void Integrate(float seconds);
+
+    vec3 GetPosition(int handle) const;
+    void SetPosition(int handle, vec3 const &position);
+    vec3 GetVelocity(int handle) const;
+    void SetVelocity(int handle, vec3 const &velocity);
+    quat GetRotation(int handle) const;
+    void SetRotation(int handle, quat const &rotation);
+    vec3 GetRotationVelocity(int handle) const;
+    void SetRotationVelocity(int handle, vec3 const &velocity);
+
+    /* The bounding box relative to the position and orientation of the
+     * entry, and the resulting box in world space. */
+    box3 GetLocalAABB(int handle) const;
+    void SetLocalAABB(int handle, box3 const &aabb);
+    box3 GetAABB(int handle) const;
+
+    /* Also copy the world space box of an entry there whenever it is
+     * recomputed, for code that expects bounds at a fixed address. */
+    void SetAABBOutput(int handle, box3 *output);
+
+private:
+    enum
+    {
+        /* Position and velocity */
+        PX, PY, PZ, VX, VY, VZ,
+        /* Rotation and angular velocity */
+        QW, QX, QY, QZ, WX, WY, WZ,
+        /* Local box centre and half extents */
+        CX, CY, CZ, HX, HY, HZ,
+        /* World box */
+        AX, AY, AZ, BX, BY, BZ,
+        COMPONENT_COUNT
+    };
+
+    /* Process entries index to index + F::width - 1 */
+    template<typename F> void IntegrateBlock(int index, float seconds);
+    template<typename F> void RefreshBlock(int index);
+
+    void Refresh(int index);
+
+    array<float> m_data[COMPONENT_COUNT];
+    array<box3 *> m_outputs;
+    /* Handle of each entry, and entry of each handle; free handles
+     * hold the next free handle instead. */
+    array<int> m_handles, m_entries;
+    int m_free;
+};
+
+} /* namespace lol */
+
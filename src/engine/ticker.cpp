@@ -31,8 +31,12 @@ public:
     TickerData() :
         nentities(0),
         frame(0), recording(0), deltatime(0), bias(0), fps(0),
+        m_step(0), m_accum(0), m_alpha(1), m_max_steps(1), m_headless(false),
 #if LOL_BUILD_DEBUG
         keepalive(0),
+#endif
+#if LOL_FEATURE_THREADS
+        gamethread(nullptr), drawthread(nullptr), diskthread(nullptr),
 #endif
         quit(0), quitframe(0), quitdelay(20), panic(0)
     {
@@ -55,24 +59,47 @@ public:
     }
 
 private:
-    /* Entity management */
+    /* Entity management. Entities know their position in the lists they
+     * belong to, and every scene draws the draw lists, skipping entities
+     * without the scene's bit in their mask. */
     array<Entity *> m_todolist, m_todolist_delayed, m_autolist;
     array<Entity *> m_list[Entity::ALLGROUP_END];
-    array<int> m_scenes[Entity::ALLGROUP_END];
     int nentities;
 
+    /* Entities whose last reference was released, and the ones that were
+     * marked for destruction at the previous game tick. These arrays keep
+     * their storage across frames. */
+    array<Entity *> m_releaselist, m_destroylist;
+
+    static void AddSlot(array<Entity *> &list, Entity *e, int Entity::*slot);
+    static void RemoveSlot(array<Entity *> &list, Entity *e, int Entity::*slot);
+    static void Release(Entity *e);
+
+    /* Frustum culling buffers, kept across frames */
+    array<Entity *> m_cull_list;
+    array<box3> m_cull_boxes;
+    array<bool> m_cull_visible;
+
     /* Fixed framerate management */
     int frame, recording;
     timer m_timer;
     float deltatime, bias, fps;
+
+    /* Fixed timestep management: m_accum is the time not simulated yet,
+     * and m_alpha how far into the next step the last frame is */
+    float m_step, m_accum, m_alpha;
+    int m_max_steps;
+    bool m_headless;
 #if LOL_BUILD_DEBUG
     float keepalive;
 #endif
 
     /* The three main functions (for now) */
     static void GameThreadTick();
+    static void GameStep(float seconds);
     static void DrawThreadTick();
     static void DiskThreadTick();
+    static int CullDrawEntities(Scene &scene, int &culled);
 
 #if LOL_FEATURE_THREADS
     /* The associated background threads */
@@ -90,6 +117,32 @@ tickerdata;
 
 static TickerData * const data = &tickerdata;
 
+void TickerData::AddSlot(array<Entity *> &list, Entity *e, int Entity::*slot)
+{
+    e->*slot = list.count();
+    list.push(e);
+}
+
+void TickerData::RemoveSlot(array<Entity *> &list, Entity *e, int Entity::*slot)
+{
+    Entity *last = list.last();
+    list[e->*slot] = last;
+    last->*slot = e->*slot;
+    list.remove(-1);
+    e->*slot = -1;
+}
+
+/* Called when the reference count of an entity drops to zero. Whether
+ * it gets destroyed is decided at the next game tick. */
+void TickerData::Release(Entity *e)
+{
+    if (!e->m_release_queued)
+    {
+        e->m_release_queued = true;
+        data->m_releaselist.push(e);
+    }
+}
+
 /*
  * Ticker public class
  */
@@ -102,7 +155,7 @@ void Ticker::Register(Entity *entity)
     data->m_todolist_delayed.push(entity);
 
     /* Objects are autoreleased by default. Put them in a list. */
-    data->m_autolist.push(entity);
+    TickerData::AddSlot(data->m_autolist, entity, &Entity::m_autolist_slot);
     entity->m_autorelease = 1;
     entity->m_ref = 1;
 
@@ -118,17 +171,8 @@ void Ticker::Ref(Entity *entity)
 
     if (entity->m_autorelease)
     {
-        /* Get the entity out of the m_autorelease list. This is usually
-         * very fast since the last entry in autolist is the last
-         * registered entity. */
-        for (int i = data->m_autolist.count(); i--; )
-        {
-            if (data->m_autolist[i] == entity)
-            {
-                data->m_autolist.remove_swap(i);
-                break;
-            }
-        }
+        /* Get the entity out of the m_autorelease list */
+        TickerData::RemoveSlot(data->m_autolist, entity, &Entity::m_autolist_slot);
         entity->m_autorelease = 0;
     }
     else
@@ -143,7 +187,9 @@ int Ticker::Unref(Entity *entity)
     ASSERT(!entity->m_autorelease, "dereferencing autoreleased entity %s\n",
            entity->GetName().c_str());
 
-    return --entity->m_ref;
+    if (--entity->m_ref == 0)
+        TickerData::Release(entity);
+    return entity->m_ref;
 }
 
 #if LOL_FEATURE_THREADS
@@ -233,8 +279,15 @@ void TickerData::GameThreadTick()
     /* Ensure some randomness */
     rand<int>();
 
-    /* If recording with fixed framerate, set deltatime to a fixed value */
-    if (data->recording && data->fps)
+    bool fixed = data->m_step > 0.f;
+
+    /* If stepping headless, or recording with fixed framerate, set
+     * deltatime to a fixed value */
+    if (data->m_headless)
+    {
+        data->deltatime = data->m_step;
+    }
+    else if (data->recording && data->fps)
     {
         data->deltatime = 1.f / data->fps;
     }
@@ -244,10 +297,12 @@ void TickerData::GameThreadTick()
         data->bias += data->deltatime;
     }
 
-    /* Do not go below 15 fps */
+    /* Do not go below 15 fps. In fixed timestep mode, the number of
+     * game steps per frame is limited instead. */
     if (data->deltatime > 1.f / 15.f)
     {
-        data->deltatime = 1.f / 15.f;
+        if (!fixed)
+            data->deltatime = 1.f / 15.f;
         data->bias = 0.f;
     }
 
@@ -278,7 +333,8 @@ void TickerData::GameThreadTick()
 #if !LOL_BUILD_RELEASE
                 msg::error("poking %s\n", e->GetName().c_str());
 #endif
-                e->m_ref--;
+                if (--e->m_ref == 0)
+                    Release(e);
                 n++;
             }
         }
@@ -292,104 +348,89 @@ void TickerData::GameThreadTick()
         data->quitdelay = data->quitdelay > 1 ? data->quitdelay / 2 : 1;
     }
 
-    /* Garbage collect objects that can be destroyed. We can do this
-     * before inserting awaiting objects, because only objects already
-     * in the tick lists can be marked for destruction. */
-    array<Entity*> destroy_list;
-    bool do_reserve = true;
-    for (int g = 0; g < Entity::ALLGROUP_END; ++g)
+    if (fixed)
     {
-        for (int i = data->m_list[g].count(); i--;)
+        /* Run the game steps that fit in the elapsed time, then drop
+         * whole steps that could not be caught up with */
+        data->m_accum += data->deltatime;
+        for (int n = 0; n < data->m_max_steps && data->m_accum >= data->m_step; ++n)
         {
-            Entity *e = data->m_list[g][i];
-
-            if (e->m_destroy && g < Entity::GAMEGROUP_END)
-            {
-                /* Game tick list:
-                * If entity is to be destroyed, remove it */
-                data->m_list[g].remove_swap(i);
-                if (do_reserve)
-                {
-                    do_reserve = false;
-                    destroy_list.reserve(data->nentities); //Should it be less ?
-                }
-                destroy_list.push_unique(e);
-            }
-            else if (e->m_destroy)
-            {
-                /* Draw tick list:
-                * If entity is to be destroyed,
-                * remove it and store it. */
-                data->m_list[g].remove_swap(i);
-                int removal_count = 0;
-                for (int j = 0; j < Scene::GetCount(); j++)
-                {
-                    //If entity is concerned by this scene, add it in the list
-                    if (Scene::GetScene(j).IsRelevant(e))
-                        removal_count++;
-                    //Update scene index
-                    data->m_scenes[e->m_drawgroup][j] -= removal_count;
-                }
-                if (do_reserve)
-                {
-                    do_reserve = false;
-                    destroy_list.reserve(data->nentities); //Should it be less ?
-                }
-                destroy_list.push_unique(e);
-            }
-            else
-            {
-                if (e->m_ref <= 0 && g >= Entity::DRAWGROUP_BEGIN)
-                    e->m_destroy = 1;
-            }
+            GameStep(data->m_step);
+            data->m_accum -= data->m_step;
         }
+        if (data->m_accum >= data->m_step)
+            data->m_accum = lol::fmod(data->m_accum, data->m_step);
+        data->m_alpha = data->m_accum / data->m_step;
+    }
+    else
+    {
+        GameStep(data->deltatime);
+        data->m_alpha = 1.f;
+    }
+
+    Profiler::Stop(Profiler::STAT_TICK_GAME);
+}
+
+/* Run one game step of the given duration: destroy, insert, move and
+ * tick entities. */
+void TickerData::GameStep(float seconds)
+{
+    /* Delete the entities marked for destruction at the previous tick.
+     * They were not ticked since, and were not drawn either. */
+    for (Entity *e : data->m_destroylist)
+    {
+        RemoveSlot(data->m_list[e->m_gamegroup], e, &Entity::m_gamelist_slot);
+        if (e->m_drawlist_slot >= 0)
+            RemoveSlot(data->m_list[e->m_drawgroup], e, &Entity::m_drawlist_slot);
+        delete e;
     }
-    if (!!destroy_list.count())
+    data->nentities -= data->m_destroylist.count();
+    data->m_destroylist.empty();
+
+    /* Mark the released entities that were not referenced again. Only
+     * objects already in the tick lists can be marked for destruction,
+     * the others wait for the next tick. */
+    for (int i = data->m_releaselist.count(); i--; )
     {
-        data->nentities -= destroy_list.count();
-        for (Entity* e : destroy_list)
-            delete e;
+        Entity *e = data->m_releaselist[i];
+        if (e->m_gamelist_slot < 0)
+            continue;
+
+        data->m_releaselist.remove_swap(i);
+        e->m_release_queued = false;
+        if (e->m_ref <= 0)
+        {
+            e->m_destroy = 1;
+            data->m_destroylist.push(e);
+        }
     }
 
     /* Insert waiting objects into the appropriate lists */
     while (data->m_todolist.count())
     {
-        Entity *e = data->m_todolist.last();
+        Entity *e = data->m_todolist.pop();
 
-        //If the entity has no mask, default it
-        if (e->m_scene_mask == 0)
-        {
+        /* If the entity has no mask, default it. Headless programs may
+         * have no scene at all. */
+        if (e->m_scene_mask == 0 && Scene::GetCount())
             Scene::GetScene().Link(e);
-        }
 
-        data->m_todolist.remove(-1);
-        data->m_list[e->m_gamegroup].push(e);
+        AddSlot(data->m_list[e->m_gamegroup], e, &Entity::m_gamelist_slot);
         if (e->m_drawgroup != Entity::DRAWGROUP_NONE)
-        {
-            if (data->m_scenes[e->m_drawgroup].count() < Scene::GetCount())
-                data->m_scenes[e->m_drawgroup].resize(Scene::GetCount());
-
-            int added_count = 0;
-            for (int i = 0; i < Scene::GetCount(); i++)
-            {
-                //If entity is concerned by this scene, add it in the list
-                if (Scene::GetScene(i).IsRelevant(e))
-                {
-                    data->m_list[e->m_drawgroup].insert(e, data->m_scenes[e->m_drawgroup][i]);
-                    added_count++;
-                }
-                //Update scene index
-                data->m_scenes[e->m_drawgroup][i] += added_count;
-            }
-        }
+            AddSlot(data->m_list[e->m_drawgroup], e, &Entity::m_drawlist_slot);
 
         // Initialize the entity
         e->InitGame();
     }
 
-    data->m_todolist = data->m_todolist_delayed;
+    for (Entity *e : data->m_todolist_delayed)
+        data->m_todolist.push(e);
     data->m_todolist_delayed.empty();
 
+    /* Integrate the motion of entities in the motion store in one pass,
+     * so that their game tick sees up to date transforms */
+    WorldEntity::GetMotionStore().Integrate(seconds);
+
     /* Tick objects for the game loop */
     for (int g = Entity::GAMEGROUP_BEGIN; g < Entity::GAMEGROUP_END && !data->quit /* Stop as soon as required */; ++g)
     {
@@ -404,7 +445,7 @@ void TickerData::GameThreadTick()
                                e->GetName().c_str(), e);
                 e->m_tickstate = Entity::STATE_PRETICK_GAME;
 #endif
-                e->TickGame(data->deltatime);
+                e->TickGame(seconds);
 #if !LOL_BUILD_RELEASE
                 if (e->m_tickstate != Entity::STATE_POSTTICK_GAME)
                     msg::error("entity %s [%p] missed super game tick\n",
@@ -414,8 +455,6 @@ void TickerData::GameThreadTick()
             }
         }
     }
-
-    Profiler::Stop(Profiler::STAT_TICK_GAME);
 }
 
 //-----------------------------------------------------------------------------
@@ -423,6 +462,8 @@ void TickerData::DrawThreadTick()
 {
     Profiler::Start(Profiler::STAT_TICK_DRAW);
 
+    int visible = 0, culled = 0;
+
     /* Render each scene one after the other */
     for (int idx = 0; idx < Scene::GetCount() && !data->quit /* Stop as soon as required */; ++idx)
     {
@@ -442,6 +483,10 @@ void TickerData::DrawThreadTick()
             case Entity::DRAWGROUP_BEGIN:
                 scene.Reset();
                 break;
+            case Entity::DRAWGROUP_CAMERA + 1:
+                /* Cameras are up to date, cull the remaining groups */
+                visible += CullDrawEntities(scene, culled);
+                break;
             default:
                 break;
             }
@@ -450,7 +495,7 @@ void TickerData::DrawThreadTick()
             {
                 Entity *e = data->m_list[g][i];
 
-                if (!e->m_destroy)
+                if (!e->m_destroy && !e->m_culled && scene.IsRelevant(e))
                 {
 #if !LOL_BUILD_RELEASE
                     if (e->m_tickstate != Entity::STATE_IDLE)
@@ -478,9 +523,56 @@ void TickerData::DrawThreadTick()
         scene.DisableDisplay();
     }
 
+    Profiler::Record(Profiler::STAT_DRAW_VISIBLE, (float)visible);
+    Profiler::Record(Profiler::STAT_DRAW_CULLED, (float)culled);
+
+    int uniforms_sent, uniforms_skipped;
+    Shader::GetUniformStats(uniforms_sent, uniforms_skipped);
+    Profiler::Record(Profiler::STAT_DRAW_UNIFORMS, (float)uniforms_sent);
+    Profiler::Record(Profiler::STAT_DRAW_UNIFORMS_SKIPPED, (float)uniforms_skipped);
     Profiler::Stop(Profiler::STAT_TICK_DRAW);
 }
 
+/* Test the bounds of all draw entities that opted into frustum culling
+ * against the scene camera, in one batch, and flag the invisible ones
+ * so that their draw tick is skipped. Return the number of visible
+ * entities and add the number of culled ones to culled. */
+int TickerData::CullDrawEntities(Scene &scene, int &culled)
+{
+    data->m_cull_list.empty();
+    data->m_cull_boxes.empty();
+
+    for (int g = Entity::DRAWGROUP_CAMERA + 1; g < Entity::DRAWGROUP_END; ++g)
+    {
+        for (Entity *e : data->m_list[g])
+        {
+            e->m_culled = false;
+            if (e->m_draw_bounds && !e->m_destroy && scene.IsRelevant(e))
+            {
+                data->m_cull_list.push(e);
+                data->m_cull_boxes.push(*e->m_draw_bounds);
+            }
+        }
+    }
+
+    int count = data->m_cull_list.count();
+    if (!count)
+        return 0;
+
+    Camera *camera = scene.GetCamera();
+    frustum f(camera->GetProjection() * camera->GetView());
+
+    data->m_cull_visible.resize(count);
+    int visible = TestAABBVsFrustum(data->m_cull_boxes.data(), count, f,
+                                    data->m_cull_visible.data());
+
+    for (int i = 0; i < count; ++i)
+        data->m_cull_list[i]->m_culled = !data->m_cull_visible[i];
+
+    culled += count - visible;
+    return visible;
+}
+
 void TickerData::DiskThreadTick()
 {
     ;
@@ -548,6 +640,49 @@ void Ticker::TickDraw()
 #endif
 }
 
+void Ticker::TickGame()
+{
+    TickerData::GameThreadTick();
+}
+
+void Ticker::SetFixedRate(float rate, int max_steps)
+{
+    data->m_step = rate > 0.f ? 1.f / rate : 0.f;
+    data->m_max_steps = max(max_steps, 1);
+    data->m_accum = 0.f;
+    data->m_alpha = 1.f;
+}
+
+float Ticker::GetInterpolation()
+{
+    return data->m_alpha;
+}
+
+float Ticker::StepGame(int count)
+{
+    ASSERT(data->m_step > 0.f, "stepping game without a fixed rate\n");
+#if LOL_FEATURE_THREADS
+    /* The game groups are not locked, so they must not be ticked by the
+     * game thread at the same time */
+    ASSERT(!data->gamethread, "stepping game after Ticker::Setup()\n");
+#endif
+
+    /* Every tick sees exactly one step, so that the simulation only
+     * depends on the number of steps */
+    timer t;
+    data->m_headless = true;
+    for (int i = 0; i < count; ++i)
+        TickerData::GameThreadTick();
+    data->m_headless = false;
+    float seconds = t.get();
+
+    /* Restart the frame timer, so that the next TickGame() does not take
+     * the stepping time for a slow frame and run catch-up steps */
+    data->m_timer.get();
+
+    return seconds > 0.f ? count / seconds : 0.f;
+}
+
 void Ticker::StartRecording()
 {
     data->recording++;
@@ -568,8 +703,10 @@ void Ticker::Shutdown()
     /* We're bailing out. Release all m_autorelease objects. */
     while (data->m_autolist.count())
     {
-        data->m_autolist.last()->m_ref--;
-        data->m_autolist.remove(-1);
+        Entity *e = data->m_autolist.pop();
+        e->m_autolist_slot = -1;
+        if (--e->m_ref == 0)
+            TickerData::Release(e);
     }
 
     data->quit = 1;
@@ -32,6 +32,26 @@ public:
 
     static void Setup(float fps);
     static void TickDraw();
+    /* Run one game tick on the calling thread, without drawing, for
+     * programs without a display such as servers and tests. Do not mix
+     * with Setup() and TickDraw(). */
+    static void TickGame();
+
+    /* Tick the game groups in fixed steps of 1/rate seconds instead of
+     * once per frame. At most max_steps steps are run per frame to catch
+     * up after slow frames; the time left over is dropped. A rate of zero
+     * goes back to one variable step per frame. */
+    static void SetFixedRate(float rate, int max_steps = 5);
+    /* Fraction of a fixed step elapsed since the last game step, in
+     * [0, 1), for drawing between the last two game states (see
+     * TimeInterp::Blend). Always 1 with variable steps. */
+    static float GetInterpolation();
+    /* Run count fixed game steps on the calling thread as fast as
+     * possible, without drawing nor waiting, for server-side simulation
+     * and deterministic replays. Return the number of steps per second.
+     * Like TickGame(), do not mix with Setup() and TickDraw(). */
+    static float StepGame(int count);
+
     static void StartBenchmark();
     static void StopBenchmark();
     static void StartRecording();
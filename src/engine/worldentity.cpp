@@ -17,6 +17,12 @@
 namespace lol
 {
 
+/*
+ * Shared motion store
+ */
+
+static MotionStore motion_store;
+
 /*
  * Public WorldEntity class
  */
@@ -32,6 +38,7 @@ WorldEntity::WorldEntity()
 
 WorldEntity::~WorldEntity()
 {
+    EnableMotionStore(false);
 }
 
 std::string WorldEntity::GetName() const
@@ -39,6 +46,92 @@ std::string WorldEntity::GetName() const
     return "<worldentity>";
 }
 
+void WorldEntity::EnableMotionStore(bool enable)
+{
+    if (enable && m_motion_handle < 0)
+    {
+        /* The current box, relative to the position, becomes the box
+         * in the entity’s local frame. */
+        m_motion_handle = motion_store.Alloc();
+        motion_store.SetPosition(m_motion_handle, m_position);
+        motion_store.SetVelocity(m_motion_handle, m_velocity);
+        motion_store.SetRotation(m_motion_handle, m_rotation);
+        motion_store.SetRotationVelocity(m_motion_handle, m_rotation_velocity);
+        motion_store.SetLocalAABB(m_motion_handle, m_aabb - m_position);
+        motion_store.SetAABBOutput(m_motion_handle, &m_aabb);
+    }
+    else if (!enable && m_motion_handle >= 0)
+    {
+        m_position = motion_store.GetPosition(m_motion_handle);
+        m_velocity = motion_store.GetVelocity(m_motion_handle);
+        m_rotation = motion_store.GetRotation(m_motion_handle);
+        m_rotation_velocity = motion_store.GetRotationVelocity(m_motion_handle);
+        motion_store.Release(m_motion_handle);
+        m_motion_handle = -1;
+    }
+}
+
+MotionStore &WorldEntity::GetMotionStore()
+{
+    return motion_store;
+}
+
+vec3 WorldEntity::GetPosition() const
+{
+    return m_motion_handle < 0 ? m_position
+                               : motion_store.GetPosition(m_motion_handle);
+}
+
+void WorldEntity::SetPosition(vec3 const &position)
+{
+    if (m_motion_handle < 0)
+        m_position = position;
+    else
+        motion_store.SetPosition(m_motion_handle, position);
+}
+
+vec3 WorldEntity::GetVelocity() const
+{
+    return m_motion_handle < 0 ? m_velocity
+                               : motion_store.GetVelocity(m_motion_handle);
+}
+
+void WorldEntity::SetVelocity(vec3 const &velocity)
+{
+    if (m_motion_handle < 0)
+        m_velocity = velocity;
+    else
+        motion_store.SetVelocity(m_motion_handle, velocity);
+}
+
+quat WorldEntity::GetRotation() const
+{
+    return m_motion_handle < 0 ? m_rotation
+                               : motion_store.GetRotation(m_motion_handle);
+}
+
+void WorldEntity::SetRotation(quat const &rotation)
+{
+    if (m_motion_handle < 0)
+        m_rotation = rotation;
+    else
+        motion_store.SetRotation(m_motion_handle, rotation);
+}
+
+vec3 WorldEntity::GetRotationVelocity() const
+{
+    return m_motion_handle < 0 ? m_rotation_velocity
+                               : motion_store.GetRotationVelocity(m_motion_handle);
+}
+
+void WorldEntity::SetRotationVelocity(vec3 const &velocity)
+{
+    if (m_motion_handle < 0)
+        m_rotation_velocity = velocity;
+    else
+        motion_store.SetRotationVelocity(m_motion_handle, velocity);
+}
+
 void WorldEntity::TickGame(float seconds)
 {
     Entity::TickGame(seconds);
@@ -20,6 +20,7 @@
 #include <lol/math/transform.h>
 
 #include "engine/entity.h"
+#include "engine/motionstore.h"
 
 namespace lol
 {
@@ -29,6 +30,28 @@ class WorldEntity : public Entity
 public:
     virtual std::string GetName() const;
 
+    /* Skip the draw tick when m_aabb, in world space, is not visible */
+    inline void SetFrustumCulling(bool enable)
+    {
+        SetDrawBounds(enable ? &m_aabb : nullptr);
+    }
+
+    /* Move the transform and motion of this entity to the shared motion
+     * store, which integrates velocities once per frame before the game
+     * tick. The store then keeps m_aabb up to date, but the other
+     * members below are no longer used: use the accessors instead. */
+    void EnableMotionStore(bool enable);
+    static MotionStore &GetMotionStore();
+
+    vec3 GetPosition() const;
+    void SetPosition(vec3 const &position);
+    vec3 GetVelocity() const;
+    void SetVelocity(vec3 const &velocity);
+    quat GetRotation() const;
+    void SetRotation(quat const &rotation);
+    vec3 GetRotationVelocity() const;
+    void SetRotationVelocity(vec3 const &velocity);
+
 public:
     box3 m_aabb;
     vec3 m_position = vec3::zero;
@@ -42,6 +65,9 @@ protected:
 
     virtual void TickGame(float seconds);
     virtual void TickDraw(float seconds, Scene &scene);
+
+private:
+    int m_motion_handle = -1;
 };
 
 } /* namespace lol */
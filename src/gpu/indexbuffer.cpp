@@ -32,6 +32,11 @@ class IndexBufferData
     size_t m_size;
     GLuint m_ibo;
     uint8_t *m_memory;
+
+    /* Range given to the last Lock(), and whether the GL buffer storage
+     * was already allocated, in which case only that range is uploaded. */
+    size_t m_lock_offset, m_lock_size;
+    bool m_allocated;
 };
 
 //
@@ -43,6 +48,9 @@ IndexBuffer::IndexBuffer(size_t size)
   : m_data(new IndexBufferData)
 {
     m_data->m_size = size;
+    m_data->m_lock_offset = 0;
+    m_data->m_lock_size = size;
+    m_data->m_allocated = false;
     if (!size)
         return;
     glGenBuffers(1, &m_data->m_ibo);
@@ -69,7 +77,10 @@ void *IndexBuffer::Lock(size_t offset, size_t size)
     if (!m_data->m_size)
         return nullptr;
 
-    UNUSED(size);
+    /* A size of zero means up to the end of the buffer */
+    ASSERT(offset + size <= m_data->m_size, "locking past the end of the buffer");
+    m_data->m_lock_offset = offset;
+    m_data->m_lock_size = size ? size : m_data->m_size - offset;
     return m_data->m_memory + offset;
 }
 
@@ -79,8 +90,13 @@ void IndexBuffer::Unlock()
         return;
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_data->m_ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_data->m_size, m_data->m_memory,
-                 GL_STATIC_DRAW);
+    if (m_data->m_allocated)
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m_data->m_lock_offset, m_data->m_lock_size,
+                        m_data->m_memory + m_data->m_lock_offset);
+    else
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_data->m_size, m_data->m_memory,
+                     GL_STATIC_DRAW);
+    m_data->m_allocated = true;
 }
 
 void IndexBuffer::Bind()
@@ -66,9 +66,42 @@ static const char* attribute_names[] =
     "in_Color",
     "in_Fog",
     "in_Depth",
-    "in_Sample"
+    "in_Sample",
+    "in_Instance"
 };
 
+/* Uniforms that the engine sets itself; their locations are looked up
+ * once, right after linking. */
+enum BuiltinUniform
+{
+    /* Scene data, only set this way without uniform buffers */
+    U_PROJECTION,
+    U_VIEW,
+    U_INV_VIEW,
+    U_LIGHTS,
+    /* Per-object data */
+    U_MODEL,
+    U_MODELVIEW,
+    U_NORMALMAT,
+    U_BUILTIN_COUNT
+};
+
+static const char* builtin_uniform_names[] =
+{
+    "u_projection",
+    "u_view",
+    "u_inv_view",
+    "u_lights",
+    "u_model",
+    "u_modelview",
+    "u_normalmat",
+};
+
+/* The lolfx directive declaring the shared scene uniforms, and the
+ * uniform buffer binding point they use. */
+static char const *scene_pragma = "#pragma lol scene_uniforms";
+static GLuint const scene_binding = 0;
+
 /*
  * Shader implementation class
  */
@@ -81,22 +114,126 @@ private:
     std::string m_name;
 
     GLuint prog_id, vert_id, frag_id;
-    // Benlitz: using a simple array could be faster since there is never more than a few attribute locations to store
-    std::map<uint64_t, GLint> attrib_locations;
-    std::map<uint64_t, bool> attrib_errors;
+    /* Patched sources, kept until the link result is known */
+    std::string vert_code, frag_code;
+    uint64_t binary_key;
+    bool ready;
+
+    hash_map<uint64_t, GLint> attrib_locations;
+    hash_map<uint64_t, bool> attrib_errors;
     size_t vert_crc, frag_crc;
 
+    /* Active uniforms, enumerated once after linking and indexed by the
+     * hash of their name. Each one keeps a copy of the last single value
+     * sent, so that setting it again to the same value is skipped. */
+    struct UniformInfo
+    {
+        GLint location;
+        bool cached;
+        uint8_t value[sizeof(mat4)];
+    };
+    array<UniformInfo> uniforms;
+    hash_map<uint64_t, int> uniform_slots;
+
+    ShaderUniform builtin_uniforms[U_BUILTIN_COUNT];
+    bool uses_scene_data;
+    int scene_serial;
+
+    void Finish();
+    ShaderUniform GetUniform(ShaderUniformName const &uni);
+    int AddUniform(GLint location);
+    static bool NeedsUpload(ShaderUniform const &uni,
+                            void const *value, size_t size);
+
     /* Shader patcher */
     static int GetVersion();
+    static bool HasUniformBuffers();
     static std::string Patch(std::string const &code, ShaderType type);
 
-    /* Global shader cache */
-    static Shader *shaders[];
-    static int nshaders;
+    /* Driver features for faster startup */
+    static bool HasParallelCompile();
+    static bool HasProgramBinaries();
+    static uint64_t GetDriverHash();
+    bool LoadBinary();
+    void SaveBinary();
+
+    /* Global shader cache, indexed by the hash of both sources */
+    static hash_map<size_t, Shader *> shaders;
+    static std::string binary_dir;
+
+    /* Per-frame scene data, with a serial number telling shaders
+     * without uniform buffers when to upload it again. */
+    static ShaderSceneData scene_data;
+    static int scene_data_serial;
+    static GLuint scene_ubo;
+
+    /* The shader whose uniform table matches the GL state, and how many
+     * uniform values were sent or skipped. */
+    static ShaderData *bound_shader;
+    static int uniforms_sent, uniforms_skipped;
 };
 
-Shader *ShaderData::shaders[256];
-int ShaderData::nshaders = 0;
+hash_map<size_t, Shader *> ShaderData::shaders;
+std::string ShaderData::binary_dir;
+
+ShaderSceneData ShaderData::scene_data;
+int ShaderData::scene_data_serial = 0;
+GLuint ShaderData::scene_ubo = 0;
+
+ShaderData *ShaderData::bound_shader = nullptr;
+int ShaderData::uniforms_sent = 0;
+int ShaderData::uniforms_skipped = 0;
+
+/* Return the slot of the uniform at this location, creating it if it
+ * is not known yet; array uniforms are found under several names. */
+int ShaderData::AddUniform(GLint location)
+{
+    for (int i = 0; i < uniforms.count(); ++i)
+        if (location >= 0 && uniforms[i].location == location)
+            return i;
+
+    UniformInfo info;
+    info.location = location;
+    info.cached = false;
+    uniforms.push(info);
+    return uniforms.count() - 1;
+}
+
+/* Tell whether a uniform value needs to be sent to GL, and remember it
+ * if so. Only the bound shader can skip values, since its table is the
+ * only one known to match what GL has. A null value (for arrays) always
+ * needs to be sent and forgets the previous one. */
+bool ShaderData::NeedsUpload(ShaderUniform const &uni,
+                             void const *value, size_t size)
+{
+    if ((GLint)uni.frag == -1)
+        return false;
+
+    ShaderData *bound = bound_shader;
+    if (bound && uni.flags == bound->prog_id && uni.vert
+         && uni.vert <= (uintptr_t)bound->uniforms.count())
+    {
+        UniformInfo &info = bound->uniforms[(int)uni.vert - 1];
+        if (!value)
+        {
+            info.cached = false;
+        }
+        else if (info.cached && !memcmp(info.value, value, size))
+        {
+            ++uniforms_skipped;
+            return false;
+        }
+        else
+        {
+            ASSERT(size <= sizeof(info.value));
+            memcpy(info.value, value, size);
+            info.cached = true;
+        }
+    }
+
+    ++uniforms_sent;
+    return true;
+}
 
 /*
  * LolFx parser
@@ -109,7 +246,7 @@ struct lolfx_parser
 {
 public:
     std::string m_section;
-    std::map<std::string, std::string> m_programs;
+    flat_map<std::string, std::string> m_programs;
 
 private:
     // title <- '[' (!']')+ ']' .{eol}
@@ -202,23 +339,30 @@ Shader *Shader::Create(std::string const &name, std::string const &code)
 
     size_t new_vert_crc = std::hash<std::string>{}(vert);
     size_t new_frag_crc = std::hash<std::string>{}(frag);
+    size_t key = new_vert_crc ^ (new_frag_crc * 0x9e3779b97f4a7c15ull);
 
-    for (int n = 0; n < ShaderData::nshaders; n++)
-    {
-        if (ShaderData::shaders[n]->data->vert_crc == new_vert_crc
-             && ShaderData::shaders[n]->data->frag_crc == new_frag_crc)
-        {
-            return ShaderData::shaders[n];
-        }
-    }
+    Shader *ret = nullptr;
+    if (try_get(ShaderData::shaders, key, ret)
+         && ret->data->vert_crc == new_vert_crc
+         && ret->data->frag_crc == new_frag_crc)
+        return ret;
 
-    Shader *ret = new Shader(name, vert, frag);
-    ShaderData::shaders[ShaderData::nshaders] = ret;
-    ShaderData::nshaders++;
+    /* On the unlikely key collision, the new shader is not cached */
+    bool collision = ret != nullptr;
+    ret = new Shader(name, vert, frag);
+    if (!collision)
+        ShaderData::shaders[key] = ret;
 
     return ret;
 }
 
+void Shader::SetBinaryDir(std::string const &dir)
+{
+    ShaderData::binary_dir = dir;
+    if (dir.length() && dir.back() != '/' && dir.back() != '\\')
+        ShaderData::binary_dir += '/';
+}
+
 void Shader::Destroy(Shader *shader)
 {
     /* XXX: do nothing! the shader should remain in cache */
@@ -230,93 +374,138 @@ Shader::Shader(std::string const &name,
   : data(new ShaderData())
 {
     data->m_name = name;
+    data->vert_crc = std::hash<std::string>{}(vert);
+    data->frag_crc = std::hash<std::string>{}(frag);
+    data->vert_code = ShaderData::Patch(vert, ShaderType::Vertex);
+    data->frag_code = ShaderData::Patch(frag, ShaderType::Fragment);
+    data->vert_id = data->frag_id = 0;
+    data->binary_key = 0;
+    data->ready = false;
 
-    char errbuf[4096];
-    std::string shader_code;
-    GLchar const *gl_code;
-    GLint status;
-    GLsizei len;
+    data->uses_scene_data = vert.find(scene_pragma) != std::string::npos
+                         || frag.find(scene_pragma) != std::string::npos;
+    data->scene_serial = -1;
 
-    /* Compile vertex shader */
-    data->vert_crc = std::hash<std::string>{}(vert);
+    data->prog_id = glCreateProgram();
+    if (data->LoadBinary())
+        return;
+
+    /* Only start compiling and linking here. Nothing asks for the result
+     * until the shader is first used, so drivers compiling on their own
+     * threads can work on all shaders created in the meantime. */
+    GLchar const *gl_code;
 
-    shader_code = ShaderData::Patch(vert, ShaderType::Vertex);
     data->vert_id = glCreateShader(GL_VERTEX_SHADER);
-    gl_code = shader_code.c_str();
+    gl_code = data->vert_code.c_str();
     glShaderSource(data->vert_id, 1, &gl_code, nullptr);
     glCompileShader(data->vert_id);
 
-    glGetShaderInfoLog(data->vert_id, sizeof(errbuf), &len, errbuf);
-    glGetShaderiv(data->vert_id, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE)
-    {
-        msg::error("failed to compile vertex shader %s: %s\n",
-                   name.c_str(), errbuf);
-        msg::error("shader source:\n%s\n", shader_code.c_str());
-    }
-    else if (len > 16)
-    {
-        msg::debug("compile log for vertex shader %s: %s\n", name.c_str(), errbuf);
-        msg::debug("shader source:\n%s\n", shader_code.c_str());
-    }
-
-    /* Compile fragment shader */
-    data->frag_crc = std::hash<std::string>{}(frag);
-
-    shader_code = ShaderData::Patch(frag, ShaderType::Fragment);
     data->frag_id = glCreateShader(GL_FRAGMENT_SHADER);
-    gl_code = shader_code.c_str();
+    gl_code = data->frag_code.c_str();
     glShaderSource(data->frag_id, 1, &gl_code, nullptr);
     glCompileShader(data->frag_id);
 
-    glGetShaderInfoLog(data->frag_id, sizeof(errbuf), &len, errbuf);
-    glGetShaderiv(data->frag_id, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE)
-    {
-        msg::error("failed to compile fragment shader %s: %s\n",
-                   name.c_str(), errbuf);
-        msg::error("shader source:\n%s\n", shader_code.c_str());
-    }
-    else if (len > 16)
-    {
-        msg::debug("compile log for fragment shader %s: %s\n",
-                   name.c_str(), errbuf);
-        msg::debug("shader source:\n%s\n", shader_code.c_str());
-    }
-
-    /* Create program */
-    data->prog_id = glCreateProgram();
     glAttachShader(data->prog_id, data->vert_id);
     glAttachShader(data->prog_id, data->frag_id);
-
+#if defined GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    if (ShaderData::HasProgramBinaries() && ShaderData::binary_dir.length())
+        glProgramParameteri(data->prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
     glLinkProgram(data->prog_id);
-    glGetProgramInfoLog(data->prog_id, sizeof(errbuf), &len, errbuf);
-    glGetProgramiv(data->prog_id, GL_LINK_STATUS, &status);
-    if (status != GL_TRUE)
+}
+
+bool Shader::IsReady() const
+{
+    if (data->ready)
+        return true;
+
+#if defined GL_COMPLETION_STATUS_KHR
+    if (ShaderData::HasParallelCompile())
     {
-        msg::error("failed to link program %s: %s\n", name.c_str(), errbuf);
+        GLint done = GL_FALSE;
+        glGetProgramiv(data->prog_id, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
     }
-    else if (len > 16)
+#endif
+
+    /* Without the extension, asking would wait for the result anyway */
+    return true;
+}
+
+/* Wait for the link result, report errors, and build the attribute and
+ * uniform tables. */
+void ShaderData::Finish()
+{
+    if (ready)
+        return;
+    ready = true;
+
+    char errbuf[4096];
+    GLint status;
+    GLsizei len;
+    char const *name = m_name.c_str();
+
+    if (vert_id)
     {
-        msg::debug("link log for program %s: %s\n", name.c_str(), errbuf);
+        glGetShaderInfoLog(vert_id, sizeof(errbuf), &len, errbuf);
+        glGetShaderiv(vert_id, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            msg::error("failed to compile vertex shader %s: %s\n", name, errbuf);
+            msg::error("shader source:\n%s\n", vert_code.c_str());
+        }
+        else if (len > 16)
+        {
+            msg::debug("compile log for vertex shader %s: %s\n", name, errbuf);
+            msg::debug("shader source:\n%s\n", vert_code.c_str());
+        }
+
+        glGetShaderInfoLog(frag_id, sizeof(errbuf), &len, errbuf);
+        glGetShaderiv(frag_id, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            msg::error("failed to compile fragment shader %s: %s\n", name, errbuf);
+            msg::error("shader source:\n%s\n", frag_code.c_str());
+        }
+        else if (len > 16)
+        {
+            msg::debug("compile log for fragment shader %s: %s\n", name, errbuf);
+            msg::debug("shader source:\n%s\n", frag_code.c_str());
+        }
+
+        glGetProgramInfoLog(prog_id, sizeof(errbuf), &len, errbuf);
+        glGetProgramiv(prog_id, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            msg::error("failed to link program %s: %s\n", name, errbuf);
+        }
+        else
+        {
+            if (len > 16)
+                msg::debug("link log for program %s: %s\n", name, errbuf);
+            SaveBinary();
+        }
     }
 
+    vert_code.clear();
+    frag_code.clear();
+
     GLint validated;
-    glValidateProgram(data->prog_id);
-    glGetProgramiv(data->prog_id, GL_VALIDATE_STATUS, &validated);
+    glValidateProgram(prog_id);
+    glGetProgramiv(prog_id, GL_VALIDATE_STATUS, &validated);
     if (validated != GL_TRUE)
     {
-        msg::error("failed to validate program %s\n", name.c_str());
+        msg::error("failed to validate program %s\n", name);
     }
 
     GLint num_attribs;
-    glGetProgramiv(data->prog_id, GL_ACTIVE_ATTRIBUTES, &num_attribs);
+    glGetProgramiv(prog_id, GL_ACTIVE_ATTRIBUTES, &num_attribs);
 
 #if EMSCRIPTEN //WebGL doesn't support GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, so chose a default size value.
     GLint max_len = 256;
 #else
     GLint max_len;
-    glGetProgramiv(data->prog_id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_len);
+    glGetProgramiv(prog_id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_len);
 #endif
 
     char* name_buffer = new char[max_len];
@@ -325,7 +514,7 @@ Shader::Shader(std::string const &name,
         int attrib_len;
         int attrib_size;
         int attrib_type;
-        glGetActiveAttrib(data->prog_id, i, max_len, &attrib_len, (GLint*)&attrib_size, (GLenum*)&attrib_type, name_buffer);
+        glGetActiveAttrib(prog_id, i, max_len, &attrib_len, (GLint*)&attrib_size, (GLenum*)&attrib_type, name_buffer);
 
         std::string attr_name(name_buffer);
         int index = -1;
@@ -349,31 +538,82 @@ Shader::Shader(std::string const &name,
         }
         else
         {
-            GLint location = glGetAttribLocation(data->prog_id, name_buffer);
+            GLint location = glGetAttribLocation(prog_id, name_buffer);
             uint64_t flags = (uint64_t)(uint16_t)usage.ToScalar() << 16;
             flags |= (uint64_t)(uint16_t)index;
             // TODO: this is here just in case. Remove this once everything has been correctly tested
 #if _DEBUG
-            if (has_key(data->attrib_locations, flags))
+            if (has_key(attrib_locations, flags))
             {
                 msg::error("error while parsing attribute semantics in %s\n",
                            attr_name.c_str());
             }
 #endif
-            data->attrib_locations[flags] = location;
+            attrib_locations[flags] = location;
         }
     }
 
     delete[] name_buffer;
+
+    /* Build the uniform table. Arrays are reported as "name[0]" and get
+     * looked up as "name" too; uniforms inside blocks have no location. */
+    GLint num_uniforms;
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORMS, &num_uniforms);
+
+#if EMSCRIPTEN
+    max_len = 256;
+#else
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+#endif
+
+    name_buffer = new char[max_len];
+    for (int i = 0; i < num_uniforms; ++i)
+    {
+        GLint uniform_size;
+        GLenum uniform_type;
+        glGetActiveUniform(prog_id, i, max_len, nullptr,
+                           &uniform_size, &uniform_type, name_buffer);
+
+        GLint location = glGetUniformLocation(prog_id, name_buffer);
+        if (location < 0)
+            continue;
+
+        std::string uniform_name(name_buffer);
+        int slot = AddUniform(location);
+        uniform_slots[ShaderUniformName::Hash(uniform_name.c_str())] = slot;
+        if (ends_with(uniform_name, "[0]"))
+        {
+            uniform_name.resize(uniform_name.length() - 3);
+            uniform_slots[ShaderUniformName::Hash(uniform_name.c_str())] = slot;
+        }
+    }
+
+    delete[] name_buffer;
+
+    /* Look up the uniforms we set ourselves */
+    for (int i = 0; i < U_BUILTIN_COUNT; ++i)
+        builtin_uniforms[i] = GetUniform(ShaderUniformName(builtin_uniform_names[i]));
+
+#if defined GL_UNIFORM_BUFFER
+    if (uses_scene_data && ShaderData::HasUniformBuffers())
+    {
+        GLuint block = glGetUniformBlockIndex(prog_id, "lol_scene");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(prog_id, block, scene_binding);
+    }
+#endif
 }
 
 int Shader::GetAttribCount() const
 {
+    data->Finish();
     return data->attrib_locations.size();
 }
 
 ShaderAttrib Shader::GetAttribLocation(VertexUsage usage, int index) const
 {
+    data->Finish();
+
     ShaderAttrib ret;
     ret.m_flags = (uint64_t)(uint16_t)usage.ToScalar() << 16;
     ret.m_flags |= (uint64_t)(uint16_t)index;
@@ -394,15 +634,37 @@ ShaderAttrib Shader::GetAttribLocation(VertexUsage usage, int index) const
     return ret;
 }
 
-ShaderUniform Shader::GetUniformLocation(std::string const& uni) const
+bool Shader::HasAttrib(VertexUsage usage, int index) const
 {
-    return GetUniformLocation(uni.c_str());
+    data->Finish();
+
+    uint64_t flags = (uint64_t)(uint16_t)usage.ToScalar() << 16;
+    flags |= (uint64_t)(uint16_t)index;
+    return has_key(data->attrib_locations, flags);
 }
-ShaderUniform Shader::GetUniformLocation(char const *uni) const
+
+ShaderUniform Shader::GetUniformLocation(ShaderUniformName const &uni) const
 {
+    data->Finish();
+    return data->GetUniform(uni);
+}
+
+ShaderUniform ShaderData::GetUniform(ShaderUniformName const &uni)
+{
+    int slot;
+    if (!try_get(uniform_slots, uni.m_hash, slot))
+    {
+        /* Array elements and struct members may not have been reported
+         * after linking; ask GL once, and remember missing ones too. */
+        GLint location = glGetUniformLocation(prog_id, uni.m_name);
+        slot = AddUniform(location);
+        uniform_slots[uni.m_hash] = slot;
+    }
+
     ShaderUniform ret;
-    ret.frag = (uintptr_t)glGetUniformLocation(data->prog_id, uni);
-    ret.vert = 0;
+    ret.frag = (uintptr_t)uniforms[slot].location;
+    ret.vert = (uintptr_t)slot + 1;
+    ret.flags = prog_id;
     return ret;
 }
 
@@ -412,57 +674,68 @@ ShaderUniform Shader::GetUniformLocation(char const *uni) const
 
 void Shader::SetUniform(ShaderUniform const &uni, int i)
 {
-    glUniform1i((GLint)uni.frag, i);
+    if (ShaderData::NeedsUpload(uni, &i, sizeof(i)))
+        glUniform1i((GLint)uni.frag, i);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, ivec2 const &v)
 {
-    glUniform2i((GLint)uni.frag, v.x, v.y);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform2i((GLint)uni.frag, v.x, v.y);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, ivec3 const &v)
 {
-    glUniform3i((GLint)uni.frag, v.x, v.y, v.z);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform3i((GLint)uni.frag, v.x, v.y, v.z);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, ivec4 const &v)
 {
-    glUniform4i((GLint)uni.frag, v.x, v.y, v.z, v.w);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform4i((GLint)uni.frag, v.x, v.y, v.z, v.w);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, float f)
 {
-    glUniform1f((GLint)uni.frag, f);
+    if (ShaderData::NeedsUpload(uni, &f, sizeof(f)))
+        glUniform1f((GLint)uni.frag, f);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, vec2 const &v)
 {
-    glUniform2fv((GLint)uni.frag, 1, &v[0]);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform2fv((GLint)uni.frag, 1, &v[0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, vec3 const &v)
 {
-    glUniform3fv((GLint)uni.frag, 1, &v[0]);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform3fv((GLint)uni.frag, 1, &v[0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, vec4 const &v)
 {
-    glUniform4fv((GLint)uni.frag, 1, &v[0]);
+    if (ShaderData::NeedsUpload(uni, &v, sizeof(v)))
+        glUniform4fv((GLint)uni.frag, 1, &v[0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, mat2 const &m)
 {
-    glUniformMatrix2fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
+    if (ShaderData::NeedsUpload(uni, &m, sizeof(m)))
+        glUniformMatrix2fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, mat3 const &m)
 {
-    glUniformMatrix3fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
+    if (ShaderData::NeedsUpload(uni, &m, sizeof(m)))
+        glUniformMatrix3fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, mat4 const &m)
 {
-    glUniformMatrix4fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
+    if (ShaderData::NeedsUpload(uni, &m, sizeof(m)))
+        glUniformMatrix4fv((GLint)uni.frag, 1, GL_FALSE, &m[0][0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, TextureUniform tex, int index)
@@ -479,41 +752,113 @@ void Shader::SetUniform(ShaderUniform const &uni, TextureUniform tex, int index)
 
 void Shader::SetUniform(ShaderUniform const &uni, array<float> const &v)
 {
-    glUniform1fv((GLint)uni.frag, (GLsizei)v.count(), &v[0]);
+    if (ShaderData::NeedsUpload(uni, nullptr, 0))
+        glUniform1fv((GLint)uni.frag, (GLsizei)v.count(), &v[0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, array<vec2> const &v)
 {
-    glUniform2fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
+    if (ShaderData::NeedsUpload(uni, nullptr, 0))
+        glUniform2fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, array<vec3> const &v)
 {
-    glUniform3fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
+    if (ShaderData::NeedsUpload(uni, nullptr, 0))
+        glUniform3fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
 }
 
 void Shader::SetUniform(ShaderUniform const &uni, array<vec4> const &v)
 {
-    glUniform4fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
+    if (ShaderData::NeedsUpload(uni, nullptr, 0))
+        glUniform4fv((GLint)uni.frag, (GLsizei)v.count(), &v[0][0]);
+}
+
+void Shader::SetModelMatrix(mat4 const &model)
+{
+    ShaderUniform const *u = data->builtin_uniforms;
+    auto is_used = [](ShaderUniform const &uni) { return (GLint)uni.frag != -1; };
+
+    SetUniform(u[U_MODEL], model);
+
+    if (is_used(u[U_MODELVIEW]) || is_used(u[U_NORMALMAT]))
+    {
+        mat4 modelview = ShaderData::scene_data.view * model;
+        SetUniform(u[U_MODELVIEW], modelview);
+        if (is_used(u[U_NORMALMAT]))
+            SetUniform(u[U_NORMALMAT], transpose(inverse(mat3(modelview))));
+    }
 }
 
 void Shader::Bind() const
 {
+    data->Finish();
     glUseProgram(data->prog_id);
+    ShaderData::bound_shader = data;
+
+    /* Without uniform buffers, shaders get the scene data the first
+     * time they are bound after it changed. */
+    if (data->uses_scene_data && data->scene_serial != ShaderData::scene_data_serial
+         && !ShaderData::HasUniformBuffers())
+    {
+        ShaderSceneData const &sd = ShaderData::scene_data;
+        ShaderUniform const *u = data->builtin_uniforms;
+
+        Shader *that = const_cast<Shader *>(this);
+        that->SetUniform(u[U_PROJECTION], sd.projection);
+        that->SetUniform(u[U_VIEW], sd.view);
+        that->SetUniform(u[U_INV_VIEW], sd.inv_view);
+        if (ShaderData::NeedsUpload(u[U_LIGHTS], nullptr, 0))
+            glUniform4fv((GLint)u[U_LIGHTS].frag, LOL_MAX_LIGHT_COUNT * 2, &sd.lights[0][0]);
+
+        data->scene_serial = ShaderData::scene_data_serial;
+    }
 }
 
 void Shader::Unbind() const
 {
     /* FIXME: untested */
     glUseProgram(0);
+    ShaderData::bound_shader = nullptr;
+}
+
+void Shader::SetSceneData(ShaderSceneData const &scene_data)
+{
+    ShaderData::scene_data = scene_data;
+    ++ShaderData::scene_data_serial;
+
+#if defined GL_UNIFORM_BUFFER
+    if (ShaderData::HasUniformBuffers())
+    {
+        if (!ShaderData::scene_ubo)
+            glGenBuffers(1, &ShaderData::scene_ubo);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ShaderData::scene_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(scene_data), &scene_data, GL_STREAM_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, scene_binding, ShaderData::scene_ubo);
+    }
+#endif
+}
+
+void Shader::GetUniformStats(int &sent, int &skipped)
+{
+    sent = ShaderData::uniforms_sent;
+    skipped = ShaderData::uniforms_skipped;
+    ShaderData::uniforms_sent = ShaderData::uniforms_skipped = 0;
 }
 
 Shader::~Shader()
 {
-    glDetachShader(data->prog_id, data->vert_id);
-    glDetachShader(data->prog_id, data->frag_id);
-    glDeleteShader(data->vert_id);
-    glDeleteShader(data->frag_id);
+    if (ShaderData::bound_shader == data)
+        ShaderData::bound_shader = nullptr;
+
+    if (data->vert_id)
+    {
+        glDetachShader(data->prog_id, data->vert_id);
+        glDetachShader(data->prog_id, data->frag_id);
+        glDeleteShader(data->vert_id);
+        glDeleteShader(data->frag_id);
+    }
     glDeleteProgram(data->prog_id);
 
     delete data;
@@ -569,14 +914,249 @@ int ShaderData::GetVersion()
     return version;
 }
 
+/* Check whether uniform blocks can be used in our 1.30 shaders */
+bool ShaderData::HasUniformBuffers()
+{
+#if defined GL_UNIFORM_BUFFER && !defined HAVE_GLES_2X
+    static int ret = -1;
+
+    if (ret < 0)
+    {
+        char const *test =
+            "#version 130\n"
+            "#extension GL_ARB_uniform_buffer_object : require\n"
+            "layout(std140) uniform lol_test { vec4 v; };\n"
+            "void main() { gl_Position = v; }";
+        GLint status = GL_FALSE;
+
+        if (GetVersion() >= 130)
+        {
+            int id = glCreateShader(GL_VERTEX_SHADER);
+            glShaderSource(id, 1, &test, nullptr);
+            glCompileShader(id);
+            glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+            glDeleteShader(id);
+        }
+
+        ret = status == GL_TRUE;
+    }
+
+    return ret > 0;
+#else
+    return false;
+#endif
+}
+
 /*
  * Simple shader source patching for old GLSL versions.
  */
+static bool has_extension(char const *name)
+{
+    char const *list = (char const *)glGetString(GL_EXTENSIONS);
+    if (list)
+    {
+        /* Match whole names only */
+        size_t len = strlen(name);
+        for (char const *p = strstr(list, name); p; p = strstr(p + len, name))
+            if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+                return true;
+        return false;
+    }
+
+#if defined GL_NUM_EXTENSIONS && !defined HAVE_GLES_2X
+    /* Core profiles only list extensions one by one */
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+        if (!strcmp((char const *)glGetStringi(GL_EXTENSIONS, i), name))
+            return true;
+#endif
+    return false;
+}
+
+/* Check whether the driver can compile shaders on its own threads, and
+ * allow it to use as many as it wants. */
+bool ShaderData::HasParallelCompile()
+{
+#if defined GL_COMPLETION_STATUS_KHR
+    static int ret = -1;
+
+    if (ret < 0)
+    {
+        /* Both extensions share their tokens, but each one has its own
+         * entry point, which is null when only the other is exposed. */
+        if (has_extension("GL_KHR_parallel_shader_compile"))
+        {
+            ret = 1;
+            glMaxShaderCompilerThreadsKHR(0xffffffffu);
+        }
+        else if (has_extension("GL_ARB_parallel_shader_compile"))
+        {
+            ret = 1;
+#if defined GL_ARB_parallel_shader_compile
+            glMaxShaderCompilerThreadsARB(0xffffffffu);
+#endif
+        }
+        else
+            ret = 0;
+    }
+
+    return ret > 0;
+#else
+    return false;
+#endif
+}
+
+/* Check whether linked programs can be saved and loaded back */
+bool ShaderData::HasProgramBinaries()
+{
+#if defined GL_NUM_PROGRAM_BINARY_FORMATS && !defined HAVE_GLES_2X
+    static int ret = -1;
+
+    if (ret < 0)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ret = formats > 0;
+    }
+
+    return ret > 0;
+#else
+    return false;
+#endif
+}
+
+/* Program binaries are only valid for the driver that created them */
+uint64_t ShaderData::GetDriverHash()
+{
+    static uint64_t ret = 0;
+
+    if (!ret)
+    {
+        std::string driver;
+        for (GLenum e : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            char const *str = (char const *)glGetString(e);
+            driver += str ? str : "";
+            driver += '\n';
+        }
+        ret = ShaderUniformName::Hash(driver.c_str());
+    }
+
+    return ret;
+}
+
+/* Binary files start with a magic number and the binary format */
+static char const binary_magic[4] = { 'L', 'o', 'l', 'p' };
+
+bool ShaderData::LoadBinary()
+{
+#if defined GL_NUM_PROGRAM_BINARY_FORMATS && !defined HAVE_GLES_2X
+    if (!binary_dir.length() || !HasProgramBinaries())
+        return false;
+
+    binary_key = GetDriverHash();
+    binary_key = ShaderUniformName::Hash(vert_code.c_str(), binary_key);
+    binary_key = ShaderUniformName::Hash(frag_code.c_str(), binary_key);
+
+    File f;
+    f.Open(binary_dir + format("%016llx.bin", (unsigned long long)binary_key),
+           FileAccess::Read, true);
+    if (!f.IsValid())
+        return false;
+
+    std::string data = f.ReadString();
+    f.Close();
+
+    GLenum binary_format;
+    size_t const header = sizeof(binary_magic) + sizeof(binary_format);
+    if (data.length() <= header
+         || memcmp(data.data(), binary_magic, sizeof(binary_magic)))
+        return false;
+
+    memcpy(&binary_format, data.data() + sizeof(binary_magic), sizeof(binary_format));
+    glProgramBinary(prog_id, binary_format, data.data() + header,
+                    (GLsizei)(data.length() - header));
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(prog_id, GL_LINK_STATUS, &status);
+    if (status == GL_TRUE)
+    {
+        msg::debug("loaded program %s from binary cache\n", m_name.c_str());
+        return true;
+    }
+
+    /* Probably saved by another driver version; build from source */
+    glDeleteProgram(prog_id);
+    prog_id = glCreateProgram();
+#endif
+    return false;
+}
+
+/* The binary directory may not be writable; the cache is then unused */
+void ShaderData::SaveBinary()
+{
+#if defined GL_NUM_PROGRAM_BINARY_FORMATS && !defined HAVE_GLES_2X
+    if (!binary_dir.length() || !HasProgramBinaries())
+        return;
+
+    GLint len = 0;
+    glGetProgramiv(prog_id, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0)
+        return;
+
+    array<uint8_t> binary;
+    binary.resize(len);
+    GLenum binary_format;
+    glGetProgramBinary(prog_id, len, &len, &binary_format, binary.data());
+
+    File f;
+    f.Open(binary_dir + format("%016llx.bin", (unsigned long long)binary_key),
+           FileAccess::Write, true);
+    if (!f.IsValid())
+        return;
+
+    f.Write(binary_magic, sizeof(binary_magic));
+    f.Write(&binary_format, sizeof(binary_format));
+    f.Write(binary.data(), len);
+    f.Close();
+#endif
+}
+
 std::string ShaderData::Patch(std::string const &code, ShaderType type)
 {
     int ver_driver = GetVersion();
 
     std::string patched_code = code;
+
+    /* Expand the scene uniforms into a uniform block, or into plain
+     * uniforms when uniform buffers are not available. */
+    size_t scene_pos = patched_code.find(scene_pragma);
+    if (scene_pos != std::string::npos)
+    {
+        bool ubo = HasUniformBuffers();
+        char const *prefix = ubo ? "    " : "uniform ";
+        std::string decl = ubo ? "layout(std140) uniform lol_scene\n{\n" : "";
+        decl += format("%smat4 u_projection;\n"
+                       "%smat4 u_view;\n"
+                       "%smat4 u_inv_view;\n"
+                       "%svec4 u_lights[%d];\n", prefix, prefix, prefix,
+                       prefix, LOL_MAX_LIGHT_COUNT * 2);
+        if (ubo)
+            decl += "};";
+        patched_code.replace(scene_pos, strlen(scene_pragma), decl);
+
+        /* The extension must be enabled before any declaration */
+        if (ubo)
+        {
+            size_t version_pos = patched_code.find("#version");
+            size_t eol = version_pos == std::string::npos ? std::string::npos
+                       : patched_code.find('\n', version_pos);
+            patched_code.insert(eol == std::string::npos ? 0 : eol + 1,
+                                "#extension GL_ARB_uniform_buffer_object : require\n");
+        }
+    }
+
     if (ver_driver >= 130)
         return patched_code;
 
@@ -12,6 +12,9 @@
 
 #include <lol/engine-internal.h>
 
+#include <cstring>
+#include <cstdio>
+
 #include "lolgl.h"
 
 // FIXME: fine-tune this define
@@ -34,6 +37,11 @@ class VertexBufferData
 
     GLuint m_vbo;
     uint8_t *m_memory;
+
+    /* Range given to the last Lock(), and whether the GL buffer storage
+     * was already allocated, in which case only that range is uploaded. */
+    size_t m_lock_offset, m_lock_size;
+    bool m_allocated;
 };
 
 //
@@ -134,6 +142,68 @@ void VertexDeclaration::DrawIndexedElements(MeshPrimitive type, int count, const
     }
 }
 
+void VertexDeclaration::DrawIndexedElementsInstanced(MeshPrimitive type, int count,
+                                                     int instances, const short* skip,
+                                                     short typeSize)
+{
+    if (count <= 0 || instances <= 0)
+        return;
+
+#if defined GL_VERSION_3_3 || defined GL_ES_VERSION_3_0
+    uint32_t elementType = typeSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    switch (type.ToScalar())
+    {
+    case MeshPrimitive::Triangles:
+        glDrawElementsInstanced(GL_TRIANGLES, count, elementType, skip, instances);
+        break;
+    case MeshPrimitive::TriangleStrips:
+        glDrawElementsInstanced(GL_TRIANGLE_STRIP, count, elementType, skip, instances);
+        break;
+    case MeshPrimitive::TriangleFans:
+        glDrawElementsInstanced(GL_TRIANGLE_FAN, count, elementType, skip, instances);
+        break;
+    case MeshPrimitive::Points:
+        glDrawElementsInstanced(GL_POINTS, count, elementType, skip, instances);
+        break;
+    case MeshPrimitive::Lines:
+        glDrawElementsInstanced(GL_LINES, count, elementType, skip, instances);
+        break;
+    }
+#else
+    UNUSED(type, skip, typeSize);
+    ASSERT(false, "instanced draws are not supported\n");
+#endif
+}
+
+/* Instanced draws and attribute divisors are core in GL 3.3 and GLES 3.0;
+ * the headers may know about them even if the context is older. */
+bool VertexDeclaration::HasInstancing()
+{
+#if defined GL_VERSION_3_3 || defined GL_ES_VERSION_3_0
+    static int ret = -1;
+
+    if (ret < 0)
+    {
+        char const *version = (char const *)glGetString(GL_VERSION);
+        char const *es = version ? strstr(version, "OpenGL ES ") : nullptr;
+        int major = 0, minor = 0;
+        if (version)
+            sscanf(es ? es + 10 : version, "%d.%d", &major, &minor);
+
+        ret = major * 10 + minor >= (es ? 30 : 33);
+#if defined LOL_USE_GLEW && !defined __APPLE__
+        /* If this is not available, don't use it */
+        ret = ret && glDrawElementsInstanced && glVertexAttribDivisor;
+#endif
+    }
+
+    return ret > 0;
+#else
+    return false;
+#endif
+}
+
 void VertexDeclaration::Unbind()
 {
     for (int i = 0; i < m_count; i++)
@@ -144,6 +214,11 @@ void VertexDeclaration::Unbind()
                 if (m_streams[j].reg == m_streams[i].reg)
                     m_streams[j].reg = -1;
 
+#if defined GL_VERSION_3_3 || defined GL_ES_VERSION_3_0
+            /* Other declarations expect per-vertex data in this slot */
+            if (m_streams[i].usage == VertexUsage::Instance)
+                glVertexAttribDivisor(m_streams[i].reg, 0);
+#endif
             glDisableVertexAttribArray(m_streams[i].reg);
         }
     }
@@ -169,7 +244,7 @@ void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attr1,
     SetStream(vb, attribs);
 }
 
-void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attribs[])
+void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attribs[], int first)
 {
     if (!vb->m_data->m_size)
         return;
@@ -213,16 +288,23 @@ void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attribs[])
                 if (i < attr_index)
                     offset += m_streams[i].size;
             }
+        offset += first * stride;
 
         /* Finally, we need to retrieve the type of the data */
 #if !defined GL_DOUBLE
 #   define GL_DOUBLE 0
+#endif
+#if !defined GL_HALF_FLOAT && defined GL_HALF_FLOAT_OES
+#   define GL_HALF_FLOAT GL_HALF_FLOAT_OES
+#elif !defined GL_HALF_FLOAT
+#   define GL_HALF_FLOAT 0
 #endif
         static struct { GLint size; GLenum type; } const tlut[] =
         {
             { 0, 0 },
 #if LOL_FEATURE_CXX11_UNRESTRICTED_UNIONS
-            { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, /* half */
+            { 1, GL_HALF_FLOAT }, { 2, GL_HALF_FLOAT }, { 3, GL_HALF_FLOAT },
+                { 4, GL_HALF_FLOAT }, /* half */
 #endif
             { 1, GL_FLOAT }, { 2, GL_FLOAT }, { 3, GL_FLOAT },
                 { 4, GL_FLOAT }, /* float */
@@ -250,6 +332,7 @@ void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attribs[])
         if (reg != 0xffffffff)
         {
             if (tlut[type_index].type == GL_FLOAT
+                 || tlut[type_index].type == GL_HALF_FLOAT
                  || tlut[type_index].type == GL_DOUBLE
                  || tlut[type_index].type == GL_BYTE
                  || tlut[type_index].type == GL_UNSIGNED_BYTE
@@ -274,6 +357,10 @@ void VertexDeclaration::SetStream(VertexBuffer *vb, ShaderAttrib attribs[])
                                        tlut[type_index].type,
                                        stride, (GLvoid const *)(uintptr_t)offset);
             }
+#endif
+#if defined GL_VERSION_3_3 || defined GL_ES_VERSION_3_0
+            if (usage == VertexUsage::Instance)
+                glVertexAttribDivisor((GLint)reg, 1);
 #endif
         }
     }
@@ -347,6 +434,9 @@ VertexBuffer::VertexBuffer(size_t size)
   : m_data(new VertexBufferData)
 {
     m_data->m_size = size;
+    m_data->m_lock_offset = 0;
+    m_data->m_lock_size = size;
+    m_data->m_allocated = false;
     if (!size)
         return;
 
@@ -374,8 +464,10 @@ void *VertexBuffer::Lock(size_t offset, size_t size)
     if (!m_data->m_size)
         return nullptr;
 
-    /* FIXME: is there a way to use "size"? */
-    UNUSED(size);
+    /* A size of zero means up to the end of the buffer */
+    ASSERT(offset + size <= m_data->m_size, "locking past the end of the buffer");
+    m_data->m_lock_offset = offset;
+    m_data->m_lock_size = size ? size : m_data->m_size - offset;
     return m_data->m_memory + offset;
 }
 
@@ -385,8 +477,13 @@ void VertexBuffer::Unlock()
         return;
 
     glBindBuffer(GL_ARRAY_BUFFER, m_data->m_vbo);
-    glBufferData(GL_ARRAY_BUFFER, m_data->m_size, m_data->m_memory,
-                 GL_STATIC_DRAW);
+    if (m_data->m_allocated)
+        glBufferSubData(GL_ARRAY_BUFFER, m_data->m_lock_offset, m_data->m_lock_size,
+                        m_data->m_memory + m_data->m_lock_offset);
+    else
+        glBufferData(GL_ARRAY_BUFFER, m_data->m_size, m_data->m_memory,
+                     GL_STATIC_DRAW);
+    m_data->m_allocated = true;
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -12,8 +12,6 @@
 
 #pragma once
 
-#include <map>
-
 //
 // The ImageCodecData class
 // ------------------------
@@ -65,7 +63,7 @@ public:
     WrapMode m_wrap_x, m_wrap_y;
 
     /* A map of the various available bitplanes */
-    std::map<int, PixelDataBase *> m_pixels;
+    flat_map<int, PixelDataBase *> m_pixels;
     /* The last bitplane being accessed for writing */
     PixelFormat m_format;
 };
@@ -13,7 +13,17 @@
 
 #pragma once
 
+//
+// The AABBTree, Quadtree and Octree classes
+// -----------------------------------------
+// Spatial indices of elements that provide GetAABB(). They are facades
+// over dynamic_bvh, so that re-registering a moving element is a cheap
+// O(log n) update rather than a search through all elements.
+//
+
 #include <lol/base/array.h>
+#include <lol/base/hash_map.h>
+#include <lol/algorithm/bvh.h>
 #include <lol/debug/lines.h>
 #include <lol/image/color.h>
 
@@ -29,107 +39,40 @@ template <typename TE> class Octree;
 namespace Debug {
 //--
 
-template<typename TREE, typename TE, typename TBB>
-void DrawInner(TREE *tree, array<TBB, vec4> &boxes,
-               array<TE *, int, vec4> &elements,
-               array<int, TBB> &leaves, int children, vec4 color)
-{
-    boxes.push(tree->GetAABB(), Color::white);
-    leaves.push(0, boxes.last().m1);
-    while (leaves.count() > 0)
-    {
-        for (int j = 0; j < tree->GetTree()[leaves[0].m1].m_elements.count(); j++)
-        {
-            bool done = false;
-            for (int k = 0; k < elements.count(); k++)
-            {
-                if (elements[k].m1 == tree->GetElements()[tree->GetTree()[leaves[0].m1].m_elements[j]].m_element)
-                {
-                    elements[k].m2++;
-                    done = true;
-                    break;
-                }
-            }
-            if (!done)
-                elements.push(tree->GetElements()[tree->GetTree()[leaves[0].m1].m_elements[j]].m_element, 1, Color::red);
-        }
-
-        for (int i = 0; i < children; i++)
-        {
-            if (tree->GetTree()[leaves[0].m1].m_children[i] != 0)
-            {
-                TBB bbox = tree->GetSubAABB(leaves[0].m2, i);
-                leaves.push(tree->GetTree()[leaves[0].m1].m_children[i], bbox);
-                boxes.push(bbox, color);
-            }
-        }
-        leaves.remove(0);
-    }
-}
-
-//--
+/* Draw the tree nodes with the given colour and the elements in red,
+ * each element raised by a small offset per tree level. */
 template <typename TE, typename TV = void>
 void Draw(Quadtree<TE>* tree, vec4 color)
 {
-    array<box2, vec4> boxes;
-    array<TE*, int, vec4> elements;
-    array<int, box2> leaves;
-
-    DrawInner<Quadtree<TE>, TE, box2>(tree, boxes, elements, leaves, 4, color);
-
+    float const y = tree->m_debug_y_offset;
     vec3 off = vec3(0.0f, 0.1f, 0.0f);
-    //vec3 add = vec3(0.0f, 0.1f, 0.0f);
-    while (boxes.count() > 0)
-    {
-        Debug::DrawBox(vec3(boxes[0].m1.aa.x, tree->m_debug_y_offset, boxes[0].m1.aa.y),
-                       vec3(boxes[0].m1.bb.x, tree->m_debug_y_offset, boxes[0].m1.bb.y),
-                       boxes[0].m2);
-        boxes.remove(0);
-    }
-    while (elements.count() > 0)
+
+    tree->GetTree().walk([&](box2 const &aabb, TE *element, int depth)
     {
-        while (elements[0].m2 > 0)
-        {
-            Debug::DrawBox(vec3(elements[0].m1->GetAABB().aa.x, tree->m_debug_y_offset, elements[0].m1->GetAABB().aa.y) + off * (float)elements[0].m2,
-                           vec3(elements[0].m1->GetAABB().bb.x, tree->m_debug_y_offset, elements[0].m1->GetAABB().bb.y) + off * (float)elements[0].m2,
-                           elements[0].m3);
-            elements[0].m2--;
-        }
-        elements.remove(0);
-    }
+        if (element)
+            Debug::DrawBox(vec3(element->GetAABB().aa.x, y, element->GetAABB().aa.y) + off * (float)depth,
+                           vec3(element->GetAABB().bb.x, y, element->GetAABB().bb.y) + off * (float)depth,
+                           Color::red);
+        else
+            Debug::DrawBox(vec3(aabb.aa.x, y, aabb.aa.y),
+                           vec3(aabb.bb.x, y, aabb.bb.y), color);
+    });
 }
 //--
 template <typename TE, typename TV = void>
 void Draw(Octree<TE>* tree, vec4 color)
 {
-    array<box3, vec4> boxes;
-    array<TE*, int, vec4> elements;
-    array<int, box3> leaves;
-
-    DrawInner<Octree<TE>, TE, box3>(tree, boxes, elements, leaves, 8, color);
-
     vec3 off = vec3(0.0f, 0.1f, 0.0f);
-    //vec3 add = vec3(0.0f, 0.1f, 0.0f);
-    while (boxes.count() > 0)
-    {
-        //float size = boxes[0].m1.bb.x - boxes[0].m1.aa.x;
-        Debug::DrawBox(vec3(boxes[0].m1.aa.x, boxes[0].m1.aa.y, boxes[0].m1.aa.z) /* + off * (m_size.x / size) */,
-                        vec3(boxes[0].m1.bb.x, boxes[0].m1.bb.y, boxes[0].m1.bb.z) /* + off * (m_size.x / size) */,
-                        boxes[0].m2);
-        //off += add;
-        boxes.remove(0);
-    }
-    while (elements.count() > 0)
+
+    tree->GetTree().walk([&](box3 const &aabb, TE *element, int depth)
     {
-        while (elements[0].m2 > 0)
-        {
-            Debug::DrawBox(vec3(elements[0].m1->GetAABB().aa.x, elements[0].m1->GetAABB().aa.y, elements[0].m1->GetAABB().aa.z) + off * (float)elements[0].m2,
-                            vec3(elements[0].m1->GetAABB().bb.x, elements[0].m1->GetAABB().bb.y, elements[0].m1->GetAABB().bb.z) + off * (float)elements[0].m2,
-                            elements[0].m3);
-            elements[0].m2--;
-        }
-        elements.remove(0);
-    }
+        if (element)
+            Debug::DrawBox(element->GetAABB().aa + off * (float)depth,
+                           element->GetAABB().bb + off * (float)depth,
+                           Color::red);
+        else
+            Debug::DrawBox(aabb.aa, aabb.bb, color);
+    });
 }
 //--
 }
@@ -138,38 +81,15 @@ void Draw(Octree<TE>* tree, vec4 color)
 template <typename TE, typename TV, typename TB, size_t child_nb>
 class AABBTree
 {
-    struct NodeLeaf
-    {
-        int             m_parent;
-        //Children pos in the list
-        int             m_children[child_nb];
-        //Element list
-        array<int>      m_elements;
-
-        NodeLeaf(int parent)
-        {
-            m_parent = parent;
-            for (size_t i = 0; i < child_nb; ++i)
-                m_children[i] = 0;
-        }
-    };
-
-    struct TreeElement
-    {
-        TE*             m_element;
-        array<int>      m_leaves;
-
-        inline bool operator==(const TE*& element) { return m_element == element; }
-    };
-
 public:
+    typedef dynamic_bvh<TE, TV::count> tree_type;
+
     AABBTree()
     {
         m_max_depth = 1;
         m_max_element = 1;
-        AddLeaf(0);
     }
-    ~AABBTree()
+    virtual ~AABBTree()
     {
         Clear();
     }
@@ -182,157 +102,58 @@ public:
         m_size = src.m_size;
         m_max_depth = src.m_max_depth;
         m_max_element = src.m_max_element;
+        m_tree.set_margin(src.m_tree.get_margin());
     }
 
-private:
-    //--
-    bool CleanupEmptyLeaves(int leaf=0)
-    {
-        int empty_children = 0;
-        for (size_t i = 0; i < child_nb; ++i)
-        {
-            bool child_empty = false;
-            if (m_tree[leaf].m_children[i] != 0)
-                child_empty = CleanupEmptyLeaves(m_tree[leaf].m_children[i]);
-            empty_children += (int)(m_tree[leaf].m_children[i] == 0 || child_empty);
-        }
-        if (empty_children == 4 && leaf != 0)
-        {
-            for (size_t i = 0; i < child_nb; ++i)
-            {
-                int old_leaf = m_tree[leaf].m_children[i];
-                if (old_leaf != 0)
-                    m_free_leaves << old_leaf;
-                m_tree[leaf].m_children[i] = 0;
-            }
-            return true;
-        }
-        return false;
-    }
-    //--
-    void RemoveElement(TE* element)
-    {
-        int idx = INDEX_NONE;
-        for (int i = 0; i < m_elements.count(); ++i)
-            if (m_elements[i].m_element == element)
-                idx = i;
-
-        if (idx == INDEX_NONE)
-            return;
-
-        //Remove item from tree leaves
-        for (int i = 0; i < m_elements[idx].m_leaves.count(); i++)
-            m_tree[m_elements[idx].m_leaves[i]].m_elements.removeItem(idx);
-
-        //Try leaves cleanup
-        CleanupEmptyLeaves();
-    }
-    //--
-    int AddElement(TE* element)
+public:
+    /* Add an element, or update it if it is already registered. As
+     * before, elements outside of GetAABB() are not tracked. */
+    void RegisterElement(TE* element)
     {
-        for (int i = 0; i < m_elements.count(); ++i)
-            if (m_elements[i].m_element == element)
-                return i;
+        TB aabb = element->GetAABB();
+        bool inside = TestAABBVsAABB(GetAABB(), aabb);
+        auto it = m_elements.find(element);
 
-        TreeElement new_element;
-        new_element.m_element = element;
-        new_element.m_leaves = array<int>();
-        m_elements << new_element;
-        return m_elements.count() - 1;
-    }
-    //--
-    int AddLeaf(int parent)
-    {
-        int idx = m_tree.count();
-        if (m_free_leaves.count())
+        if (it == m_elements.end())
         {
-            idx = m_free_leaves.pop();
-            m_tree[idx] = NodeLeaf(parent);
+            if (inside)
+                m_elements[element] = m_tree.insert(element, aabb);
         }
+        else if (inside)
+            m_tree.update(it->second, aabb);
         else
-            m_tree << NodeLeaf(parent);
-        return idx;
+            UnregisterElement(element);
     }
 
-    //--
-    bool TestLeaf(int leaf, const TB& leaf_bb, const TB& test_bb, array<TE*>& elements)
+    void UnregisterElement(TE* element)
     {
-        bool result = false;
-        if (TestAABBVsAABB(leaf_bb, test_bb))
-        {
-            NodeLeaf& node = m_tree[leaf];
-            for (size_t i = 0; i < child_nb; ++i)
-            {
-                if (node.m_children[i] != 0)
-                {
-                    TB sub_aabb = GetSubAABB(leaf_bb, (int)i);
-                    result = result | TestLeaf(node.m_children[i], sub_aabb, test_bb, elements);
-                }
-                else
-                {
-                    for (int j = 0; j < node.m_elements.count(); j++)
-                        elements.push_unique(m_elements[node.m_elements[j]].m_element);
-                    result = true;
-                }
-            }
-        }
-        return result;
+        auto it = m_elements.find(element);
+        if (it == m_elements.end())
+            return;
+
+        m_tree.remove(it->second);
+        m_elements.erase(element);
     }
-    //--
-    bool RegisterElement(TE* element, int leaf, TB leaf_bb, int depth)
+
+    /* Append the elements whose box intersects bbox; return whether
+     * any was found. */
+    bool FindElements(const TB& bbox, array<TE*>& elements)
     {
-        if (TestAABBVsAABB(leaf_bb, element->GetAABB()))
+        int count = elements.count();
+        m_tree.query(bbox, [&](int proxy)
         {
-            bool found_child = false;
-            for (size_t i = 0; i < child_nb; ++i)
-            {
-                TB child_bb = GetSubAABB(leaf_bb, (int)i);
-                int child_leaf = m_tree[leaf].m_children[i];
-                //there is a child, go further down
-                if (child_leaf != 0)
-                    found_child = found_child | RegisterElement(element, child_leaf, child_bb, depth + 1);
-            }
-            if (found_child)
-                return true;
-
-            //Too much elements, we need to re-dispatch the elements
-            if (m_tree[leaf].m_elements.count() + 1 > m_max_element &&
-                depth < m_max_depth)
-            {
-                //Extract elements
-                array<int> elements = m_tree[leaf].m_elements;
-                elements.push_unique(AddElement(element));
-                m_tree[leaf].m_elements.empty();
-                //Add children
-                for (size_t j = 0; j < child_nb; ++j)
-                    m_tree[leaf].m_children[j] = AddLeaf(leaf);
-                //Re-run extracted elements
-                while (elements.count())
-                {
-                    RegisterElement(m_elements[elements[0]].m_element, leaf, leaf_bb, depth);
-                    elements.remove(0);
-                }
-            }
-            //else add to list.
-            else
-            {
-                int idx = AddElement(element);
-                m_elements[idx].m_leaves.push_unique(leaf);
-                m_tree[leaf].m_elements.push_unique(idx);
-            }
+            TE *element = m_tree.get_element(proxy);
+            if (TestAABBVsAABB(element->GetAABB(), bbox))
+                elements.push(element);
             return true;
-        }
-        return false;
+        });
+        return elements.count() > count;
     }
 
-public:
-    void                RegisterElement(TE* element)                        { RegisterElement(element, 0, GetAABB(), 0); }
-    void                UnregisterElement(TE* element)                      { RemoveElement(element); }
-    bool                FindElements(const TB& bbox, array<TE*>& elements)  { return TestLeaf(0, GetAABB(), bbox, elements); }
-    void                Clear()
+    void Clear()
     {
-        m_tree.empty();
-        m_elements.empty();
+        m_tree.clear();
+        m_elements.clear();
     }
 
     //--
@@ -350,25 +171,28 @@ public:
     TV                  GetSize()                       { return m_size; }
     int                 GetMaxDepth()                   { return m_max_depth; }
     int                 GetMaxElement()                 { return m_max_element; }
+    float               GetMargin()                     { return m_tree.get_margin(); }
     void                SetSize(TV size)                { m_size = size; }
     void                SetMaxDepth(int max_depth)      { m_max_depth = max_depth; }
     void                SetMaxElement(int max_element)  { m_max_element = max_element; }
+    void                SetMargin(float margin)         { m_tree.set_margin(margin); }
 
-    array<NodeLeaf> const & GetTree() const
+    tree_type const & GetTree() const
     {
         return m_tree;
     }
 
-    array<TreeElement> const & GetElements() const
+    hash_map<TE*, int> const & GetElements() const
     {
         return m_elements;
     }
 
 protected:
-    array<NodeLeaf>     m_tree;         //actual tree
-    array<TreeElement>  m_elements;     //elements to leaves
-    array<int>          m_free_leaves;  //leaves removed from tree
+    tree_type           m_tree;         //actual tree
+    hash_map<TE*, int>  m_elements;     //elements to tree handles
     TV                  m_size;         //Main tree size
+    /* The depth and element limits of the old subdivision trees are
+     * kept for compatibility but no longer used. */
     int                 m_max_depth;    //Maximum depth possible
     int                 m_max_element;  //Maximum element per leaf
 };
@@ -377,7 +201,7 @@ protected:
 template <typename TE>
 class Quadtree : public AABBTree<TE, vec2, box2, 4>
 {
-    friend void Debug::Draw<TE,void>(Octree<TE>* tree, vec4 color);
+    friend void Debug::Draw<TE,void>(Quadtree<TE>* tree, vec4 color);
 public:
     Quadtree()          { m_debug_y_offset = 0.f; }
     virtual ~Quadtree() { }
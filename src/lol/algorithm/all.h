@@ -11,6 +11,7 @@
 #pragma once
 
 #include <lol/algorithm/sort.h>
+#include <lol/algorithm/bvh.h>
 #include <lol/algorithm/aabb_tree.h>
 #include <lol/algorithm/portal.h>
 
@@ -0,0 +1,486 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// The dynamic_bvh class
+// ---------------------
+// A dynamic bounding volume hierarchy of 2D or 3D boxes. Leaves store
+// boxes enlarged by a margin so that small motions need no update,
+// insertion picks the sibling with the lowest surface area cost, and
+// tree rotations keep the hierarchy balanced. Elements are identified
+// by the integer handles that insert() returns, and queries report
+// them through callbacks without allocating memory.
+//
+
+#include <lol/base/array.h>
+#include <lol/base/assert.h>
+#include <lol/math/geometry.h>
+
+#include <algorithm> /* for std::swap */
+
+namespace lol
+{
+
+template<typename TE, int N>
+class dynamic_bvh
+{
+public:
+    typedef vec_t<float, N> vec_type;
+    typedef box_t<float, N> box_type;
+
+    static int const NONE = -1;
+
+    dynamic_bvh(float margin = 0.1f)
+      : m_root(NONE),
+        m_free(NONE),
+        m_count(0),
+        m_margin(margin)
+    {
+    }
+
+    /* Add an element and return its handle */
+    int insert(TE *element, box_type const &aabb)
+    {
+        int proxy = alloc_node();
+        m_nodes[proxy].m_aabb = fatten(aabb);
+        m_nodes[proxy].m_element = element;
+        m_nodes[proxy].m_height = 0;
+        insert_leaf(proxy);
+        ++m_count;
+        return proxy;
+    }
+
+    void remove(int proxy)
+    {
+        ASSERT(is_leaf(proxy), "invalid proxy %d\n", proxy);
+        remove_leaf(proxy);
+        free_node(proxy);
+        --m_count;
+    }
+
+    /* Move an element; return true if its new box did not fit in the
+     * enlarged one and the element had to be reinserted. */
+    bool update(int proxy, box_type const &aabb)
+    {
+        ASSERT(is_leaf(proxy), "invalid proxy %d\n", proxy);
+        if (contains(m_nodes[proxy].m_aabb, aabb))
+            return false;
+
+        remove_leaf(proxy);
+        m_nodes[proxy].m_aabb = fatten(aabb);
+        insert_leaf(proxy);
+        return true;
+    }
+
+    /* Move many elements at once. If only a few of them left their
+     * enlarged boxes, reinsert these; otherwise, grow the leaves in
+     * place and recompute all internal boxes in one linear pass. */
+    void refit(int const *proxies, box_type const *aabbs, int count)
+    {
+        int moved = 0;
+        for (int i = 0; i < count; ++i)
+            moved += !contains(m_nodes[proxies[i]].m_aabb, aabbs[i]);
+
+        if (moved * REFIT_RATIO < m_count)
+        {
+            for (int i = 0; i < count; ++i)
+                update(proxies[i], aabbs[i]);
+            return;
+        }
+
+        for (int i = 0; i < count; ++i)
+            if (!contains(m_nodes[proxies[i]].m_aabb, aabbs[i]))
+                m_nodes[proxies[i]].m_aabb = fatten(aabbs[i]);
+        if (m_root != NONE)
+            refit_node(m_root);
+    }
+
+    void clear()
+    {
+        m_nodes.empty();
+        m_root = m_free = NONE;
+        m_count = 0;
+    }
+
+    inline int count() const { return m_count; }
+    inline int height() const { return m_root == NONE ? 0 : m_nodes[m_root].m_height; }
+
+    inline float get_margin() const { return m_margin; }
+    inline void set_margin(float margin) { m_margin = margin; }
+
+    inline TE *get_element(int proxy) const { return m_nodes[proxy].m_element; }
+    inline box_type const &get_fat_aabb(int proxy) const { return m_nodes[proxy].m_aabb; }
+
+    /* Call f(proxy) for each element whose enlarged box intersects
+     * aabb. Returning false from f stops the query. */
+    template<typename F>
+    void query(box_type const &aabb, F f) const
+    {
+        traverse([&aabb](box_type const &b) { return TestAABBVsAABB(b, aabb); }, f);
+    }
+
+    /* Same as above, for the elements that may be inside a frustum */
+    template<typename F>
+    void query(frustum const &view, F f) const
+    {
+        traverse([&view](box_type const &b) { return TestAABBVsFrustum(b, view); }, f);
+    }
+
+    /* Same as above, for the elements that may cross segment [p0,p1] */
+    template<typename F>
+    void query_ray(vec_type const &p0, vec_type const &p1, F f) const
+    {
+        vec_type dir = p1 - p0;
+        traverse([&p0, &dir](box_type const &b) { return test_segment(b, p0, dir); }, f);
+    }
+
+    /* Call f(aabb, element, depth) for every node of the tree, with a
+     * null element for internal nodes. Mostly useful for debugging. */
+    template<typename F>
+    void walk(F f) const
+    {
+        if (m_root != NONE)
+            walk_node(m_root, 0, f);
+    }
+
+private:
+    static int const STACK_SIZE = 64;
+    static int const REFIT_RATIO = 4;
+
+    struct node
+    {
+        box_type m_aabb;
+        TE *m_element;
+        /* Parent for nodes in the tree, next free node otherwise */
+        int m_parent;
+        int m_child1, m_child2;
+        /* 0 for leaves, -1 for free nodes */
+        int m_height;
+
+        inline bool is_leaf() const { return m_child1 == NONE; }
+    };
+
+    /* A traversal stack that only allocates for unusually deep trees */
+    class traversal_stack
+    {
+    public:
+        inline void push(int i)
+        {
+            if (m_count < STACK_SIZE)
+                m_data[m_count] = i;
+            else
+                m_extra.push(i);
+            ++m_count;
+        }
+
+        inline int pop()
+        {
+            --m_count;
+            return m_count < STACK_SIZE ? m_data[m_count] : m_extra.pop();
+        }
+
+        inline int count() const { return m_count; }
+
+    private:
+        int m_data[STACK_SIZE];
+        int m_count = 0;
+        array<int> m_extra;
+    };
+
+    template<typename T, typename F>
+    void traverse(T test, F f) const
+    {
+        if (m_root == NONE)
+            return;
+
+        traversal_stack stack;
+        stack.push(m_root);
+        while (stack.count())
+        {
+            node const &n = m_nodes[stack.pop()];
+            if (!test(n.m_aabb))
+                continue;
+
+            if (!n.is_leaf())
+            {
+                stack.push(n.m_child1);
+                stack.push(n.m_child2);
+            }
+            else if (!f(int(&n - m_nodes.data())))
+                return;
+        }
+    }
+
+    template<typename F>
+    void walk_node(int index, int depth, F &f) const
+    {
+        node const &n = m_nodes[index];
+        f(n.m_aabb, n.m_element, depth);
+        if (!n.is_leaf())
+        {
+            walk_node(n.m_child1, depth + 1, f);
+            walk_node(n.m_child2, depth + 1, f);
+        }
+    }
+
+    /*
+     * Box helpers
+     */
+
+    box_type fatten(box_type const &aabb) const
+    {
+        return box_type(aabb.aa - vec_type(m_margin), aabb.bb + vec_type(m_margin));
+    }
+
+    static inline box_type merge(box_type const &a, box_type const &b)
+    {
+        return box_type(min(a.aa, b.aa), max(a.bb, b.bb));
+    }
+
+    static inline bool contains(box_type const &outer, box_type const &inner)
+    {
+        for (int i = 0; i < N; ++i)
+            if (inner.aa[i] < outer.aa[i] || inner.bb[i] > outer.bb[i])
+                return false;
+        return true;
+    }
+
+    /* Surface area heuristic costs, up to a constant factor */
+    static inline float cost(box2 const &b)
+    {
+        vec2 e = b.extent();
+        return e.x + e.y;
+    }
+
+    static inline float cost(box3 const &b)
+    {
+        vec3 e = b.extent();
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    /* Slab test of segment [p0, p0 + dir] against a box */
+    static bool test_segment(box_type const &b, vec_type const &p0, vec_type const &dir)
+    {
+        float tmin = 0.f, tmax = 1.f;
+        for (int i = 0; i < N; ++i)
+        {
+            if (dir[i] == 0.f)
+            {
+                if (p0[i] < b.aa[i] || p0[i] > b.bb[i])
+                    return false;
+                continue;
+            }
+
+            float t0 = (b.aa[i] - p0[i]) / dir[i];
+            float t1 = (b.bb[i] - p0[i]) / dir[i];
+            tmin = lol::max(tmin, lol::min(t0, t1));
+            tmax = lol::min(tmax, lol::max(t0, t1));
+            if (tmin > tmax)
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Node management
+     */
+
+    inline bool is_leaf(int index) const
+    {
+        return index >= 0 && index < m_nodes.count()
+                && m_nodes[index].m_height == 0;
+    }
+
+    int alloc_node()
+    {
+        int index = m_free;
+        if (index == NONE)
+        {
+            index = m_nodes.count();
+            m_nodes.push(node());
+        }
+        else
+            m_free = m_nodes[index].m_parent;
+
+        node &n = m_nodes[index];
+        n.m_element = nullptr;
+        n.m_parent = n.m_child1 = n.m_child2 = NONE;
+        n.m_height = 0;
+        return index;
+    }
+
+    void free_node(int index)
+    {
+        m_nodes[index].m_parent = m_free;
+        m_nodes[index].m_height = -1;
+        m_free = index;
+    }
+
+    void replace_child(int parent, int old_child, int new_child)
+    {
+        if (parent == NONE)
+            m_root = new_child;
+        else if (m_nodes[parent].m_child1 == old_child)
+            m_nodes[parent].m_child1 = new_child;
+        else
+            m_nodes[parent].m_child2 = new_child;
+    }
+
+    void refresh(int index)
+    {
+        node &n = m_nodes[index];
+        node const &c1 = m_nodes[n.m_child1], &c2 = m_nodes[n.m_child2];
+        n.m_aabb = merge(c1.m_aabb, c2.m_aabb);
+        n.m_height = 1 + lol::max(c1.m_height, c2.m_height);
+    }
+
+    void refit_node(int index)
+    {
+        if (m_nodes[index].is_leaf())
+            return;
+        refit_node(m_nodes[index].m_child1);
+        refit_node(m_nodes[index].m_child2);
+        refresh(index);
+    }
+
+    /* Lower bound of the cost of inserting a box below node index */
+    float descent_cost(int index, box_type const &aabb) const
+    {
+        node const &n = m_nodes[index];
+        float ret = cost(merge(n.m_aabb, aabb));
+        return n.is_leaf() ? ret : ret - cost(n.m_aabb);
+    }
+
+    void insert_leaf(int leaf)
+    {
+        if (m_root == NONE)
+        {
+            m_root = leaf;
+            m_nodes[leaf].m_parent = NONE;
+            return;
+        }
+
+        /* Walk down the tree towards the cheapest sibling: stop when
+         * pairing with the current node costs less than the smallest
+         * cost any of its descendants could have. */
+        box_type const aabb = m_nodes[leaf].m_aabb;
+        int sibling = m_root;
+        while (!m_nodes[sibling].is_leaf())
+        {
+            node const &n = m_nodes[sibling];
+            float combined = cost(merge(n.m_aabb, aabb));
+            float here = 2.f * combined;
+            float inherited = 2.f * (combined - cost(n.m_aabb));
+            float cost1 = descent_cost(n.m_child1, aabb) + inherited;
+            float cost2 = descent_cost(n.m_child2, aabb) + inherited;
+
+            if (here < cost1 && here < cost2)
+                break;
+            sibling = cost1 < cost2 ? n.m_child1 : n.m_child2;
+        }
+
+        /* Create a new parent for the sibling and the leaf */
+        int old_parent = m_nodes[sibling].m_parent;
+        int parent = alloc_node();
+        m_nodes[parent].m_parent = old_parent;
+        m_nodes[parent].m_child1 = sibling;
+        m_nodes[parent].m_child2 = leaf;
+        m_nodes[sibling].m_parent = parent;
+        m_nodes[leaf].m_parent = parent;
+        replace_child(old_parent, sibling, parent);
+
+        fix_upwards(parent);
+    }
+
+    void remove_leaf(int leaf)
+    {
+        if (leaf == m_root)
+        {
+            m_root = NONE;
+            return;
+        }
+
+        /* Replace the parent with the sibling */
+        int parent = m_nodes[leaf].m_parent;
+        int grandparent = m_nodes[parent].m_parent;
+        int sibling = m_nodes[parent].m_child1 == leaf ? m_nodes[parent].m_child2
+                                                       : m_nodes[parent].m_child1;
+        replace_child(grandparent, parent, sibling);
+        m_nodes[sibling].m_parent = grandparent;
+        free_node(parent);
+
+        if (grandparent != NONE)
+            fix_upwards(grandparent);
+    }
+
+    /* Rebalance and refresh all ancestors of a modified node */
+    void fix_upwards(int index)
+    {
+        while (index != NONE)
+        {
+            index = balance(index);
+            refresh(index);
+            index = m_nodes[index].m_parent;
+        }
+    }
+
+    /* If one child of node a is more than one level taller than the
+     * other, rotate it up and return the new root of the subtree. */
+    int balance(int a)
+    {
+        node const &n = m_nodes[a];
+        if (n.is_leaf() || n.m_height < 2)
+            return a;
+
+        int diff = m_nodes[n.m_child2].m_height - m_nodes[n.m_child1].m_height;
+        if (diff > 1)
+            return rotate(a, n.m_child2, false);
+        if (diff < -1)
+            return rotate(a, n.m_child1, true);
+        return a;
+    }
+
+    /* Move node up, a child of a, above a. It keeps its taller child
+     * and gives the other one to a in its place. */
+    int rotate(int a, int up, bool up_is_child1)
+    {
+        node &na = m_nodes[a], &nu = m_nodes[up];
+        int keep = nu.m_child1, give = nu.m_child2;
+        if (m_nodes[keep].m_height < m_nodes[give].m_height)
+            std::swap(keep, give);
+
+        nu.m_parent = na.m_parent;
+        replace_child(nu.m_parent, a, up);
+        nu.m_child1 = a;
+        nu.m_child2 = keep;
+        na.m_parent = up;
+
+        if (up_is_child1)
+            na.m_child1 = give;
+        else
+            na.m_child2 = give;
+        m_nodes[give].m_parent = a;
+
+        refresh(a);
+        refresh(up);
+        return up;
+    }
+
+    array<node> m_nodes;
+    int m_root, m_free, m_count;
+    float m_margin;
+};
+
+} /* namespace lol */
+
@@ -14,6 +14,10 @@
 #pragma once
 
 #include <lol/base/array.h>
+#include <lol/sys/thread.h>
+
+#include <cstring> /* for memcpy */
+#include <type_traits>
 
 namespace lol
 {
@@ -22,8 +26,8 @@ namespace lol
  * Shuffle an array.
  */
 
-template<typename T, typename ARRAY>
-void array_base<T, ARRAY>::shuffle()
+template<typename T, typename ARRAY, ptrdiff_t N>
+void array_base<T, ARRAY, N>::shuffle()
 {
     auto n = count();
     auto ni = n;
@@ -35,20 +39,232 @@ void array_base<T, ARRAY>::shuffle()
 }
 
 /*
- * Sort an array
+ * Sorting primitives working on raw element pointers. They only
+ * require operator < on the elements.
+ */
+
+template<typename T>
+static void insertion_sort(T *data, ptrdiff_t count)
+{
+    for (ptrdiff_t i = 1; i < count; ++i)
+    {
+        if (!(data[i] < data[i - 1]))
+            continue;
+
+        T tmp = std::move(data[i]);
+        ptrdiff_t j = i;
+        do
+        {
+            data[j] = std::move(data[j - 1]);
+            --j;
+        }
+        while (j > 0 && tmp < data[j - 1]);
+        data[j] = std::move(tmp);
+    }
+}
+
+template<typename T>
+static void heap_sort(T *data, ptrdiff_t count)
+{
+    auto sift_down = [data](ptrdiff_t root, ptrdiff_t end)
+    {
+        while (2 * root + 1 < end)
+        {
+            ptrdiff_t child = 2 * root + 1;
+            if (child + 1 < end && data[child] < data[child + 1])
+                ++child;
+            if (!(data[root] < data[child]))
+                return;
+            std::swap(data[root], data[child]);
+            root = child;
+        }
+    };
+
+    for (ptrdiff_t i = count / 2; i--; )
+        sift_down(i, count);
+    for (ptrdiff_t i = count; --i > 0; )
+    {
+        std::swap(data[0], data[i]);
+        sift_down(0, i);
+    }
+}
+
+template<typename T>
+static void introsort(T *data, ptrdiff_t count, int depth)
+{
+    while (count > 16)
+    {
+        /* Too many bad pivots: switch to heap sort to stay O(n log n) */
+        if (depth-- == 0)
+        {
+            heap_sort(data, count);
+            return;
+        }
+
+        /* Move the median of data[1], data[count/2] and data[count-1]
+         * to data[0]; the two others act as sentinels for the
+         * unguarded partition loop below. */
+        T *a = data + 1, *b = data + count / 2, *c = data + count - 1;
+        if (*a < *b)
+            std::swap(*data, *b < *c ? *b : *a < *c ? *c : *a);
+        else
+            std::swap(*data, *a < *c ? *a : *b < *c ? *c : *b);
+
+        ptrdiff_t i = 1, j = count;
+        for (;;)
+        {
+            while (data[i] < data[0])
+                ++i;
+            --j;
+            while (data[0] < data[j])
+                --j;
+            if (!(i < j))
+                break;
+            std::swap(data[i], data[j]);
+            ++i;
+        }
+
+        /* Recurse on the right part, loop on the left part */
+        introsort(data + i, count - i, depth);
+        count = i;
+    }
+
+    insertion_sort(data, count);
+}
+
+template<typename T>
+static void introsort(T *data, ptrdiff_t count)
+{
+    int depth = 0;
+    for (ptrdiff_t n = count; n > 1; n >>= 1)
+        depth += 2;
+    introsort(data, count, depth);
+}
+
+/* Merge the two sorted runs [src, src+n1) and [src+n1, src+n1+n2)
+ * into dst, whose elements must already be constructed. */
+template<typename T>
+static void merge_runs(T *src, ptrdiff_t n1, ptrdiff_t n2, T *dst)
+{
+    T *a = src, *a_end = src + n1, *b = a_end, *b_end = b + n2;
+
+    while (a < a_end && b < b_end)
+        *dst++ = *b < *a ? std::move(*b++) : std::move(*a++);
+    while (a < a_end)
+        *dst++ = std::move(*a++);
+    while (b < b_end)
+        *dst++ = std::move(*b++);
+}
+
+template<typename T>
+static void parallel_merge_sort(T *data, ptrdiff_t count)
+{
+    /* Use a power of two number of jobs so that runs merge pairwise */
+    thread_pool &pool = thread_pool::get();
+    int jobs = 1;
+    while (jobs * 2 <= pool.count()
+            && jobs < 16 && count / (jobs * 2) >= PARALLEL_SORT_THRESHOLD / 4)
+        jobs *= 2;
+
+    if (count < PARALLEL_SORT_THRESHOLD || jobs < 2)
+    {
+        introsort(data, count);
+        return;
+    }
+
+    ptrdiff_t bounds[17];
+    for (int i = 0; i <= jobs; ++i)
+        bounds[i] = count * i / jobs;
+
+    /* Sort each run on the shared worker pool */
+    pool.run(jobs, [data, &bounds](int i)
+    {
+        introsort(data + bounds[i], bounds[i + 1] - bounds[i]);
+    });
+
+    /* Merge runs pairwise, ping-ponging between data and buffer */
+    array<T> buffer;
+    buffer.reserve(count);
+    for (ptrdiff_t i = 0; i < count; ++i)
+        buffer.push(std::move(data[i]));
+
+    T *src = buffer.data(), *dst = data;
+    for (int width = 1; width < jobs; width *= 2)
+    {
+        pool.run(jobs / (2 * width), [src, dst, width, &bounds](int pair)
+        {
+            int i = pair * 2 * width;
+            ptrdiff_t start = bounds[i];
+            ptrdiff_t n1 = bounds[i + width] - start;
+            ptrdiff_t n2 = bounds[i + 2 * width] - bounds[i + width];
+            merge_runs(src + start, n1, n2, dst + start);
+        });
+        std::swap(src, dst);
+    }
+
+    if (src != data)
+        for (ptrdiff_t i = 0; i < count; ++i)
+            data[i] = std::move(src[i]);
+}
+
+/*
+ * Radix sort keys: map integers and floats to unsigned integers that
+ * compare in the same order.
  */
 
-template<typename T, typename ARRAY>
-static void quick_swap_sort(array_base<T, ARRAY> &a,
-                            ptrdiff_t start, ptrdiff_t stop);
+template<typename K>
+static inline typename std::enable_if<std::is_integral<K>::value
+                                       && !std::is_same<K, bool>::value,
+                                      typename std::make_unsigned<K>::type>::type
+radix_sort_key(K x)
+{
+    typedef typename std::make_unsigned<K>::type U;
+    U const sign = std::is_signed<K>::value ? U(1) << (8 * sizeof(U) - 1) : U(0);
+    return U(x) ^ sign;
+}
 
-template<typename T, typename ARRAY>
-void array_base<T, ARRAY>::sort(SortAlgorithm algorithm)
+static inline uint32_t radix_sort_key(float x)
 {
-#if !SORT_WORKS // yeah cause it's shite.
-    algorithm = SortAlgorithm::Bubble;
-#endif
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits ^ (uint32_t(-int32_t(bits >> 31)) | 0x80000000u);
+}
+
+static inline uint64_t radix_sort_key(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits ^ (uint64_t(-int64_t(bits >> 63)) | 0x8000000000000000u);
+}
+
+template<typename T>
+struct has_radix_sort_key
+  : std::integral_constant<bool, (std::is_integral<T>::value
+                                   && !std::is_same<T, bool>::value)
+                                  || std::is_same<T, float>::value
+                                  || std::is_same<T, double>::value>
+{
+};
+
+template<typename T, typename ARRAY, ptrdiff_t N>
+static void radix_sort_dispatch(array_base<T, ARRAY, N> &a, std::true_type)
+{
+    a.radix_sort([](T const &x) { return x; });
+}
+
+template<typename T, typename ARRAY, ptrdiff_t N>
+static void radix_sort_dispatch(array_base<T, ARRAY, N> &a, std::false_type)
+{
+    a.sort(SortAlgorithm::Introsort);
+}
+
+/*
+ * Sort an array
+ */
 
+template<typename T, typename ARRAY, ptrdiff_t N>
+void array_base<T, ARRAY, N>::sort(SortAlgorithm algorithm)
+{
     // Classic bubble
     if (algorithm == SortAlgorithm::Bubble)
     {
@@ -64,64 +280,73 @@ void array_base<T, ARRAY>::sort(SortAlgorithm algorithm)
             }
         }
     }
-    // Quick sort with swap
-    else if (algorithm == SortAlgorithm::QuickSwap)
+    else if (algorithm == SortAlgorithm::Radix)
     {
-        quick_swap_sort(*this, 0, count_s());
+        radix_sort_dispatch(*this, has_radix_sort_key<T>());
+    }
+    else if (algorithm == SortAlgorithm::ParallelMerge)
+    {
+        parallel_merge_sort(m_data, m_count);
+    }
+    // Introsort, also used for QuickSwap
+    else
+    {
+        introsort(m_data, m_count);
     }
 }
 
-template<typename T, typename ARRAY>
-static void quick_swap_sort(array_base<T, ARRAY> &a,
-                            ptrdiff_t start, ptrdiff_t stop)
+template<typename T, typename ARRAY, ptrdiff_t N>
+template<typename F>
+void array_base<T, ARRAY, N>::radix_sort(F key)
 {
-    ptrdiff_t m[3] =
-    {
-        rand(start, stop),
-        rand(start, stop),
-        rand(start, stop)
-    };
+    typedef decltype(radix_sort_key(key(m_data[0]))) key_t;
+
+    if (m_count < 2)
+        return;
+
+    /* Sort (key, index) pairs 8 bits at a time, then move the
+     * elements to their final place in one pass. */
+    array<key_t, uint32_t> tmp_src, tmp_dst;
+    tmp_src.resize(m_count);
+    tmp_dst.resize(m_count);
 
-    for (int i = 0; i < 2; )
+    auto *src = tmp_src.data(), *dst = tmp_dst.data();
+    for (ptrdiff_t i = 0; i < m_count; ++i)
     {
-        if (a[m[i+1]] < a[m[i]])
-        {
-            ptrdiff_t mt = m[i+1];
-            m[i+1] = m[i];
-            m[i] = mt;
-            i = 0;
-        }
-        else
-            i++;
+        src[i].m1 = radix_sort_key(key(m_data[i]));
+        src[i].m2 = (uint32_t)i;
     }
 
-    // actual stuff
-    T median = a[m[1]];
-    ptrdiff_t i0 = start, i1 = stop - 1;
-    bool b_swap = false;
-    while (i0 < i1)
+    for (int shift = 0; shift < 8 * (int)sizeof(key_t); shift += 8)
     {
-        if (!(a[i0] < median) && a[i1] < median)
-        {
-            a.swap(i0, i1);
-            i0++;
-            i1--;
-            b_swap = true;
-        }
-        else
+        ptrdiff_t offsets[256] = { 0 };
+        for (ptrdiff_t i = 0; i < m_count; ++i)
+            ++offsets[(src[i].m1 >> shift) & 0xff];
+
+        /* Skip passes where all keys share the same digit */
+        if (offsets[(src[0].m1 >> shift) & 0xff] == m_count)
+            continue;
+
+        for (ptrdiff_t i = 0, total = 0; i < 256; ++i)
         {
-            if (a[i0] < median)
-                i0++;
-            if (!(a[i1] < median))
-                i1--;
+            ptrdiff_t tmp = offsets[i];
+            offsets[i] = total;
+            total += tmp;
         }
+
+        for (ptrdiff_t i = 0; i < m_count; ++i)
+            dst[offsets[(src[i].m1 >> shift) & 0xff]++] = src[i];
+
+        std::swap(src, dst);
     }
-    if (stop - start == 1 || !b_swap)
-        return;
-    if (start < i0)
-        quick_swap_sort(a, start, i0);
-    if (i0 < stop)
-        quick_swap_sort(a, i0, stop);
+
+    element_t *tmp = alloc(m_count);
+    for (ptrdiff_t i = 0; i < m_count; ++i)
+        new(&tmp[i]) element_t(std::move(m_data[src[i].m2]));
+    for (ptrdiff_t i = 0; i < m_count; ++i)
+        m_data[i].~element_t();
+    relocate(m_data, tmp, m_count);
+    release(tmp);
 }
 
 } /* namespace lol */
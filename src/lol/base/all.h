@@ -21,5 +21,7 @@
 #include <lol/base/avl_tree.h>
 #include <lol/base/string.h>
 #include <lol/base/map.h>
+#include <lol/base/hash_map.h>
+#include <lol/base/flat_map.h>
 #include <lol/base/enum.h>
 
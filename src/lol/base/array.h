@@ -25,6 +25,9 @@
 
 #include <new> /* for placement new */
 #include <algorithm> /* for std::swap */
+#include <utility> /* for std::move */
+#include <type_traits>
+#include <cstring> /* for memcpy */
 #include <stdint.h>
 #include <initializer_list>
 
@@ -39,30 +42,87 @@ static ptrdiff_t const INDEX_NONE = -1;
 
 enum class SortAlgorithm : uint8_t
 {
+    /* Kept for compatibility; same as Introsort. */
     QuickSwap,
     Bubble,
+    Introsort,
+    /* LSD radix sort; only for integer and floating point arrays,
+     * other types fall back to Introsort. */
+    Radix,
+    /* Merge sort across worker threads for large arrays, falls back
+     * to Introsort below PARALLEL_SORT_THRESHOLD elements. */
+    ParallelMerge,
+};
+
+static ptrdiff_t const PARALLEL_SORT_THRESHOLD = 1 << 16;
+
+/*
+ * Memory alignment of array storage. Defaults to 16 bytes so that vec4
+ * and mat4 arrays are SIMD-friendly, or to alignof(T) if it is larger.
+ * Specialise this for a given type to get e.g. 64-byte (cache line)
+ * alignment.
+ */
+
+template<typename T> struct array_alignment
+{
+    static size_t const value = alignof(T) > 16 ? alignof(T) : 16;
+};
+
+/*
+ * Optional inline storage for the first N elements of an array. When
+ * N is zero this class is empty and takes no room in the array object.
+ */
+
+template<typename T, ptrdiff_t N> struct array_inline_storage
+{
+protected:
+    inline T *inline_data()
+    {
+        return reinterpret_cast<T *>(m_storage);
+    }
+
+    inline T const *inline_data() const
+    {
+        return reinterpret_cast<T const *>(m_storage);
+    }
+
+private:
+    alignas(array_alignment<T>::value) uint8_t m_storage[sizeof(T) * N];
+};
+
+template<typename T> struct array_inline_storage<T, 0>
+{
+protected:
+    inline T *inline_data() { return nullptr; }
+    inline T const *inline_data() const { return nullptr; }
 };
 
 /*
  * The base array type.
  *
  * Contains an m_data memory array of Elements, of which only the first
- * m_count are allocated. The rest is uninitialised memory.
+ * m_count are allocated. The rest is uninitialised memory. If N is
+ * nonzero, m_data initially points to inline storage for N elements
+ * and only goes to the heap when more room is needed.
  */
 
-template<typename T, typename ARRAY> class LOL_ATTR_NODISCARD array_base
+template<typename T, typename ARRAY, ptrdiff_t N = 0>
+class LOL_ATTR_NODISCARD array_base : protected array_inline_storage<T, N>
 {
 public:
     typedef T element_t;
 
-    inline array_base() : m_data(0), m_count(0), m_reserved(0)
+    inline array_base()
+      : m_data(this->inline_data()),
+        m_count(0),
+        m_reserved(N)
     {
     }
 
     inline array_base(std::initializer_list<element_t> const &list)
-      : m_data(0),
+      : m_data(this->inline_data()),
         m_count(0),
-        m_reserved(0)
+        m_reserved(N)
     {
         reserve(list.size());
         for (auto elem : list)
@@ -73,10 +133,14 @@ public:
     {
         for (ptrdiff_t i = 0; i < m_count; i++)
             m_data[i].~element_t();
-        delete[] reinterpret_cast<uint8_t *>(m_data);
+        if (!is_inline())
+            release(m_data);
     }
 
-    array_base(array_base const& that) : m_data(0), m_count(0), m_reserved(0)
+    array_base(array_base const& that)
+      : m_data(this->inline_data()),
+        m_count(0),
+        m_reserved(N)
     {
         /* Reserve the exact number of values instead of what the other
          * array had reserved. Just a method for not wasting too much. */
@@ -86,6 +150,14 @@ public:
         m_count = that.m_count;
     }
 
+    array_base(array_base &&that)
+      : m_data(this->inline_data()),
+        m_count(0),
+        m_reserved(N)
+    {
+        steal(that);
+    }
+
     array_base& operator=(array_base const& that)
     {
         if ((uintptr_t)this != (uintptr_t)&that)
@@ -100,7 +172,7 @@ public:
                  * remaining elements. */
                 reserve(that.m_count);
                 for (ptrdiff_t i = 0; i < m_count && i < that.m_count; i++)
-                    m_data[i] = element_t(that[i]);
+                    m_data[i] = that[i];
                 for (ptrdiff_t i = m_count; i < that.m_count; i++)
                     new(&m_data[i]) element_t(that[i]);
             }
@@ -111,7 +183,7 @@ public:
                  * that we do not have, and finally destroy the remaining
                  * elements. */
                 for (ptrdiff_t i = 0; i < m_count && i < that.m_count; i++)
-                    m_data[i] = element_t(that[i]);
+                    m_data[i] = that[i];
                 for (ptrdiff_t i = m_count; i < that.m_count; i++)
                     new(&m_data[i]) element_t(that[i]);
                 for (ptrdiff_t i = that.m_count; i < m_count; i++)
@@ -122,6 +194,22 @@ public:
         return *this;
     }
 
+    array_base& operator=(array_base &&that)
+    {
+        if ((uintptr_t)this != (uintptr_t)&that)
+        {
+            for (ptrdiff_t i = 0; i < m_count; i++)
+                m_data[i].~element_t();
+            if (!is_inline())
+                release(m_data);
+            m_data = this->inline_data();
+            m_count = 0;
+            m_reserved = N;
+            steal(that);
+        }
+        return *this;
+    }
+
     array_base& operator+=(array_base const &that)
     {
         ptrdiff_t todo = that.m_count;
@@ -217,6 +305,24 @@ public:
         return *this;
     }
 
+    inline array_base& operator<<(T &&x)
+    {
+        if (m_count >= m_reserved)
+        {
+            /* x may live inside this array, so keep it safe while
+             * the storage is being moved around. */
+            T tmp(std::move(x));
+            grow();
+            new (&m_data[m_count]) element_t(std::move(tmp));
+        }
+        else
+        {
+            new (&m_data[m_count]) element_t(std::move(x));
+        }
+        ++m_count;
+        return *this;
+    }
+
     inline array_base& operator>>(T const &x)
     {
         remove_item(x);
@@ -228,6 +334,11 @@ public:
         *this << x;
     }
 
+    inline void push(T &&x)
+    {
+        *this << std::move(x);
+    }
+
     inline bool push_unique(T const &x)
     {
         if (find(x) != INDEX_NONE)
@@ -238,20 +349,28 @@ public:
     }
 
     inline void insert(T const &x, ptrdiff_t pos)
+    {
+        /* x may live inside this array and be moved by make_room() */
+        insert(element_t(x), pos);
+    }
+
+    inline void insert(T &&x, ptrdiff_t pos)
     {
         ASSERT(pos >= 0 && pos <= m_count,
                "cannot insert at index %ld in array of size %ld",
                (long int)pos, (long int)m_count);
 
         if (m_count >= m_reserved)
-            grow();
-
-        for (ptrdiff_t i = m_count; i > pos; --i)
         {
-            new (&m_data[i]) element_t(m_data[i - 1]);
-            m_data[i - 1].~element_t();
+            T tmp(std::move(x));
+            make_room(pos);
+            new (&m_data[pos]) element_t(std::move(tmp));
+        }
+        else
+        {
+            make_room(pos);
+            new (&m_data[pos]) element_t(std::move(x));
         }
-        new (&m_data[pos]) element_t(x);
         ++m_count;
     }
 
@@ -301,7 +420,7 @@ public:
     inline T pop()
     {
         ASSERT(m_count > 0);
-        element_t tmp = last();
+        element_t tmp = std::move(last());
         remove(m_count - 1, 1);
         return tmp;
     }
@@ -325,10 +444,19 @@ public:
         if (pos < 0)
             pos = m_count + pos;
 
-        for (ptrdiff_t i = pos; i + todelete < m_count; i++)
-            m_data[i] = m_data[i + todelete];
-        for (ptrdiff_t i = m_count - todelete; i < m_count; i++)
-            m_data[i].~element_t();
+        if (std::is_trivially_copyable<element_t>::value)
+        {
+            if (pos + todelete < m_count)
+                memmove((void *)&m_data[pos], (void const *)&m_data[pos + todelete],
+                        (m_count - pos - todelete) * sizeof(element_t));
+        }
+        else
+        {
+            for (ptrdiff_t i = pos; i + todelete < m_count; i++)
+                m_data[i] = std::move(m_data[i + todelete]);
+            for (ptrdiff_t i = m_count - todelete; i < m_count; i++)
+                m_data[i].~element_t();
+        }
         m_count -= todelete;
     }
 
@@ -345,7 +473,7 @@ public:
         for (ptrdiff_t i = 0; i < todelete; i++)
         {
             if (pos + i < m_count - 1 - i)
-                m_data[pos + i] = m_data[m_count - 1 - i];
+                m_data[pos + i] = std::move(m_data[m_count - 1 - i]);
             m_data[m_count - 1 - i].~element_t();
         }
         m_count -= todelete;
@@ -377,26 +505,21 @@ public:
         if (toreserve <= m_reserved)
             return;
 
-        /* This cast is not very nice, because we kill any alignment
-         * information we could have. But until C++ gives us the proper
-         * tools to deal with it, we assume new uint8_t[] returns properly
-         * aligned data. */
-        element_t *tmp = reinterpret_cast<element_t *>(reinterpret_cast<uintptr_t>
-                               (new uint8_t[sizeof(element_t) * toreserve]));
-        ASSERT(tmp, "out of memory in array class");
-        for (ptrdiff_t i = 0; i < m_count; i++)
-        {
-            new(&tmp[i]) element_t(m_data[i]);
-            m_data[i].~element_t();
-        }
-        delete[] reinterpret_cast<uint8_t *>(m_data);
+        element_t *tmp = alloc(toreserve);
+        relocate(tmp, m_data, m_count);
+        if (!is_inline())
+            release(m_data);
         m_data = tmp;
         m_reserved = toreserve;
     }
 
     void shuffle();
 
-    void sort(SortAlgorithm algorithm);
+    void sort(SortAlgorithm algorithm = SortAlgorithm::Introsort);
+
+    /* Radix sort using key(element), which must return an integer,
+     * float or double value. */
+    template<typename F> void radix_sort(F key);
 
     /* Support C++11 range-based for loops */
     class const_iterator
@@ -470,6 +593,98 @@ protected:
         reserve(m_count * 13 / 8 + 8);
     }
 
+    /* Make room for one element at index pos, growing the array if
+     * necessary. The caller is responsible for constructing the new
+     * element and incrementing m_count. */
+    void make_room(ptrdiff_t pos)
+    {
+        if (m_count >= m_reserved)
+            grow();
+
+        if (std::is_trivially_copyable<element_t>::value)
+        {
+            memmove((void *)&m_data[pos + 1], (void const *)&m_data[pos],
+                    (m_count - pos) * sizeof(element_t));
+        }
+        else
+        {
+            for (ptrdiff_t i = m_count; i > pos; --i)
+            {
+                new (&m_data[i]) element_t(std::move(m_data[i - 1]));
+                m_data[i - 1].~element_t();
+            }
+        }
+    }
+
+    inline bool is_inline() const
+    {
+        return m_data == this->inline_data();
+    }
+
+    /* Move-construct count elements from src to dst and destroy the
+     * originals. Trivially copyable elements are simply memcpy’d. */
+    static void relocate(element_t *dst, element_t *src, ptrdiff_t count)
+    {
+        if (std::is_trivially_copyable<element_t>::value)
+        {
+            if (count)
+                memcpy((void *)dst, (void const *)src, count * sizeof(element_t));
+        }
+        else
+        {
+            for (ptrdiff_t i = 0; i < count; i++)
+            {
+                new(&dst[i]) element_t(std::move(src[i]));
+                src[i].~element_t();
+            }
+        }
+    }
+
+    /* Take ownership of another array’s data; if it lives in inline
+     * storage, the elements themselves need to be moved. */
+    void steal(array_base &that)
+    {
+        if (that.is_inline())
+        {
+            reserve(that.m_count);
+            relocate(m_data, that.m_data, that.m_count);
+            m_count = that.m_count;
+        }
+        else
+        {
+            m_data = that.m_data;
+            m_count = that.m_count;
+            m_reserved = that.m_reserved;
+            that.m_data = that.inline_data();
+            that.m_reserved = N;
+        }
+        that.m_count = 0;
+    }
+
+    /* Allocate uninitialised memory aligned to array_alignment<T>. The
+     * pointer returned by new[] is stored right before the aligned
+     * block so that release() can find it back. */
+    static element_t *alloc(ptrdiff_t count)
+    {
+        size_t const align = array_alignment<element_t>::value;
+        uint8_t *raw = new uint8_t[sizeof(element_t) * count
+                                    + sizeof(uint8_t *) + align - 1];
+        ASSERT(raw, "out of memory in array class");
+        uintptr_t ret = (reinterpret_cast<uintptr_t>(raw) + sizeof(uint8_t *)
+                          + align - 1) & ~(uintptr_t)(align - 1);
+        memcpy(reinterpret_cast<uint8_t **>(ret) - 1, &raw, sizeof(raw));
+        return reinterpret_cast<element_t *>(ret);
+    }
+
+    static void release(element_t *data)
+    {
+        if (!data)
+            return;
+        uint8_t *raw;
+        memcpy(&raw, reinterpret_cast<uint8_t **>(data) - 1, sizeof(raw));
+        delete[] raw;
+    }
+
     element_t *m_data;
     ptrdiff_t m_count, m_reserved;
 };
@@ -506,7 +721,7 @@ public:
         {
             tuple<T...> tmp = { args... };
             this->grow();
-            new (&this->m_data[this->m_count]) tuple<T...>(tmp);
+            new (&this->m_data[this->m_count]) tuple<T...>(std::move(tmp));
         }
         else
         {
@@ -521,15 +736,9 @@ public:
                "cannot insert at index %ld in array of size %ld",
                (long int)pos, (long int)this->m_count);
 
-        if (this->m_count >= this->m_reserved)
-            this->grow();
-
-        for (ptrdiff_t i = this->m_count; i > pos; --i)
-        {
-            new (&this->m_data[i]) element_t(this->m_data[i - 1]);
-            this->m_data[i - 1].~element_t();
-        }
-        new (&this->m_data[pos]) tuple<T...>({ args... });
+        tuple<T...> tmp = { args... };
+        this->make_room(pos);
+        new (&this->m_data[pos]) tuple<T...>(std::move(tmp));
         ++this->m_count;
     }
 };
@@ -554,6 +763,31 @@ public:
 #endif
 };
 
+/*
+ * An array that can hold up to N elements without any heap allocation,
+ * for short-lived arrays built in hot code paths.
+ */
+
+template<typename T, ptrdiff_t N>
+class small_array
+  : public array_base<T, small_array<T, N>, N>
+{
+#if LOL_FEATURE_CXX11_INHERIT_CONSTRUCTORS
+    using array_base<T, small_array<T, N>, N>::array_base;
+#else
+public:
+    typedef T element_t;
+
+    inline small_array()
+      : array_base<T, small_array<T, N>, N>::array_base()
+    {}
+
+    inline small_array(std::initializer_list<element_t> const &list)
+      : array_base<T, small_array<T, N>, N>::array_base(list)
+    {}
+#endif
+};
+
 /*
  * C++11 iterators
  */
@@ -582,5 +816,29 @@ typename array<T...>::const_iterator end(array<T...> const &a)
     return typename array<T...>::const_iterator(&a, a.count());
 }
 
+template<typename T, ptrdiff_t N>
+typename small_array<T, N>::iterator begin(small_array<T, N> &a)
+{
+    return typename small_array<T, N>::iterator(&a, 0);
+}
+
+template<typename T, ptrdiff_t N>
+typename small_array<T, N>::iterator end(small_array<T, N> &a)
+{
+    return typename small_array<T, N>::iterator(&a, a.count());
+}
+
+template<typename T, ptrdiff_t N>
+typename small_array<T, N>::const_iterator begin(small_array<T, N> const &a)
+{
+    return typename small_array<T, N>::const_iterator(&a, 0);
+}
+
+template<typename T, ptrdiff_t N>
+typename small_array<T, N>::const_iterator end(small_array<T, N> const &a)
+{
+    return typename small_array<T, N>::const_iterator(&a, a.count());
+}
+
 } /* namespace lol */
 
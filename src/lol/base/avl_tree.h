@@ -14,11 +14,23 @@
 
 #pragma once
 
+//
+// The avl_tree class
+// ------------------
+// An ordered map backed by an AVL tree. Nodes are carved out of blocks
+// owned by the tree and are also chained in key order, so iteration
+// does not need to walk the tree.
+//
+
+#include <lol/base/array.h>
+
+#include <algorithm> /* for std::min, std::max */
+#include <new> /* for placement new */
+#include <type_traits> /* for std::aligned_storage */
+
 namespace lol
 {
 
-#include <lol/base/all.h>
-
 template<typename K, typename V>
 class avl_tree
 {
@@ -33,19 +45,13 @@ public:
         m_root(nullptr),
         m_count(0)
     {
-        for (auto it : other)
-            insert(it.key, it.value);
+        copy_from(other);
     }
 
     avl_tree & operator=(avl_tree const & other)
     {
         if (&other != this)
-        {
-            clear();
-
-            for (auto it : other)
-                insert(it.key, it.value);
-        }
+            copy_from(other);
 
         return *this;
     }
@@ -59,12 +65,12 @@ public:
     {
         if (!m_root)
         {
-            m_root = new tree_node(key, value, &m_root);
+            m_root = m_pool.alloc(key, value, &m_root);
             ++m_count;
             return true;
         }
 
-        if (m_root->insert(key, value))
+        if (m_root->insert(key, value, m_pool))
         {
             ++m_count;
             return true;
@@ -78,7 +84,7 @@ public:
         if (!m_root)
             return false;
 
-        if (m_root->erase(key))
+        if (m_root->erase(key, m_pool))
         {
             --m_count;
             return true;
@@ -105,15 +111,36 @@ public:
             while (node)
             {
                 tree_node * next = node->get_next();
-                delete node;
+                node->~tree_node();
                 node = next;
             }
         }
 
+        /* Every node is gone, so the pool blocks can be reused as is */
+        m_pool.reset();
         m_root = nullptr;
         m_count = 0;
     }
 
+    /* Replace the tree contents with items, which must be sorted by
+     * strictly increasing key. This runs in linear time and lays out
+     * the nodes in key order. Return false if items are not sorted. */
+    bool assign_sorted(array<K, V> const & items)
+    {
+        for (int i = 1; i < items.count(); ++i)
+            if (!(items[i - 1].m1 < items[i].m1))
+                return false;
+
+        int i = 0;
+        build(items.count(), [&]()
+        {
+            auto const & item = items[i++];
+            return m_pool.alloc(item.m1, item.m2, nullptr);
+        });
+
+        return true;
+    }
+
     bool try_get(K const & key, V * & value_ptr) const
     {
         if (m_root)
@@ -156,6 +183,7 @@ public:
 
     class iterator;
     class const_iterator;
+    template<typename IT> class key_range;
 
     iterator begin()
     {
@@ -192,10 +220,54 @@ public:
         return const_iterator(nullptr);
     }
 
+    /* Iterator to the first element whose key is not less than key */
+    iterator lower_bound(K const & key)
+    {
+        return iterator(find_bound<false>(key));
+    }
+
+    const_iterator lower_bound(K const & key) const
+    {
+        return const_iterator(find_bound<false>(key));
+    }
+
+    /* Iterator to the first element whose key is greater than key */
+    iterator upper_bound(K const & key)
+    {
+        return iterator(find_bound<true>(key));
+    }
+
+    const_iterator upper_bound(K const & key) const
+    {
+        return const_iterator(find_bound<true>(key));
+    }
+
+    /* All elements whose key k verifies lo <= k < hi, for use in
+     * range-based for loops */
+    key_range<iterator> range(K const & lo, K const & hi)
+    {
+        if (!(lo < hi))
+            return key_range<iterator>(end(), end());
+
+        return key_range<iterator>(lower_bound(lo), lower_bound(hi));
+    }
+
+    key_range<const_iterator> range(K const & lo, K const & hi) const
+    {
+        if (!(lo < hi))
+            return key_range<const_iterator>(end(), end());
+
+        return key_range<const_iterator>(lower_bound(lo), lower_bound(hi));
+    }
+
 protected:
 
+    class node_pool;
+
     class tree_node
     {
+        friend class avl_tree;
+
     public:
         tree_node(K key, V value, tree_node ** parent_slot) :
             m_key(key),
@@ -219,7 +291,7 @@ protected:
 
         /* Insert a value in tree and return true or update an existing value for
          * the existing key and return false */
-        bool insert(K const & key, V const & value)
+        bool insert(K const & key, V const & value, node_pool & pool)
         {
             int i = -1 + (key < m_key) + 2 * (m_key < key);
 
@@ -228,12 +300,12 @@ protected:
             if (i < 0)
                 m_value = value;
             else if (m_child[i])
-                created = m_child[i]->insert(key, value);
+                created = m_child[i]->insert(key, value, pool);
             else
             {
                 created = true;
 
-                m_child[i] = new tree_node(key, value, &m_child[i]);
+                m_child[i] = pool.alloc(key, value, &m_child[i]);
 
                 m_child[i]->m_chain[i] = m_chain[i];
                 m_child[i]->m_chain[i ? 0 : 1] = this;
@@ -252,7 +324,7 @@ protected:
         }
 
         /* Erase a value in tree and return true or return false */
-        bool erase(K const & key)
+        bool erase(K const & key, node_pool & pool)
         {
             int i = -1 + (key < m_key) + 2 * (m_key < key);
 
@@ -265,14 +337,14 @@ protected:
                 erased = true;
                 suicide = true;
             }
-            else if (m_child[i] && m_child[i]->erase(key))
+            else if (m_child[i] && m_child[i]->erase(key, pool))
             {
                 rebalance_if_needed();
                 erased = true;
             }
 
             if (suicide)
-                delete this;
+                pool.release(this);
 
             return erased;
         }
@@ -314,7 +386,7 @@ protected:
                 min_node = min_node->m_child[0];
         }
 
-        void get_max(tree_node * & max_node) const
+        void get_max(tree_node * & max_node)
         {
             max_node = this;
 
@@ -405,60 +477,54 @@ protected:
             }
         }
 
+        /* Take the in-order neighbour from the taller side, so that the
+         * subtree it leaves stays balanced, and put it in our place. */
         void erase_self()
         {
-            int i = (get_balance() == -1);
-
-            tree_node * replacement = m_child[1 - i];
+            int i = (get_balance() < 0);
 
-            if (replacement)
-            {
-                while (replacement->m_child[i])
-                    replacement = replacement->m_child[i];
-            }
+            tree_node * replacement = m_child[1 - i] ? m_child[1 - i]->detach_extreme(i) : nullptr;
 
             if (replacement)
             {
-                *replacement->m_parent_slot = replacement->m_child[1 - i];
-                if (replacement->m_child[1 - i])
-                    replacement->m_child[1 - i]->m_parent_slot = replacement->m_parent_slot;
-
                 replacement->m_parent_slot = m_parent_slot;
                 *replacement->m_parent_slot = replacement;
 
-                replacement->m_child[0] = m_child[0];
-                if (replacement->m_child[0])
-                    replacement->m_child[0]->m_parent_slot = &replacement->m_child[0];
-
-                replacement->m_child[1] = m_child[1];
-                if (replacement->m_child[1])
-                    replacement->m_child[1]->m_parent_slot = &replacement->m_child[1];
-
-                if (replacement->m_child[1-i])
-                    replacement->m_child[1-i]->deep_balance(replacement->m_key);
+                for (int j = 0; j <= 1; ++j)
+                {
+                    replacement->m_child[j] = m_child[j];
+                    if (replacement->m_child[j])
+                        replacement->m_child[j]->m_parent_slot = &replacement->m_child[j];
+                }
 
-                replacement->update_balance();
+                replacement->rebalance_if_needed();
             }
             else
             {
                 *m_parent_slot = m_child[i];
                 if (m_child[i])
                     m_child[i]->m_parent_slot = m_parent_slot;
-
-                replacement = m_child[i];
             }
 
             replace_chain(replacement);
         }
 
-        void deep_balance(K const & key)
+        /* Unlink the leftmost (i = 0) or rightmost (i = 1) node of this
+         * subtree and return it, rebalancing on the way back up. */
+        tree_node * detach_extreme(int i)
         {
-            int i = -1 + (key < m_key) + 2 * (m_key < key);
+            if (m_child[i])
+            {
+                tree_node * ret = m_child[i]->detach_extreme(i);
+                rebalance_if_needed();
+                return ret;
+            }
 
-            if (i != -1 && m_child[i])
-                m_child[i]->deep_balance(key);
+            *m_parent_slot = m_child[1 - i];
+            if (m_child[1 - i])
+                m_child[1 - i]->m_parent_slot = m_parent_slot;
 
-            update_balance();
+            return this;
         }
 
         void replace_chain(tree_node * replacement)
@@ -499,6 +565,168 @@ protected:
         tree_node * m_chain[2]; // Linked list used to keep order between nodes
     };
 
+    /* Node storage: blocks of growing size that are never freed before
+     * the tree is destroyed, with released nodes kept in a free list. */
+    class node_pool
+    {
+    public:
+        node_pool() :
+            m_free(nullptr),
+            m_block(0),
+            m_used(0)
+        {
+        }
+
+        node_pool(node_pool const &) = delete;
+        node_pool & operator=(node_pool const &) = delete;
+
+        ~node_pool()
+        {
+            for (node_slot * block : m_blocks)
+                delete[] block;
+        }
+
+        tree_node * alloc(K const & key, V const & value, tree_node ** parent_slot)
+        {
+            node_slot * slot = m_free;
+
+            if (slot)
+                m_free = slot->m_next;
+            else
+            {
+                if (m_block < m_blocks.count() && m_used == block_size(m_block))
+                {
+                    ++m_block;
+                    m_used = 0;
+                }
+
+                if (m_block == m_blocks.count())
+                    m_blocks.push(new node_slot[block_size(m_block)]);
+
+                slot = m_blocks[m_block] + m_used++;
+            }
+
+            return new (slot) tree_node(key, value, parent_slot);
+        }
+
+        void release(tree_node * node)
+        {
+            node->~tree_node();
+
+            node_slot * slot = reinterpret_cast<node_slot *>(node);
+            slot->m_next = m_free;
+            m_free = slot;
+        }
+
+        /* Make all the storage available again; the caller must have
+         * destroyed every node beforehand. */
+        void reset()
+        {
+            m_free = nullptr;
+            m_block = 0;
+            m_used = 0;
+        }
+
+    private:
+        union node_slot
+        {
+            node_slot * m_next;
+            typename std::aligned_storage<sizeof(tree_node),
+                                          alignof(tree_node)>::type m_storage;
+        };
+
+        static int block_size(int block)
+        {
+            return 16 << std::min(block, 8);
+        }
+
+        array<node_slot *> m_blocks;
+        node_slot * m_free;
+        int m_block, m_used;
+    };
+
+    /* Return the first node whose key is not less than key, or greater
+     * than key if STRICT is true. */
+    template<bool STRICT>
+    tree_node * find_bound(K const & key) const
+    {
+        tree_node * ret = nullptr;
+
+        for (tree_node * node = m_root; node; )
+        {
+            bool right = STRICT ? !(key < node->m_key) : node->m_key < key;
+            if (!right)
+                ret = node;
+            node = node->m_child[right];
+        }
+
+        return ret;
+    }
+
+    void copy_from(avl_tree const & other)
+    {
+        tree_node * node = nullptr;
+
+        if (other.m_root)
+            other.m_root->get_min(node);
+
+        build(other.m_count, [&]()
+        {
+            tree_node * ret = m_pool.alloc(node->m_key, node->m_value, nullptr);
+            node = node->get_next();
+            return ret;
+        });
+    }
+
+    /* Rebuild the tree from count nodes returned in key order by
+     * next(). Nodes are allocated in that order, so that iterating
+     * over the result mostly walks memory linearly. */
+    template<typename F>
+    void build(int count, F next)
+    {
+        clear();
+
+        array<tree_node *> nodes;
+        nodes.reserve(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            tree_node * node = next();
+
+            if (i)
+            {
+                node->m_chain[0] = nodes.last();
+                nodes.last()->m_chain[1] = node;
+            }
+
+            nodes.push(node);
+        }
+
+        link(nodes.data(), count, &m_root);
+        m_count = count;
+    }
+
+    /* Turn a sorted run of nodes into a balanced subtree hanging from
+     * parent_slot and return its height. */
+    static int link(tree_node ** nodes, int count, tree_node ** parent_slot)
+    {
+        if (!count)
+        {
+            *parent_slot = nullptr;
+            return 0;
+        }
+
+        int mid = count / 2;
+        tree_node * node = nodes[mid];
+
+        *parent_slot = node;
+        node->m_parent_slot = parent_slot;
+        node->m_stairs[0] = link(nodes, mid, &node->m_child[0]);
+        node->m_stairs[1] = link(nodes + mid + 1, count - mid - 1, &node->m_child[1]);
+
+        return std::max(node->m_stairs[0], node->m_stairs[1]) + 1;
+    }
+
 public:
 
     /* Iterators related */
@@ -635,8 +863,36 @@ public:
         tree_node * m_node;
     };
 
+    template<typename IT>
+    class key_range
+    {
+    public:
+
+        key_range(IT begin, IT end) :
+            m_begin(begin),
+            m_end(end)
+        {
+        }
+
+        IT begin() const
+        {
+            return m_begin;
+        }
+
+        IT end() const
+        {
+            return m_end;
+        }
+
+    protected:
+
+        IT m_begin, m_end;
+    };
+
 protected:
 
+    node_pool m_pool;
+
     tree_node * m_root;
 
     int m_count;
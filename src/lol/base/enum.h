@@ -13,6 +13,9 @@
 
 #pragma once
 
+#include <lol/base/map.h>
+#include <lol/base/hash_map.h>
+
 #include <string>
 #include <map>
 
@@ -62,16 +65,21 @@ public:
     {
         /* FIXME: we all know this isn’t thread safe. But is it really
         * a big deal? */
-        static std::map<int64_t, std::string> enum_map;
+        static hash_map<int64_t, std::string> enum_map;
         static bool ready = false;
 
-        if (ready || this->BuildEnumMap(enum_map))
+        if (!ready)
         {
+            std::map<int64_t, std::string> tmp;
+            if (!this->BuildEnumMap(tmp))
+                return "<invalid enum>";
+            for (auto const &kv : tmp)
+                enum_map.insert(kv);
             ready = true;
-            if (has_key(enum_map, (int64_t)m_value))
-                return enum_map[(int64_t)m_value];
         }
-        return "<invalid enum>";
+
+        std::string ret;
+        return try_get(enum_map, (int64_t)m_value, ret) ? ret : "<invalid enum>";
     }
 
     /* Safe comparisons between enums of the same type */
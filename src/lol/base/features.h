@@ -30,6 +30,20 @@
 #   undef LOL_FEATURE_THREADS
 #endif
 
+/* SIMD instruction sets available at compile time */
+#define LOL_FEATURE_SSE2 0
+#define LOL_FEATURE_NEON 0
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#   undef LOL_FEATURE_SSE2
+#   define LOL_FEATURE_SSE2 1
+#endif
+
+#if defined __ARM_NEON || defined __ARM_NEON__
+#   undef LOL_FEATURE_NEON
+#   define LOL_FEATURE_NEON 1
+#endif
+
 /* Use this to disable code that causes compiler crashes. */
 #if defined _MSC_VER
 #   undef LOL_FEATURE_VISUAL_STUDIO_THAT_FUCKING_PIECE_OF_SHIT_COMPILER
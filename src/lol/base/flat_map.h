@@ -0,0 +1,130 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// The flat_map class
+// ------------------
+// A map stored as a sorted array of key/value pairs. Lookups are binary
+// searches in contiguous memory and insertions are O(n), which makes it
+// a good fit for small, read-mostly tables. The interface is a subset of
+// std::map’s, so that has_key(), try_get() and keys() work with it.
+//
+
+#include <lol/base/array.h>
+
+#include <functional> /* for std::less */
+#include <utility> /* for std::pair */
+
+namespace lol
+{
+
+template<typename K, typename V, typename C = std::less<K>>
+class flat_map
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef value_type *iterator;
+    typedef value_type const *const_iterator;
+
+    inline size_t size() const { return (size_t)m_data.count_s(); }
+
+    inline iterator begin() { return m_data.data(); }
+    inline iterator end() { return m_data.data() + m_data.count_s(); }
+    inline const_iterator begin() const { return m_data.data(); }
+    inline const_iterator end() const { return m_data.data() + m_data.count_s(); }
+
+    iterator find(K const &key)
+    {
+        ptrdiff_t i = lower_bound(key);
+        return is_match(i, key) ? begin() + i : end();
+    }
+
+    const_iterator find(K const &key) const
+    {
+        ptrdiff_t i = lower_bound(key);
+        return is_match(i, key) ? begin() + i : end();
+    }
+
+    inline size_t count(K const &key) const
+    {
+        return is_match(lower_bound(key), key) ? 1 : 0;
+    }
+
+    V &operator [](K const &key)
+    {
+        ptrdiff_t i = lower_bound(key);
+        if (!is_match(i, key))
+            m_data.insert(value_type(key, V()), i);
+        return m_data[i].second;
+    }
+
+    std::pair<iterator, bool> insert(value_type const &kv)
+    {
+        ptrdiff_t i = lower_bound(kv.first);
+        bool inserted = !is_match(i, kv.first);
+        if (inserted)
+            m_data.insert(kv, i);
+        return std::make_pair(begin() + i, inserted);
+    }
+
+    size_t erase(K const &key)
+    {
+        ptrdiff_t i = lower_bound(key);
+        if (!is_match(i, key))
+            return 0;
+        m_data.remove(i);
+        return 1;
+    }
+
+    inline void clear()
+    {
+        m_data.empty();
+    }
+
+    inline void reserve(size_t count)
+    {
+        m_data.reserve((ptrdiff_t)count);
+    }
+
+private:
+    /* Index of the first element whose key is not less than key */
+    ptrdiff_t lower_bound(K const &key) const
+    {
+        ptrdiff_t first = 0, len = m_data.count_s();
+        while (len > 0)
+        {
+            ptrdiff_t half = len / 2;
+            if (C()(m_data[first + half].first, key))
+            {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else
+                len = half;
+        }
+        return first;
+    }
+
+    inline bool is_match(ptrdiff_t i, K const &key) const
+    {
+        return i < m_data.count_s() && !C()(key, m_data[i].first);
+    }
+
+    array<value_type> m_data;
+};
+
+} /* namespace lol */
+
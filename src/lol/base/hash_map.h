@@ -0,0 +1,407 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// The hash_map class
+// ------------------
+// An open addressing hash map with SwissTable-style metadata: each slot
+// has a control byte holding 7 bits of its hash (or an empty/deleted
+// marker), and lookups compare 16 control bytes at a time, using SSE2
+// when available. The interface is a subset of std::map’s, so that
+// has_key(), try_get() and keys() work with it.
+//
+
+#include <lol/base/features.h>
+#include <lol/base/assert.h>
+
+#include <functional> /* for std::hash */
+#include <utility> /* for std::pair */
+#include <new> /* for placement new */
+#include <stdint.h>
+
+#if LOL_FEATURE_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace lol
+{
+
+template<typename K, typename V,
+         typename H = std::hash<K>, typename E = std::equal_to<K>>
+class hash_map
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+
+private:
+    static int const GROUP_SIZE = 16;
+    static int8_t const CTRL_EMPTY = -128;
+    static int8_t const CTRL_DELETED = -2;
+    static size_t const NOT_FOUND = ~(size_t)0;
+
+    template<typename M, typename P> class iterator_base
+    {
+    public:
+        iterator_base(M *map, size_t pos)
+          : m_map(map),
+            m_pos(pos)
+        {
+            skip();
+        }
+
+        P &operator *() const { return m_map->m_slots[m_pos]; }
+        P *operator ->() const { return &m_map->m_slots[m_pos]; }
+
+        iterator_base &operator ++()
+        {
+            ++m_pos;
+            skip();
+            return *this;
+        }
+
+        bool operator ==(iterator_base const &that) const
+        {
+            return m_pos == that.m_pos;
+        }
+
+        bool operator !=(iterator_base const &that) const
+        {
+            return m_pos != that.m_pos;
+        }
+
+    private:
+        void skip()
+        {
+            while (m_pos < m_map->m_capacity && m_map->m_ctrl[m_pos] < 0)
+                ++m_pos;
+        }
+
+        M *m_map;
+        size_t m_pos;
+    };
+
+public:
+    typedef iterator_base<hash_map, value_type> iterator;
+    typedef iterator_base<hash_map const, value_type const> const_iterator;
+
+    hash_map()
+      : m_ctrl(nullptr),
+        m_slots(nullptr),
+        m_capacity(0),
+        m_size(0),
+        m_deleted(0)
+    {
+    }
+
+    hash_map(hash_map const &that)
+      : hash_map()
+    {
+        reserve(that.m_size);
+        for (auto const &kv : that)
+            insert(kv);
+    }
+
+    hash_map(hash_map &&that)
+      : hash_map()
+    {
+        std::swap(m_ctrl, that.m_ctrl);
+        std::swap(m_slots, that.m_slots);
+        std::swap(m_capacity, that.m_capacity);
+        std::swap(m_size, that.m_size);
+        std::swap(m_deleted, that.m_deleted);
+    }
+
+    ~hash_map()
+    {
+        destroy();
+    }
+
+    hash_map &operator =(hash_map const &that)
+    {
+        if (this != &that)
+        {
+            clear();
+            reserve(that.m_size);
+            for (auto const &kv : that)
+                insert(kv);
+        }
+        return *this;
+    }
+
+    hash_map &operator =(hash_map &&that)
+    {
+        if (this != &that)
+        {
+            destroy();
+            m_ctrl = that.m_ctrl;
+            m_slots = that.m_slots;
+            m_capacity = that.m_capacity;
+            m_size = that.m_size;
+            m_deleted = that.m_deleted;
+            that.m_ctrl = nullptr;
+            that.m_slots = nullptr;
+            that.m_capacity = that.m_size = that.m_deleted = 0;
+        }
+        return *this;
+    }
+
+    inline size_t size() const { return m_size; }
+
+    inline iterator begin() { return iterator(this, 0); }
+    inline iterator end() { return iterator(this, m_capacity); }
+    inline const_iterator begin() const { return const_iterator(this, 0); }
+    inline const_iterator end() const { return const_iterator(this, m_capacity); }
+
+    iterator find(K const &key)
+    {
+        size_t i = find_index(key, hash(key));
+        return iterator(this, i == NOT_FOUND ? m_capacity : i);
+    }
+
+    const_iterator find(K const &key) const
+    {
+        size_t i = find_index(key, hash(key));
+        return const_iterator(this, i == NOT_FOUND ? m_capacity : i);
+    }
+
+    inline size_t count(K const &key) const
+    {
+        return find_index(key, hash(key)) == NOT_FOUND ? 0 : 1;
+    }
+
+    V &operator [](K const &key)
+    {
+        bool inserted;
+        size_t i = insert_index(key, inserted);
+        if (inserted)
+            new (&m_slots[i]) value_type(key, V());
+        return m_slots[i].second;
+    }
+
+    std::pair<iterator, bool> insert(value_type const &kv)
+    {
+        bool inserted;
+        size_t i = insert_index(kv.first, inserted);
+        if (inserted)
+            new (&m_slots[i]) value_type(kv);
+        return std::make_pair(iterator(this, i), inserted);
+    }
+
+    size_t erase(K const &key)
+    {
+        size_t i = find_index(key, hash(key));
+        if (i == NOT_FOUND)
+            return 0;
+
+        m_slots[i].~value_type();
+        --m_size;
+
+        /* If the group still has an empty slot, no probe sequence ever
+         * went past it, so the slot can be marked empty again. */
+        if (match(m_ctrl + i / GROUP_SIZE * GROUP_SIZE, CTRL_EMPTY))
+            m_ctrl[i] = CTRL_EMPTY;
+        else
+        {
+            m_ctrl[i] = CTRL_DELETED;
+            ++m_deleted;
+        }
+        return 1;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < m_capacity; ++i)
+        {
+            if (m_ctrl[i] >= 0)
+                m_slots[i].~value_type();
+            m_ctrl[i] = CTRL_EMPTY;
+        }
+        m_size = m_deleted = 0;
+    }
+
+    void reserve(size_t count)
+    {
+        if (count * 8 > m_capacity * 7)
+            rehash(count);
+    }
+
+private:
+    static inline uint64_t hash(K const &key)
+    {
+        /* Many std::hash implementations are the identity function, so
+         * mix the bits to use them both for h1 and h2. */
+        uint64_t x = (uint64_t)H()(key) * 0x9e3779b97f4a7c15ull;
+        return x ^ (x >> 32);
+    }
+
+    static inline int8_t h2(uint64_t h)
+    {
+        return (int8_t)(h >> 57);
+    }
+
+    /* Return a bitmask of the control bytes in the group equal to c */
+    static inline uint32_t match(int8_t const *ctrl, int8_t c)
+    {
+#if LOL_FEATURE_SSE2
+        __m128i group = _mm_loadu_si128((__m128i const *)ctrl);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+        uint32_t ret = 0;
+        for (int i = 0; i < GROUP_SIZE; ++i)
+            ret |= uint32_t(ctrl[i] == c) << i;
+        return ret;
+#endif
+    }
+
+    /* Return a bitmask of the empty or deleted slots in the group */
+    static inline uint32_t match_free(int8_t const *ctrl)
+    {
+#if LOL_FEATURE_SSE2
+        __m128i group = _mm_loadu_si128((__m128i const *)ctrl);
+        return (uint32_t)_mm_movemask_epi8(group);
+#else
+        uint32_t ret = 0;
+        for (int i = 0; i < GROUP_SIZE; ++i)
+            ret |= uint32_t(ctrl[i] < 0) << i;
+        return ret;
+#endif
+    }
+
+    static inline int lowest_bit(uint32_t x)
+    {
+#if defined __GNUC__
+        return __builtin_ctz(x);
+#else
+        int ret = 0;
+        for ( ; !(x & 1); x >>= 1)
+            ++ret;
+        return ret;
+#endif
+    }
+
+    /* Probe groups with triangular steps, which visits all groups
+     * since the group count is a power of two. */
+    size_t find_index(K const &key, uint64_t h) const
+    {
+        if (!m_capacity)
+            return NOT_FOUND;
+
+        size_t const mask = m_capacity / GROUP_SIZE - 1;
+        size_t g = (size_t)h & mask;
+        for (size_t step = 1; ; ++step)
+        {
+            int8_t const *ctrl = m_ctrl + g * GROUP_SIZE;
+            for (uint32_t bits = match(ctrl, h2(h)); bits; bits &= bits - 1)
+            {
+                size_t i = g * GROUP_SIZE + lowest_bit(bits);
+                if (E()(m_slots[i].first, key))
+                    return i;
+            }
+            if (match(ctrl, CTRL_EMPTY))
+                return NOT_FOUND;
+            g = (g + step) & mask;
+        }
+    }
+
+    size_t find_free(uint64_t h) const
+    {
+        size_t const mask = m_capacity / GROUP_SIZE - 1;
+        size_t g = (size_t)h & mask;
+        for (size_t step = 1; ; ++step)
+        {
+            uint32_t bits = match_free(m_ctrl + g * GROUP_SIZE);
+            if (bits)
+                return g * GROUP_SIZE + lowest_bit(bits);
+            g = (g + step) & mask;
+        }
+    }
+
+    /* Find the slot for key, or reserve a new one, in which case the
+     * caller must construct the value. */
+    size_t insert_index(K const &key, bool &inserted)
+    {
+        uint64_t const h = hash(key);
+        size_t i = find_index(key, h);
+        if (i != NOT_FOUND)
+        {
+            inserted = false;
+            return i;
+        }
+
+        /* Keep the load factor, tombstones included, under 7/8 */
+        if ((m_size + m_deleted + 1) * 8 > m_capacity * 7)
+            rehash(m_size + 1);
+
+        i = find_free(h);
+        if (m_ctrl[i] == CTRL_DELETED)
+            --m_deleted;
+        m_ctrl[i] = h2(h);
+        ++m_size;
+        inserted = true;
+        return i;
+    }
+
+    /* Reallocate storage for at least count elements at a load factor
+     * of 7/16, which also gets rid of tombstones. */
+    void rehash(size_t count)
+    {
+        size_t capacity = GROUP_SIZE;
+        while (count * 16 > capacity * 7)
+            capacity *= 2;
+
+        int8_t *old_ctrl = m_ctrl;
+        value_type *old_slots = m_slots;
+        size_t old_capacity = m_capacity;
+
+        m_ctrl = new int8_t[capacity];
+        m_slots = static_cast<value_type *>(::operator new(capacity * sizeof(value_type)));
+        m_capacity = capacity;
+        m_deleted = 0;
+        for (size_t i = 0; i < capacity; ++i)
+            m_ctrl[i] = CTRL_EMPTY;
+
+        for (size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old_ctrl[i] < 0)
+                continue;
+            uint64_t const h = hash(old_slots[i].first);
+            size_t j = find_free(h);
+            m_ctrl[j] = h2(h);
+            new (&m_slots[j]) value_type(std::move(old_slots[i]));
+            old_slots[i].~value_type();
+        }
+
+        delete[] old_ctrl;
+        ::operator delete(old_slots);
+    }
+
+    void destroy()
+    {
+        clear();
+        delete[] m_ctrl;
+        ::operator delete(m_slots);
+        m_ctrl = nullptr;
+        m_slots = nullptr;
+        m_capacity = 0;
+    }
+
+    int8_t *m_ctrl;
+    value_type *m_slots;
+    size_t m_capacity, m_size, m_deleted;
+};
+
+} /* namespace lol */
+
@@ -16,6 +16,7 @@
 //
 // Simple map utilities
 // --------------------
+// These work with std::map as well as lol::hash_map and lol::flat_map.
 //
 
 #include <lol/base/array.h>
@@ -57,6 +57,8 @@ struct VertexUsageBase : public StructSafeEnum
         Fog,
         Depth,
         Sample,
+        /* Per-instance data, advancing once per instance drawn */
+        Instance,
         MAX,
     };
 
@@ -78,6 +80,7 @@ protected:
         enum_map[Fog] = "Fog";
         enum_map[Depth] = "Depth";
         enum_map[Sample] = "Sample";
+        enum_map[Instance] = "Instance";
         enum_map[MAX] = "MAX";
         return true;
     }
@@ -270,16 +273,47 @@ typedef SafeEnum<ShaderVariableTypeBase> ShaderVariableType;
 struct ShaderUniform
 {
     friend class Shader;
+    friend class ShaderData;
 
 public:
-    inline ShaderUniform() : flags(0) {}
+    inline ShaderUniform() : frag((uintptr_t)-1), vert(0), flags(0) {}
 
 private:
+    /* The GL location, the slot in the shader uniform table plus one,
+     * and the program the uniform was looked up in. */
     uintptr_t frag, vert;
-    /* FIXME: do we really need this to indicate which locations are valid? */
     uint32_t flags;
 };
 
+//ShaderUniformName -----------------------------------------------------------
+/* A uniform name along with its hash, computed at compile time when the
+ * name is a string literal. A name built from a std::string must not
+ * outlive it. */
+struct ShaderUniformName
+{
+    template<size_t N>
+    constexpr ShaderUniformName(char const (&name)[N])
+      : m_name(name), m_hash(Hash(name)) {}
+
+    inline ShaderUniformName(std::string const &name)
+      : m_name(name.c_str()), m_hash(Hash(name.c_str())) {}
+
+    explicit constexpr ShaderUniformName(char const *name)
+      : m_name(name), m_hash(Hash(name)) {}
+
+    /* 64-bit FNV-1a; a loop rather than recursion, as it also hashes
+     * whole shader sources at runtime */
+    static constexpr uint64_t Hash(char const *s, uint64_t h = 0xcbf29ce484222325ull)
+    {
+        for ( ; *s; ++s)
+            h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+        return h;
+    }
+
+    char const *m_name;
+    uint64_t m_hash;
+};
+
 //ShaderAttrib ----------------------------------------------------------------
 struct ShaderAttrib
 {
@@ -310,6 +344,23 @@ private:
     uint64_t m_flags;
 };
 
+//ShaderSceneData -------------------------------------------------------------
+/* Maximum number of lights sent to shaders */
+#define LOL_MAX_LIGHT_COUNT 8
+
+/* Per-frame data shared by all shaders through the lol_scene uniform
+ * block. Shaders declare it with “#pragma lol scene_uniforms”, which
+ * gives them u_projection, u_view, u_inv_view and u_lights. The layout
+ * matches std140 so that it can be uploaded as is. */
+struct ShaderSceneData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 inv_view;
+    /* Position and type, then colour, of each light */
+    vec4 lights[LOL_MAX_LIGHT_COUNT * 2];
+};
+
 class ShaderData;
 
 //Shader ----------------------------------------------------------------------
@@ -319,11 +370,28 @@ public:
     static Shader *Create(std::string const &name, std::string const &code);
     static void Destroy(Shader *shader);
 
+    /* Save linked programs in this directory, when the driver allows
+     * it, and load them from there instead of compiling them again.
+     * sys::init() sets it to the executable directory; an empty string
+     * disables the cache. */
+    static void SetBinaryDir(std::string const &dir);
+
+    /* Creating a shader only starts compiling it. This tells whether
+     * using it now would have to wait for the driver; meshes are not
+     * drawn until their shader is ready. */
+    bool IsReady() const;
+
     int GetAttribCount() const;
     ShaderAttrib GetAttribLocation(VertexUsage usage, int index) const;
+    /* Same lookup, without complaining when the attribute is missing */
+    bool HasAttrib(VertexUsage usage, int index) const;
 
-    ShaderUniform GetUniformLocation(std::string const& uni) const;
-    ShaderUniform GetUniformLocation(char const *uni) const;
+    /* Uniforms are enumerated once after linking, so this is a single
+     * hash table lookup. */
+    ShaderUniform GetUniformLocation(ShaderUniformName const &uni) const;
+
+    /* Setting a uniform to the value it already has in the bound
+     * shader does not call GL; arrays are always uploaded. */
     void SetUniform(ShaderUniform const &uni, int i);
     void SetUniform(ShaderUniform const &uni, ivec2 const &v);
     void SetUniform(ShaderUniform const &uni, ivec3 const &v);
@@ -342,9 +410,20 @@ public:
     void SetUniform(ShaderUniform const &uni, array<vec3> const &v);
     void SetUniform(ShaderUniform const &uni, array<vec4> const &v);
 
+    /* Set u_model, u_modelview and u_normalmat, using the view matrix
+     * of the current scene data; missing uniforms are skipped. */
+    void SetModelMatrix(mat4 const &model);
+
     void Bind() const;
     void Unbind() const;
 
+    /* Upload the per-frame scene data, once for all shaders */
+    static void SetSceneData(ShaderSceneData const &scene_data);
+
+    /* Get the number of uniform values sent to GL and of unchanged ones
+     * that were skipped since the last call, then reset both. */
+    static void GetUniformStats(int &sent, int &skipped);
+
 protected:
     Shader(std::string const &name, std::string const &vert, std::string const &frag);
     ~Shader();
@@ -217,6 +217,15 @@ public:
      * types. Both skip and count are numbers of indices, not primitives. */
     void DrawIndexedElements(MeshPrimitive type, int count, const short* skip = nullptr, short typeSize = 2);
 
+    /* Same as above, for several instances at once. Streams with the
+     * VertexUsage::Instance usage advance once per instance instead of
+     * once per vertex. Only call this if HasInstancing() is true. */
+    void DrawIndexedElementsInstanced(MeshPrimitive type, int count, int instances,
+                                      const short* skip = nullptr, short typeSize = 2);
+
+    /* Whether the driver supports instanced draws */
+    static bool HasInstancing();
+
     void Unbind();
     void SetStream(VertexBuffer *vb, ShaderAttrib attr1,
                                      ShaderAttrib attr2 = ShaderAttrib(),
@@ -231,7 +240,8 @@ public:
                                      ShaderAttrib attr11 = ShaderAttrib(),
                                      ShaderAttrib attr12 = ShaderAttrib());
 
-    void SetStream(VertexBuffer *vb, ShaderAttrib attribs[]);
+    /* The stream is read from its element number “first” onwards */
+    void SetStream(VertexBuffer *vb, ShaderAttrib attribs[], int first = 0);
 
     int GetStreamCount() const;
 
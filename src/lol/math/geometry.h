@@ -282,6 +282,27 @@ int TestRayVsRay(vec3 const &ray_p00, vec3 const &ray_p01,
                  vec3 &isec_p);
 bool TestPointVsFrustum(const vec3& point, const mat4& frustum, vec3* result_point = nullptr);
 
+/* The six planes of the volume that a projection × view matrix maps to
+ * the clip cube, stored as (normal, distance) with normals pointing
+ * inside, in left, right, bottom, top, near, far order. */
+struct frustum
+{
+    frustum() {}
+    explicit frustum(mat4 const &m);
+
+    vec4 planes[6];
+};
+
+/* Return false if the box lies entirely outside the frustum. The test
+ * is conservative: some boxes near the frustum corners are reported as
+ * visible even though they are not. */
+bool TestAABBVsFrustum(box3 const &aabb, frustum const &f);
+
+/* Test count boxes at once, storing the result for each of them in
+ * visible; return the number of visible boxes. */
+int TestAABBVsFrustum(box3 const *aabbs, int count, frustum const &f,
+                      bool *visible);
+
 //Ray/Plane : Normal must be given normalized. returns 1 if succeeded.
 template <typename TV>
 bool TestRayVsPlane(const TV &ray_p0,  const TV &ray_p1,
@@ -88,6 +88,21 @@ public:
         return (1.f - u) * m_val[(start + a) % N] + u * m_val[(start + b) % N];
     }
 
+    /* Blend the last two values, e.g. game states from fixed steps, with
+     * alpha going from 0 (previous value) to 1 (last value). */
+    T Blend(float alpha)
+    {
+        if (m_pos == -N)
+            return T();
+        if (m_pos == 1 - N)
+            return m_val[0];
+
+        int last = (m_pos + N - 1) % N;
+        int prev = (m_pos + N - 2) % N;
+
+        return (1.f - alpha) * m_val[prev] + alpha * m_val[last];
+    }
+
     inline void Reset()
     {
         m_pos = -N;
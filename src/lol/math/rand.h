@@ -13,14 +13,81 @@
 //
 // The Random number generators
 // ----------------------------
+// rand() draws from a xoshiro256** generator that each thread owns, so
+// that threads neither share nor lock any state. Explicit rand_engine
+// objects give reproducible sequences, for instance one per worker job,
+// and can fill whole arrays at once.
 //
 
 #include <cstdlib>
+#include <cstddef>
 #include <stdint.h>
+#include <atomic>
 
 namespace lol
 {
 
+class rand_engine
+{
+public:
+    explicit inline rand_engine(uint64_t seed = 0) { this->seed(seed); }
+
+    /* Expand the seed with SplitMix64, which never yields an all-zero
+     * state */
+    inline void seed(uint64_t seed)
+    {
+        for (auto &s : m_state)
+        {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    /* 64 random bits */
+    inline uint64_t next()
+    {
+        uint64_t ret = rotl(m_state[1] * 5, 7) * 9;
+        uint64_t t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return ret;
+    }
+
+    /* Uniform values in [0, 1), using the high bits */
+    inline float next_float() { return (float)(next() >> 40) * (1.f / 16777216.f); }
+    inline double next_double() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    /* Fill arrays with uniform values in [a, b), or with normally
+     * distributed values. These run four streams side by side, seeded
+     * from this engine, so the results do not depend on SIMD support. */
+    void fill(float *data, size_t count, float a = 0.f, float b = 1.f);
+    void fill(int32_t *data, size_t count, int32_t a, int32_t b);
+    void fill_normal(float *data, size_t count, float mean = 0.f, float stddev = 1.f);
+
+    /* The engine used by rand() in the calling thread. Each thread gets
+     * a different seed; the first one always gets the same. */
+    static inline rand_engine &get_thread()
+    {
+        static std::atomic<uint64_t> counter(0);
+        static thread_local rand_engine engine(counter++);
+        return engine;
+    }
+
+private:
+    static inline uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_state[4];
+};
+
 /* Random number generators */
 template<typename T> LOL_ATTR_NODISCARD static inline T rand();
 template<typename T> LOL_ATTR_NODISCARD static inline T rand(T a);
@@ -34,25 +101,25 @@ template<typename T> LOL_ATTR_NODISCARD static inline T rand(T a)
 
 template<> LOL_ATTR_NODISCARD inline half rand<half>(half a)
 {
-    float f = (float)std::rand() / (float)RAND_MAX;
+    float f = rand_engine::get_thread().next_float();
     return (half)(a * f);
 }
 
 template<> LOL_ATTR_NODISCARD inline float rand<float>(float a)
 {
-    float f = (float)std::rand() / (float)RAND_MAX;
+    float f = rand_engine::get_thread().next_float();
     return a * f;
 }
 
 template<> LOL_ATTR_NODISCARD inline double rand<double>(double a)
 {
-    double f = (double)std::rand() / (double)RAND_MAX;
+    double f = rand_engine::get_thread().next_double();
     return a * f;
 }
 
 template<> LOL_ATTR_NODISCARD inline ldouble rand<ldouble>(ldouble a)
 {
-    ldouble f = (ldouble)std::rand() / (ldouble)RAND_MAX;
+    ldouble f = (ldouble)rand_engine::get_thread().next_double();
     return a * f;
 }
 
@@ -62,54 +129,21 @@ template<typename T> LOL_ATTR_NODISCARD static inline T rand(T a, T b)
     return a + rand<T>(b - a);
 }
 
-/* Default random number generator */
+/* Default random number generator; integers are never negative */
 template<typename T> LOL_ATTR_NODISCARD static inline T rand()
 {
+    uint64_t ret = rand_engine::get_thread().next();
+
     switch (sizeof(T))
     {
     case 1:
-        return static_cast<T>(std::rand() & 0x7f);
+        return static_cast<T>(ret >> 57);
     case 2:
-    {
-        uint16_t ret = std::rand();
-        if (RAND_MAX < 0x7fff)
-            ret = (ret << 7) ^ std::rand();
-        return static_cast<T>(ret & 0x7fffu);
-    }
+        return static_cast<T>(ret >> 49);
     case 4:
-    {
-        uint32_t ret = std::rand();
-        if (RAND_MAX >= 0xffff)
-            ret = (ret << 16) ^ std::rand();
-        else
-        {
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-        }
-        return static_cast<T>(ret & 0x7fffffffu);
-    }
+        return static_cast<T>(ret >> 33);
     case 8:
-    {
-        uint64_t ret = std::rand();
-        if (RAND_MAX >= 0xffff)
-        {
-            ret = (ret << 16) ^ std::rand();
-            ret = (ret << 16) ^ std::rand();
-            ret = (ret << 16) ^ std::rand();
-        }
-        else
-        {
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-            ret = (ret << 8) ^ std::rand();
-        }
-        return static_cast<T>(ret & (~(uint64_t)0 >> 1));
-    }
+        return static_cast<T>(ret >> 1);
     default:
         ASSERT(false, "rand() doesn’t support types of size %d\n",
                (int)sizeof(T));
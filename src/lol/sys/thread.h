@@ -18,6 +18,7 @@
 //
 
 #include <functional>
+#include <atomic>
 
 #if LOL_FEATURE_THREADS
 #   include <thread>
@@ -82,142 +83,235 @@ private:
 #endif
 };
 
-// A FIFO queue for threads
+// A bounded FIFO queue for threads, with any number of producers and
+// consumers. Each slot carries a sequence number telling whether it is
+// ready to be written or read at the current lap, so that the fast path
+// only needs one compare-and-swap. Threads only sleep on the condition
+// variables when the queue is actually full or empty.
 template<typename T, int N = 128>
 class queue
 {
 public:
     queue()
-      : m_start(0),
-        m_count(0)
+      : m_push_pos(0),
+        m_pop_pos(0)
     {
+        m_waiters[0] = m_waiters[1] = 0;
+        for (int i = 0; i < CAPACITY; ++i)
+            m_slots[i].m_seq.store(free_seq(i), std::memory_order_relaxed);
     }
 
-    // Will block the thread if another has already locked
+    // Will block the thread if the queue is full
     void push(T value)
     {
-#if LOL_FEATURE_THREADS
-        /* Wait for the mutex availability or non-fullness */
-        std::unique_lock<std::mutex> uni_lock(m_mutex);
-        m_full_cond.wait(uni_lock, [&]{ return m_count < CAPACITY; });
-#endif
+        push_batch(&value, 1);
+    }
 
-        do_push(value); /* Push value */
+    // Will not block, return false if the queue is full
+    bool try_push(T value)
+    {
+        return try_push_batch(&value, 1) == 1;
+    }
 
-#if LOL_FEATURE_THREADS
-        /* Release lock and notify empty condition var (in that order) */
-        uni_lock.unlock();
-        m_empty_cond.notify_one();
-#endif
+    // Will block the thread if the queue is empty
+    T pop()
+    {
+        T ret;
+        pop_batch(&ret, 1);
+        return ret;
     }
 
-    // Will not block if another has already locked
-    bool try_push(T value)
+    // Will not block, return false if the queue is empty
+    bool try_pop(T &ret)
     {
-#if LOL_FEATURE_THREADS
-        /* Same as Push(), except .... */
-        std::unique_lock<std::mutex> uni_lock(m_mutex, std::try_to_lock);
-        /* Bail on fail try_lock fail */
-        if (!uni_lock.owns_lock())
-            return false;
-        /* Bail on max CAPACITY */
-        if (m_count == CAPACITY)
+        return try_pop_batch(&ret, 1) == 1;
+    }
+
+    // Push all values, blocking the thread whenever the queue is full
+    void push_batch(T const *values, int count)
+    {
+        while (count > 0)
         {
-            uni_lock.unlock();
-            return false;
+            int n = wait_for([&]{ return try_push_batch(values, count); },
+                             WAIT_FOR_ROOM);
+            values += n;
+            count -= n;
         }
-#else
-        if (m_count == CAPACITY)
-            return false;
-#endif
+    }
 
-        do_push(value); /* Push value */
+    // Push as many values as possible without blocking; return the
+    // number of values pushed, which are always the first ones
+    int try_push_batch(T const *values, int count)
+    {
+        if (count <= 0)
+            return 0;
 
-#if LOL_FEATURE_THREADS
-        /* Release lock and notify empty condition var (in that order) */
-        uni_lock.unlock();
-        m_empty_cond.notify_one();
-#endif
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            /* Count the free slots following pos at this lap */
+            int n = 0;
+            while (n < count && n < CAPACITY
+                    && slot(pos + n).m_seq.load(std::memory_order_acquire) == free_seq(pos + n))
+                ++n;
+
+            if (n == 0)
+            {
+                /* Either the queue is full, or another producer took
+                 * the slot and we need to catch up. */
+                size_t seq = slot(pos).m_seq.load(std::memory_order_acquire);
+                if ((ptrdiff_t)(seq - free_seq(pos)) < 0)
+                    return 0;
+                pos = m_push_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (m_push_pos.compare_exchange_weak(pos, pos + n,
+                                                 std::memory_order_relaxed))
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    slot(pos + i).m_value = values[i];
+                    slot(pos + i).m_seq.store(full_seq(pos + i), std::memory_order_release);
+                }
+                wake(WAIT_FOR_VALUES);
+                return n;
+            }
+        }
+    }
+
+    // Pop up to count values, blocking the thread until at least one
+    // is available; return the number of values popped
+    int pop_batch(T *values, int count)
+    {
+        if (count <= 0)
+            return 0;
 
-        return true;
+        return wait_for([&]{ return try_pop_batch(values, count); },
+                        WAIT_FOR_VALUES);
     }
 
-    // Will block the thread if another has already locked
-    T pop()
+    // Pop up to count values without blocking; return the number of
+    // values popped
+    int try_pop_batch(T *values, int count)
     {
-#if LOL_FEATURE_THREADS
-        /* Wait for the mutex availability or non-emptiness */
-        std::unique_lock<std::mutex> uni_lock(m_mutex);
-        m_empty_cond.wait(uni_lock, [&]{return m_count > 0; });
-#else
-        ASSERT(0, "Pop should only be used with threads. Use try_pop instead.");
-#endif
+        if (count <= 0)
+            return 0;
 
-        T ret = do_pop(); /* Pop value */
+        size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            /* Count the filled slots following pos at this lap */
+            int n = 0;
+            while (n < count && n < CAPACITY
+                    && slot(pos + n).m_seq.load(std::memory_order_acquire) == full_seq(pos + n))
+                ++n;
+
+            if (n == 0)
+            {
+                size_t seq = slot(pos).m_seq.load(std::memory_order_acquire);
+                if ((ptrdiff_t)(seq - full_seq(pos)) < 0)
+                    return 0;
+                pos = m_pop_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (m_pop_pos.compare_exchange_weak(pos, pos + n,
+                                                std::memory_order_relaxed))
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    values[i] = std::move(slot(pos + i).m_value);
+                    slot(pos + i).m_seq.store(free_seq(pos + i + CAPACITY), std::memory_order_release);
+                }
+                wake(WAIT_FOR_ROOM);
+                return n;
+            }
+        }
+    }
 
-#if LOL_FEATURE_THREADS
-        /* Release lock and notify full condition var (in that order) */
-        uni_lock.unlock();
-        m_full_cond.notify_one();
-#endif
+private:
+    struct queue_slot
+    {
+        std::atomic<size_t> m_seq;
+        T m_value;
+    };
 
-        return ret;
+    inline queue_slot &slot(size_t pos)
+    {
+        return m_slots[pos % CAPACITY];
     }
 
-    // Will not block if another has already locked
-    bool try_pop(T &ret)
+    /* Sequence numbers of a slot that can be written, or read, at
+     * position pos. Using even and odd values keeps the two states
+     * distinct even when CAPACITY is 1. */
+    static inline size_t free_seq(size_t pos) { return 2 * pos; }
+    static inline size_t full_seq(size_t pos) { return 2 * pos + 1; }
+
+    enum { WAIT_FOR_ROOM = 0, WAIT_FOR_VALUES = 1 };
+
+    /* Call f until it returns non-zero, spinning for a while before
+     * going to sleep until the other side calls wake(). */
+    template<typename F>
+    int wait_for(F f, int reason)
     {
-#if LOL_FEATURE_THREADS
-        /* Same as Pop(), except .... */
-        std::unique_lock<std::mutex> uni_lock(m_mutex, std::try_to_lock);
-        /* Bail on fail try_lock fail */
-        if (!uni_lock.owns_lock())
-            return false;
-        /* Bail on zero count */
-        if (m_count == 0)
+        for (int spin = 0; spin < SPIN_COUNT; ++spin)
         {
-            uni_lock.unlock();
-            return false;
-        }
-#else
-        if (m_count == 0)
-            return false;
+            int ret = f();
+            if (ret)
+                return ret;
+#if LOL_FEATURE_THREADS
+            std::this_thread::yield();
 #endif
-
-        ret = do_pop(); /* Pop value */
+        }
 
 #if LOL_FEATURE_THREADS
-        /* Release lock and notify full condition var (in that order) */
-        uni_lock.unlock();
-        m_full_cond.notify_one();
+        int ret = 0;
+        std::unique_lock<std::mutex> uni_lock(m_mutex);
+        m_waiters[reason].fetch_add(1);
+        /* Pairs with the fence in wake(): either the other side sees
+         * our waiter count, or we see its update. */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_cond[reason].wait(uni_lock, [&]{ return (ret = f()) != 0; });
+        m_waiters[reason].fetch_sub(1);
+        return ret;
+#else
+        UNUSED(reason);
+        ASSERT(0, "blocking queue operations need threads, use try_push and try_pop instead");
+        return 0;
 #endif
-
-        return true;
     }
 
-    // Inner methods for actual update
-private:
-    void do_push(T &value)
-    {
-        m_values[(m_start + m_count) % CAPACITY] = value;
-        m_count++;
-    }
-
-    T& do_pop()
+    void wake(int reason)
     {
-        int idx = m_start;
-        m_start = (m_start + 1) % CAPACITY;
-        m_count--;
-        return m_values[idx];
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters[reason].load(std::memory_order_relaxed))
+        {
+#if LOL_FEATURE_THREADS
+            /* Taking the lock ensures that waiters are either sleeping
+             * or have not checked the queue yet. */
+            m_mutex.lock();
+            m_mutex.unlock();
+            m_cond[reason].notify_all();
+#endif
+        }
     }
 
-private:
     static int const CAPACITY = N;
-    T m_values[CAPACITY];
-    int m_start, m_count;
+    static int const SPIN_COUNT = 64;
+
+    queue_slot m_slots[CAPACITY];
+
+    /* Keep the producer and consumer positions on separate cache lines */
+    std::atomic<size_t> m_push_pos;
+    char m_padding0[64];
+    std::atomic<size_t> m_pop_pos;
+    char m_padding1[64];
+
+    std::atomic<int> m_waiters[2];
 #if LOL_FEATURE_THREADS
     std::mutex m_mutex;
-    std::condition_variable m_empty_cond, m_full_cond;
+    std::condition_variable m_cond[2];
 #endif
 };
 
@@ -261,5 +355,139 @@ private:
     std::function<void(thread*)> m_function;
 };
 
+// A persistent pool of worker threads for data parallel loops. Workers
+// are created once and sleep between calls to run(); the calling thread
+// takes part in the work. Nested or concurrent calls to run() do not
+// wait for the pool and execute their jobs serially instead.
+class thread_pool
+{
+public:
+    // The pool shared by the engine, with one worker per extra core
+    static thread_pool &get()
+    {
+#if LOL_FEATURE_THREADS
+        static thread_pool pool((int)std::thread::hardware_concurrency() - 1);
+#else
+        static thread_pool pool(0);
+#endif
+        return pool;
+    }
+
+    thread_pool(int workers)
+      : m_count(0)
+    {
+#if LOL_FEATURE_THREADS
+        m_fn = nullptr;
+        m_jobs = 0;
+        m_next = 0;
+        m_active = 0;
+        m_generation = 0;
+        m_quit = false;
+        while (m_count < workers && m_count < MAX_WORKERS)
+            m_workers[m_count++] = new thread([this](thread *) { worker_main(); });
+#else
+        UNUSED(workers);
+#endif
+    }
+
+    ~thread_pool()
+    {
+#if LOL_FEATURE_THREADS
+        m_mutex.lock();
+        m_quit = true;
+        m_mutex.unlock();
+        m_work_cond.notify_all();
+        for (int i = 0; i < m_count; ++i)
+            delete m_workers[i];
+#endif
+    }
+
+    // Number of threads that can run jobs, including the caller
+    int count() const
+    {
+        return m_count + 1;
+    }
+
+    // Call fn(i) for every i in [0, jobs) and return once all are done
+    void run(int jobs, std::function<void(int)> const &fn)
+    {
+#if LOL_FEATURE_THREADS
+        if (jobs > 1 && m_count > 0 && m_run_mutex.try_lock())
+        {
+            {
+                /* Workers late for the previous run must leave it
+                 * before its state is reset */
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done_cond.wait(lock, [this]{ return m_active == 0; });
+                m_fn = &fn;
+                m_jobs = jobs;
+                m_next = 0;
+                ++m_generation;
+            }
+            m_work_cond.notify_all();
+
+            for (int i; (i = m_next++) < jobs; )
+                fn(i);
+
+            /* Every job was taken; wait for the workers still running
+             * theirs. Workers only join a run under the lock, so none
+             * can still use fn once this returns. */
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done_cond.wait(lock, [this]{ return m_active == 0; });
+            m_fn = nullptr;
+            lock.unlock();
+            m_run_mutex.unlock();
+            return;
+        }
+#endif
+        for (int i = 0; i < jobs; ++i)
+            fn(i);
+    }
+
+private:
+#if LOL_FEATURE_THREADS
+    void worker_main()
+    {
+        unsigned int generation = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_work_cond.wait(lock, [&]{ return m_quit || m_generation != generation; });
+            if (m_quit)
+                break;
+
+            generation = m_generation;
+            std::function<void(int)> const *fn = m_fn;
+            int jobs = m_jobs;
+            ++m_active;
+            lock.unlock();
+
+            for (int i; (i = m_next++) < jobs; )
+                (*fn)(i);
+
+            lock.lock();
+            if (--m_active == 0)
+                m_done_cond.notify_one();
+        }
+    }
+#endif
+
+    static int const MAX_WORKERS = 63;
+
+    thread *m_workers[MAX_WORKERS];
+    int m_count;
+
+#if LOL_FEATURE_THREADS
+    std::function<void(int)> const *m_fn;
+    int m_jobs, m_active;
+    std::atomic<int> m_next;
+    unsigned int m_generation;
+    bool m_quit;
+
+    std::mutex m_mutex, m_run_mutex;
+    std::condition_variable m_work_cond, m_done_cond;
+#endif
+};
+
 } /* namespace lol */
 
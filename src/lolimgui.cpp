@@ -168,6 +168,8 @@ LolImGui::~LolImGui()
 
     Shader::Destroy(m_shader);
     delete m_vdecl;
+    delete m_vbuff;
+    delete m_ibuff;
 }
 
 //-----------------------------------------------------------------------------
@@ -415,50 +417,92 @@ void LolImGui::RenderDrawListsMethod(ImDrawData* draw_data)
     if (!m_shader)
         return;
 
+    /* Gather all draw lists into a single vertex buffer and a single
+     * index buffer, so that there is only one upload per frame. The
+     * buffers only ever grow, and indices are rebased on the way so that
+     * they point into the merged vertex buffer. */
+    int const vtx_count = draw_data->TotalVtxCount;
+    int const idx_count = draw_data->TotalIdxCount;
+    if (!vtx_count || !idx_count)
+        return;
+
+    short const idx_size = vtx_count > 0x10000 ? 4 : 2;
+    size_t const vtx_bytes = vtx_count * sizeof(ImDrawVert);
+    size_t const idx_bytes = idx_count * idx_size;
+
+    if (!m_vbuff || m_vbuff->GetSize() < vtx_bytes)
+    {
+        delete m_vbuff;
+        m_vbuff = new VertexBuffer(PotUp(vtx_bytes));
+    }
+    if (!m_ibuff || m_ibuff->GetSize() < idx_bytes)
+    {
+        delete m_ibuff;
+        m_ibuff = new IndexBuffer(PotUp(idx_bytes));
+    }
+
+    ImDrawVert *vert = (ImDrawVert *)m_vbuff->Lock(0, vtx_bytes);
+    uint8_t *indices = (uint8_t *)m_ibuff->Lock(0, idx_bytes);
+    for (int n = 0, vtx_offset = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        memcpy(vert + vtx_offset, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+
+        for (int i = 0; i < cmd_list->IdxBuffer.Size; i++)
+        {
+            uint32_t index = cmd_list->IdxBuffer[i] + vtx_offset;
+            if (idx_size == 2)
+                *(uint16_t *)indices = (uint16_t)index;
+            else
+                *(uint32_t *)indices = index;
+            indices += idx_size;
+        }
+
+        vtx_offset += cmd_list->VtxBuffer.Size;
+    }
+    m_vbuff->Unlock();
+    m_ibuff->Unlock();
+
     RenderContext rc;
     rc.SetCullMode(CullMode::Disabled);
     rc.SetDepthFunc(DepthFunc::Disabled);
     rc.SetScissorMode(ScissorMode::Enabled);
 
     m_shader->Bind();
+    m_shader->SetUniform(m_ortho, ortho);
+    m_shader->SetUniform(m_texture, m_font->GetTexture()->GetTextureUniform(), 0);
+
+    m_font->Bind();
+    m_ibuff->Bind();
+    m_vdecl->Bind();
+    m_vdecl->SetStream(m_vbuff, m_attribs[0], m_attribs[1], m_attribs[2]);
+
+    /* Consecutive commands often share their texture and clip rect, only
+     * send the changes to the driver. */
+    TextureImage *bound_image = nullptr;
+    vec4 clip_rect(-1.f);
+    size_t idx_offset = 0;
+
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        /*const unsigned char* vtx_buffer = (const unsigned char*)&cmd_list->VtxBuffer.front();*/
 
-        //Register uniforms
-        m_shader->SetUniform(m_ortho, ortho);
-        m_shader->SetUniform(m_texture, m_font->GetTexture()->GetTextureUniform(), 0);
-
-        struct Vertex
-        {
-            vec2 pos, tex;
-            u8vec4 color;
-        };
-
-        VertexBuffer* vbo = new VertexBuffer(cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-        ImDrawVert *vert = (ImDrawVert *)vbo->Lock(0, 0);
-        memcpy(vert, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-        vbo->Unlock();
-
-        IndexBuffer *ibo = new IndexBuffer(cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-        ImDrawIdx *indices = (ImDrawIdx *)ibo->Lock(0, 0);
-        memcpy(indices, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-        ibo->Unlock();
-
-        m_font->Bind();
-        ibo->Bind();
-        m_vdecl->Bind();
-        m_vdecl->SetStream(vbo, m_attribs[0], m_attribs[1], m_attribs[2]);
-
-        const ImDrawIdx* idx_buffer_offset = 0;
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
             const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[(int)cmd_i];
             TextureImage* image = (TextureImage*)pcmd->TextureId;
-            if (image) image->Bind();
+            if (image && image != bound_image)
+            {
+                image->Bind();
+                bound_image = image;
+            }
 
-            rc.SetScissorRect(vec4(pcmd->ClipRect.x, pcmd->ClipRect.y, pcmd->ClipRect.z, pcmd->ClipRect.w));
+            vec4 rect(pcmd->ClipRect.x, pcmd->ClipRect.y, pcmd->ClipRect.z, pcmd->ClipRect.w);
+            if (rect != clip_rect)
+            {
+                rc.SetScissorRect(rect);
+                clip_rect = rect;
+            }
 
 #ifdef SHOW_IMGUI_DEBUG
             //-----------------------------------------------------------------
@@ -479,10 +523,10 @@ void LolImGui::RenderDrawListsMethod(ImDrawData* draw_data)
             };
             for (int i = 0; i < 4; ++i)
                 Debug::DrawLine(pos[i], pos[(i + 1) % 4], Color::white);
-            ImDrawVert* buf = vert;
+            ImDrawVert* buf = cmd_list->VtxBuffer.Data;
             for (uint16_t i = 0; i < pcmd->ElemCount; i += 3)
             {
-                uint16_t ib = indices[idx_buffer_offset_i + i];
+                uint16_t ib = cmd_list->IdxBuffer[idx_buffer_offset_i + i];
                 vec2 pos[3];
                 pos[0] = vec2(buf[ib + 0].pos.x, buf[ib + 0].pos.y);
                 pos[1] = vec2(buf[ib + 1].pos.x, buf[ib + 1].pos.y);
@@ -503,21 +547,19 @@ void LolImGui::RenderDrawListsMethod(ImDrawData* draw_data)
 #endif //SHOW_IMGUI_DEBUG
             //Debug::DrawLine(vec2::zero, vec2::axis_x /*, Color::green*/);
 
-            m_vdecl->DrawIndexedElements(MeshPrimitive::Triangles, pcmd->ElemCount, (const short*)idx_buffer_offset);
-
-            idx_buffer_offset += pcmd->ElemCount;
+            m_vdecl->DrawIndexedElements(MeshPrimitive::Triangles, pcmd->ElemCount,
+                                         (const short*)(idx_offset * idx_size), idx_size);
 
-            if (image) image->Unbind();
+            idx_offset += pcmd->ElemCount;
         }
-
-        m_vdecl->Unbind();
-        ibo->Unbind();
-        m_font->Unbind();
-
-        delete vbo;
-        delete ibo;
     }
 
+    if (bound_image)
+        bound_image->Unbind();
+    m_vdecl->Unbind();
+    m_ibuff->Unbind();
+    m_font->Unbind();
+
     m_shader->Unbind();
 }
 
@@ -214,6 +214,7 @@ protected:
     Uniform m_texture;
     array<ShaderAttrib> m_attribs;
     VertexDeclaration* m_vdecl = nullptr;
+    VertexBuffer* m_vbuff = nullptr;
     IndexBuffer* m_ibuff = nullptr;
     Controller* m_controller = nullptr;
     InputDevice* m_mouse = nullptr;
@@ -17,6 +17,7 @@
 #include <string>
 #include <cstdlib>
 #include <cctype>
+#include <cstring>
 
 //
 // Base Lua class for Lua script loading
@@ -25,6 +26,178 @@
 namespace lol
 {
 
+//-----------------------------------------------------------------------------
+// Compiled Lua chunks are dumped next to their source file, with a “c”
+// appended to the name, and tagged with a hash of the source so that a
+// stale dump is never used. Files can also be compiled in advance on a
+// worker thread, each with its own lua_State; the resulting bytecode is
+// then picked up by the next load of the same source.
+//-----------------------------------------------------------------------------
+class LuaChunkCache
+{
+public:
+    /* Push the compiled chunk for this source, or an error message */
+    static int Load(lua_State *l, std::string const &path,
+                    std::string const &source)
+    {
+        uint64_t key = Hash(source);
+        std::string chunkname = "@" + path;
+        std::string bytecode;
+
+        m_mutex.lock();
+        auto it = m_chunks.find(key);
+        if (it != m_chunks.end())
+        {
+            bytecode = std::move(it->second);
+            m_chunks.erase(key);
+        }
+        m_mutex.unlock();
+
+        if (bytecode.length() || ReadCache(path, key, bytecode))
+        {
+            if (luaL_loadbufferx(l, bytecode.data(), bytecode.length(),
+                                 chunkname.c_str(), "b") == LUA_OK)
+                return LUA_OK;
+
+            /* Probably dumped by another Lua version; compile again */
+            lua_pop(l, 1);
+        }
+
+        int status = luaL_loadbufferx(l, source.data(), source.length(),
+                                      chunkname.c_str(), "t");
+        if (status == LUA_OK && Dump(l, bytecode))
+            WriteCache(path, key, bytecode);
+        return status;
+    }
+
+    /* Compile a file on a worker thread */
+    static void Preload(std::string const &filename)
+    {
+#if LOL_FEATURE_THREADS
+        m_mutex.lock();
+        bool pending = m_pending.count(filename) > 0;
+        if (!pending)
+            m_pending[filename] = new thread([filename](thread *)
+            {
+                Compile(filename);
+            });
+        m_mutex.unlock();
+#else
+        UNUSED(filename);
+#endif
+    }
+
+    /* Wait for the compilation of a file started by Preload() */
+    static void Wait(std::string const &filename)
+    {
+        thread *worker = nullptr;
+
+        m_mutex.lock();
+        auto it = m_pending.find(filename);
+        if (it != m_pending.end())
+        {
+            worker = it->second;
+            m_pending.erase(filename);
+        }
+        m_mutex.unlock();
+
+        /* The thread destructor joins */
+        delete worker;
+    }
+
+private:
+    static void Compile(std::string const &filename)
+    {
+        File f;
+        for (auto const &candidate : sys::get_path_list(filename))
+        {
+            f.Open(candidate, FileAccess::Read, true);
+            if (!f.IsValid())
+                continue;
+
+            std::string source = f.ReadString();
+            f.Close();
+
+            lua_State *l = luaL_newstate();
+            std::string bytecode;
+            if (Load(l, candidate, source) == LUA_OK && Dump(l, bytecode))
+            {
+                m_mutex.lock();
+                m_chunks[Hash(source)] = std::move(bytecode);
+                m_mutex.unlock();
+            }
+            lua_close(l);
+            return;
+        }
+    }
+
+    /* Dump the function on top of the stack */
+    static bool Dump(lua_State *l, std::string &bytecode)
+    {
+        bytecode.clear();
+        return lua_dump(l, [](lua_State *, void const *p, size_t size, void *data)
+        {
+            ((std::string *)data)->append((char const *)p, size);
+            return 0;
+        }, &bytecode, 0) == 0;
+    }
+
+    static bool ReadCache(std::string const &path, uint64_t key,
+                          std::string &bytecode)
+    {
+        File f;
+        f.Open(path + "c", FileAccess::Read, true);
+        if (!f.IsValid())
+            return false;
+
+        std::string data = f.ReadString();
+        f.Close();
+
+        if (data.length() <= sizeof(MAGIC) + sizeof(key)
+             || memcmp(data.data(), MAGIC, sizeof(MAGIC))
+             || memcmp(data.data() + sizeof(MAGIC), &key, sizeof(key)))
+            return false;
+
+        bytecode = data.substr(sizeof(MAGIC) + sizeof(key));
+        return true;
+    }
+
+    /* Data directories may not be writable; the cache is then unused */
+    static void WriteCache(std::string const &path, uint64_t key,
+                           std::string const &bytecode)
+    {
+        File f;
+        f.Open(path + "c", FileAccess::Write, true);
+        if (!f.IsValid())
+            return;
+
+        f.Write(MAGIC, sizeof(MAGIC));
+        f.Write(&key, sizeof(key));
+        f.Write(bytecode);
+        f.Close();
+    }
+
+    /* 64-bit FNV-1a, so that keys do not change between runs */
+    static uint64_t Hash(std::string const &s)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (char ch : s)
+            h = (h ^ (uint8_t)ch) * 0x100000001b3ull;
+        return h ^ s.length();
+    }
+
+    static char const MAGIC[4];
+
+    static mutex m_mutex;
+    static hash_map<uint64_t, std::string> m_chunks;
+    static hash_map<std::string, thread *> m_pending;
+};
+
+char const LuaChunkCache::MAGIC[4] = { 'L', 'o', 'l', 'c' };
+mutex LuaChunkCache::m_mutex;
+hash_map<uint64_t, std::string> LuaChunkCache::m_chunks;
+hash_map<std::string, thread *> LuaChunkCache::m_pending;
+
 //-----------------------------------------------------------------------------
 class LuaBaseData
 {
@@ -39,6 +212,53 @@ class LuaBaseData
         return 0;
     }
 
+    //Metatables for math values ----------------------------------------------
+    template<typename T>
+    static void RegisterValue(lua_State *l, char const *name, char const *components)
+    {
+        luaL_newmetatable(l, name);
+        lua_pushstring(l, components);
+        lua_pushcclosure(l, ValueIndex<T>, 1);
+        lua_setfield(l, -2, "__index");
+        lua_pushstring(l, components);
+        lua_pushcclosure(l, ValueNewIndex<T>, 1);
+        lua_setfield(l, -2, "__newindex");
+        lua_rawsetp(l, LUA_REGISTRYINDEX, Lolua::TypeKey<T>::Get());
+    }
+
+    //Index of the component named by the key, using the upvalue for names
+    static int ValueComponent(lua_State *l)
+    {
+        char const *key = lua_tostring(l, 2);
+        char const *components = lua_tostring(l, lua_upvalueindex(1));
+        if (!key || !key[0] || key[1])
+            return -1;
+        char const *pos = strchr(components, key[0]);
+        return pos ? (int)(pos - components) : -1;
+    }
+
+    template<typename T>
+    static int ValueIndex(lua_State *l)
+    {
+        T *value = (T *)lua_touserdata(l, 1);
+        int i = ValueComponent(l);
+        if (i < 0)
+            return 0;
+        lua_pushnumber(l, (*value)[i]);
+        return 1;
+    }
+
+    template<typename T>
+    static int ValueNewIndex(lua_State *l)
+    {
+        T *value = (T *)lua_touserdata(l, 1);
+        int i = ValueComponent(l);
+        if (i < 0)
+            return luaL_error(l, "invalid component %s", lua_tostring(l, 2));
+        (*value)[i] = (float)luaL_checknumber(l, 3);
+        return 0;
+    }
+
     //Exec lua code -----------------------------------------------------------
     static int LuaDoCode(lua_State *l, std::string const& s)
     {
@@ -63,24 +283,29 @@ class LuaBaseData
         std::string filename = stack.Get<std::string>();
         int status = LUA_ERRFILE;
 
+        /* A background compilation of this file may still be running */
+        LuaChunkCache::Wait(filename);
+
         File f;
         for (auto const &candidate : sys::get_path_list(filename))
         {
-            f.Open(candidate, FileAccess::Read);
+            f.Open(candidate, FileAccess::Read, true);
             if (f.IsValid())
             {
                 std::string s = f.ReadString();
                 f.Close();
 
                 msg::debug("loading Lua file %s\n", candidate.c_str());
-                status = LuaDoCode(l, s);
+                status = LuaChunkCache::Load(l, candidate, s);
+                if (status == LUA_OK)
+                    status = lua_pcall(l, 0, LUA_MULTRET, 0);
                 break;
             }
         }
 
         if (status == LUA_ERRFILE)
             msg::error("could not find Lua file %s\n", filename.c_str());
-        else if (status == 1)
+        else if (status != LUA_OK)
         {
             stack.SetIndex(-1);
             auto error = stack.Get<std::string>();
@@ -104,6 +329,11 @@ Loader::Loader()
     lua_atpanic(m_lua_state, LuaBaseData::LuaPanic);
     luaL_openlibs(m_lua_state);
 
+    LuaBaseData::RegisterValue<vec2>(m_lua_state, "vec2", "xy");
+    LuaBaseData::RegisterValue<vec3>(m_lua_state, "vec3", "xyz");
+    LuaBaseData::RegisterValue<vec4>(m_lua_state, "vec4", "xyzw");
+    LuaBaseData::RegisterValue<quat>(m_lua_state, "quat", "wxyz");
+
     /* Override dofile() */
     LuaFunction do_file(m_lua_state, "dofile", LuaBaseData::LuaDoFile);
 
@@ -161,6 +391,12 @@ bool Loader::ExecLuaFile(std::string const &lua)
     return status == 0;
 }
 
+//-----------------------------------------------------------------------------
+void Loader::Preload(std::string const &lua)
+{
+    LuaChunkCache::Preload(lua);
+}
+
 //-----------------------------------------------------------------------------
 bool Loader::ExecLuaCode(std::string const &lua)
 {
@@ -16,7 +16,11 @@
 #include "3rdparty/lua/src/lua.hpp"
 //#include "lua/luawrapper.hpp"
 
+#include <new> /* for placement new */
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 //
 // Base Lua class for Lua script loading
@@ -29,6 +33,31 @@ namespace lol
 namespace Lolua
 {
 
+//-----------------------------------------------------------------------------
+// Metatables are also stored in the registry under the address of a static
+// variable specific to each type, so that looking them up or checking the
+// type of a userdata does not need to hash any string.
+//-----------------------------------------------------------------------------
+template<typename T>
+struct TypeKey
+{
+    static void *Get() { static char key; return &key; }
+};
+
+// Return the userdata at the given index if its metatable is the one
+// stored under the given key, and nullptr otherwise.
+static inline void *TestUserData(lua_State *l, int index, void *key)
+{
+    void *data = lua_touserdata(l, index);
+    if (!data || !lua_getmetatable(l, index))
+        return nullptr;
+    lua_rawgetp(l, LUA_REGISTRYINDEX, key);
+    if (!lua_rawequal(l, -1, -2))
+        data = nullptr;
+    lua_pop(l, 2);
+    return data;
+}
+
 //-----------------------------------------------------------------------------
 typedef luaL_Reg ClassMethod;
 typedef struct ClassVar
@@ -168,6 +197,9 @@ public:
         luaL_setfuncs(l, GetInstanceMethods<TLuaClass>(), 0);
         lua_pushvalue(l, -1);
         lua_setfield(l, -1, "__index");
+        //Also store it under the type key, for fast lookups
+        lua_pushvalue(l, -1);
+        lua_rawsetp(l, LUA_REGISTRYINDEX, TypeKey<TLuaClass>::Get());
 
         //Create variables Get/Set
         const array<Object::Library::ClassVarStr>& variables = GetVariables<TLuaClass>();
@@ -227,7 +259,7 @@ protected:
         *data = TLuaClass::New(l, n_args);
 
         //Retrieve instance table
-        luaL_getmetatable(l, GetMethodName<TLuaClass>());
+        lua_rawgetp(l, LUA_REGISTRYINDEX, TypeKey<TLuaClass>::Get());
         //Set metatable to instance
         lua_setmetatable(l, -2);
         //Return 1 so Lua will get the UserData and clean the stack.
@@ -294,9 +326,6 @@ protected:
         m_index = start_index;
     }
 
-public:
-    virtual ~Stack() { }
-
 protected:
     int32_t GetArgs()
     {
@@ -395,9 +424,11 @@ protected:
     template<typename P> inline bool InnerIsValidPtr() { return !!lua_isuserdata(m_state, m_index); }
     template<typename P> inline Ptr<P> InnerGetPtr(Ptr<P> value)
     {
-        P** obj = static_cast<P**>(value.m_throw_error
-                                        ? luaL_checkudata(m_state, m_index++, ObjectHelper::GetMethodName<P>())
-                                        : luaL_testudata(m_state, m_index++, ObjectHelper::GetMethodName<P>()) );
+        P** obj = static_cast<P**>(TestUserData(m_state, m_index, TypeKey<P>::Get()));
+        //Only look the metatable up by name to raise the error
+        if (!obj && value.m_throw_error)
+            luaL_checkudata(m_state, m_index, ObjectHelper::GetMethodName<P>());
+        ++m_index;
         return Ptr<P>(obj ? *obj : value.m_value);
     }
     template<typename P> inline int InnerPushPtr(Ptr<P> value)
@@ -408,6 +439,32 @@ protected:
     }
 #endif //STACK_STRING
 
+    //-------------------------------------------------------------------------
+    //Math values are pushed as full userdata holding a copy of the value, and
+    //read either from such userdata or from one number per component.
+    template<typename T> inline bool InnerIsValidValue()
+    {
+        return TestUserData(m_state, m_index, TypeKey<T>::Get()) || InnerIsValid<float>();
+    }
+    template<typename T> inline T InnerGetValue(T value)
+    {
+        if (T* data = static_cast<T*>(TestUserData(m_state, m_index, TypeKey<T>::Get())))
+        {
+            ++m_index;
+            return *data;
+        }
+        for (int i = 0; i < T::count; ++i)
+            value[i] = i ? Get<float>(value[i], true) : InnerGet<float>(value[i]);
+        return value;
+    }
+    template<typename T> inline int InnerPushValue(T const &value)
+    {
+        new (lua_newuserdata(m_state, sizeof(T))) T(value);
+        lua_rawgetp(m_state, LUA_REGISTRYINDEX, TypeKey<T>::Get());
+        lua_setmetatable(m_state, -2);
+        return 1;
+    }
+
     //-------------------------------------------------------------------------
 private:
     lua_State*  m_state = nullptr;
@@ -554,27 +611,87 @@ template<> inline int Stack::InnerPush<uint32_t>(uint32_t value)     { lua_pushi
 
 //-----------------------------------------------------------------------------
 #ifndef STACK_VEC2
-template<> inline bool Stack::InnerIsValid<vec2>()       { return InnerIsValid<float>(); }
-template<> inline vec2 Stack::InnerGet<vec2>(vec2 value) { return vec2(InnerGet<float>(value.x), Get<float>(value.y, true)); }
-template<> inline int Stack::InnerPush<vec2>(vec2 value) { return (InnerPush<float>(value.x) + InnerPush<float>(value.y)); }
+template<> inline bool Stack::InnerIsValid<vec2>()       { return InnerIsValidValue<vec2>(); }
+template<> inline vec2 Stack::InnerGet<vec2>(vec2 value) { return InnerGetValue<vec2>(value); }
+template<> inline int Stack::InnerPush<vec2>(vec2 value) { return InnerPushValue<vec2>(value); }
 #endif //STACK_VEC2
 
 //-----------------------------------------------------------------------------
 #ifndef STACK_VEC3
-template<> inline bool Stack::InnerIsValid<vec3>()       { return InnerIsValid<float>(); }
-template<> inline vec3 Stack::InnerGet<vec3>(vec3 value) { return vec3(InnerGet<float>(value.x), Get<float>(value.y, true), Get<float>(value.z, true)); }
-template<> inline int Stack::InnerPush<vec3>(vec3 value) { return (InnerPush<float>(value.x) + InnerPush<float>(value.y) + InnerPush<float>(value.z)); }
+template<> inline bool Stack::InnerIsValid<vec3>()       { return InnerIsValidValue<vec3>(); }
+template<> inline vec3 Stack::InnerGet<vec3>(vec3 value) { return InnerGetValue<vec3>(value); }
+template<> inline int Stack::InnerPush<vec3>(vec3 value) { return InnerPushValue<vec3>(value); }
 #endif //STACK_VEC3
 
 //-----------------------------------------------------------------------------
 #ifndef STACK_VEC4
-template<> inline bool Stack::InnerIsValid<vec4>()       { return InnerIsValid<float>(); }
-template<> inline vec4 Stack::InnerGet<vec4>(vec4 value) { return vec4(InnerGet<float>(value.x), Get<float>(value.y, true), Get<float>(value.z, true), Get<float>(value.w, true)); }
-template<> inline int Stack::InnerPush<vec4>(vec4 value) { return (InnerPush<float>(value.x) + InnerPush<float>(value.y) + InnerPush<float>(value.z) + InnerPush<float>(value.w)); }
+template<> inline bool Stack::InnerIsValid<vec4>()       { return InnerIsValidValue<vec4>(); }
+template<> inline vec4 Stack::InnerGet<vec4>(vec4 value) { return InnerGetValue<vec4>(value); }
+template<> inline int Stack::InnerPush<vec4>(vec4 value) { return InnerPushValue<vec4>(value); }
 #endif // STACK_VEC4
 
+//-----------------------------------------------------------------------------
+#ifndef STACK_QUAT
+template<> inline quat Stack::InnerDefault<quat>()       { return quat(1.f); }
+template<> inline bool Stack::InnerIsValid<quat>()       { return InnerIsValidValue<quat>(); }
+template<> inline quat Stack::InnerGet<quat>(quat value) { return InnerGetValue<quat>(value); }
+template<> inline int Stack::InnerPush<quat>(quat value) { return InnerPushValue<quat>(value); }
+#endif // STACK_QUAT
+
 #endif //REGION_STACK_VAR
 
+//-----------------------------------------------------------------------------
+// Method: a lua_CFunction generated from a member function pointer of a class
+// registered with ObjectHelper. The instance is the first Lua argument and
+// all the others are read in order; nothing is allocated on the C++ side.
+// Use it in method tables as { "Name", LOLUA_METHOD(&MyClass::Name) }.
+//-----------------------------------------------------------------------------
+template<typename R> struct MethodResult
+{
+    template<typename F> static int Push(Stack& s, F const& call) { s << call(); return s.End(); }
+};
+
+template<> struct MethodResult<void>
+{
+    template<typename F> static int Push(Stack& s, F const& call) { call(); return s.End(); }
+};
+
+template<typename M, M method> struct Method;
+
+#define LOLUA_METHOD_SPECIALIZATION(CONST) \
+    template<typename T, typename R, typename... A, R (T::*method)(A...) CONST> \
+    struct Method<R (T::*)(A...) CONST, method> \
+    { \
+        static int Call(lua_State* l) \
+        { \
+            return Invoke(l, std::index_sequence_for<A...>()); \
+        } \
+    \
+    private: \
+        template<size_t... I> \
+        static int Invoke(lua_State* l, std::index_sequence<I...>) \
+        { \
+            /* obj.Method() instead of obj:Method() passes no instance; \
+             * raise a script error instead of calling through null */ \
+            T** self = static_cast<T**>(TestUserData(l, 1, TypeKey<T>::Get())); \
+            if (!self || !*self) \
+                return luaL_argerror(l, 1, lua_pushfstring(l, "%s expected, call methods with ':'", \
+                                                           ObjectHelper::GetObjectName<T>())); \
+            auto s = Stack::Begin(l); \
+            T CONST* o = s.GetPtr<T>(); \
+            /* Braced initialisation evaluates the arguments in order */ \
+            std::tuple<typename std::decay<A>::type...> args { s.Get<typename std::decay<A>::type>()... }; \
+            return MethodResult<R>::Push(s, [&]() { return (o->*method)(std::get<I>(args)...); }); \
+        } \
+    };
+
+LOLUA_METHOD_SPECIALIZATION()
+LOLUA_METHOD_SPECIALIZATION(const)
+
+#undef LOLUA_METHOD_SPECIALIZATION
+
+#define LOLUA_METHOD(METHOD) (&Lolua::Method<decltype(METHOD), METHOD>::Call)
+
 //-----------------------------------------------------------------------------
 class Loader
 {
@@ -586,6 +703,10 @@ public:
     bool ExecLuaFile(std::string const &lua);
     bool ExecLuaCode(std::string const &lua);
 
+    /* Compile a Lua file on a worker thread; a later ExecLuaFile() on the
+     * same file then only has to load the resulting bytecode. */
+    static void Preload(std::string const &lua);
+
     //-------------------------------------------------------------------------
 #define DECLARE_LOADER_GET(T0, T1, GET_NAME) \
     template<typename T0> \
@@ -16,6 +16,10 @@
 
 #include <ostream> /* std::ostream */
 
+#if LOL_FEATURE_SSE2
+#   include <emmintrin.h>
+#endif
+
 namespace lol
 {
     //Test epsilon stuff
@@ -266,5 +270,93 @@ namespace lol
                 return false;
         return true;
     }
+
+    //--
+    frustum::frustum(mat4 const &m)
+    {
+        /* Gribb & Hartmann: each plane is the last row of the matrix
+         * plus or minus one of the three other rows. */
+        vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        for (int i = 0; i < 3; ++i)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+    }
+
+    //--
+    bool TestAABBVsFrustum(box3 const &aabb, frustum const &f)
+    {
+        /* A box is outside a plane if its corner furthest along the
+         * plane normal is behind it. */
+        vec3 c = aabb.center();
+        vec3 e = 0.5f * aabb.extent();
+        for (vec4 const &p : f.planes)
+            if (dot(p.xyz, c) + dot(abs(p.xyz), e) + p.w < 0.f)
+                return false;
+        return true;
+    }
+
+    //--
+    int TestAABBVsFrustum(box3 const *aabbs, int count, frustum const &f,
+                          bool *visible)
+    {
+        int ret = 0, i = 0;
+
+#if LOL_FEATURE_SSE2
+        /* Test four boxes per iteration, transposed so that each SIMD
+         * lane handles one box. */
+        __m128 const half = _mm_set1_ps(0.5f);
+        __m128 const zero = _mm_setzero_ps();
+        for ( ; i + 4 <= count; i += 4)
+        {
+            box3 const *b = aabbs + i;
+            __m128 ax = _mm_setr_ps(b[0].aa.x, b[1].aa.x, b[2].aa.x, b[3].aa.x);
+            __m128 ay = _mm_setr_ps(b[0].aa.y, b[1].aa.y, b[2].aa.y, b[3].aa.y);
+            __m128 az = _mm_setr_ps(b[0].aa.z, b[1].aa.z, b[2].aa.z, b[3].aa.z);
+            __m128 bx = _mm_setr_ps(b[0].bb.x, b[1].bb.x, b[2].bb.x, b[3].bb.x);
+            __m128 by = _mm_setr_ps(b[0].bb.y, b[1].bb.y, b[2].bb.y, b[3].bb.y);
+            __m128 bz = _mm_setr_ps(b[0].bb.z, b[1].bb.z, b[2].bb.z, b[3].bb.z);
+
+            __m128 cx = _mm_mul_ps(_mm_add_ps(ax, bx), half);
+            __m128 cy = _mm_mul_ps(_mm_add_ps(ay, by), half);
+            __m128 cz = _mm_mul_ps(_mm_add_ps(az, bz), half);
+            __m128 ex = _mm_mul_ps(_mm_sub_ps(bx, ax), half);
+            __m128 ey = _mm_mul_ps(_mm_sub_ps(by, ay), half);
+            __m128 ez = _mm_mul_ps(_mm_sub_ps(bz, az), half);
+
+            __m128 outside = zero;
+            for (vec4 const &p : f.planes)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(p.x)),
+                               _mm_mul_ps(cy, _mm_set1_ps(p.y))),
+                    _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(p.z)),
+                               _mm_set1_ps(p.w)));
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(lol::abs(p.x))),
+                               _mm_mul_ps(ey, _mm_set1_ps(lol::abs(p.y)))),
+                    _mm_mul_ps(ez, _mm_set1_ps(lol::abs(p.z))));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (int j = 0; j < 4; ++j)
+            {
+                visible[i + j] = !(mask & (1 << j));
+                ret += visible[i + j];
+            }
+        }
+#endif
+
+        for ( ; i < count; ++i)
+        {
+            visible[i] = TestAABBVsFrustum(aabbs[i], f);
+            ret += visible[i];
+        }
+        return ret;
+    }
 } /* namespace lol */
 
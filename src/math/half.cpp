@@ -10,6 +10,23 @@
 
 #include <lol/engine-internal.h>
 
+#if LOL_FEATURE_SSE2
+#   include <emmintrin.h>
+#   if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+#       define LOL_HALF_F16C 1
+#       include <immintrin.h>
+#       if defined _MSC_VER
+#           include <intrin.h>
+#       else
+#           include <cpuid.h>
+#       endif
+#   endif
+#endif
+
+#if LOL_FEATURE_NEON && defined __aarch64__
+#   include <arm_neon.h>
+#endif
+
 namespace lol
 {
 
@@ -219,13 +236,171 @@ half::operator float() const
     return u.f;
 }
 
+/*
+ * Bulk conversions. Floats are rounded exactly like makeaccurate() does;
+ * hardware conversions (F16C, NEON) round to nearest even, so they are
+ * only used for the half to float direction, which is always exact.
+ */
+
+#if LOL_FEATURE_SSE2
+/* Same algorithm as float_to_half_branch(), four values at a time. The
+ * denormal case lets the FPU do the variable shift: the float with its
+ * low 12 mantissa bits cleared, times 2^25, is the rounding input. */
+static inline __m128i float_to_half_sse2(__m128i x)
+{
+    __m128i const ax = _mm_and_si128(x, _mm_set1_epi32(0x7fffffff));
+    __m128i const sign = _mm_and_si128(_mm_srli_epi32(x, 16),
+                                       _mm_set1_epi32(0x8000));
+
+    __m128i normal = _mm_sub_epi32(_mm_srli_epi32(ax, 13),
+                                   _mm_set1_epi32(112 << 10));
+    normal = _mm_add_epi32(normal, _mm_and_si128(_mm_srli_epi32(ax, 12),
+                                                 _mm_set1_epi32(1)));
+
+    __m128 f = _mm_castsi128_ps(_mm_and_si128(ax, _mm_set1_epi32(0x7ffff000)));
+    __m128i t = _mm_cvttps_epi32(_mm_mul_ps(f, _mm_set1_ps(33554432.f)));
+    __m128i denormal = _mm_add_epi32(_mm_srli_epi32(t, 1),
+                                     _mm_and_si128(t, _mm_set1_epi32(1)));
+
+    __m128i nan = _mm_cmpgt_epi32(ax, _mm_set1_epi32(0x7f800000));
+    __m128i inf = _mm_or_si128(_mm_set1_epi32(0x7c00),
+                               _mm_and_si128(nan, _mm_set1_epi32(1)));
+
+    __m128i is_denormal = _mm_cmplt_epi32(ax, _mm_set1_epi32(113 << 23));
+    __m128i is_inf = _mm_cmpgt_epi32(ax, _mm_set1_epi32((143 << 23) - 1));
+    __m128i is_zero = _mm_cmplt_epi32(ax, _mm_set1_epi32(103 << 23));
+
+    __m128i ret = _mm_or_si128(_mm_and_si128(is_denormal, denormal),
+                               _mm_andnot_si128(is_denormal, normal));
+    ret = _mm_or_si128(_mm_and_si128(is_inf, inf),
+                       _mm_andnot_si128(is_inf, ret));
+    ret = _mm_andnot_si128(is_zero, ret);
+    return _mm_or_si128(ret, sign);
+}
+
+/* Same results as half_to_float_nobranch(): denormals are rebuilt by
+ * subtracting the implicit leading one from a normalised value. */
+static inline __m128i half_to_float_sse2(__m128i h)
+{
+    __m128i const sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i const em = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    __m128i const e = _mm_and_si128(h, _mm_set1_epi32(0x7c00));
+
+    __m128i normal = _mm_add_epi32(em, _mm_set1_epi32(112 << 23));
+    __m128i special = _mm_add_epi32(em, _mm_set1_epi32(224 << 23));
+    __m128 d = _mm_castsi128_ps(_mm_add_epi32(em, _mm_set1_epi32(113 << 23)));
+    __m128i denormal = _mm_castps_si128(_mm_sub_ps(d,
+                           _mm_castsi128_ps(_mm_set1_epi32(113 << 23))));
+
+    __m128i is_denormal = _mm_cmpeq_epi32(e, _mm_setzero_si128());
+    __m128i is_special = _mm_cmpeq_epi32(e, _mm_set1_epi32(0x7c00));
+
+    __m128i ret = _mm_or_si128(_mm_and_si128(is_special, special),
+                               _mm_andnot_si128(is_special, normal));
+    ret = _mm_or_si128(_mm_and_si128(is_denormal, denormal),
+                       _mm_andnot_si128(is_denormal, ret));
+    return _mm_or_si128(ret, sign);
+}
+#endif
+
+#if LOL_HALF_F16C
+/* F16C instructions are VEX-encoded, so the OS must also save the AVX
+ * state. The compiler’s own CPU detection is not available everywhere. */
+static bool has_f16c()
+{
+    unsigned int info[4] = { 0, 0, 0, 0 };
+#if defined _MSC_VER
+    __cpuid((int *)info, 1);
+#else
+    __get_cpuid(1, &info[0], &info[1], &info[2], &info[3]);
+#endif
+    if (!(info[2] & (1u << 29)) || !(info[2] & (1u << 27)))
+        return false;
+
+#if defined _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0, xcr0_hi;
+    __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+#endif
+    return (xcr0 & 6) == 6;
+}
+
+#if !defined _MSC_VER
+__attribute__((target("f16c")))
+#endif
+static size_t half_to_float_f16c(float *dst, uint16_t const *src, size_t nelem)
+{
+    size_t i = 0;
+    for ( ; i + 4 <= nelem; i += 4)
+    {
+        __m128i h = _mm_loadl_epi64((__m128i const *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(h));
+    }
+    return i;
+}
+#endif
+
+static size_t float_to_half_simd(uint16_t *dst, float const *src, size_t nelem)
+{
+    size_t i = 0;
+#if LOL_FEATURE_SSE2
+    /* Values are biased so that the signed saturating pack keeps them */
+    __m128i const bias = _mm_set1_epi32(0x8000);
+    for ( ; i + 8 <= nelem; i += 8)
+    {
+        __m128i a = float_to_half_sse2(_mm_loadu_si128((__m128i const *)(src + i)));
+        __m128i b = float_to_half_sse2(_mm_loadu_si128((__m128i const *)(src + i + 4)));
+        __m128i h = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_xor_si128(h, _mm_set1_epi16((short)0x8000)));
+    }
+#else
+    UNUSED(dst, src, nelem);
+#endif
+    return i;
+}
+
+static size_t half_to_float_simd(float *dst, uint16_t const *src, size_t nelem)
+{
+#if LOL_HALF_F16C
+    static bool const use_f16c = has_f16c();
+    if (use_f16c)
+        return half_to_float_f16c(dst, src, nelem);
+#endif
+
+    size_t i = 0;
+#if LOL_FEATURE_NEON && defined __aarch64__
+    for ( ; i + 4 <= nelem; i += 4)
+    {
+        float16x4_t h = vreinterpret_f16_u16(vld1_u16(src + i));
+        vst1q_f32(dst + i, vcvt_f32_f16(h));
+    }
+#elif LOL_FEATURE_SSE2
+    for ( ; i + 8 <= nelem; i += 8)
+    {
+        __m128i h = _mm_loadu_si128((__m128i const *)(src + i));
+        __m128i lo = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+        __m128i hi = _mm_unpackhi_epi16(h, _mm_setzero_si128());
+        _mm_storeu_si128((__m128i *)(dst + i), half_to_float_sse2(lo));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), half_to_float_sse2(hi));
+    }
+#else
+    UNUSED(dst, src, nelem);
+#endif
+    return i;
+}
+
 size_t half::convert(half *dst, float const *src, size_t nelem)
 {
-    for (size_t i = 0; i < nelem; i++)
+    static_assert(sizeof(half) == sizeof(uint16_t), "half must be 16-bit");
+
+    size_t i = float_to_half_simd((uint16_t *)dst, src, nelem);
+    for ( ; i < nelem; i++)
     {
         union { float f; uint32_t x; } u;
-        u.f = *src++;
-        *dst++ = makebits(float_to_half_nobranch(u.x));
+        u.f = src[i];
+        dst[i] = makebits(float_to_half_branch(u.x));
     }
 
     return nelem;
@@ -233,14 +408,15 @@ size_t half::convert(half *dst, float const *src, size_t nelem)
 
 size_t half::convert(float *dst, half const *src, size_t nelem)
 {
-    for (size_t i = 0; i < nelem; i++)
+    size_t i = half_to_float_simd(dst, (uint16_t const *)src, nelem);
+    for ( ; i < nelem; i++)
     {
         union { float f; uint32_t x; } u;
 
         /* This code is really too slow on the PS3, even with the denormal
          * handling stripped off. */
-        u.x = half_to_float_nobranch((*src++).bits);
-        *dst++ = u.f;
+        u.x = half_to_float_nobranch(src[i].bits);
+        dst[i] = u.f;
     }
 
     return nelem;
@@ -0,0 +1,211 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <cmath>
+#include <cstring>
+
+#if LOL_FEATURE_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace lol
+{
+
+/*
+ * Four xoshiro128** streams run side by side for bulk generation. The
+ * SSE2 and scalar versions produce the same values.
+ */
+
+namespace
+{
+
+#if LOL_FEATURE_SSE2
+struct rand_lanes
+{
+    rand_lanes(rand_engine &engine)
+    {
+        uint32_t init[4][4];
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; j += 2)
+            {
+                uint64_t x = engine.next();
+                init[i][j] = (uint32_t)x;
+                init[i][j + 1] = (uint32_t)(x >> 32);
+            }
+        for (int i = 0; i < 4; ++i)
+            s[i] = _mm_loadu_si128((__m128i const *)init[i]);
+    }
+
+    static inline __m128i rotl(__m128i x, int k)
+    {
+        return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+    }
+
+    /* Multiplications by 5 and 9 are done with shifts, as SSE2 has no
+     * 32-bit multiplication */
+    inline __m128i next()
+    {
+        __m128i x = _mm_add_epi32(_mm_slli_epi32(s[1], 2), s[1]);
+        x = rotl(x, 7);
+        __m128i ret = _mm_add_epi32(_mm_slli_epi32(x, 3), x);
+
+        __m128i t = _mm_slli_epi32(s[1], 9);
+        s[2] = _mm_xor_si128(s[2], s[0]);
+        s[3] = _mm_xor_si128(s[3], s[1]);
+        s[1] = _mm_xor_si128(s[1], s[2]);
+        s[0] = _mm_xor_si128(s[0], s[3]);
+        s[2] = _mm_xor_si128(s[2], t);
+        s[3] = rotl(s[3], 11);
+        return ret;
+    }
+
+    /* Four floats in [a, a + range) */
+    inline void next_float(float *out, float a, float range)
+    {
+        __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(next(), 8));
+        f = _mm_mul_ps(f, _mm_set1_ps(range * (1.f / 16777216.f)));
+        _mm_storeu_ps(out, _mm_add_ps(f, _mm_set1_ps(a)));
+    }
+
+    /* Four integers in [a, a + range), using the high half of a 32×32
+     * bit product instead of a modulo */
+    inline void next_int(int32_t *out, int32_t a, uint32_t range)
+    {
+        __m128i x = next(), r = _mm_set1_epi32((int)range);
+        __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, r), 32);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), r);
+        odd = _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0));
+        x = _mm_or_si128(even, odd);
+        _mm_storeu_si128((__m128i *)out, _mm_add_epi32(x, _mm_set1_epi32(a)));
+    }
+
+    __m128i s[4];
+};
+#else
+struct rand_lanes
+{
+    rand_lanes(rand_engine &engine)
+    {
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; j += 2)
+            {
+                uint64_t x = engine.next();
+                s[i][j] = (uint32_t)x;
+                s[i][j + 1] = (uint32_t)(x >> 32);
+            }
+    }
+
+    static inline uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    inline void next(uint32_t *out)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            out[j] = rotl(s[1][j] * 5, 7) * 9;
+
+            uint32_t t = s[1][j] << 9;
+            s[2][j] ^= s[0][j];
+            s[3][j] ^= s[1][j];
+            s[1][j] ^= s[2][j];
+            s[0][j] ^= s[3][j];
+            s[2][j] ^= t;
+            s[3][j] = rotl(s[3][j], 11);
+        }
+    }
+
+    inline void next_float(float *out, float a, float range)
+    {
+        uint32_t x[4];
+        next(x);
+        for (int j = 0; j < 4; ++j)
+            out[j] = (float)(int32_t)(x[j] >> 8)
+                   * (range * (1.f / 16777216.f)) + a;
+    }
+
+    inline void next_int(int32_t *out, int32_t a, uint32_t range)
+    {
+        uint32_t x[4];
+        next(x);
+        for (int j = 0; j < 4; ++j)
+            out[j] = (int32_t)((uint64_t)x[j] * range >> 32) + a;
+    }
+
+    uint32_t s[4][4];
+};
+#endif
+
+} /* namespace */
+
+void rand_engine::fill(float *data, size_t count, float a, float b)
+{
+    rand_lanes lanes(*this);
+
+    size_t i = 0;
+    for ( ; i + 4 <= count; i += 4)
+        lanes.next_float(data + i, a, b - a);
+
+    if (i < count)
+    {
+        float tail[4];
+        lanes.next_float(tail, a, b - a);
+        memcpy(data + i, tail, (count - i) * sizeof(float));
+    }
+}
+
+void rand_engine::fill(int32_t *data, size_t count, int32_t a, int32_t b)
+{
+    rand_lanes lanes(*this);
+    uint32_t range = (uint32_t)b - (uint32_t)a;
+
+    size_t i = 0;
+    for ( ; i + 4 <= count; i += 4)
+        lanes.next_int(data + i, a, range);
+
+    if (i < count)
+    {
+        int32_t tail[4];
+        lanes.next_int(tail, a, range);
+        memcpy(data + i, tail, (count - i) * sizeof(int32_t));
+    }
+}
+
+/* Box-Muller transform of uniform values, two at a time */
+void rand_engine::fill_normal(float *data, size_t count, float mean, float stddev)
+{
+    fill(data, count);
+
+    auto transform = [mean, stddev](float &x, float &y)
+    {
+        float r = stddev * std::sqrt(-2.f * std::log(1.f - x));
+        float theta = 6.28318530718f * y;
+        x = mean + r * std::cos(theta);
+        y = mean + r * std::sin(theta);
+    };
+
+    for (size_t i = 0; i + 2 <= count; i += 2)
+        transform(data[i], data[i + 1]);
+
+    if (count & 1)
+    {
+        float x = next_float(), y = next_float();
+        transform(x, y);
+        data[count - 1] = x;
+    }
+}
+
+} /* namespace lol */
+
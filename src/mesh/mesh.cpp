@@ -39,16 +39,28 @@ void Mesh::Render(Scene& scene, mat4 const &matrix)
     }
 }
 
-void Mesh::Render()
+void Mesh::Render(Scene& scene, array<mat4> const &matrices)
 {
     for (int i = 0; i < m_submeshes.count(); ++i)
+        scene.AddPrimitiveRenderer(this, new PrimitiveMeshBatch(m_submeshes[i], matrices));
+}
+
+void Mesh::Render()
+{
+    int const count = GetDrawnSubMeshCount();
+    for (int i = 0; i < count; ++i)
         m_submeshes[i]->Render();
 }
 
 void Mesh::SetMaterial(Shader *shader)
 {
+    /* The instanced variant belongs to the previous material; batches
+     * fall back to drawing copies one by one with the new shader */
     for (int i = 0; i < m_submeshes.count(); ++i)
+    {
         m_submeshes[i]->SetShader(shader);
+        m_submeshes[i]->SetInstanceShader(nullptr);
+    }
 }
 
 /*
@@ -58,6 +70,7 @@ void Mesh::SetMaterial(Shader *shader)
 SubMesh::SubMesh(Shader *shader, VertexDeclaration *vdecl)
   : m_mesh_prim(MeshPrimitive::Triangles),
     m_shader(shader),
+    m_instance_shader(nullptr),
     m_vdecl(vdecl)
 {
     Ticker::Ref(m_shader);
@@ -66,6 +79,8 @@ SubMesh::SubMesh(Shader *shader, VertexDeclaration *vdecl)
 SubMesh::~SubMesh()
 {
     Ticker::Unref(m_shader);
+    if (m_instance_shader)
+        Ticker::Unref(m_instance_shader);
     // TODO: cleanup
 }
 
@@ -86,6 +101,20 @@ Shader *SubMesh::GetShader()
     return m_shader;
 }
 
+void SubMesh::SetInstanceShader(Shader *shader)
+{
+    if (m_instance_shader)
+        Ticker::Unref(m_instance_shader);
+    m_instance_shader = shader;
+    if (m_instance_shader)
+        Ticker::Ref(m_instance_shader);
+}
+
+Shader *SubMesh::GetInstanceShader()
+{
+    return m_instance_shader;
+}
+
 void SubMesh::SetVertexDeclaration(VertexDeclaration *vdecl)
 {
     m_vdecl = vdecl;
@@ -110,6 +139,13 @@ void SubMesh::AddTexture(std::string const &name, Texture* texture)
 }
 
 void SubMesh::Render()
+{
+    Bind(m_shader);
+    m_vdecl->DrawIndexedElements(MeshPrimitive::Triangles, m_ibo->GetSize() / sizeof(uint16_t));
+    Unbind();
+}
+
+void SubMesh::Bind(Shader *shader)
 {
     int vertex_count = 0;
 
@@ -129,7 +165,7 @@ void SubMesh::Render()
         {
             VertexUsage usage = stream.GetUsage(j);
             int usage_index = usage.ToScalar();
-            attribs[j] = m_shader->GetAttribLocation(usage, usages[usage_index]++);
+            attribs[j] = shader->GetAttribLocation(usage, usages[usage_index]++);
         }
 
         vertex_count += m_vbos[i]->GetSize() / m_vdecl->GetStream(i).GetSize();
@@ -142,13 +178,16 @@ void SubMesh::Render()
     for (int i = 0; i < m_textures.count(); ++i)
     {
         // TODO: might be good to cache this
-        ShaderUniform u_tex = m_shader->GetUniformLocation(m_textures[i].m1);
-        m_shader->SetUniform(u_tex, m_textures[i].m2->GetTextureUniform(), i);
+        ShaderUniform u_tex = shader->GetUniformLocation(m_textures[i].m1);
+        shader->SetUniform(u_tex, m_textures[i].m2->GetTextureUniform(), i);
     }
 
     m_ibo->Bind();
     m_vdecl->Bind();
-    m_vdecl->DrawIndexedElements(MeshPrimitive::Triangles, m_ibo->GetSize() / sizeof(uint16_t));
+}
+
+void SubMesh::Unbind()
+{
     m_vdecl->Unbind();
     m_ibo->Unbind();
 }
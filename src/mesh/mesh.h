@@ -55,17 +55,23 @@ class Mesh
 
 public:
     Mesh();
-    ~Mesh();
+    virtual ~Mesh();
 
     /* FIXME: this should eventually take a “material” as argument, which
-     * may behave differently between submeshes. */
+     * may behave differently between submeshes. Instance shaders are
+     * cleared, since they were variants of the previous material. */
     void SetMaterial(Shader *shader);
 
     //TODO: Not sure about the name
-    void Render(Scene& scene, mat4 const &matrix);
+    virtual void Render(Scene& scene, mat4 const &matrix);
+    /* Draw one copy of the mesh per matrix, batching them per submesh */
+    virtual void Render(Scene& scene, array<mat4> const &matrices);
 
 protected:
     void Render();
+    /* How many submeshes, from the first, Render() draws; subclasses
+     * may keep alternative versions of the mesh after them */
+    virtual int GetDrawnSubMeshCount() const { return m_submeshes.count(); }
 
 public:
     array<class SubMesh *> m_submeshes;
@@ -82,6 +88,7 @@ public:
 class SubMesh
 {
     friend class PrimitiveMesh;
+    friend class PrimitiveMeshBatch;
     friend class Mesh;
 
 public:
@@ -96,11 +103,22 @@ public:
     void SetIndexBuffer(IndexBuffer* ibo);
     void AddTexture(std::string const &name, Texture* texture);
 
+    /* The shader used to draw several copies at once. It reads the model
+     * matrix columns from in_Instance0 to in_Instance3 instead of using
+     * u_model, and derives its normal matrix itself. */
+    void SetInstanceShader(Shader *shader);
+    Shader *GetInstanceShader();
+
 protected:
     void Render();
 
+    /* Set up the streams, textures and index buffer for drawing with
+     * the given shader, which must already be bound. */
+    void Bind(Shader *shader);
+    void Unbind();
+
     MeshPrimitive m_mesh_prim;
-    Shader *m_shader;
+    Shader *m_shader, *m_instance_shader;
     VertexDeclaration* m_vdecl;
     array<VertexBuffer *> m_vbos;
     IndexBuffer *m_ibo;
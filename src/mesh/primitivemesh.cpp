@@ -35,59 +35,189 @@ void PrimitiveMesh::Render(Scene& scene, PrimitiveSource* primitive)
     /* TODO: this should be the main entry for rendering of all
     * primitives found in the scene graph. When we have one. */
 
-    Shader *shader = nullptr;
-    ShaderUniform u_model, u_modelview, u_normalmat, uni_tex, uni_texsize;
-    ShaderAttrib a_pos, a_tex;
+    /* FIXME: ignored for now */
+    UNUSED(scene, primitive);
+
+    /* Camera and lights come from the per-frame scene data that
+     * Scene::render() uploaded; only per-object matrices are set here. */
+    Shader *shader = m_submesh->GetShader();
+
+    /* Skip the draw rather than stall while the driver is still
+     * compiling the shader on its own threads */
+    if (!shader->IsReady())
+        return;
+
+    shader->Bind();
+    shader->SetModelMatrix(m_matrix);
+
+    m_submesh->Render();
+}
+
+/*
+ * PrimitiveMeshBatch class
+ */
+
+namespace
+{
+
+/* Model matrices of the batch being drawn. They are uploaded right
+ * before each draw, so all batches can share the same buffer. */
+VertexBuffer *instance_vbo = nullptr;
+VertexDeclaration *instance_vdecl = nullptr;
+
+} /* namespace */
+
+PrimitiveMeshBatch::PrimitiveMeshBatch()
+  : m_last_run(-1),
+    m_grouped(true)
+{
+}
+
+PrimitiveMeshBatch::PrimitiveMeshBatch(SubMesh *submesh, array<mat4> const &matrices)
+  : PrimitiveMeshBatch()
+{
+    Add(submesh, matrices);
+}
+
+PrimitiveMeshBatch::~PrimitiveMeshBatch()
+{
+}
+
+int PrimitiveMeshBatch::FindRun(SubMesh *submesh)
+{
+    /* There are usually very few distinct submeshes, and consecutive
+     * copies are often of the same one. */
+    if (m_last_run >= 0 && m_runs[m_last_run].submesh == submesh)
+        return m_last_run;
+
+    int n = 0;
+    while (n < m_runs.count() && m_runs[n].submesh != submesh)
+        ++n;
+    if (n == m_runs.count())
+        m_runs.push(run { submesh, 0, 0 });
+
+    /* Copies of a submesh that already had some are no longer together */
+    if (m_runs[n].count)
+        m_grouped = false;
+    return m_last_run = n;
+}
+
+void PrimitiveMeshBatch::Add(SubMesh *submesh, mat4 const &matrix)
+{
+    int n = FindRun(submesh);
+    ++m_runs[n].count;
+    m_run_of << n;
+    m_matrices << matrix;
+}
+
+void PrimitiveMeshBatch::Add(SubMesh *submesh, array<mat4> const &matrices)
+{
+    int n = FindRun(submesh);
+    m_runs[n].count += matrices.count();
+    m_run_of.resize(m_run_of.count() + matrices.count(), n);
+    m_matrices.reserve(m_matrices.count() + matrices.count());
+    for (mat4 const &m : matrices)
+        m_matrices << m;
+}
+
+void PrimitiveMeshBatch::Prepare()
+{
+    int first = 0;
+    for (run &r : m_runs)
+    {
+        r.first = first;
+        first += r.count;
+    }
+
+    if (m_grouped)
+        return;
+
+    /* Move each matrix to its run, keeping the order they were added in */
+    array<mat4> sorted;
+    sorted.resize(m_matrices.count());
+    array<int> cursor;
+    for (run const &r : m_runs)
+        cursor << r.first;
+    for (int i = 0; i < m_matrices.count(); ++i)
+        sorted[cursor[m_run_of[i]]++] = m_matrices[i];
+
+    for (int n = 0; n < m_runs.count(); ++n)
+        for (int i = m_runs[n].first; i < m_runs[n].first + m_runs[n].count; ++i)
+            m_run_of[i] = n;
+
+    m_matrices = std::move(sorted);
+    m_grouped = true;
+    m_last_run = -1;
+}
 
+void PrimitiveMeshBatch::Render(Scene& scene, PrimitiveSource* primitive)
+{
     /* FIXME: ignored for now */
-    UNUSED(primitive);
+    UNUSED(scene, primitive);
+
+    if (!m_runs.count())
+        return;
 
+    Prepare();
+
+    SubMesh *first = m_runs[0].submesh;
+    Shader *shader = first->m_instance_shader;
+    bool instanced = shader && shader->IsReady()
+                      && VertexDeclaration::HasInstancing();
+    if (!instanced)
+        shader = first->m_shader;
+    if (!shader->IsReady())
+        return;
+    shader->Bind();
+
+    ShaderAttrib attribs[12];
+    if (instanced)
     {
-        /* If this primitive uses a new shader, update attributes */
-        if (m_submesh->GetShader() != shader)
+        size_t bytes = m_matrices.bytes();
+        if (!instance_vbo || instance_vbo->GetSize() < bytes)
         {
-            shader = m_submesh->GetShader();
-
-            a_pos = shader->GetAttribLocation(VertexUsage::Position, 0);
-            a_tex = shader->GetAttribLocation(VertexUsage::TexCoord, 0);
-
-            shader->Bind();
-
-            /* Per-scene matrices */
-            ShaderUniform u_mat;
-            u_mat = shader->GetUniformLocation("u_projection");
-            shader->SetUniform(u_mat, scene.GetCamera()->GetProjection());
-            u_mat = shader->GetUniformLocation("u_view");
-            shader->SetUniform(u_mat, scene.GetCamera()->GetView());
-            u_mat = shader->GetUniformLocation("u_inv_view");
-            shader->SetUniform(u_mat, inverse(scene.GetCamera()->GetView()));
-
-            /* Per-object matrices, will be set later */
-            u_model = shader->GetUniformLocation("u_model");
-            u_modelview = shader->GetUniformLocation("u_modelview");
-            u_normalmat = shader->GetUniformLocation("u_normalmat");
-
-            /* Per-scene environment */
-            array<Light *> const &lights = scene.GetLights();
-            array<vec4> light_data;
-
-            /* FIXME: the 4th component of the position can be used for other things */
-            /* FIXME: GetUniform("blabla") is costly */
-            for (auto l : lights)
-                light_data << vec4(l->GetPosition(), (float)l->GetType()) << l->GetColor();
-            while (light_data.count() < LOL_MAX_LIGHT_COUNT)
-                light_data << vec4::zero << vec4::zero;
-
-            ShaderUniform u_lights = shader->GetUniformLocation("u_lights");
-            shader->SetUniform(u_lights, light_data);
+            delete instance_vbo;
+            instance_vbo = new VertexBuffer(bytes * 2);
         }
+        if (!instance_vdecl)
+            instance_vdecl = new VertexDeclaration(
+                VertexStream<vec4, vec4, vec4, vec4>(VertexUsage::Instance,
+                                                     VertexUsage::Instance,
+                                                     VertexUsage::Instance,
+                                                     VertexUsage::Instance));
+
+        memcpy(instance_vbo->Lock(0, bytes), m_matrices.data(), bytes);
+        instance_vbo->Unlock();
+
+        for (int i = 0; i < 4; ++i)
+            attribs[i] = shader->GetAttribLocation(VertexUsage::Instance, i);
+    }
 
-        shader->SetUniform(u_model, m_matrix);
-        mat4 modelview = scene.GetCamera()->GetView() * m_matrix;
-        shader->SetUniform(u_modelview, modelview);
-        shader->SetUniform(u_normalmat, transpose(inverse(mat3(modelview))));
-
-        m_submesh->Render();
+    for (run const &r : m_runs)
+    {
+        SubMesh *submesh = r.submesh;
+        ASSERT(submesh->m_shader == first->m_shader
+                && submesh->m_vdecl == first->m_vdecl,
+               "batched submeshes must share a shader and a vertex declaration\n");
+
+        int count = (int)(submesh->m_ibo->GetSize() / sizeof(uint16_t));
+        submesh->Bind(shader);
+        if (instanced)
+        {
+            instance_vdecl->SetStream(instance_vbo, attribs, r.first);
+            submesh->m_vdecl->DrawIndexedElementsInstanced(MeshPrimitive::Triangles,
+                                                           count, r.count);
+            instance_vdecl->Unbind();
+        }
+        else
+        {
+            for (int i = r.first; i < r.first + r.count; ++i)
+            {
+                shader->SetModelMatrix(m_matrices[i]);
+                submesh->m_vdecl->DrawIndexedElements(MeshPrimitive::Triangles, count);
+            }
+        }
+        submesh->Unbind();
     }
 }
 
@@ -32,5 +32,47 @@ private:
     mat4 m_matrix;
 };
 
+/*
+ * Draws many copies of submeshes sharing a shader and a vertex
+ * declaration, such as the levels of detail of a mesh. The shader is
+ * bound once, and each submesh is drawn with a single instanced call
+ * that reads its model matrices from a per-instance stream, using the
+ * submesh's instance shader. Without one, or without driver support,
+ * the submeshes fall back to one draw per copy.
+ */
+
+class PrimitiveMeshBatch : public PrimitiveRenderer
+{
+public:
+    PrimitiveMeshBatch();
+    PrimitiveMeshBatch(SubMesh *submesh, array<mat4> const &matrices);
+    virtual ~PrimitiveMeshBatch();
+
+    void Add(SubMesh *submesh, mat4 const &matrix);
+    void Add(SubMesh *submesh, array<mat4> const &matrices);
+
+    /* Group the model matrices by submesh. This is called by Render()
+     * and does not touch the GPU or the submeshes themselves. */
+    void Prepare();
+
+    int GetDrawCount() const { return m_runs.count(); }
+    array<mat4> const &GetMatrices() const { return m_matrices; }
+
+    virtual void Render(Scene& scene, PrimitiveSource* primitive);
+
+private:
+    int FindRun(SubMesh *submesh);
+
+    /* Copies of one submesh; after Prepare() their matrices are
+     * m_matrices[first] to m_matrices[first + count - 1]. */
+    struct run { SubMesh *submesh; int first, count; };
+
+    array<run> m_runs;
+    array<mat4> m_matrices;
+    array<int> m_run_of;
+    int m_last_run;
+    bool m_grouped;
+};
+
 } /* namespace lol */
 
@@ -0,0 +1,209 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <cfloat>
+
+#include "simd.h"
+
+namespace lol
+{
+
+/*
+ * ParticleSystem implementation
+ */
+
+ParticleSystem::ParticleSystem()
+  : m_gravity(0.f),
+    m_drag(0.f),
+    m_kill_height(-FLT_MAX),
+    m_vertices(nullptr),
+    m_texcoords(nullptr)
+{
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    delete m_vertices;
+    delete m_texcoords;
+}
+
+void ParticleSystem::Emit(int id, vec3 const &pos, vec3 const &vel,
+                          float lifetime)
+{
+    m_data[PX].push(pos.x);
+    m_data[PY].push(pos.y);
+    m_data[PZ].push(pos.z);
+    m_data[VX].push(vel.x);
+    m_data[VY].push(vel.y);
+    m_data[VZ].push(vel.z);
+    m_data[LIFE].push(lifetime < 0.f ? FLT_MAX : lifetime);
+    m_ids.push(id);
+}
+
+void ParticleSystem::Clear()
+{
+    for (int c = 0; c < COMPONENT_COUNT; ++c)
+        m_data[c].empty();
+    m_ids.empty();
+}
+
+vec3 ParticleSystem::GetPosition(int index) const
+{
+    return vec3(m_data[PX][index], m_data[PY][index], m_data[PZ][index]);
+}
+
+vec3 ParticleSystem::GetVelocity(int index) const
+{
+    return vec3(m_data[VX][index], m_data[VY][index], m_data[VZ][index]);
+}
+
+void ParticleSystem::Update(float seconds)
+{
+    int const count = m_ids.count();
+
+    thread_pool &pool = thread_pool::get();
+    int jobs = 1;
+    while (jobs * 2 <= pool.count()
+            && jobs < 16 && count / (jobs * 2) >= PARALLEL_UPDATE_THRESHOLD)
+        jobs *= 2;
+
+    /* Split on multiples of four so that no block straddles two jobs */
+    pool.run(jobs, [this, count, jobs, seconds](int i)
+    {
+        int start = (int)((int64_t)count * i / jobs) & ~3;
+        int end = i + 1 < jobs ? (int)((int64_t)count * (i + 1) / jobs) & ~3
+                               : count;
+        UpdateRange(start, end, seconds);
+    });
+
+    /* Remove dead particles by moving the last one in their place; the
+     * moved particle is checked again before going further. */
+    for (int i = 0; i < m_ids.count(); )
+    {
+        if (m_data[LIFE][i] > 0.f && m_data[PY][i] >= m_kill_height)
+        {
+            ++i;
+            continue;
+        }
+
+        for (int c = 0; c < COMPONENT_COUNT; ++c)
+            m_data[c].remove_swap(i);
+        m_ids.remove_swap(i);
+    }
+}
+
+void ParticleSystem::UpdateRange(int start, int end, float seconds)
+{
+    int i = start;
+
+#if LOL_FEATURE_SSE2
+    for ( ; i + lane4::width <= end; i += lane4::width)
+        UpdateBlock<lane4>(i, seconds);
+#endif
+    for ( ; i < end; ++i)
+        UpdateBlock<lane1>(i, seconds);
+}
+
+template<typename F>
+void ParticleSystem::UpdateBlock(int index, float seconds)
+{
+    auto load = [this, index](int c) { return F::load(m_data[c].data() + index); };
+    auto store = [this, index](int c, F x) { x.store(m_data[c].data() + index); };
+
+    F const dt(seconds), h(0.5f * seconds);
+    F const damping(max(0.f, 1.f - m_drag * seconds));
+
+    /* Trapezoidal integration of the position, as the velocity changes
+     * linearly over the time step. */
+    for (int k = 0; k < 3; ++k)
+    {
+        F v = load(VX + k);
+        F nv = (v + F(m_gravity[k]) * dt) * damping;
+        store(VX + k, nv);
+        store(PX + k, load(PX + k) + (v + nv) * h);
+    }
+
+    store(LIFE, load(LIFE) - dt);
+}
+
+void ParticleSystem::Fill(vec3 *vertices, vec2 *texcoords,
+                          ivec2 const *tile_sizes,
+                          box2 const *tile_texels) const
+{
+    float const *px = m_data[PX].data();
+    float const *py = m_data[PY].data();
+    float const *pz = m_data[PZ].data();
+
+    for (int i = 0; i < m_ids.count(); ++i)
+    {
+        int id = m_ids[i];
+        vec2 a(px[i], py[i]), b = a + (vec2)tile_sizes[id];
+        float z = pz[i];
+
+        *vertices++ = vec3(b.x, b.y, z);
+        *vertices++ = vec3(a.x, b.y, z);
+        *vertices++ = vec3(b.x, a.y, z);
+        *vertices++ = vec3(b.x, a.y, z);
+        *vertices++ = vec3(a.x, b.y, z);
+        *vertices++ = vec3(a.x, a.y, z);
+
+        box2 const &t = tile_texels[id];
+        *texcoords++ = vec2(t.bb.x, t.aa.y);
+        *texcoords++ = vec2(t.aa.x, t.aa.y);
+        *texcoords++ = vec2(t.bb.x, t.bb.y);
+        *texcoords++ = vec2(t.bb.x, t.bb.y);
+        *texcoords++ = vec2(t.aa.x, t.aa.y);
+        *texcoords++ = vec2(t.aa.x, t.bb.y);
+    }
+}
+
+void ParticleSystem::Render(Scene &scene, TileSet *tileset)
+{
+    int const count = m_ids.count();
+
+    /* Nothing can be drawn until the tileset texture is uploaded */
+    if (!count || !tileset->GetTexture())
+        return;
+
+    m_tile_sizes.empty();
+    m_tile_texels.empty();
+    for (int id = 0; id < tileset->GetTileCount(); ++id)
+    {
+        m_tile_sizes.push(tileset->GetTileSize(id));
+        m_tile_texels.push(tileset->GetTileTexel(id));
+    }
+
+    /* Grow the buffers by powers of two so that they get reallocated
+     * only a few times during the lifetime of the system. */
+    size_t needed = 6 * sizeof(vec3) * count;
+    if (!m_vertices || m_vertices->GetSize() < needed)
+    {
+        size_t capacity = 6 * PotUp((size_t)count);
+        delete m_vertices;
+        delete m_texcoords;
+        m_vertices = new VertexBuffer(capacity * sizeof(vec3));
+        m_texcoords = new VertexBuffer(capacity * sizeof(vec2));
+    }
+
+    vec3 *vertices = (vec3 *)m_vertices->Lock(0, 0);
+    vec2 *texcoords = (vec2 *)m_texcoords->Lock(0, 0);
+    Fill(vertices, texcoords, m_tile_sizes.data(), m_tile_texels.data());
+    m_vertices->Unlock();
+    m_texcoords->Unlock();
+
+    scene.AddTileBuffer(tileset, m_vertices, m_texcoords, count);
+}
+
+} /* namespace lol */
+
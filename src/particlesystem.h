@@ -0,0 +1,100 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// The ParticleSystem class
+// ------------------------
+// Particle positions, velocities and lifetimes stored as one contiguous
+// array per component. Updating is a single pass over the arrays, four
+// particles at a time when SSE2 is available and split across several
+// threads for large systems. Dead particles are removed by moving the
+// last one in their place, and the survivors are written straight into
+// vertex buffers that are reused from one frame to the next.
+//
+
+#include <lol/base/array.h>
+#include <lol/math/geometry.h>
+
+namespace lol
+{
+
+class Scene;
+class TileSet;
+class VertexBuffer;
+
+class ParticleSystem
+{
+public:
+    ParticleSystem();
+    ~ParticleSystem();
+
+    void SetGravity(vec3 const &gravity) { m_gravity = gravity; }
+    vec3 GetGravity() const { return m_gravity; }
+
+    /* Fraction of the velocity lost per second */
+    void SetDrag(float drag) { m_drag = drag; }
+    float GetDrag() const { return m_drag; }
+
+    /* Particles falling below this height are removed */
+    void SetKillHeight(float height) { m_kill_height = height; }
+    float GetKillHeight() const { return m_kill_height; }
+
+    /* A negative lifetime means the particle never expires */
+    void Emit(int id, vec3 const &pos, vec3 const &vel, float lifetime = -1.f);
+    void Clear();
+    inline int GetCount() const { return m_ids.count(); }
+
+    vec3 GetPosition(int index) const;
+    vec3 GetVelocity(int index) const;
+    inline int GetId(int index) const { return m_ids[index]; }
+
+    /* Integrate all particles, then remove the dead ones */
+    void Update(float seconds);
+
+    /* Write six vertices per particle, as two triangles covering the
+     * tile, the same way Scene::AddTile would place them. */
+    void Fill(vec3 *vertices, vec2 *texcoords,
+              ivec2 const *tile_sizes, box2 const *tile_texels) const;
+
+    /* Fill the vertex buffers and hand them over to the scene */
+    void Render(Scene &scene, TileSet *tileset);
+
+private:
+    enum
+    {
+        PX, PY, PZ, VX, VY, VZ, LIFE,
+        COMPONENT_COUNT
+    };
+
+    /* Number of particles above which updates use several threads */
+    static int const PARALLEL_UPDATE_THRESHOLD = 65536;
+
+    /* Process particles index to index + F::width - 1 */
+    template<typename F> void UpdateBlock(int index, float seconds);
+    void UpdateRange(int start, int end, float seconds);
+
+    array<float> m_data[COMPONENT_COUNT];
+    array<int> m_ids;
+
+    vec3 m_gravity;
+    float m_drag, m_kill_height;
+
+    /* Streaming buffers, and per tile data for the tileset in use */
+    VertexBuffer *m_vertices, *m_texcoords;
+    array<ivec2> m_tile_sizes;
+    array<box2> m_tile_texels;
+};
+
+} /* namespace lol */
+
@@ -52,9 +52,12 @@ void Profiler::Start(int id)
 
 void Profiler::Stop(int id)
 {
-    float seconds = data[id].m_timer.get();
+    Record(id, data[id].m_timer.get());
+}
 
-    data[id].history[Ticker::GetFrameNum() % ProfilerData::HISTORY] = seconds;
+void Profiler::Record(int id, float value)
+{
+    data[id].history[Ticker::GetFrameNum() % ProfilerData::HISTORY] = value;
     data[id].avg = 0.0f;
     data[id].max = 0.0f;
 
@@ -14,6 +14,8 @@
 // The Profiler class
 // -------------------
 // The Profiler is a static class that collects statistic counters.
+// Timings are measured with Start() and Stop(); other values such as
+// object counts can be fed to the same history with Record().
 //
 
 #include <stdint.h>
@@ -30,6 +32,10 @@ public:
         STAT_TICK_GAME,
         STAT_TICK_DRAW,
         STAT_TICK_BLIT,
+        STAT_DRAW_VISIBLE,
+        STAT_DRAW_CULLED,
+        STAT_DRAW_UNIFORMS,
+        STAT_DRAW_UNIFORMS_SKIPPED,
         STAT_USER_00,
         STAT_USER_01,
         STAT_USER_02,
@@ -45,6 +51,7 @@ public:
 
     static void Start(int id);
     static void Stop(int id);
+    static void Record(int id, float value);
     static float GetAvg(int id);
     static float GetMax(int id);
 
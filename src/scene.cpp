@@ -51,6 +51,17 @@ struct Tile
     int m_id;
 };
 
+/*
+ * Quads already written to vertex buffers, drawn with the tiles
+ */
+
+struct TileBuffer
+{
+    TileSet *m_tileset;
+    VertexBuffer *m_vertices, *m_texcoords;
+    int m_quads;
+};
+
 //-----------------------------------------------------------------------------
 static array<SceneDisplay*> m_scene_displays;
 
@@ -161,8 +172,8 @@ private:
      * - Updated by entity
      * - Marked Fire&Forget
      * - Scene is destroyed */
-    std::map<uintptr_t, array<PrimitiveRenderer*>> m_prim_renderers;
-    static std::map<uintptr_t, array<PrimitiveSource*>> m_prim_sources;
+    hash_map<uintptr_t, array<PrimitiveRenderer*>> m_prim_renderers;
+    static hash_map<uintptr_t, array<PrimitiveSource*>> m_prim_sources;
     static mutex m_prim_mutex;
 
     Camera *m_default_cam;
@@ -186,6 +197,7 @@ private:
         int m_cam;
         array<Tile> m_tiles;
         array<Tile> m_palettes;
+        array<TileBuffer> m_buffers;
         array<Light *> m_lights;
 
         Shader *m_shader;
@@ -197,7 +209,7 @@ private:
     m_tile_api;
 };
 uint64_t SceneData::m_used_id = 1;
-std::map<uintptr_t, array<PrimitiveSource*>> SceneData::m_prim_sources;
+hash_map<uintptr_t, array<PrimitiveSource*>> SceneData::m_prim_sources;
 mutex SceneData::m_prim_mutex;
 
 /*
@@ -210,8 +222,15 @@ Scene::Scene(ivec2 size)
     data->m_renderbuffer[1] = new Framebuffer(size);
     data->m_renderbuffer[2] = new Framebuffer(size);
     data->m_renderbuffer[3] = new Framebuffer(size);
+
+    /* Create all engine shaders before using any of them, so that the
+     * driver may compile them in parallel. */
     data->m_pp.m_shader[0] = Shader::Create(LOLFX_RESOURCE_NAME(gpu_blit));
     data->m_pp.m_shader[1] = Shader::Create(LOLFX_RESOURCE_NAME(gpu_postprocess));
+    data->m_tile_api.m_shader = Shader::Create(LOLFX_RESOURCE_NAME(gpu_tile));
+    data->m_tile_api.m_palette_shader = Shader::Create(LOLFX_RESOURCE_NAME(gpu_palette));
+    data->m_line_api.m_shader = Shader::Create(LOLFX_RESOURCE_NAME(gpu_line));
+
     data->m_pp.m_coord[0] = data->m_pp.m_shader[0]->GetAttribLocation(VertexUsage::Position, 0);
     data->m_pp.m_coord[1] = data->m_pp.m_shader[1]->GetAttribLocation(VertexUsage::Position, 0);
     data->m_pp.m_vdecl = new VertexDeclaration(VertexStream<vec2>(VertexUsage::Position));
@@ -235,12 +254,9 @@ Scene::Scene(ivec2 size)
     PushCamera(data->m_default_cam);
 
     data->m_tile_api.m_cam = -1;
-    data->m_tile_api.m_shader = 0;
-    data->m_tile_api.m_palette_shader = 0;
     data->m_tile_api.m_vdecl = new VertexDeclaration(VertexStream<vec3>(VertexUsage::Position),
                                                      VertexStream<vec2>(VertexUsage::TexCoord));
 
-    data->m_line_api.m_shader = 0;
     data->m_line_api.m_vdecl = new VertexDeclaration(VertexStream<vec4,vec4>(VertexUsage::Position, VertexUsage::Color));
 
     data->m_line_api.m_debug_mask = 1;
@@ -529,6 +545,19 @@ void Scene::AddTile(TileSet *tileset, int id, mat4 model)
         data->m_tile_api.m_tiles.push(t);
 }
 
+void Scene::AddTileBuffer(TileSet *tileset, VertexBuffer *vertices,
+                          VertexBuffer *texcoords, int quads)
+{
+    ASSERT(!!data, "Trying to access a non-ready scene");
+
+    TileBuffer b;
+    b.m_tileset = tileset;
+    b.m_vertices = vertices;
+    b.m_texcoords = texcoords;
+    b.m_quads = quads;
+    data->m_tile_api.m_buffers.push(b);
+}
+
 //-----------------------------------------------------------------------------
 void Scene::AddLine(vec3 a, vec3 b, vec4 color)
 {
@@ -611,6 +640,23 @@ void Scene::render(float seconds)
 {
     gpu_marker("Render");
 
+    /* Upload the camera and lights once for all shaders */
+    ShaderSceneData scene_data;
+    scene_data.projection = GetCamera()->GetProjection();
+    scene_data.view = GetCamera()->GetView();
+    scene_data.inv_view = inverse(scene_data.view);
+
+    /* FIXME: the 4th component of the position can be used for other things */
+    array<Light *> const &lights = GetLights();
+    for (int i = 0; i < LOL_MAX_LIGHT_COUNT; ++i)
+    {
+        Light *l = i < lights.count() ? lights[i] : nullptr;
+        scene_data.lights[2 * i] = l ? vec4(l->GetPosition(), (float)l->GetType()) : vec4::zero;
+        scene_data.lights[2 * i + 1] = l ? l->GetColor() : vec4::zero;
+    }
+
+    Shader::SetSceneData(scene_data);
+
     // FIXME: get rid of the delta time argument
     render_primitives();
     render_tiles();
@@ -706,7 +752,8 @@ void Scene::render_tiles() // XXX: rename to Blit()
     RenderContext rc;
 
     /* Early test if nothing needs to be rendered */
-    if (!data->m_tile_api.m_tiles.count() && !data->m_tile_api.m_palettes.count())
+    if (!data->m_tile_api.m_tiles.count() && !data->m_tile_api.m_palettes.count()
+         && !data->m_tile_api.m_buffers.count())
         return;
 
     /* FIXME: we disable culling for now because we don’t have a reliable
@@ -722,9 +769,13 @@ void Scene::render_tiles() // XXX: rename to Blit()
     glEnable(GL_TEXTURE_2D);
 #endif
 
+    bool has_palettes = data->m_tile_api.m_palettes.count() > 0;
+    for (TileBuffer const &b : data->m_tile_api.m_buffers)
+        has_palettes |= !!b.m_tileset->GetPalette();
+
     if (!data->m_tile_api.m_shader)
         data->m_tile_api.m_shader = Shader::Create(LOLFX_RESOURCE_NAME(gpu_tile));
-    if (!data->m_tile_api.m_palette_shader && data->m_tile_api.m_palettes.count())
+    if (!data->m_tile_api.m_palette_shader && has_palettes)
         data->m_tile_api.m_palette_shader = Shader::Create(LOLFX_RESOURCE_NAME(gpu_palette));
 
     for (int p = 0; p < 2; p++)
@@ -732,7 +783,11 @@ void Scene::render_tiles() // XXX: rename to Blit()
         Shader *shader      = (p == 0) ? data->m_tile_api.m_shader : data->m_tile_api.m_palette_shader;
         array<Tile>& tiles  = (p == 0) ? data->m_tile_api.m_tiles : data->m_tile_api.m_palettes;
 
-        if (tiles.count() == 0)
+        int buffer_count = 0;
+        for (TileBuffer const &b : data->m_tile_api.m_buffers)
+            buffer_count += (p == 1) == !!b.m_tileset->GetPalette();
+
+        if (tiles.count() == 0 && buffer_count == 0)
             continue;
 
         ShaderUniform uni_mat, uni_tex, uni_pal, uni_texsize;
@@ -753,6 +808,37 @@ void Scene::render_tiles() // XXX: rename to Blit()
         uni_pal = data->m_tile_api.m_palette_shader ? data->m_tile_api.m_palette_shader->GetUniformLocation("u_palette") : ShaderUniform();
         uni_texsize = shader->GetUniformLocation("u_texsize");
 
+        auto draw = [&](TileSet *tileset, VertexBuffer *vb1, VertexBuffer *vb2, int quads)
+        {
+            /* Bind texture */
+            if (tileset->GetPalette())
+            {
+                if (tileset->GetTexture())
+                    shader->SetUniform(uni_tex, tileset->GetTexture()->GetTextureUniform(), 0);
+                if (tileset->GetPalette()->GetTexture())
+                    shader->SetUniform(uni_pal, tileset->GetPalette()->GetTexture()->GetTextureUniform(), 1);
+            }
+            else
+            {
+                shader->SetUniform(uni_tex, 0);
+                if (tileset->GetTexture())
+                    shader->SetUniform(uni_tex, tileset->GetTexture()->GetTextureUniform(), 0);
+                tileset->Bind();
+            }
+            shader->SetUniform(uni_texsize,
+                           (vec2)tileset->GetTextureSize());
+
+            /* Bind vertex and texture coordinate buffers */
+            data->m_tile_api.m_vdecl->Bind();
+            data->m_tile_api.m_vdecl->SetStream(vb1, attr_pos);
+            data->m_tile_api.m_vdecl->SetStream(vb2, attr_tex);
+
+            /* Draw arrays */
+            data->m_tile_api.m_vdecl->DrawElements(MeshPrimitive::Triangles, 0, quads * 6);
+            data->m_tile_api.m_vdecl->Unbind();
+            tileset->Unbind();
+        };
+
         for (int buf = 0, i = 0, n; i < tiles.count(); i = n, buf += 2)
         {
             /* Count how many quads will be needed */
@@ -778,35 +864,13 @@ void Scene::render_tiles() // XXX: rename to Blit()
             vb1->Unlock();
             vb2->Unlock();
 
-            /* Bind texture */
-            if (tiles[i].m_tileset->GetPalette())
-            {
-                if (tiles[i].m_tileset->GetTexture())
-                    shader->SetUniform(uni_tex, tiles[i].m_tileset->GetTexture()->GetTextureUniform(), 0);
-                if (tiles[i].m_tileset->GetPalette()->GetTexture())
-                    shader->SetUniform(uni_pal, tiles[i].m_tileset->GetPalette()->GetTexture()->GetTextureUniform(), 1);
-            }
-            else
-            {
-                shader->SetUniform(uni_tex, 0);
-                if (tiles[i].m_tileset->GetTexture())
-                    shader->SetUniform(uni_tex, tiles[i].m_tileset->GetTexture()->GetTextureUniform(), 0);
-                tiles[i].m_tileset->Bind();
-            }
-            shader->SetUniform(uni_texsize,
-                           (vec2)tiles[i].m_tileset->GetTextureSize());
-
-            /* Bind vertex and texture coordinate buffers */
-            data->m_tile_api.m_vdecl->Bind();
-            data->m_tile_api.m_vdecl->SetStream(vb1, attr_pos);
-            data->m_tile_api.m_vdecl->SetStream(vb2, attr_tex);
-
-            /* Draw arrays */
-            data->m_tile_api.m_vdecl->DrawElements(MeshPrimitive::Triangles, 0, (n - i) * 6);
-            data->m_tile_api.m_vdecl->Unbind();
-            tiles[i].m_tileset->Unbind();
+            draw(tiles[i].m_tileset, vb1, vb2, n - i);
         }
 
+        for (TileBuffer const &b : data->m_tile_api.m_buffers)
+            if ((p == 1) == !!b.m_tileset->GetPalette())
+                draw(b.m_tileset, b.m_vertices, b.m_texcoords, b.m_quads);
+
         tiles.empty();
 
         shader->Unbind();
@@ -815,6 +879,8 @@ void Scene::render_tiles() // XXX: rename to Blit()
             break;
     }
 
+    data->m_tile_api.m_buffers.empty();
+
 #if (defined LOL_USE_GLEW || defined HAVE_GL_2X) && !defined HAVE_GLES_2X
     glDisable(GL_TEXTURE_2D);
 #endif
@@ -25,8 +25,6 @@
 #include "camera.h"
 #include "mesh/mesh.h"
 
-#define LOL_MAX_LIGHT_COUNT 8
-
 namespace lol
 {
 
@@ -232,6 +230,11 @@ public:
      * the architecture we want to build */
     void AddTile(TileSet *tileset, int id, vec3 pos, vec2 scale, float radians);
     void AddTile(TileSet *tileset, int id, mat4 model);
+    /* Draw quads already written to vertex buffers owned by the caller,
+     * laid out the way TileSet::BlitTile writes them. The buffers must
+     * stay alive until the scene is rendered. */
+    void AddTileBuffer(TileSet *tileset, VertexBuffer *vertices,
+                       VertexBuffer *texcoords, int quads);
 
 public:
     void AddLine(vec3 a, vec3 b, vec4 color);
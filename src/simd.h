@@ -0,0 +1,107 @@
+//
+//  Lol Engine
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+//
+// SIMD lane types
+// ---------------
+// Kernels over structure-of-arrays data can be written once as templates
+// over a lane type: lane1 processes a single float, and lane4 processes
+// four floats with SSE instructions when they are available.
+//
+
+#include <lol/base/features.h>
+
+#include <cmath>
+#include <cstddef>
+
+#if LOL_FEATURE_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace lol
+{
+
+struct lane1
+{
+    static int const width = 1;
+
+    inline lane1(float x) : m(x) {}
+
+    static inline lane1 load(float const *p) { return lane1(*p); }
+    inline void store(float *p) const { *p = m; }
+
+    /* Strided access, for fields of arrays of structures */
+    static inline lane1 gather(float const *p, ptrdiff_t stride)
+    {
+        (void)stride;
+        return lane1(*p);
+    }
+    inline void scatter(float *p, ptrdiff_t stride) const
+    {
+        (void)stride;
+        *p = m;
+    }
+
+    inline lane1 operator +(lane1 x) const { return m + x.m; }
+    inline lane1 operator -(lane1 x) const { return m - x.m; }
+    inline lane1 operator *(lane1 x) const { return m * x.m; }
+    inline lane1 operator /(lane1 x) const { return m / x.m; }
+
+    friend inline lane1 lane_sqrt(lane1 x) { return std::sqrt(x.m); }
+    friend inline lane1 lane_abs(lane1 x) { return std::fabs(x.m); }
+    friend inline lane1 lane_max(lane1 x, lane1 y) { return x.m > y.m ? x.m : y.m; }
+
+    float m;
+};
+
+#if LOL_FEATURE_SSE2
+struct lane4
+{
+    static int const width = 4;
+
+    inline lane4(__m128 x) : m(x) {}
+    inline lane4(float x) : m(_mm_set1_ps(x)) {}
+
+    static inline lane4 load(float const *p) { return _mm_loadu_ps(p); }
+    inline void store(float *p) const { _mm_storeu_ps(p, m); }
+
+    static inline lane4 gather(float const *p, ptrdiff_t stride)
+    {
+        return _mm_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride]);
+    }
+    inline void scatter(float *p, ptrdiff_t stride) const
+    {
+        float tmp[4];
+        _mm_storeu_ps(tmp, m);
+        p[0] = tmp[0];
+        p[stride] = tmp[1];
+        p[2 * stride] = tmp[2];
+        p[3 * stride] = tmp[3];
+    }
+
+    inline lane4 operator +(lane4 x) const { return _mm_add_ps(m, x.m); }
+    inline lane4 operator -(lane4 x) const { return _mm_sub_ps(m, x.m); }
+    inline lane4 operator *(lane4 x) const { return _mm_mul_ps(m, x.m); }
+    inline lane4 operator /(lane4 x) const { return _mm_div_ps(m, x.m); }
+
+    friend inline lane4 lane_sqrt(lane4 x) { return _mm_sqrt_ps(x.m); }
+    friend inline lane4 lane_abs(lane4 x) { return _mm_andnot_ps(_mm_set1_ps(-0.f), x.m); }
+    friend inline lane4 lane_max(lane4 x, lane4 y) { return _mm_max_ps(x.m, y.m); }
+
+    __m128 m;
+};
+#endif
+
+} /* namespace lol */
+
@@ -148,6 +148,9 @@ void init(int argc, char *argv[],
         got_rootdir = true;
     }
 
+    /* Keep linked shader programs next to the executable */
+    Shader::SetBinaryDir(binarydir);
+
     msg::debug("binary dir: “%s”\n", binarydir.c_str());
     for (int i = 0; i < data_dir.count(); ++i)
         msg::debug("data dir %d/%d: “%s”\n", i + 1, data_dir.count(),
@@ -184,9 +184,10 @@ void BaseThreadManager::DispatchJob(array<ThreadJob*> const& jobs)
 //-----------------------------------------------------------------------------
 bool BaseThreadManager::FetchResult(array<ThreadJob*>& results)
 {
-    ThreadJob* result;
-    while (m_resultqueue.try_pop(result))
-        results << result;
+    ThreadJob* batch[16];
+    for (int n; (n = m_resultqueue.try_pop_batch(batch, 16)) > 0; )
+        for (int i = 0; i < n; ++i)
+            results << batch[i];
     return results.count() > 0;
 }
 
@@ -245,13 +246,11 @@ void BaseThreadManager::TickGame(float seconds)
     //Start if needed
     Start();
 
-    //Dispatch work task
-    while (m_job_dispatch.count() > 0 && AddThreadWork(m_job_dispatch[0]))
-    {
-        m_job_dispatch.remove(0);
-        //Keep track of added jobs
-        m_job_dispatched++;
-    }
+    //Dispatch as many work tasks as the queue can take
+    int dispatched = m_jobqueue.try_push_batch(m_job_dispatch.data(), m_job_dispatch.count());
+    m_job_dispatch.remove(0, dispatched);
+    //Keep track of added jobs
+    m_job_dispatched += dispatched;
 
     //Execute one task per frame if thread are not available
 #if !defined(LOL_FEATURE_THREADS) || !LOL_FEATURE_THREADS
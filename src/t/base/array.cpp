@@ -19,15 +19,20 @@ namespace lol
 
 struct tracked_object
 {
-    static int m_ctor, m_dtor;
+    static int m_ctor, m_dtor, m_copy;
 
     tracked_object() { m_ctor++; }
-    tracked_object(tracked_object const &) { m_ctor++; }
+    tracked_object(tracked_object const &) { m_ctor++; m_copy++; }
+    tracked_object(tracked_object &&) { m_ctor++; }
     ~tracked_object() { m_dtor++; }
+
+    tracked_object &operator =(tracked_object const &) { m_copy++; return *this; }
+    tracked_object &operator =(tracked_object &&) { return *this; }
 };
 
 int tracked_object::m_ctor = 0;
 int tracked_object::m_dtor = 0;
+int tracked_object::m_copy = 0;
 
 lolunit_declare_fixture(array_test)
 {
@@ -267,6 +272,134 @@ lolunit_declare_fixture(array_test)
         }
         lolunit_assert_equal(tracked_object::m_ctor, tracked_object::m_dtor);
     }
+
+    lolunit_declare_test(element_move)
+    {
+        /* Growing and shrinking arrays should never copy elements. */
+        tracked_object::m_ctor = 0;
+        tracked_object::m_dtor = 0;
+        tracked_object::m_copy = 0;
+        {
+            array<tracked_object> a;
+
+            for (int i = 0; i < 100; ++i)
+                a.push(tracked_object());
+            a.insert(tracked_object(), 10);
+            a.remove(20, 5);
+            a.remove_swap(30, 5);
+            a.pop();
+
+            array<tracked_object> b = std::move(a);
+            lolunit_assert_equal(a.count(), 0);
+            lolunit_assert_equal(b.count(), 90);
+        }
+        lolunit_assert_equal(tracked_object::m_copy, 0);
+        lolunit_assert_equal(tracked_object::m_ctor, tracked_object::m_dtor);
+    }
+
+    lolunit_declare_test(array_alignment)
+    {
+        array<float> a;
+        array<vec4> b;
+        array<mat4> c;
+
+        for (int i = 0; i < 100; ++i)
+        {
+            a.push(1.f);
+            b.push(vec4(1.f));
+            c.push(mat4(1.f));
+
+            lolunit_assert_equal((uintptr_t)a.data() % 16, 0u);
+            lolunit_assert_equal((uintptr_t)b.data() % 16, 0u);
+            lolunit_assert_equal((uintptr_t)c.data() % 16, 0u);
+        }
+    }
+
+    lolunit_declare_test(small_array_inline)
+    {
+        small_array<int, 4> a;
+        int const *inline_data = a.data();
+
+        a << 0 << 1 << 2 << 3;
+        lolunit_assert_equal(a.data(), inline_data);
+
+        a << 4;
+        lolunit_assert_different(a.data(), inline_data);
+        for (int i = 0; i < 5; ++i)
+            lolunit_assert_equal(a[i], i);
+
+        small_array<int, 4> b = a;
+        lolunit_assert_equal(b.count(), 5);
+        b.remove_swap(0, 2);
+        lolunit_assert_equal(b.count(), 3);
+        lolunit_assert_equal(b[0], 4);
+        lolunit_assert_equal(b[1], 3);
+        lolunit_assert_equal(b[2], 2);
+
+        int sum = 0;
+        for (int x : b)
+            sum += x;
+        lolunit_assert_equal(sum, 9);
+    }
+
+    lolunit_declare_test(small_array_move)
+    {
+        tracked_object::m_ctor = 0;
+        tracked_object::m_dtor = 0;
+        tracked_object::m_copy = 0;
+        {
+            small_array<tracked_object, 8> a;
+            a.resize(3);
+
+            /* Moving from inline storage moves each element */
+            small_array<tracked_object, 8> b = std::move(a);
+            lolunit_assert_equal(a.count(), 0);
+            lolunit_assert_equal(b.count(), 3);
+
+            /* Moving from the heap just steals the pointer */
+            b.resize(20);
+            tracked_object const *heap_data = b.data();
+            small_array<tracked_object, 8> c;
+            c = std::move(b);
+            lolunit_assert_equal(c.data(), heap_data);
+            lolunit_assert_equal(c.count(), 20);
+            lolunit_assert_equal(b.count(), 0);
+        }
+        lolunit_assert_equal(tracked_object::m_ctor, tracked_object::m_dtor);
+    }
+
+    lolunit_declare_test(array_benchmark)
+    {
+        int const count = 100000;
+        timer t;
+
+        array<int> a;
+        for (int i = 0; i < count; ++i)
+            a.push(i);
+        float t_push = t.get();
+
+        array<std::string> b;
+        for (int i = 0; i < count / 100; ++i)
+            b.insert(std::string("lol"), b.count() / 2);
+        float t_insert = t.get();
+
+        while (a.count() > 0)
+            a.remove_swap(a.count() / 2);
+        float t_remove_swap = t.get();
+
+        for (int i = 0; i < count; ++i)
+        {
+            small_array<int, 16> c;
+            for (int j = 0; j < 16; ++j)
+                c.push(j);
+        }
+        float t_small = t.get();
+
+        msg::info("array: %d push %.3fms, %d insert %.3fms, "
+                  "%d remove_swap %.3fms, %d small_array %.3fms\n",
+                  count, 1e3f * t_push, count / 100, 1e3f * t_insert,
+                  count, 1e3f * t_remove_swap, count, 1e3f * t_small);
+    }
 };
 
 } /* namespace lol */
@@ -16,6 +16,8 @@
 
 #include <lolunit.h>
 
+#include <map>
+
 namespace lol
 {
 
@@ -277,6 +279,180 @@ lolunit_declare_fixture(avl_tree_test)
         lolunit_assert_equal(test1.count(), 10);
         lolunit_assert_equal(test2.count(), 10);
     }
+
+    lolunit_declare_test(avl_tree_bounds)
+    {
+        avl_tree<int, int> tree;
+
+        lolunit_assert(!(tree.lower_bound(0) != tree.end()));
+
+        for (int i = 0 ; i < 100 ; ++i)
+            tree.insert(i * 10, i);
+
+        lolunit_assert_equal((*tree.lower_bound(-5)).key, 0);
+        lolunit_assert_equal((*tree.lower_bound(0)).key, 0);
+        lolunit_assert_equal((*tree.upper_bound(0)).key, 10);
+        lolunit_assert_equal((*tree.lower_bound(15)).key, 20);
+        lolunit_assert_equal((*tree.upper_bound(15)).key, 20);
+        lolunit_assert_equal((*tree.lower_bound(990)).key, 990);
+        lolunit_assert(!(tree.upper_bound(990) != tree.end()));
+        lolunit_assert(!(tree.lower_bound(995) != tree.end()));
+
+        int test = 250;
+        for (auto iterator : tree.range(245, 500))
+        {
+            lolunit_assert_equal(iterator.key, test);
+            test += 10;
+        }
+        lolunit_assert_equal(test, 500);
+
+        int n = 0;
+        for (auto iterator : tree.range(500, 245))
+            n += iterator.value;
+        for (auto iterator : tree.range(2000, 3000))
+            n += iterator.value;
+        lolunit_assert_equal(n, 0);
+
+        avl_tree<int, int> const & const_tree = tree;
+        n = 0;
+        for (auto iterator : const_tree.range(0, 1000))
+            n += iterator.value;
+        lolunit_assert_equal(n, 99 * 100 / 2);
+    }
+
+    lolunit_declare_test(avl_tree_assign_sorted)
+    {
+        for (int count : { 0, 1, 2, 3, 7, 8, 100, 1000 })
+        {
+            test_tree tree;
+            array<int, int> items;
+
+            for (int i = 0 ; i < count ; ++i)
+                items.push(2 * i, i);
+
+            lolunit_set_context(count);
+            lolunit_assert(tree.assign_sorted(items));
+            lolunit_assert_equal(tree.count(), count);
+            if (count)
+                lolunit_assert_lequal(std::abs(tree.get_root_balance()), 1);
+
+            int i = 0;
+            for (auto iterator : tree)
+            {
+                lolunit_assert_equal(iterator.key, 2 * i);
+                lolunit_assert_equal(iterator.value, i);
+                ++i;
+            }
+            lolunit_assert_equal(i, count);
+
+            /* The tree must still behave after a bulk build */
+            for (int i = 0 ; i < count ; ++i)
+                lolunit_assert(tree.insert(2 * i + 1, -i));
+            for (int i = 0 ; i < count ; i += 2)
+                lolunit_assert(tree.erase(2 * i));
+            lolunit_assert_equal(tree.count(), 2 * count - (count + 1) / 2);
+
+            int last = -1;
+            for (auto iterator : tree)
+            {
+                lolunit_assert_less(last, iterator.key);
+                last = iterator.key;
+            }
+        }
+
+        avl_tree<int, int> tree;
+        tree.insert(42, 0);
+
+        array<int, int> unsorted;
+        unsorted.push(1, 0);
+        unsorted.push(1, 0);
+        lolunit_assert(!tree.assign_sorted(unsorted));
+        lolunit_assert(tree.exists(42));
+    }
+
+    lolunit_declare_test(avl_tree_node_reuse)
+    {
+        avl_tree<int, int> tree;
+
+        for (int pass = 0 ; pass < 3 ; ++pass)
+        {
+            for (int i = 0 ; i < 5000 ; ++i)
+                tree.insert(rand(10000), i);
+            for (int i = 0 ; i < 5000 ; ++i)
+                tree.erase(rand(10000));
+
+            int count = 0, last = -1;
+            for (auto iterator : tree)
+            {
+                lolunit_assert_less(last, iterator.key);
+                last = iterator.key;
+                ++count;
+            }
+            lolunit_assert_equal(tree.count(), count);
+
+            if (pass == 1)
+                tree.clear();
+        }
+    }
+
+    lolunit_declare_test(avl_tree_benchmark)
+    {
+        int const count = 200000;
+
+        array<int> keys;
+        for (int i = 0 ; i < count ; ++i)
+            keys.push(i * 3);
+        keys.shuffle();
+
+        std::map<int, int> m;
+        avl_tree<int, int> tree;
+
+        timer t;
+        for (int i = 0 ; i < count ; ++i)
+            m[keys[i]] = i;
+        float t_insert1 = t.get();
+        for (int i = 0 ; i < count ; ++i)
+            tree.insert(keys[i], i);
+        float t_insert2 = t.get();
+
+        int64_t sum1 = 0, sum2 = 0;
+        for (int n = 0 ; n < 10 ; ++n)
+            for (auto const & kv : m)
+                sum1 += kv.second;
+        float t_iter1 = t.get();
+        for (int n = 0 ; n < 10 ; ++n)
+            for (auto iterator : tree)
+                sum2 += iterator.value;
+        float t_iter2 = t.get();
+        lolunit_assert_equal(sum1, sum2);
+
+        for (int i = 0 ; i < count ; ++i)
+        {
+            auto it = m.lower_bound(keys[i] - 1);
+            sum1 += it->second;
+        }
+        float t_bound1 = t.get();
+        for (int i = 0 ; i < count ; ++i)
+        {
+            auto it = tree.lower_bound(keys[i] - 1);
+            sum2 += (*it).value;
+        }
+        float t_bound2 = t.get();
+        lolunit_assert_equal(sum1, sum2);
+
+        std::map<int, int> m_copy = m;
+        float t_copy1 = t.get();
+        avl_tree<int, int> tree_copy = tree;
+        float t_copy2 = t.get();
+        lolunit_assert_equal((int)m_copy.size(), tree_copy.count());
+
+        msg::info("avl_tree: %d ints, std::map vs. avl_tree: insert %.3fms "
+                  "vs. %.3fms, iterate %.3fms vs. %.3fms, lower_bound "
+                  "%.3fms vs. %.3fms, copy %.3fms vs. %.3fms\n", count,
+                  1e3f * t_insert1, 1e3f * t_insert2, 1e3f * t_iter1,
+                  1e3f * t_iter2, 1e3f * t_bound1, 1e3f * t_bound2,
+                  1e3f * t_copy1, 1e3f * t_copy2);
+    }
 };
 
 }
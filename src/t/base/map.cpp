@@ -32,6 +32,148 @@ lolunit_declare_fixture(map_test)
         lolunit_assert(!has_key(m, 1));
         lolunit_assert(has_key(m, 2));
     }
+
+    lolunit_declare_test(hash_map_basic)
+    {
+        hash_map<int, int> m;
+
+        m[0] = 1;
+        m[2] = 2;
+
+        lolunit_assert_equal(m.size(), 2u);
+        lolunit_assert(has_key(m, 0));
+        lolunit_assert(!has_key(m, 1));
+        lolunit_assert(has_key(m, 2));
+
+        int val = 0;
+        lolunit_assert(try_get(m, 2, val));
+        lolunit_assert_equal(val, 2);
+        lolunit_assert(!try_get(m, 3, val));
+
+        lolunit_assert(!m.insert(std::make_pair(2, 5)).second);
+        lolunit_assert(m.insert(std::make_pair(3, 5)).second);
+        lolunit_assert_equal(m[3], 5);
+
+        lolunit_assert_equal(m.erase(2), 1u);
+        lolunit_assert_equal(m.erase(2), 0u);
+        lolunit_assert(!has_key(m, 2));
+        lolunit_assert_equal(keys(m).count(), 2);
+    }
+
+    lolunit_declare_test(hash_map_many)
+    {
+        hash_map<std::string, int> m;
+
+        for (int i = 0; i < 10000; ++i)
+            m[format("%d", i)] = i;
+        lolunit_assert_equal(m.size(), 10000u);
+
+        /* Erase every other key, which leaves tombstones behind, then
+         * check that lookups and reinsertions still work. */
+        for (int i = 0; i < 10000; i += 2)
+            lolunit_assert_equal(m.erase(format("%d", i)), 1u);
+        lolunit_assert_equal(m.size(), 5000u);
+
+        for (int i = 0; i < 10000; ++i)
+            lolunit_assert_equal(has_key(m, format("%d", i)), i % 2 == 1);
+
+        for (int i = 0; i < 20000; i += 2)
+            m[format("%d", i)] = -i;
+        lolunit_assert_equal(m.size(), 15000u);
+
+        int sum = 0;
+        for (auto const &kv : m)
+            sum += kv.second;
+        lolunit_assert_equal(sum, 25000000 - 99990000);
+
+        hash_map<std::string, int> m2 = m;
+        m.clear();
+        lolunit_assert_equal(m.size(), 0u);
+        lolunit_assert(!has_key(m, "1"));
+        lolunit_assert_equal(m2.size(), 15000u);
+        lolunit_assert_equal(m2["9999"], 9999);
+    }
+
+    lolunit_declare_test(flat_map_basic)
+    {
+        flat_map<std::string, int> m;
+
+        m["c"] = 3;
+        m["a"] = 1;
+        m["b"] = 2;
+
+        lolunit_assert_equal(m.size(), 3u);
+        lolunit_assert(has_key(m, "a"));
+        lolunit_assert(!has_key(m, "d"));
+
+        /* Keys are kept sorted */
+        array<std::string> k = keys(m);
+        lolunit_assert_equal(k.count(), 3);
+        lolunit_assert(k[0] == "a");
+        lolunit_assert(k[1] == "b");
+        lolunit_assert(k[2] == "c");
+
+        int val = 0;
+        lolunit_assert(try_get(m, "b", val));
+        lolunit_assert_equal(val, 2);
+
+        lolunit_assert_equal(m.erase("b"), 1u);
+        lolunit_assert(!has_key(m, "b"));
+        lolunit_assert_equal(m.size(), 2u);
+        m.clear();
+        lolunit_assert_equal(m.size(), 0u);
+    }
+
+    lolunit_declare_test(map_benchmark)
+    {
+        int const count = 100000;
+
+        array<uint64_t> keys;
+        for (int i = 0; i < count; ++i)
+            keys.push(((uint64_t)rand<uint32_t>() << 32) | (uint64_t)i);
+
+        std::map<uint64_t, int> m1;
+        hash_map<uint64_t, int> m2;
+        flat_map<uint64_t, int> m3;
+
+        timer t;
+        for (int i = 0; i < count; ++i)
+            m1[keys[i]] = i;
+        float t_insert1 = t.get();
+        for (int i = 0; i < count; ++i)
+            m2[keys[i]] = i;
+        float t_insert2 = t.get();
+
+        int64_t sum1 = 0, sum2 = 0, sum3 = 0;
+        for (int n = 0; n < 10; ++n)
+            for (int i = 0; i < count; ++i)
+                sum1 += m1.find(keys[i])->second;
+        float t_find1 = t.get();
+        for (int n = 0; n < 10; ++n)
+            for (int i = 0; i < count; ++i)
+                sum2 += m2.find(keys[i])->second;
+        float t_find2 = t.get();
+
+        /* flat_map insertion is O(n), so only fill it with a few keys */
+        for (int i = 0; i < 64; ++i)
+            m3[keys[i]] = i;
+        t.get();
+        for (int n = 0; n < 10; ++n)
+            for (int i = 0; i < count; ++i)
+                sum3 += m3.find(keys[i % 64])->second;
+        float t_find3 = t.get();
+
+        lolunit_assert_equal(sum1, sum2);
+        for (int i = 0; i < count; ++i)
+            sum3 -= 10 * (i % 64);
+        lolunit_assert_equal(sum3, 0);
+
+        msg::info("map: %d inserts std::map %.3fms hash_map %.3fms, "
+                  "%d lookups std::map %.3fms hash_map %.3fms "
+                  "flat_map(64) %.3fms\n", count, 1e3f * t_insert1,
+                  1e3f * t_insert2, 10 * count, 1e3f * t_find1,
+                  1e3f * t_find2, 1e3f * t_find3);
+    }
 };
 
 } /* namespace lol */
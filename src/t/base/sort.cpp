@@ -0,0 +1,204 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+namespace lol
+{
+
+template<typename T>
+static bool is_sorted(array<T> const &a)
+{
+    for (int i = 1; i < a.count(); ++i)
+        if (a[i] < a[i - 1])
+            return false;
+    return true;
+}
+
+template<typename T>
+static T sum(array<T> const &a)
+{
+    T ret = T(0);
+    for (T const &x : a)
+        ret += x;
+    return ret;
+}
+
+struct sort_item
+{
+    int key, payload;
+
+    bool operator <(sort_item const &that) const { return key < that.key; }
+};
+
+lolunit_declare_fixture(sort_test)
+{
+    lolunit_declare_test(introsort_random)
+    {
+        for (int n : { 0, 1, 2, 3, 15, 16, 17, 100, 1000, 10000 })
+        {
+            array<int> a;
+            for (int i = 0; i < n; ++i)
+                a.push(rand(-1000, 1000));
+            int s = sum(a);
+
+            lolunit_set_context(n);
+            a.sort();
+            lolunit_assert(is_sorted(a));
+            lolunit_assert_equal(a.count(), n);
+            lolunit_assert_equal(sum(a), s);
+        }
+    }
+
+    lolunit_declare_test(introsort_degenerate)
+    {
+        /* Patterns that break naive quicksort pivots */
+        array<int> a, b, c, d;
+        for (int i = 0; i < 10000; ++i)
+        {
+            a.push(i);
+            b.push(10000 - i);
+            c.push(42);
+            d.push(i % 2 ? i : 10000 - i);
+        }
+
+        a.sort(SortAlgorithm::Introsort);
+        b.sort(SortAlgorithm::Introsort);
+        c.sort(SortAlgorithm::Introsort);
+        d.sort(SortAlgorithm::QuickSwap);
+
+        lolunit_assert(is_sorted(a));
+        lolunit_assert(is_sorted(b));
+        lolunit_assert(is_sorted(c));
+        lolunit_assert(is_sorted(d));
+    }
+
+    lolunit_declare_test(bubble)
+    {
+        array<int> a;
+        for (int i = 0; i < 100; ++i)
+            a.push(rand(100));
+
+        a.sort(SortAlgorithm::Bubble);
+        lolunit_assert(is_sorted(a));
+    }
+
+    lolunit_declare_test(radix_int)
+    {
+        array<int32_t> a;
+        array<uint16_t> b;
+        array<int64_t> c;
+        for (int i = 0; i < 10000; ++i)
+        {
+            a.push(rand(-100000, 100000));
+            b.push((uint16_t)rand(65536));
+            c.push((int64_t)rand(-100000, 100000) << 24);
+        }
+        int32_t s = sum(a);
+
+        a.sort(SortAlgorithm::Radix);
+        b.sort(SortAlgorithm::Radix);
+        c.sort(SortAlgorithm::Radix);
+
+        lolunit_assert(is_sorted(a));
+        lolunit_assert(is_sorted(b));
+        lolunit_assert(is_sorted(c));
+        lolunit_assert_equal(sum(a), s);
+    }
+
+    lolunit_declare_test(radix_float)
+    {
+        array<float> a;
+        array<double> b;
+        for (int i = 0; i < 10000; ++i)
+        {
+            a.push(rand(-1000.f, 1000.f));
+            b.push(rand(-1e10, 1e10));
+        }
+        a.push(-0.f);
+        a.push(0.f);
+
+        a.sort(SortAlgorithm::Radix);
+        b.sort(SortAlgorithm::Radix);
+
+        lolunit_assert(is_sorted(a));
+        lolunit_assert(is_sorted(b));
+    }
+
+    lolunit_declare_test(radix_key)
+    {
+        array<sort_item> a;
+        for (int i = 0; i < 1000; ++i)
+            a.push(sort_item{ rand(10), i });
+
+        /* Radix sort is stable */
+        a.radix_sort([](sort_item const &x) { return x.key; });
+        for (int i = 1; i < a.count(); ++i)
+        {
+            lolunit_assert_lequal(a[i - 1].key, a[i].key);
+            if (a[i - 1].key == a[i].key)
+                lolunit_assert_less(a[i - 1].payload, a[i].payload);
+        }
+
+        /* Non-arithmetic types fall back to introsort */
+        a.sort(SortAlgorithm::Radix);
+        for (int i = 1; i < a.count(); ++i)
+            lolunit_assert_lequal(a[i - 1].key, a[i].key);
+    }
+
+    lolunit_declare_test(parallel_merge)
+    {
+        for (int n : { 100, (int)PARALLEL_SORT_THRESHOLD,
+                       5 * (int)PARALLEL_SORT_THRESHOLD + 17 })
+        {
+            array<std::string> a;
+            for (int i = 0; i < n; ++i)
+                a.push(format("%08d", rand(10000000)));
+
+            lolunit_set_context(n);
+            a.sort(SortAlgorithm::ParallelMerge);
+            lolunit_assert(is_sorted(a));
+            lolunit_assert_equal(a.count(), n);
+        }
+    }
+
+    lolunit_declare_test(sort_benchmark)
+    {
+        int const count = 1000000;
+
+        array<float> src;
+        for (int i = 0; i < count; ++i)
+            src.push(rand(-1000.f, 1000.f));
+
+        array<float> a = src, b = src, c = src;
+        timer t;
+        a.sort(SortAlgorithm::Introsort);
+        float t_intro = t.get();
+        b.sort(SortAlgorithm::Radix);
+        float t_radix = t.get();
+        c.sort(SortAlgorithm::ParallelMerge);
+        float t_parallel = t.get();
+
+        lolunit_assert(is_sorted(a));
+        lolunit_assert(a == b);
+        lolunit_assert(a == c);
+
+        msg::info("sort: %d floats, introsort %.3fms, radix %.3fms, "
+                  "parallel merge %.3fms\n", count, 1e3f * t_intro,
+                  1e3f * t_radix, 1e3f * t_parallel);
+    }
+};
+
+} /* namespace lol */
+
@@ -0,0 +1,671 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace lol
+{
+
+lolunit_declare_fixture(easymesh_test)
+{
+    /* Record a few commands, including an expensive one, then run them */
+    uint64_t build(EasyMesh &em, float size)
+    {
+        em.BD()->Enable(MeshBuildOperation::CommandRecording);
+        em.SetCurColor(vec4(0.2f, 0.4f, 0.6f, 1.f));
+        em.AppendBox(vec3(size), 0.f, false);
+        em.Translate(vec3(1.f, 2.f, 3.f));
+        em.SmoothMesh(2, 1, 1);
+        em.BD()->Disable(MeshBuildOperation::CommandRecording);
+        uint64_t key = em.GetCacheKey();
+        em.ExecuteCmdStack();
+        return key;
+    }
+
+    void check_same(EasyMesh &a, EasyMesh &b)
+    {
+        lolunit_assert_equal(a.m_vert.count(), b.m_vert.count());
+        lolunit_assert_equal(a.m_indices.count(), b.m_indices.count());
+        for (int i = 0; i < a.m_indices.count(); ++i)
+            lolunit_assert_equal(a.m_indices[i], b.m_indices[i]);
+
+        /* Positions are exact, other attributes are stored as halves */
+        for (int i = 0; i < a.m_vert.count(); ++i)
+        {
+            lolunit_set_context(i);
+            lolunit_assert_equal(a.m_vert[i].m_coord, b.m_vert[i].m_coord);
+            lolunit_assert(distance(a.m_vert[i].m_normal, b.m_vert[i].m_normal) < 1e-3f);
+            lolunit_assert(distance(a.m_vert[i].m_color, b.m_vert[i].m_color) < 1e-3f);
+        }
+    }
+
+    static float max_error(array<VertexData> const &a, array<VertexData> const &b)
+    {
+        float ret = 0.f;
+        for (int i = 0; i < a.count(); ++i)
+        {
+            ret = max(ret, distance(a[i].m_coord, b[i].m_coord));
+            ret = max(ret, distance(a[i].m_normal, b[i].m_normal));
+        }
+        return ret;
+    }
+
+    /* The per-vertex code of Rotate() followed by Scale() before they
+     * used the transform kernels */
+    static void reference_rotate_scale(array<VertexData> &vert, float degrees,
+                                       vec3 axis, vec3 s)
+    {
+        mat3 m = mat3::rotate(radians(degrees), axis);
+        vec3 const invs = vec3(1) / s;
+        for (auto &v : vert)
+        {
+            v.m_coord = m * v.m_coord;
+            v.m_normal = m * v.m_normal;
+        }
+        for (auto &v : vert)
+        {
+            v.m_coord *= s;
+            v.m_normal = normalize(v.m_normal * invs);
+        }
+    }
+
+    /* Same for the Taper, Twist and Bend deformers */
+    static void reference_deform(array<VertexData> &vert, MeshTransform ct,
+                                 int axis0, int axis1, float n0, float n1,
+                                 float noff)
+    {
+        for (auto &v : vert)
+        {
+            if (ct == MeshTransform::Taper)
+            {
+                float value = v.m_coord[axis0];
+                v.m_coord[(axis0 + 1) % 3] *= max(0.f, 1.f + (n0 * value + noff));
+                v.m_coord[(axis0 + 2) % 3] *= max(0.f, 1.f + (n1 * value + noff));
+            }
+            else
+            {
+                int a = ct == MeshTransform::Bend ? axis1 : axis0;
+                vec3 rotaxis = vec3(1.f);
+                rotaxis[(a + 1) % 3] = .0f;
+                rotaxis[(a + 2) % 3] = .0f;
+                v.m_coord = mat3::rotate(radians(v.m_coord[axis0] * n0 + noff), rotaxis) * v.m_coord;
+            }
+        }
+    }
+
+    /* ComputeNormals() before it used flat accumulators: the average of
+     * the distinct face normals around each vertex */
+    static void reference_normals(EasyMesh &em)
+    {
+        array<array<vec3>> normals;
+        normals.resize(em.m_vert.count());
+        for (int i = 0; i < em.m_indices.count(); i += 3)
+        {
+            vec3 p0 = em.m_vert[em.m_indices[i]].m_coord;
+            vec3 n = normalize(cross(em.m_vert[em.m_indices[i + 1]].m_coord - p0,
+                                     em.m_vert[em.m_indices[i + 2]].m_coord - p0));
+            for (int j = 0; j < 3; ++j)
+                normals[em.m_indices[i + j]] << n;
+        }
+
+        for (int i = 0; i < normals.count(); ++i)
+        {
+            if (!normals[i].count())
+                continue;
+            for (int j = 0; j < normals[i].count(); ++j)
+                for (int k = j + 1; k < normals[i].count(); ++k)
+                    if (1.f - dot(normals[i][k], normals[i][j]) < .00001f)
+                        normals[i].remove(k--);
+
+            vec3 sum = vec3::zero;
+            for (auto const &n : normals[i])
+                sum += n;
+            em.m_vert[i].m_normal = normalize(sum);
+        }
+    }
+
+    /* Run an empty command stack, which only computes normals again */
+    static void recompute_normals(EasyMesh &em)
+    {
+        em.BD()->Enable(MeshBuildOperation::PostBuildComputeNormals);
+        em.BD()->Enable(MeshBuildOperation::PreventVertCleanup);
+        em.ExecuteCmdStack();
+    }
+
+    /* Largest angle between the normals of two meshes, in degrees */
+    static float max_normal_angle(EasyMesh const &a, EasyMesh const &b)
+    {
+        float ret = 0.f;
+        for (int i = 0; i < a.m_vert.count(); ++i)
+        {
+            float d = dot(a.m_vert[i].m_normal, b.m_vert[i].m_normal);
+            ret = max(ret, degrees(std::acos(clamp(d, -1.f, 1.f))));
+        }
+        return ret;
+    }
+
+    lolunit_declare_test(normals)
+    {
+        for (int shape = 0; shape < 3; ++shape)
+        {
+            EasyMesh em;
+            if (shape == 0)
+                em.AppendBox(vec3(1.f, 2.f, 3.f));
+            else if (shape == 1)
+                em.AppendSphere(3, 2.f);
+            else
+                em.AppendTorus(24, 2.f, 3.f);
+
+            EasyMesh ref = em;
+            reference_normals(ref);
+
+            /* Faces meet at the same angle on both sides of the seams
+             * of these shapes, so weighting barely changes anything */
+            lolunit_set_context(shape);
+            lolunit_assert(max_normal_angle(em, ref) < (shape == 0 ? 0.1f : 5.f));
+        }
+
+        /* Split corners of a box become one smooth vertex */
+        EasyMesh em;
+        em.BD()->Enable(MeshBuildOperation::SmoothSplitVertices);
+        em.AppendBox(vec3(2.f));
+        for (int i = 0; i < em.m_vert.count(); ++i)
+        {
+            lolunit_set_context(i);
+            VertexData const &v = em.m_vert[i];
+            lolunit_assert(distance(normalize(v.m_coord), v.m_normal) < 1e-5f);
+        }
+    }
+
+    lolunit_declare_test(affine_fusion)
+    {
+        EasyMesh fused, separate;
+        fused.BD()->Enable(MeshBuildOperation::CommandRecording);
+        fused.AppendBox(vec3(1.f, 2.f, 3.f));
+        fused.Rotate(30.f, vec3(1.f, 2.f, 3.f));
+        fused.Translate(vec3(4.f, 5.f, 6.f));
+        fused.Scale(vec3(-2.f, 0.5f, 1.f));
+        fused.Rotate(-45.f, vec3(0.f, 1.f, 0.f));
+        fused.BD()->Disable(MeshBuildOperation::CommandRecording);
+        fused.BD()->Enable(MeshBuildOperation::PreventVertCleanup);
+        fused.ExecuteCmdStack();
+
+        separate.AppendBox(vec3(1.f, 2.f, 3.f));
+        separate.Rotate(30.f, vec3(1.f, 2.f, 3.f));
+        separate.Translate(vec3(4.f, 5.f, 6.f));
+        separate.Scale(vec3(-2.f, 0.5f, 1.f));
+        separate.Rotate(-45.f, vec3(0.f, 1.f, 0.f));
+
+        /* The mirroring scale also flipped the winding */
+        lolunit_assert_equal(separate.m_indices.count(), fused.m_indices.count());
+        for (int i = 0; i < fused.m_indices.count(); ++i)
+            lolunit_assert_equal(separate.m_indices[i], fused.m_indices[i]);
+        lolunit_assert_equal(separate.m_vert.count(), fused.m_vert.count());
+        lolunit_assert(max_error(separate.m_vert, fused.m_vert) < 1e-5f);
+    }
+
+    lolunit_declare_test(transform_benchmark)
+    {
+        int const count = 1 << 20;
+        EasyMesh em;
+        em.m_vert.resize(count);
+        for (auto &v : em.m_vert)
+        {
+            v.m_coord = vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f));
+            v.m_normal = normalize(vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), 1.f));
+        }
+        array<VertexData> ref = em.m_vert;
+
+        timer t;
+        reference_rotate_scale(ref, 30.f, vec3(1.f, 2.f, 3.f), vec3(2.f, 0.5f, 1.f));
+        float t_ref_affine = t.get();
+        em.BD()->Enable(MeshBuildOperation::CommandRecording);
+        em.Rotate(30.f, vec3(1.f, 2.f, 3.f));
+        em.Scale(vec3(2.f, 0.5f, 1.f));
+        em.BD()->Disable(MeshBuildOperation::CommandRecording);
+        em.BD()->Enable(MeshBuildOperation::PreventVertCleanup);
+        t.get();
+        em.ExecuteCmdStack();
+        float t_affine = t.get();
+        lolunit_assert(max_error(ref, em.m_vert) < 1e-5f);
+
+        float t_ref_deform = 0.f, t_deform = 0.f;
+        for (auto ct : { MeshTransform::Taper, MeshTransform::Twist, MeshTransform::Bend })
+        {
+            t.get();
+            reference_deform(ref, ct, 1, 2, 0.5f, -0.25f, 0.1f);
+            t_ref_deform += t.get();
+            if (ct == MeshTransform::Taper)
+                em.TaperY(-0.25f, 0.5f, 0.1f, false);
+            else if (ct == MeshTransform::Twist)
+                em.TwistY(0.5f, 0.1f);
+            else
+                em.BendYZ(0.5f, 0.1f);
+            t_deform += t.get();
+            lolunit_set_context((int)ct);
+            lolunit_assert(max_error(ref, em.m_vert) < 1e-5f);
+        }
+
+        msg::info("easymesh: %d vertices, rotate+scale %.2fms (was %.2fms), "
+                  "deformers %.2fms (was %.2fms)\n", count, 1e3f * t_affine,
+                  1e3f * t_ref_affine, 1e3f * t_deform, 1e3f * t_ref_deform);
+    }
+
+    lolunit_declare_test(normal_benchmark)
+    {
+        /* As many vertices as 16-bit indices allow; every triangle
+         * of a sphere has its own vertices */
+        EasyMesh em;
+        em.AppendSphere(32, 2.f);
+        EasyMesh ref = em;
+
+        timer t;
+        reference_normals(ref);
+        float t_ref = t.get();
+        recompute_normals(em);
+        float t_new = t.get();
+        lolunit_assert(max_normal_angle(em, ref) < 0.1f);
+
+        /* Welding the split vertices gives a smooth sphere */
+        em.BD()->Enable(MeshBuildOperation::SmoothSplitVertices);
+        t.get();
+        recompute_normals(em);
+        float t_split = t.get();
+        for (int i = 0; i < em.m_vert.count(); ++i)
+        {
+            lolunit_set_context(i);
+            VertexData const &v = em.m_vert[i];
+            lolunit_assert(dot(normalize(v.m_coord), v.m_normal) > 0.999f);
+        }
+
+        msg::info("easymesh: %d triangles, normals %.2fms (was %.2fms), "
+                  "with split vertices %.2fms\n", em.m_indices.count() / 3,
+                  1e3f * t_new, 1e3f * t_ref, 1e3f * t_split);
+    }
+
+    /* Triangles as original vertex ids, each rotated to start with its
+     * smallest id so that only the winding matters, then sorted */
+    static array<ivec3> triangle_set(EasyMesh const &em)
+    {
+        return triangle_set(em, em.m_indices);
+    }
+
+    static array<ivec3> triangle_set(EasyMesh const &em,
+                                     array<uint16_t> const &indices)
+    {
+        array<ivec3> ret;
+        for (int i = 0; i < indices.count(); i += 3)
+        {
+            ivec3 t(em.m_vert[indices[i]].m_bone_id.x,
+                    em.m_vert[indices[i + 1]].m_bone_id.x,
+                    em.m_vert[indices[i + 2]].m_bone_id.x);
+            while (t.x > t.y || t.x > t.z)
+                t = ivec3(t.yzx);
+            ret.push(t);
+        }
+        std::sort(ret.data(), ret.data() + ret.count(), [](ivec3 const &a, ivec3 const &b)
+        {
+            return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+        });
+        return ret;
+    }
+
+    lolunit_declare_test(render_optimization)
+    {
+        for (int shape = 0; shape < 3; ++shape)
+        {
+            EasyMesh em;
+            if (shape == 0)
+                em.AppendTorus(32, 2.f, 3.f);
+            else if (shape == 1)
+                em.AppendCylinder(32, 2.f, 1.f, 2.f, false, true, true);
+            else
+                em.AppendBox(vec3(2.f));
+            /* Primitives mostly have their own vertices for each face */
+            em.VerticesMerge();
+            if (shape == 2)
+                em.SmoothMesh(3, 1, 1);
+            for (int i = 0; i < em.m_vert.count(); ++i)
+                em.m_vert[i].m_bone_id.x = i;
+            array<ivec3> tris = triangle_set(em);
+
+            EasyMesh cache = em, overdraw = em;
+            VertexCacheStats before, after, after_overdraw;
+            timer t;
+            cache.OptimizeForRender(false, &before, &after);
+            float t_cache = t.get();
+            overdraw.OptimizeForRender(true, nullptr, &after_overdraw);
+            float t_overdraw = t.get();
+
+            lolunit_set_context(shape);
+            lolunit_assert(after.acmr < before.acmr);
+            lolunit_assert(after_overdraw.acmr < 1.1f * after.acmr);
+
+            for (EasyMesh const *m : { &cache, &overdraw })
+            {
+                /* Same triangles and winding, vertices in first use order */
+                array<ivec3> new_tris = triangle_set(*m);
+                lolunit_assert_equal(tris.count(), new_tris.count());
+                for (int i = 0; i < tris.count(); ++i)
+                    lolunit_assert(tris[i] == new_tris[i]);
+
+                int next = 0;
+                for (auto i : m->m_indices)
+                {
+                    lolunit_assert(i <= next);
+                    next = max(next, i + 1);
+                }
+            }
+
+            msg::info("easymesh: %d triangles, ACMR %.3f → %.3f (%.3f with "
+                      "overdraw), ATVR %.3f → %.3f, %.2fms (%.2fms)\n",
+                      em.m_indices.count() / 3, before.acmr, after.acmr,
+                      after_overdraw.acmr, before.atvr, after.atvr,
+                      1e3f * t_cache, 1e3f * t_overdraw);
+        }
+    }
+
+    lolunit_declare_test(render_optimization_degenerate)
+    {
+        /* A box and a fan of zero-area triangles, whose clusters have no
+         * normal to sort them by */
+        EasyMesh em;
+        em.AppendBox(vec3(2.f));
+        em.VerticesMerge();
+        int base = em.m_vert.count();
+        for (int i = 0; i < 64; ++i)
+            em.m_vert.push(VertexData(vec3(0.1f * i, 5.f, 0.f)));
+        for (int i = 0; i < 200; ++i)
+            em.m_indices << base << base + 1 + i % 63
+                         << base + 1 + (i * 7 + 3) % 63;
+        for (int i = 0; i < em.m_vert.count(); ++i)
+            em.m_vert[i].m_bone_id.x = i;
+        array<ivec3> tris = triangle_set(em);
+
+        em.OptimizeForRender(true);
+
+        array<ivec3> new_tris = triangle_set(em);
+        lolunit_assert_equal(tris.count(), new_tris.count());
+        for (int i = 0; i < tris.count(); ++i)
+            lolunit_assert(tris[i] == new_tris[i]);
+    }
+
+    /* A wavy grid facing +z, with a colour seam down the middle */
+    static void make_grid(array<VertexData> &vert, array<uint32_t> &indices,
+                          int size, float bump)
+    {
+        int const seam = size / 2, base = (size + 1) * (size + 1);
+        vert.empty();
+        for (int pass = 0; pass < 2; ++pass)
+            for (int y = 0; y <= size; ++y)
+                for (int x = pass ? seam : 0; x <= (pass ? seam : size); ++x)
+                {
+                    vec3 p((float)x, (float)y,
+                           bump * std::sin(0.3f * x) * std::cos(0.2f * y));
+                    vec4 color(pass || x > seam ? 1.f : 0.f, 0.f, 0.f, 1.f);
+                    vert.push(VertexData(p, vec3(0.f, 0.f, 1.f), color,
+                                         vec4(vec2((float)x, (float)y) / (float)size, 0.f, 0.f)));
+                }
+
+        auto id = [=](int x, int y, bool right)
+        {
+            return (uint32_t)(x == seam && right ? base + y : y * (size + 1) + x);
+        };
+        indices.empty();
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+            {
+                bool right = x >= seam;
+                indices << id(x, y, right) << id(x + 1, y, right) << id(x + 1, y + 1, right);
+                indices << id(x, y, right) << id(x + 1, y + 1, right) << id(x, y + 1, right);
+            }
+    }
+
+    lolunit_declare_test(simplify)
+    {
+        array<VertexData> vert;
+        array<uint32_t> indices;
+        int const size = 64, seam = size / 2;
+        make_grid(vert, indices, size, 0.f);
+        int const count = indices.count();
+
+        /* A flat grid loses most triangles without any error */
+        float error = EasyMesh::Simplify(vert, indices, count / 10);
+        lolunit_assert(indices.count() <= count / 10);
+        lolunit_assert(indices.count() > 0);
+        lolunit_assert(error < 1e-3f);
+
+        array<uint8_t> used;
+        used.resize(vert.count(), 0);
+        for (int i = 0; i < indices.count(); i += 3)
+        {
+            vec3 p0 = vert[indices[i]].m_coord;
+            vec3 n = cross(vert[indices[i + 1]].m_coord - p0,
+                           vert[indices[i + 2]].m_coord - p0);
+            lolunit_set_context(i);
+            lolunit_assert(n.z > 0.f);
+            for (int k = 0; k < 3; ++k)
+                used[indices[i + k]] = 1;
+        }
+
+        /* Borders and both sides of the seam are kept */
+        for (int i = 0; i < vert.count(); ++i)
+        {
+            vec3 p = vert[i].m_coord;
+            if (p.x == 0.f || p.y == 0.f || p.x == size || p.y == size || p.x == seam)
+            {
+                lolunit_set_context(i);
+                lolunit_assert(used[i]);
+            }
+        }
+
+        /* Triangles never mix the colours of both sides */
+        for (int i = 0; i < indices.count(); i += 3)
+        {
+            float c = vert[indices[i]].m_color.r;
+            lolunit_assert_equal(c, vert[indices[i + 1]].m_color.r);
+            lolunit_assert_equal(c, vert[indices[i + 2]].m_color.r);
+        }
+    }
+
+    lolunit_declare_test(lod_selection)
+    {
+        EasyMesh em;
+        array<uint32_t> indices;
+        make_grid(em.m_vert, indices, 64, 2.f);
+        for (auto i : indices)
+            em.m_indices << (uint16_t)i;
+
+        em.GenerateLods({ 0.5f, 0.25f, 0.1f });
+        lolunit_assert_equal(3, em.GetLodCount());
+        for (int i = 0; i < 3; ++i)
+        {
+            int prev = i ? em.m_lod_indices[i - 1].count() : em.m_indices.count();
+            lolunit_set_context(i);
+            lolunit_assert(em.m_lod_indices[i].count() < prev);
+            lolunit_assert(em.m_lod_errors[i] > 0.f);
+        }
+
+        /* Further away means coarser, and close enough means full detail */
+        mat4 model = mat4::translate(vec3(-32.f, -32.f, 0.f));
+        mat4 proj = mat4::perspective(radians(60.f), 800.f, 600.f, 0.1f, 1e5f);
+        int prev = 0;
+        for (float d : { 50.f, 200.f, 1000.f, 5000.f, 50000.f })
+        {
+            mat4 view = mat4::lookat(vec3(0.f, 0.f, d), vec3(0.f), vec3(0.f, 1.f, 0.f));
+            int lod = em.SelectLod(model, view, proj, 600.f);
+            lolunit_set_context(d);
+            lolunit_assert(lod >= prev);
+            prev = lod;
+        }
+        lolunit_assert_equal(3, prev);
+        mat4 near_view = mat4::lookat(vec3(0.f, 0.f, 50.f), vec3(0.f), vec3(0.f, 1.f, 0.f));
+        lolunit_assert_equal(0, em.SelectLod(model, near_view, proj, 600.f));
+
+        /* Converting reorders the vertices, levels of detail follow */
+        for (int i = 0; i < em.m_vert.count(); ++i)
+            em.m_vert[i].m_bone_id.x = i;
+        EasyMesh optimized = em;
+        optimized.OptimizeForRender(false);
+        for (int i = 0; i < 3; ++i)
+        {
+            array<ivec3> tris = triangle_set(em, em.m_lod_indices[i]);
+            array<ivec3> new_tris = triangle_set(optimized, optimized.m_lod_indices[i]);
+            lolunit_set_context(i);
+            lolunit_assert_equal(tris.count(), new_tris.count());
+            for (int j = 0; j < tris.count(); ++j)
+                lolunit_assert(tris[j] == new_tris[j]);
+        }
+    }
+
+    lolunit_declare_test(mesh_batch)
+    {
+        /* Batches only look at submeshes when drawing, so any distinct
+         * addresses will do here */
+        int tags[3];
+        SubMesh *lods[3];
+        for (int i = 0; i < 3; ++i)
+            lods[i] = (SubMesh *)&tags[i];
+
+        /* Copies that were added together stay as they are */
+        array<mat4> matrices;
+        for (int i = 0; i < 10; ++i)
+            matrices << mat4::translate(vec3((float)i, 0.f, 0.f));
+        PrimitiveMeshBatch grouped(lods[0], matrices);
+        grouped.Add(lods[1], mat4(2.f));
+        grouped.Prepare();
+        lolunit_assert_equal(2, grouped.GetDrawCount());
+        lolunit_assert_equal(11, grouped.GetMatrices().count());
+        for (int i = 0; i < 10; ++i)
+            lolunit_assert(grouped.GetMatrices()[i] == matrices[i]);
+
+        /* Interleaved copies are moved next to the other copies of
+         * their submesh, keeping their order */
+        PrimitiveMeshBatch mixed;
+        for (int i = 0; i < 10; ++i)
+            mixed.Add(lods[i % 3], matrices[i]);
+        mixed.Prepare();
+        lolunit_assert_equal(3, mixed.GetDrawCount());
+        int const order[] = { 0, 3, 6, 9, 1, 4, 7, 2, 5, 8 };
+        for (int i = 0; i < 10; ++i)
+            lolunit_assert(mixed.GetMatrices()[i] == matrices[order[i]]);
+    }
+
+    lolunit_declare_test(simplify_benchmark)
+    {
+        array<VertexData> vert;
+        array<uint32_t> indices, lod;
+        make_grid(vert, indices, 500, 10.f);
+
+        for (float ratio : { 0.5f, 0.1f, 0.01f })
+        {
+            lod = indices;
+            timer t;
+            float error = EasyMesh::Simplify(vert, lod, (int)(ratio * indices.count()));
+            float t_simplify = t.get();
+            lolunit_assert(lod.count() <= ratio * indices.count());
+
+            msg::info("easymesh: simplify %d to %d triangles in %.0fms, error %.3f\n",
+                      indices.count() / 3, lod.count() / 3, 1e3f * t_simplify, error);
+        }
+    }
+
+    /* CPU side only: the draws themselves need a GL context, so this
+     * compares the per-copy matrix work of drawing copies one by one with
+     * the cost of grouping them into instanced draws. */
+    lolunit_declare_test(batch_grouping_benchmark)
+    {
+        int tags[3];
+        SubMesh *lods[3];
+        for (int i = 0; i < 3; ++i)
+            lods[i] = (SubMesh *)&tags[i];
+
+        mat4 view = mat4::lookat(vec3(0.f, 0.f, 100.f), vec3(0.f), vec3(0.f, 1.f, 0.f));
+        array<mat4> matrices;
+        for (int i = 0; i < 100000; ++i)
+            matrices << mat4::translate(vec3(rand(-50.f, 50.f), rand(-50.f, 50.f), 0.f))
+                      * mat4::rotate(rand(6.28f), vec3(0.f, 0.f, 1.f));
+
+        for (int count : { 1000, 10000, 100000 })
+        {
+            /* One draw per copy: the work done by SetModelMatrix() */
+            timer t;
+            float sum = 0.f;
+            for (int i = 0; i < count; ++i)
+            {
+                mat4 modelview = view * matrices[i];
+                mat3 normalmat = transpose(inverse(mat3(modelview)));
+                sum += modelview[3][0] + normalmat[0][0];
+            }
+            float t_draws = t.get();
+
+            /* One batch with interleaved levels of detail, as built by
+             * EasyMesh::Render() */
+            PrimitiveMeshBatch batch;
+            for (int i = 0; i < count; ++i)
+                batch.Add(lods[i % 3], matrices[i]);
+            batch.Prepare();
+            float t_batch = t.get();
+
+            lolunit_assert_equal(3, batch.GetDrawCount());
+            lolunit_assert_equal(count, batch.GetMatrices().count());
+            lolunit_assert(sum == sum);
+
+            msg::info("easymesh: %d copies, per-copy matrices %.3fms, grouping "
+                      "into %d draws %.3fms\n", count, 1e3f * t_draws,
+                      batch.GetDrawCount(), 1e3f * t_batch);
+        }
+    }
+
+    lolunit_declare_test(build_cache)
+    {
+        EasyMesh::SetCacheDir(".");
+        int hits0, misses0, hits, misses;
+        float saved;
+        EasyMesh::GetCacheStats(hits0, misses0, saved);
+
+        timer t;
+        EasyMesh cold;
+        uint64_t key = build(cold, 2.f);
+        float t_cold = t.get();
+        EasyMesh warm;
+        build(warm, 2.f);
+        float t_warm = t.get();
+
+        EasyMesh::GetCacheStats(hits, misses, saved);
+        lolunit_assert_equal(hits0 + 1, hits);
+        lolunit_assert_equal(misses0 + 1, misses);
+        check_same(cold, warm);
+
+        /* A different argument is a different mesh */
+        EasyMesh other;
+        uint64_t other_key = build(other, 3.f);
+        EasyMesh::GetCacheStats(hits, misses, saved);
+        lolunit_assert_equal(misses0 + 2, misses);
+        lolunit_assert(other_key != key);
+        lolunit_assert(other.m_vert[0].m_coord != cold.m_vert[0].m_coord);
+
+        for (uint64_t k : { key, other_key })
+            std::remove(format("%016llx.mesh", (unsigned long long)k).c_str());
+        EasyMesh::SetCacheDir("");
+
+        msg::info("easymesh: %d vertices, build %.3fms, cached %.3fms\n",
+                  cold.m_vert.count(), 1e3f * t_cold, 1e3f * t_warm);
+    }
+};
+
+} /* namespace lol */
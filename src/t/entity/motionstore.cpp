@@ -0,0 +1,178 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+namespace lol
+{
+
+/* The same data as heap allocated objects with a virtual update, the
+ * way WorldEntity stores it, to compare against in the benchmark. */
+struct motion_object
+{
+    virtual ~motion_object() {}
+
+    virtual void update(float seconds)
+    {
+        m_position += m_velocity * seconds;
+        vec3 w = m_rotation_velocity * 0.5f * seconds;
+        quat dq = quat(0.f, w.x, w.y, w.z) * m_rotation;
+        m_rotation = normalize(m_rotation + dq);
+        mat3 m(m_rotation);
+        vec3 c = m_position + m * m_local.center();
+        vec3 e = abs(m[0]) * m_local.extent().x * 0.5f
+               + abs(m[1]) * m_local.extent().y * 0.5f
+               + abs(m[2]) * m_local.extent().z * 0.5f;
+        m_aabb = box3(c - e, c + e);
+    }
+
+    vec3 m_position, m_velocity, m_rotation_velocity;
+    quat m_rotation;
+    box3 m_local, m_aabb;
+};
+
+lolunit_declare_fixture(motion_store_test)
+{
+    lolunit_declare_test(stable_handles)
+    {
+        MotionStore store;
+        array<int> handles;
+        for (int i = 0; i < 20; ++i)
+        {
+            handles.push(store.Alloc());
+            store.SetPosition(handles.last(), vec3((float)i));
+        }
+
+        /* Releasing entries compacts the store but keeps handles valid */
+        for (int i = 0; i < 20; i += 3)
+            store.Release(handles[i]);
+        lolunit_assert_equal(13, store.GetCount());
+        for (int i = 0; i < 20; ++i)
+            if (i % 3)
+                lolunit_assert_equal((float)i, store.GetPosition(handles[i]).x);
+
+        /* Released handles are reused */
+        int h = store.Alloc();
+        lolunit_assert_equal(14, store.GetCount());
+        lolunit_assert_equal(0.f, store.GetPosition(h).x);
+        lolunit_assert_equal(1.f, store.GetRotation(h).w);
+    }
+
+    lolunit_declare_test(integrate)
+    {
+        MotionStore store;
+        array<int> handles;
+        array<motion_object> objects;
+        objects.resize(23);
+
+        for (motion_object &o : objects)
+        {
+            o.m_position = vec3(rand(-10.f, 10.f), rand(-10.f, 10.f), rand(-10.f, 10.f));
+            o.m_velocity = vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f));
+            o.m_rotation = normalize(quat(rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f)));
+            o.m_rotation_velocity = vec3(rand(-2.f, 2.f), rand(-2.f, 2.f), rand(-2.f, 2.f));
+            o.m_local = box3(vec3(-1.f, -2.f, 0.f), vec3(1.f, 3.f, 0.5f));
+
+            int h = store.Alloc();
+            store.SetPosition(h, o.m_position);
+            store.SetVelocity(h, o.m_velocity);
+            store.SetRotation(h, o.m_rotation);
+            store.SetRotationVelocity(h, o.m_rotation_velocity);
+            store.SetLocalAABB(h, o.m_local);
+            handles.push(h);
+        }
+
+        for (int frame = 0; frame < 10; ++frame)
+        {
+            store.Integrate(0.02f);
+            for (motion_object &o : objects)
+                o.update(0.02f);
+        }
+
+        for (int i = 0; i < objects.count(); ++i)
+        {
+            lolunit_set_context(i);
+            motion_object const &o = objects[i];
+            vec3 p = store.GetPosition(handles[i]);
+            quat q = store.GetRotation(handles[i]);
+            box3 b = store.GetAABB(handles[i]);
+            for (int j = 0; j < 3; ++j)
+            {
+                lolunit_assert_doubles_equal(o.m_position[j], p[j], 1e-4);
+                lolunit_assert_doubles_equal(o.m_aabb.aa[j], b.aa[j], 1e-4);
+                lolunit_assert_doubles_equal(o.m_aabb.bb[j], b.bb[j], 1e-4);
+            }
+            for (int j = 0; j < 4; ++j)
+                lolunit_assert_doubles_equal(o.m_rotation[j], q[j], 1e-4);
+        }
+    }
+
+    lolunit_declare_test(aabb_output)
+    {
+        MotionStore store;
+        box3 out;
+        int h = store.Alloc();
+        store.SetLocalAABB(h, box3(vec3(-1.f), vec3(1.f)));
+        store.SetAABBOutput(h, &out);
+        store.SetVelocity(h, vec3(10.f, 0.f, 0.f));
+        store.Integrate(0.5f);
+
+        lolunit_assert_doubles_equal(4.f, out.aa.x, 1e-5);
+        lolunit_assert_doubles_equal(6.f, out.bb.x, 1e-5);
+
+        /* A quarter turn around z swaps the x and y extents */
+        store.SetLocalAABB(h, box3(vec3(-2.f, -1.f, -1.f), vec3(2.f, 1.f, 1.f)));
+        store.SetRotation(h, quat::rotate(radians(90.f), vec3::axis_z));
+        lolunit_assert_doubles_equal(-1.f, out.aa.x - store.GetPosition(h).x, 1e-5);
+        lolunit_assert_doubles_equal(-2.f, out.aa.y, 1e-5);
+    }
+
+    lolunit_declare_test(motion_store_benchmark)
+    {
+        for (int count : { 10000, 100000, 1000000 })
+        {
+            MotionStore store;
+            array<motion_object *> objects;
+            for (int i = 0; i < count; ++i)
+            {
+                vec3 v(rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f));
+                objects.push(new motion_object());
+                objects.last()->m_velocity = v;
+                objects.last()->m_rotation_velocity = v;
+                objects.last()->m_rotation = quat(1.f);
+
+                int h = store.Alloc();
+                store.SetVelocity(h, v);
+                store.SetRotationVelocity(h, v);
+            }
+
+            timer t;
+            for (motion_object *o : objects)
+                o->update(0.02f);
+            float t_objects = t.get();
+            store.Integrate(0.02f);
+            float t_store = t.get();
+
+            for (motion_object *o : objects)
+                delete o;
+
+            msg::info("motion store: %d entities, objects %.3fms, "
+                      "store %.3fms\n", count, 1e3f * t_objects,
+                      1e3f * t_store);
+        }
+    }
+};
+
+} /* namespace lol */
+
@@ -0,0 +1,135 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+namespace lol
+{
+
+lolunit_declare_fixture(particle_test)
+{
+    lolunit_declare_test(integrate)
+    {
+        ParticleSystem ps;
+        ps.SetGravity(vec3(0.f, -10.f, 0.f));
+
+        /* Enough particles to use both the SIMD and the scalar paths */
+        for (int i = 0; i < 7; ++i)
+            ps.Emit(i, vec3((float)i, 0.f, 0.f), vec3(1.f, 5.f, 0.f));
+
+        for (int frame = 0; frame < 10; ++frame)
+            ps.Update(0.1f);
+
+        /* Without drag the trapezoidal rule is exact for gravity */
+        lolunit_assert_equal(7, ps.GetCount());
+        for (int i = 0; i < ps.GetCount(); ++i)
+        {
+            lolunit_set_context(i);
+            vec3 p = ps.GetPosition(i), v = ps.GetVelocity(i);
+            lolunit_assert_doubles_equal((float)ps.GetId(i) + 1.f, p.x, 1e-4);
+            lolunit_assert_doubles_equal(0.f, p.y, 1e-4);
+            lolunit_assert_doubles_equal(-5.f, v.y, 1e-4);
+        }
+
+        /* Drag slows particles down */
+        ps.SetGravity(vec3(0.f));
+        ps.SetDrag(0.5f);
+        ps.Update(0.1f);
+        lolunit_assert_doubles_equal(0.95f, ps.GetVelocity(0).x, 1e-5);
+    }
+
+    lolunit_declare_test(kill)
+    {
+        ParticleSystem ps;
+        ps.SetKillHeight(-100.f);
+
+        /* Every third particle falls too low, every third one expires */
+        for (int i = 0; i < 30; ++i)
+        {
+            float vy = i % 3 == 0 ? -2000.f : 0.f;
+            float lifetime = i % 3 == 1 ? 0.05f : -1.f;
+            ps.Emit(i, vec3(0.f), vec3(0.f, vy, 0.f), lifetime);
+        }
+        ps.Update(0.1f);
+
+        lolunit_assert_equal(10, ps.GetCount());
+        for (int i = 0; i < ps.GetCount(); ++i)
+            lolunit_assert_equal(2, ps.GetId(i) % 3);
+
+        /* Swap-remove keeps the data of moved particles together */
+        ps.Clear();
+        for (int i = 0; i < 10; ++i)
+            ps.Emit(i, vec3((float)i), vec3(0.f), i < 5 ? 0.05f : -1.f);
+        ps.Update(0.1f);
+        lolunit_assert_equal(5, ps.GetCount());
+        for (int i = 0; i < ps.GetCount(); ++i)
+            lolunit_assert_equal((float)ps.GetId(i), ps.GetPosition(i).z);
+    }
+
+    lolunit_declare_test(fill)
+    {
+        ParticleSystem ps;
+        ps.Emit(1, vec3(10.f, 20.f, 3.f), vec3(0.f));
+
+        ivec2 sizes[] = { ivec2(8, 8), ivec2(4, 2) };
+        box2 texels[] = { box2(vec2(0.f), vec2(0.5f)),
+                          box2(vec2(0.5f, 0.f), vec2(1.f, 0.25f)) };
+        vec3 vertices[6];
+        vec2 texcoords[6];
+        ps.Fill(vertices, texcoords, sizes, texels);
+
+        /* Same layout as TileSet::BlitTile for an unrotated tile */
+        lolunit_assert_equal(vec3(14.f, 22.f, 3.f), vertices[0]);
+        lolunit_assert_equal(vec3(10.f, 22.f, 3.f), vertices[1]);
+        lolunit_assert_equal(vec3(14.f, 20.f, 3.f), vertices[2]);
+        lolunit_assert_equal(vec3(10.f, 20.f, 3.f), vertices[5]);
+        lolunit_assert_equal(vec2(1.f, 0.f), texcoords[0]);
+        lolunit_assert_equal(vec2(0.5f, 0.25f), texcoords[5]);
+    }
+
+    lolunit_declare_test(particle_benchmark)
+    {
+        for (int count : { 10000, 100000, 1000000 })
+        {
+            ParticleSystem ps;
+            ps.SetGravity(vec3(0.f, -9.81f, 0.f));
+            ps.SetDrag(0.1f);
+            for (int i = 0; i < count; ++i)
+                ps.Emit(0, vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), 0.f),
+                        vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), 0.f),
+                        rand(1.f, 10.f));
+
+            array<vec3> vertices;
+            array<vec2> texcoords;
+            vertices.resize(6 * count);
+            texcoords.resize(6 * count);
+            ivec2 size(8);
+            box2 texel(vec2(0.f), vec2(1.f));
+
+            timer t;
+            for (int frame = 0; frame < 10; ++frame)
+                ps.Update(0.01f);
+            float t_update = t.get() / 10;
+            ps.Fill(vertices.data(), texcoords.data(), &size, &texel);
+            float t_fill = t.get();
+
+            msg::info("particles: %d, update %.0f/ms, fill %.0f/ms\n",
+                      count, 1e-3f * count / t_update,
+                      1e-3f * count / t_fill);
+        }
+    }
+};
+
+} /* namespace lol */
+
@@ -0,0 +1,194 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+namespace lol
+{
+
+/* A cheap entity that keeps count of its instances and game ticks */
+struct bullet : public Entity
+{
+    bullet() { ++alive; }
+    virtual ~bullet() { --alive; }
+
+    virtual std::string GetName() const { return "<bullet>"; }
+
+    virtual void TickGame(float seconds)
+    {
+        Entity::TickGame(seconds);
+        ++ticks;
+        last_seconds = seconds;
+    }
+
+    static int alive, ticks;
+    static float last_seconds;
+};
+
+int bullet::alive = 0;
+int bullet::ticks = 0;
+float bullet::last_seconds = 0.f;
+
+lolunit_declare_fixture(ticker_test)
+{
+    /* New entities are inserted at the second tick after their creation */
+    void spawn(array<bullet *> &bullets, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            bullets.push(new bullet());
+            Ticker::Ref(bullets.last());
+        }
+    }
+
+    /* Entities that were not inserted yet need one more tick */
+    void despawn_all(array<bullet *> &bullets)
+    {
+        for (bullet *b : bullets)
+            Ticker::Unref(b);
+        bullets.empty();
+        for (int i = 0; i < 3; ++i)
+            Ticker::TickGame();
+    }
+
+    lolunit_declare_test(spawn_despawn)
+    {
+        int alive = bullet::alive;
+        array<bullet *> bullets;
+        spawn(bullets, 100);
+        Ticker::TickGame();
+        Ticker::TickGame();
+
+        int ticks = bullet::ticks;
+        Ticker::TickGame();
+        lolunit_assert_equal(ticks + 100, bullet::ticks);
+
+        /* Released entities are no longer ticked, and deleted at the
+         * following tick; the others are still ticked once each */
+        for (int i = 0; i < 100; i += 2)
+            Ticker::Unref(bullets[i]);
+        ticks = bullet::ticks;
+        Ticker::TickGame();
+        lolunit_assert_equal(ticks + 50, bullet::ticks);
+        lolunit_assert_equal(alive + 100, bullet::alive);
+        Ticker::TickGame();
+        lolunit_assert_equal(ticks + 100, bullet::ticks);
+        lolunit_assert_equal(alive + 50, bullet::alive);
+
+        /* Referencing an entity again before the tick keeps it */
+        Ticker::Unref(bullets[1]);
+        Ticker::Ref(bullets[1]);
+        Ticker::TickGame();
+        Ticker::TickGame();
+        lolunit_assert_equal(alive + 50, bullet::alive);
+
+        array<bullet *> rest;
+        for (int i = 1; i < 100; i += 2)
+            rest.push(bullets[i]);
+        despawn_all(rest);
+        lolunit_assert_equal(alive, bullet::alive);
+    }
+
+    lolunit_declare_test(spawn_despawn_benchmark)
+    {
+        for (int count : { 10000, 100000 })
+        {
+            int alive = bullet::alive;
+            array<bullet *> bullets;
+            spawn(bullets, count);
+            Ticker::TickGame();
+            Ticker::TickGame();
+
+            /* Replace a tenth of the entities at every tick, picked at
+             * random so that removals are spread over the lists */
+            int const churn = count / 10, frames = 100;
+            float t_total = 0.f, t_worst = 0.f;
+            timer t;
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                for (int i = 0; i < churn; ++i)
+                {
+                    int n = rand(bullets.count());
+                    Ticker::Unref(bullets[n]);
+                    bullets.remove_swap(n);
+                }
+                spawn(bullets, churn);
+
+                t.get();
+                Ticker::TickGame();
+                float t_frame = t.get();
+                t_total += t_frame;
+                t_worst = max(t_worst, t_frame);
+            }
+
+            lolunit_assert_equal(count, bullets.count());
+            despawn_all(bullets);
+            lolunit_assert_equal(alive, bullet::alive);
+
+            msg::info("ticker: %d entities, %d spawned and despawned per tick, "
+                      "%.3fms per tick, worst %.3fms\n", count, churn,
+                      1e3f * t_total / frames, 1e3f * t_worst);
+        }
+    }
+
+    lolunit_declare_test(fixed_rate)
+    {
+        int alive = bullet::alive;
+        array<bullet *> bullets;
+        spawn(bullets, 10);
+
+        Ticker::SetFixedRate(60.f, 5);
+        Ticker::StepGame(2);
+
+        /* Headless steps tick every entity once with the fixed step */
+        int ticks = bullet::ticks;
+        Ticker::StepGame(30);
+        lolunit_assert_equal(ticks + 300, bullet::ticks);
+        lolunit_assert_equal(1.f / 60.f, bullet::last_seconds);
+
+        /* A slow frame only catches up with five steps */
+        timer t;
+        t.wait(0.2f);
+        ticks = bullet::ticks;
+        Ticker::TickGame();
+        lolunit_assert_equal(ticks + 50, bullet::ticks);
+        lolunit_assert_equal(1.f / 60.f, bullet::last_seconds);
+        lolunit_assert_lequal(0.f, Ticker::GetInterpolation());
+        lolunit_assert_less(Ticker::GetInterpolation(), 1.f);
+
+        Ticker::SetFixedRate(0.f);
+        lolunit_assert_equal(1.f, Ticker::GetInterpolation());
+        despawn_all(bullets);
+        lolunit_assert_equal(alive, bullet::alive);
+    }
+
+    lolunit_declare_test(fixed_rate_benchmark)
+    {
+        int alive = bullet::alive;
+        array<bullet *> bullets;
+        spawn(bullets, 10000);
+
+        Ticker::SetFixedRate(60.f);
+        Ticker::StepGame(2);
+        float rate = Ticker::StepGame(1000);
+        Ticker::SetFixedRate(0.f);
+
+        despawn_all(bullets);
+        lolunit_assert_equal(alive, bullet::alive);
+
+        msg::info("ticker: 10000 entities, %.0f fixed steps per second\n", rate);
+    }
+};
+
+} /* namespace lol */
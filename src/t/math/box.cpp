@@ -48,6 +48,52 @@ lolunit_declare_fixture(box_test)
         b1 -= vec2(0.0f, 0.6f);
         lolunit_assert_equal(false, TestAABBVsAABB(b1, b2));
     }
+
+    lolunit_declare_test(box3d_frustum)
+    {
+        mat4 proj = mat4::perspective(radians(90.f), 1.f, 1.f, 1.f, 100.f);
+        mat4 view = mat4::lookat(vec3(0.f), vec3(0.f, 0.f, -1.f), vec3(0.f, 1.f, 0.f));
+        frustum f(proj * view);
+
+        /* In front, behind, beyond the far plane, off to the side, and
+         * straddling the near plane */
+        lolunit_assert_equal(true, TestAABBVsFrustum(box3(vec3(-1.f, -1.f, -10.f), vec3(1.f, 1.f, -8.f)), f));
+        lolunit_assert_equal(false, TestAABBVsFrustum(box3(vec3(-1.f, -1.f, 8.f), vec3(1.f, 1.f, 10.f)), f));
+        lolunit_assert_equal(false, TestAABBVsFrustum(box3(vec3(-1.f, -1.f, -120.f), vec3(1.f, 1.f, -110.f)), f));
+        lolunit_assert_equal(false, TestAABBVsFrustum(box3(vec3(20.f, -1.f, -10.f), vec3(22.f, 1.f, -8.f)), f));
+        lolunit_assert_equal(true, TestAABBVsFrustum(box3(vec3(-1.f, -1.f, -2.f), vec3(1.f, 1.f, 2.f)), f));
+    }
+
+    lolunit_declare_test(box3d_frustum_batch)
+    {
+        mat4 proj = mat4::perspective(radians(60.f), 1.5f, 1.f, 0.5f, 50.f);
+        mat4 view = mat4::lookat(vec3(3.f, 4.f, 5.f), vec3(0.f), vec3(0.f, 1.f, 0.f));
+        frustum f(proj * view);
+
+        /* The batched version must agree with the single box test,
+         * including for counts that are not a multiple of four. */
+        array<box3> boxes;
+        for (int i = 0; i < 103; ++i)
+        {
+            vec3 a = vec3(rand(-40.f, 40.f), rand(-40.f, 40.f), rand(-40.f, 40.f));
+            boxes.push(box3(a, a + vec3(rand(0.f, 5.f), rand(0.f, 5.f), rand(0.f, 5.f))));
+        }
+
+        array<bool> visible;
+        visible.resize(boxes.count());
+        int count = TestAABBVsFrustum(boxes.data(), boxes.count(), f, visible.data());
+
+        int expected = 0;
+        for (int i = 0; i < boxes.count(); ++i)
+        {
+            lolunit_set_context(i);
+            lolunit_assert_equal(TestAABBVsFrustum(boxes[i], f), visible[i]);
+            expected += visible[i];
+        }
+        lolunit_assert_equal(expected, count);
+        lolunit_assert_less(0, count);
+        lolunit_assert_less(count, boxes.count());
+    }
 };
 
 } /* namespace lol */
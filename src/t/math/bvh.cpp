@@ -0,0 +1,289 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+
+#include <lolunit.h>
+
+namespace lol
+{
+
+struct bvh_item
+{
+    box3 m_aabb;
+    int m_proxy;
+
+    box3 GetAABB() const { return m_aabb; }
+};
+
+struct bvh_item2
+{
+    box2 m_aabb;
+
+    box2 GetAABB() const { return m_aabb; }
+};
+
+static box3 random_box(float range, float size)
+{
+    vec3 a(rand(-range, range), rand(-range, range), rand(-range, range));
+    return box3(a, a + vec3(rand(0.f, size), rand(0.f, size), rand(0.f, size)));
+}
+
+lolunit_declare_fixture(bvh_test)
+{
+    /* Check that a query returns a superset of the exact matches, and
+     * that every reported element has an enlarged box intersecting it. */
+    void check_query(dynamic_bvh<bvh_item, 3> const &tree,
+                     array<bvh_item> const &items, box3 const &query)
+    {
+        array<int> proxies;
+        tree.query(query, [&](int proxy)
+        {
+            proxies.push(proxy);
+            return true;
+        });
+
+        array<bool> found;
+        found.resize(items.count(), false);
+        for (int proxy : proxies)
+        {
+            lolunit_assert(TestAABBVsAABB(tree.get_fat_aabb(proxy), query));
+            found[int(tree.get_element(proxy) - items.data())] = true;
+        }
+
+        for (int i = 0; i < items.count(); ++i)
+            if (TestAABBVsAABB(items[i].m_aabb, query))
+                lolunit_assert(found[i]);
+    }
+
+    lolunit_declare_test(insert_query_remove)
+    {
+        dynamic_bvh<bvh_item, 3> tree;
+        array<bvh_item> items;
+        items.resize(1000);
+
+        for (bvh_item &item : items)
+        {
+            item.m_aabb = random_box(100.f, 5.f);
+            item.m_proxy = tree.insert(&item, item.m_aabb);
+        }
+        lolunit_assert_equal(1000, tree.count());
+
+        /* Rotations keep the tree close to balanced */
+        lolunit_assert_lequal(tree.height(), 20);
+
+        for (int i = 0; i < 50; ++i)
+            check_query(tree, items, random_box(100.f, 30.f));
+
+        for (int i = 0; i < items.count(); i += 2)
+            tree.remove(items[i].m_proxy);
+        lolunit_assert_equal(500, tree.count());
+
+        int count = 0, odd = 0;
+        tree.query(box3(vec3(-200.f), vec3(200.f)), [&](int proxy)
+        {
+            odd += int(tree.get_element(proxy) - items.data()) % 2;
+            ++count;
+            return true;
+        });
+        lolunit_assert_equal(500, count);
+        lolunit_assert_equal(500, odd);
+
+        /* Stop the query early */
+        count = 0;
+        tree.query(box3(vec3(-200.f), vec3(200.f)), [&](int)
+        {
+            return ++count < 10;
+        });
+        lolunit_assert_equal(10, count);
+    }
+
+    lolunit_declare_test(update_refit)
+    {
+        dynamic_bvh<bvh_item, 3> tree(0.5f);
+        array<bvh_item> items;
+        items.resize(500);
+        array<int> proxies;
+        array<box3> boxes;
+
+        for (bvh_item &item : items)
+        {
+            item.m_aabb = random_box(50.f, 3.f);
+            item.m_proxy = tree.insert(&item, item.m_aabb);
+        }
+
+        /* Small motions stay inside the enlarged boxes */
+        bvh_item &item = items[0];
+        item.m_aabb += vec3(0.2f);
+        lolunit_assert(!tree.update(item.m_proxy, item.m_aabb));
+        item.m_aabb += vec3(10.f);
+        lolunit_assert(tree.update(item.m_proxy, item.m_aabb));
+        check_query(tree, items, item.m_aabb);
+
+        /* Move a few items, then all of them, in batches */
+        for (int pass : { 10, 500 })
+        {
+            proxies.empty();
+            boxes.empty();
+            for (int i = 0; i < pass; ++i)
+            {
+                items[i].m_aabb += vec3(rand(-5.f, 5.f), rand(-5.f, 5.f), rand(-5.f, 5.f));
+                proxies.push(items[i].m_proxy);
+                boxes.push(items[i].m_aabb);
+            }
+            tree.refit(proxies.data(), boxes.data(), proxies.count());
+
+            for (int i = 0; i < 20; ++i)
+                check_query(tree, items, random_box(50.f, 20.f));
+        }
+    }
+
+    lolunit_declare_test(ray_frustum)
+    {
+        dynamic_bvh<bvh_item, 3> tree;
+        array<bvh_item> items;
+        items.resize(300);
+        for (bvh_item &item : items)
+        {
+            item.m_aabb = random_box(30.f, 4.f);
+            item.m_proxy = tree.insert(&item, item.m_aabb);
+        }
+
+        /* A segment along the x axis, and a frustum looking down -z */
+        vec3 p0(-40.f, 1.f, 2.f), p1(40.f, 1.f, 2.f);
+        frustum f(mat4::perspective(radians(60.f), 1.f, 1.f, 1.f, 40.f)
+                   * mat4::lookat(vec3(0.f), vec3(0.f, 0.f, -1.f), vec3(0.f, 1.f, 0.f)));
+
+        array<bool> on_ray, in_view;
+        on_ray.resize(items.count(), false);
+        in_view.resize(items.count(), false);
+        tree.query_ray(p0, p1, [&](int proxy)
+        {
+            on_ray[int(tree.get_element(proxy) - items.data())] = true;
+            return true;
+        });
+        tree.query(f, [&](int proxy)
+        {
+            in_view[int(tree.get_element(proxy) - items.data())] = true;
+            return true;
+        });
+
+        for (int i = 0; i < items.count(); ++i)
+        {
+            box3 const &b = items[i].m_aabb;
+            lolunit_set_context(i);
+            if (b.aa.y <= p0.y && p0.y <= b.bb.y && b.aa.z <= p0.z && p0.z <= b.bb.z)
+                lolunit_assert(on_ray[i]);
+            if (TestAABBVsFrustum(b, f))
+                lolunit_assert(in_view[i]);
+        }
+    }
+
+    lolunit_declare_test(octree_facade)
+    {
+        Octree<bvh_item> octree;
+        octree.SetSize(vec3(200.f));
+
+        array<bvh_item> items;
+        items.resize(200);
+        for (bvh_item &item : items)
+        {
+            item.m_aabb = random_box(80.f, 5.f);
+            octree.RegisterElement(&item);
+        }
+
+        /* Registering twice updates the element instead of adding it */
+        octree.RegisterElement(&items[0]);
+        lolunit_assert_equal(200, octree.GetTree().count());
+
+        array<bvh_item *> found;
+        box3 query(vec3(-20.f), vec3(20.f));
+        octree.FindElements(query, found);
+        int expected = 0;
+        for (bvh_item const &item : items)
+            expected += TestAABBVsAABB(item.m_aabb, query);
+        lolunit_assert_equal(expected, found.count());
+
+        /* Elements leaving the tree bounds are dropped */
+        items[0].m_aabb = box3(vec3(500.f), vec3(501.f));
+        octree.RegisterElement(&items[0]);
+        octree.UnregisterElement(&items[1]);
+        lolunit_assert_equal(198, octree.GetTree().count());
+
+        Quadtree<bvh_item2> quadtree;
+        quadtree.SetSize(vec2(10.f));
+        bvh_item2 a { box2(vec2(0.f), vec2(1.f)) }, b { box2(vec2(3.f), vec2(4.f)) };
+        quadtree.RegisterElement(&a);
+        quadtree.RegisterElement(&b);
+
+        array<bvh_item2 *> found2;
+        lolunit_assert(quadtree.FindElements(box2(vec2(0.5f), vec2(2.f)), found2));
+        lolunit_assert_equal(1, found2.count());
+        lolunit_assert_equal(&a, found2[0]);
+    }
+
+    lolunit_declare_test(bvh_benchmark)
+    {
+        int const count = 50000;
+
+        dynamic_bvh<bvh_item, 3> tree;
+        array<bvh_item> items;
+        array<vec3> velocities;
+        array<int> proxies;
+        array<box3> boxes;
+        items.resize(count);
+
+        timer t;
+        for (bvh_item &item : items)
+        {
+            item.m_aabb = random_box(500.f, 4.f);
+            item.m_proxy = tree.insert(&item, item.m_aabb);
+            velocities.push(vec3(rand(-1.f, 1.f), rand(-1.f, 1.f), rand(-1.f, 1.f)));
+            proxies.push(item.m_proxy);
+        }
+        float t_insert = t.get();
+
+        /* Move every object a bit, ten frames in a row */
+        for (int frame = 0; frame < 10; ++frame)
+            for (int i = 0; i < count; ++i)
+            {
+                items[i].m_aabb += velocities[i] * 0.05f;
+                tree.update(items[i].m_proxy, items[i].m_aabb);
+            }
+        float t_update = t.get();
+
+        for (int frame = 0; frame < 10; ++frame)
+        {
+            boxes.empty();
+            for (int i = 0; i < count; ++i)
+            {
+                items[i].m_aabb += velocities[i] * 0.05f;
+                boxes.push(items[i].m_aabb);
+            }
+            tree.refit(proxies.data(), boxes.data(), count);
+        }
+        float t_refit = t.get();
+
+        int hits = 0;
+        for (int i = 0; i < 1000; ++i)
+            tree.query(random_box(500.f, 20.f), [&](int) { ++hits; return true; });
+        float t_query = t.get();
+
+        msg::info("bvh: %d objects, insert %.3fms, update %.3fms/frame, "
+                  "refit %.3fms/frame, 1000 queries %.3fms (%d hits)\n",
+                  count, 1e3f * t_insert, 1e2f * t_update, 1e2f * t_refit,
+                  1e3f * t_query, hits);
+    }
+};
+
+} /* namespace lol */
+
@@ -168,6 +168,93 @@ lolunit_declare_fixture(half_test)
         }
     }
 
+    lolunit_declare_test(bulk_float_to_half)
+    {
+        /* Every exponent with mantissas around the rounding bits, then
+         * bit patterns spread over the whole range */
+        array<float> src;
+        for (uint32_t e = 0; e < 0x200; ++e)
+            for (uint32_t m : { 0x0u, 0x1u, 0x7ffu, 0x800u, 0xfffu, 0x1000u,
+                                0x1800u, 0x2fffu, 0x400000u, 0x7fe000u,
+                                0x7ff000u, 0x7fffffu })
+                src.push(bits_to_float(e << 23 | m));
+        for (uint64_t x = 0; x < 0x100000000ull; x += 4099)
+            src.push(bits_to_float((uint32_t)x));
+
+        array<half> dst;
+        dst.resize(src.count());
+        lolunit_assert_equal((size_t)src.count(),
+                             half::convert(dst.data(), src.data(), src.count()));
+
+        for (int i = 0; i < src.count(); ++i)
+        {
+            lolunit_set_context(i);
+            lolunit_assert_equal(half::makeaccurate(src[i]).bits, dst[i].bits);
+        }
+    }
+
+    lolunit_declare_test(bulk_half_to_float)
+    {
+        array<half> src;
+        for (uint32_t i = 0; i < 0x10000; ++i)
+            src.push(half::makebits(i));
+
+        /* An odd count and offset to exercise the unaligned tails */
+        array<float> dst;
+        dst.resize(src.count());
+        lolunit_assert_equal((size_t)src.count() - 4,
+                             half::convert(dst.data() + 1, src.data() + 1,
+                                           src.count() - 4));
+
+        for (int i = 1; i < src.count() - 3; ++i)
+        {
+            lolunit_set_context(i);
+            /* Hardware conversions may quiet signalling NaNs */
+            if (src[i].is_nan())
+                lolunit_assert((float_to_bits(dst[i]) & 0x7fffffffu) > 0x7f800000u);
+            else
+                lolunit_assert_equal(float_to_bits((float)src[i]),
+                                     float_to_bits(dst[i]));
+        }
+    }
+
+    lolunit_declare_test(bulk_convert_benchmark)
+    {
+        int const count = 1 << 20;
+        array<float> f;
+        array<half> h;
+        f.resize(count);
+        h.resize(count);
+        rand_engine::get_thread().fill(f.data(), count, -1000.f, 1000.f);
+
+        timer t;
+        for (int i = 0; i < count; ++i)
+            h[i] = half::makeaccurate(f[i]);
+        float t_scalar = t.get();
+        size_t n = half::convert(h.data(), f.data(), count);
+        float t_to_half = t.get();
+        n += half::convert(f.data(), h.data(), count);
+        float t_to_float = t.get();
+
+        lolunit_assert_equal((size_t)count * 2, n);
+        msg::info("half: %d values, makeaccurate %.0f/us, "
+                  "convert to half %.0f/us, to float %.0f/us\n", count,
+                  1e-6f * count / t_scalar, 1e-6f * count / t_to_half,
+                  1e-6f * count / t_to_float);
+    }
+
+    static float bits_to_float(uint32_t x)
+    {
+        union { uint32_t x; float f; } u = { x };
+        return u.f;
+    }
+
+    static uint32_t float_to_bits(float f)
+    {
+        union { float f; uint32_t x; } u = { f };
+        return u.x;
+    }
+
     lolunit_declare_test(half_to_int)
     {
         lolunit_assert_equal((int)(half)(0.0f), 0);
@@ -33,6 +33,24 @@ lolunit_declare_fixture(interp_test)
         lolunit_assert_doubles_equal(30.f, ti.Get(0.0f), 1.e-5f);
         lolunit_assert_doubles_equal(40.f, ti.Get(1.0f), 1.e-5f);
     }
+
+    lolunit_declare_test(time_interp_blend)
+    {
+        TimeInterp<float, 4> ti;
+
+        lolunit_assert_doubles_equal(0.f, ti.Blend(0.5f), 1.e-5f);
+        ti.Set(1.f, 10.f);
+        lolunit_assert_doubles_equal(10.f, ti.Blend(0.5f), 1.e-5f);
+
+        /* Wrap around the key buffer */
+        for (int i = 2; i <= 6; ++i)
+        {
+            ti.Set(1.f, 10.f * i);
+            lolunit_assert_doubles_equal(10.f * i - 10.f, ti.Blend(0.f), 1.e-5f);
+            lolunit_assert_doubles_equal(10.f * i - 7.5f, ti.Blend(.25f), 1.e-5f);
+            lolunit_assert_doubles_equal(10.f * i, ti.Blend(1.f), 1.e-5f);
+        }
+    }
 };
 
 } /* namespace lol */
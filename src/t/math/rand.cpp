@@ -1,7 +1,7 @@
 //
 //  Lol Engine — Unit tests
 //
-//  Copyright © 2010—2015 Sam Hocevar <sam@hocevar.net>
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
 //
 //  Lol Engine is free software. It comes without any warranty, to
 //  the extent permitted by applicable law. You can redistribute it
@@ -14,9 +14,26 @@
 
 #include <lolunit.h>
 
+#include <cstdlib>
+
 namespace lol
 {
 
+/* The previous rand<int32_t>() implementation, for comparison */
+static inline int32_t libc_rand32()
+{
+    uint32_t ret = std::rand();
+    if (RAND_MAX >= 0xffff)
+        ret = (ret << 16) ^ std::rand();
+    else
+    {
+        ret = (ret << 8) ^ std::rand();
+        ret = (ret << 8) ^ std::rand();
+        ret = (ret << 8) ^ std::rand();
+    }
+    return (int32_t)(ret & 0x7fffffffu);
+}
+
 lolunit_declare_fixture(rand_test)
 {
     lolunit_declare_test(int32_bits)
@@ -105,6 +122,119 @@ lolunit_declare_fixture(rand_test)
             lolunit_unset_context(k);
         }
     }
+
+    lolunit_declare_test(engine_seed)
+    {
+        rand_engine a(42), b(42), c(43);
+
+        bool differ = false;
+        for (int i = 0; i < 100; ++i)
+        {
+            uint64_t x = a.next();
+            lolunit_assert_equal(x, b.next());
+            differ |= x != c.next();
+        }
+        lolunit_assert(differ);
+
+        /* Bulk generation is reproducible too */
+        float fa[37], fb[37];
+        a.fill(fa, 37);
+        b.fill(fb, 37);
+        lolunit_assert(!memcmp(fa, fb, sizeof(fa)));
+    }
+
+    lolunit_declare_test(fill_uniform)
+    {
+        rand_engine engine;
+        int const count = 100003;
+
+        array<float> f;
+        f.resize(count);
+        engine.fill(f.data(), count, -2.f, 3.f);
+
+        double sum = 0.0;
+        for (float x : f)
+        {
+            lolunit_assert_gequal(x, -2.f);
+            lolunit_assert_less(x, 3.f);
+            sum += x;
+        }
+        lolunit_assert_doubles_equal(0.5, sum / count, 0.05);
+
+        array<int32_t> n;
+        n.resize(count);
+        engine.fill(n.data(), count, -3, 7);
+
+        int hist[10] = { 0 };
+        for (int32_t x : n)
+        {
+            lolunit_assert_gequal(x, -3);
+            lolunit_assert_less(x, 7);
+            ++hist[x + 3];
+        }
+        for (int k = 0; k < 10; ++k)
+        {
+            lolunit_set_context(k);
+            lolunit_assert_gequal(hist[k], count / 10 * 9 / 10);
+            lolunit_assert_lequal(hist[k], count / 10 * 11 / 10);
+            lolunit_unset_context(k);
+        }
+    }
+
+    lolunit_declare_test(fill_normal)
+    {
+        rand_engine engine;
+        int const count = 100001;
+
+        array<float> f;
+        f.resize(count);
+        engine.fill_normal(f.data(), count, 5.f, 2.f);
+
+        double sum = 0.0, sum2 = 0.0;
+        for (float x : f)
+        {
+            sum += x;
+            sum2 += x * x;
+        }
+        double mean = sum / count;
+        lolunit_assert_doubles_equal(5.0, mean, 0.05);
+        lolunit_assert_doubles_equal(2.0, std::sqrt(sum2 / count - mean * mean), 0.05);
+    }
+
+    lolunit_declare_test(rand_benchmark)
+    {
+        int const count = 10000000;
+        int32_t acc = 0;
+
+        timer t;
+        for (int i = 0; i < count; ++i)
+            acc ^= libc_rand32();
+        float t_libc = t.get();
+        for (int i = 0; i < count; ++i)
+            acc ^= rand<int32_t>();
+        float t_rand = t.get();
+
+        array<int32_t> n;
+        n.resize(count);
+        rand_engine engine;
+        t.get();
+        engine.fill(n.data(), count, 0, 1000);
+        float t_fill = t.get();
+
+        array<float> f;
+        f.resize(count);
+        t.get();
+        engine.fill(f.data(), count);
+        float t_fillf = t.get();
+        engine.fill_normal(f.data(), count);
+        float t_normal = t.get();
+
+        msg::info("rand: %d values, std::rand %.0f/µs, rand %.0f/µs, "
+                  "fill int %.0f/µs, fill float %.0f/µs, normal %.0f/µs (%d)\n",
+                  count, 1e-6f * count / t_libc, 1e-6f * count / t_rand,
+                  1e-6f * count / t_fill, 1e-6f * count / t_fillf,
+                  1e-6f * count / t_normal, acc & 1);
+    }
 };
 
 } /* namespace lol */
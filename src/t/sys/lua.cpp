@@ -0,0 +1,176 @@
+//
+//  Lol Engine — Unit tests
+//
+//  Copyright © 2010—2018 Sam Hocevar <sam@hocevar.net>
+//
+//  Lol Engine is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#include <lol/engine-internal.h>
+#include <lol/lua.h>
+
+#include <lolunit.h>
+
+#include <cstdio>
+
+namespace lol
+{
+
+/* A bound class and a plain C function doing the same work, to measure
+ * the overhead of the binding layer. */
+class LuaCounter : public LuaObject
+{
+public:
+    static LuaCounter* New(lua_State* l, int arg_nb)
+    {
+        UNUSED(l, arg_nb);
+        return new LuaCounter();
+    }
+
+    static const LuaObjectLibrary* GetLib()
+    {
+        static const LuaObjectLibrary lib = LuaObjectLibrary(
+            "Counter",
+            { { nullptr, nullptr } },
+            {
+                { "Add", LOLUA_METHOD(&LuaCounter::Add) },
+                { "Scale", LOLUA_METHOD(&LuaCounter::Scale) },
+                { nullptr, nullptr }
+            },
+            { { nullptr, nullptr, nullptr } });
+        return &lib;
+    }
+
+    void Add(float x) { m_sum += x; }
+    vec3 Scale(vec3 const &v) const { return v * m_sum; }
+
+    static int RawAdd(lua_State* l)
+    {
+        m_raw_sum += (float)lua_tonumber(l, 1);
+        return 0;
+    }
+
+    float m_sum = 0.f;
+    static float m_raw_sum;
+};
+
+float LuaCounter::m_raw_sum = 0.f;
+
+class LuaCounterLoader : public LuaLoader
+{
+public:
+    LuaCounterLoader()
+    {
+        LuaObjectHelper::Register<LuaCounter>(GetLuaState());
+        LuaFunction raw_add(GetLuaState(), "raw_add", LuaCounter::RawAdd);
+    }
+};
+
+lolunit_declare_fixture(lua_test)
+{
+    /* A script large enough for compilation to take measurable time */
+    void write_script(std::string const &path, int value)
+    {
+        std::string source;
+        for (int i = 0; i < 2000; ++i)
+            source += format("function f%d(x) return x * %d + %d end\n", i, i, i);
+        source += format("result = f1(%d) - 1\n", value);
+
+        File f;
+        f.Open(path, FileAccess::Write, true);
+        lolunit_assert(f.IsValid());
+        f.Write(source);
+        f.Close();
+    }
+
+    void check_script(std::string const &path, int expected)
+    {
+        LuaLoader loader;
+        lolunit_assert(loader.ExecLuaFile(path));
+        lolunit_assert_equal(expected, loader.Get<int>("result"));
+    }
+
+    lolunit_declare_test(bytecode_cache)
+    {
+        std::string path = "lua-cache-test.lua";
+        std::remove((path + "c").c_str());
+        write_script(path, 42);
+
+        timer t;
+        check_script(path, 42);
+        float t_cold = t.get();
+        check_script(path, 42);
+        float t_warm = t.get();
+
+        /* Changing the source invalidates the cached bytecode */
+        write_script(path, 13);
+        check_script(path, 13);
+
+        /* Compile in the background while something else happens */
+        write_script(path, 7);
+        std::remove((path + "c").c_str());
+        t.get();
+        LuaLoader::Preload(path);
+        float t_preload = t.get();
+        check_script(path, 7);
+        float t_exec = t.get();
+
+        std::remove(path.c_str());
+        std::remove((path + "c").c_str());
+
+        msg::info("lua: cold %.3fms, warm %.3fms, preload %.3fms + exec %.3fms\n",
+                  1e3f * t_cold, 1e3f * t_warm, 1e3f * t_preload, 1e3f * t_exec);
+    }
+
+    lolunit_declare_test(bound_methods)
+    {
+        LuaCounterLoader loader;
+        lolunit_assert(loader.ExecLuaCode(
+            "c = Counter.New()\n"
+            "c:Add(2)\n"
+            "v = c:Scale(1, 2, 3)\n"
+            "w = c:Scale(v)\n"
+            "x, y = w.x, w.y\n"
+            "w.z = 5\n"
+            "z = w.z\n"));
+        lolunit_assert_equal(4.f, loader.Get<float>("x"));
+        lolunit_assert_equal(8.f, loader.Get<float>("y"));
+        lolunit_assert_equal(5.f, loader.Get<float>("z"));
+        lolunit_assert_equal(vec3(4.f, 8.f, 5.f), loader.Get<vec3>("w"));
+
+        /* Calling a method with '.' is a script error, not a crash */
+        lolunit_assert(!loader.ExecLuaCode("c.Add(2)"));
+        lolunit_assert(!loader.ExecLuaCode("c.Add()"));
+        lolunit_assert(!loader.ExecLuaCode("c.Scale(v)"));
+        lolunit_assert(loader.ExecLuaCode("c:Add(1)"));
+    }
+
+    lolunit_declare_test(bound_method_benchmark)
+    {
+        LuaCounterLoader loader;
+        int const count = 1000000;
+
+        timer t;
+        lolunit_assert(loader.ExecLuaCode(format(
+            "for i = 1, %d do raw_add(1) end", count)));
+        float t_raw = t.get();
+        lolunit_assert(loader.ExecLuaCode(format(
+            "c = Counter.New() for i = 1, %d do c:Add(1) end", count)));
+        float t_bound = t.get();
+        lolunit_assert(loader.ExecLuaCode(format(
+            "d = Counter.New() d:Add(1) v = d:Scale(1, 1, 1) "
+            "for i = 1, %d do v = d:Scale(v) end", count / 10)));
+        float t_value = t.get();
+
+        msg::info("lua: %d calls, raw %.1fns, bound %.1fns, vec3 %.1fns per call\n",
+                  count, 1e9f * t_raw / count, 1e9f * t_bound / count,
+                  1e10f * t_value / count);
+    }
+};
+
+} /* namespace lol */
+
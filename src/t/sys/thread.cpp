@@ -21,6 +21,73 @@
 namespace lol
 {
 
+#if LOL_FEATURE_THREADS
+/* The mutex-based queue we used before the lock-free one, kept here
+ * as a benchmark reference */
+template<typename T, int N = 128>
+class locked_queue
+{
+public:
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> uni_lock(m_mutex);
+        m_full_cond.wait(uni_lock, [&]{ return m_count < N; });
+        m_values[(m_start + m_count++) % N] = value;
+        uni_lock.unlock();
+        m_empty_cond.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> uni_lock(m_mutex);
+        m_empty_cond.wait(uni_lock, [&]{ return m_count > 0; });
+        T ret = m_values[m_start];
+        m_start = (m_start + 1) % N;
+        --m_count;
+        uni_lock.unlock();
+        m_full_cond.notify_one();
+        return ret;
+    }
+
+private:
+    T m_values[N];
+    int m_start = 0, m_count = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_empty_cond, m_full_cond;
+};
+
+/* Have producers push count values each while as many consumers pop
+ * them, and return the sum of all popped values. */
+template<typename Q>
+static int64_t queue_contention(Q &q, int threads, int count)
+{
+    std::atomic<int64_t> sum(0);
+    array<thread *> workers;
+
+    for (int i = 0; i < threads; ++i)
+    {
+        workers << new thread([&q, count](thread *)
+        {
+            for (int n = 0; n < count; ++n)
+                q.push(n + 1);
+        });
+
+        workers << new thread([&q, &sum, count](thread *)
+        {
+            int64_t local = 0;
+            for (int n = 0; n < count; ++n)
+                local += q.pop();
+            sum += local;
+        });
+    }
+
+    for (thread *t : workers)
+        delete t;
+
+    return sum;
+}
+#endif
+
 lolunit_declare_fixture(thread_test)
 {
     //FileUpdateTesterJob ---------------------------------------------------------
@@ -225,6 +292,126 @@ lolunit_declare_fixture(thread_test)
         lolunit_assert_equal(false, b2);
         lolunit_assert_equal(42, tmp);
     }
+
+    lolunit_declare_test(queue_wrap)
+    {
+        queue<int, 3> q;
+        int tmp;
+
+        for (int i = 0; i < 10; ++i)
+        {
+            lolunit_assert(q.try_push(i));
+            lolunit_assert(q.try_push(i + 100));
+            lolunit_assert(q.try_pop(tmp));
+            lolunit_assert_equal(i, tmp);
+            lolunit_assert(q.try_pop(tmp));
+            lolunit_assert_equal(i + 100, tmp);
+            lolunit_assert(!q.try_pop(tmp));
+        }
+    }
+
+    lolunit_declare_test(queue_batch)
+    {
+        queue<int, 8> q;
+        int values[12], out[12];
+
+        for (int i = 0; i < 12; ++i)
+            values[i] = i * 3;
+
+        /* Only 8 values fit */
+        lolunit_assert_equal(8, q.try_push_batch(values, 12));
+        lolunit_assert_equal(0, q.try_push_batch(values + 8, 4));
+
+        lolunit_assert_equal(5, q.try_pop_batch(out, 5));
+        lolunit_assert_equal(4, q.try_push_batch(values + 8, 4));
+
+        lolunit_assert_equal(7, q.pop_batch(out + 5, 12));
+        for (int i = 0; i < 12; ++i)
+            lolunit_assert_equal(values[i], out[i]);
+
+        lolunit_assert_equal(0, q.try_pop_batch(out, 12));
+    }
+
+#if LOL_FEATURE_THREADS
+    lolunit_declare_test(queue_blocking)
+    {
+        queue<int, 4> q;
+        int const count = 10000;
+        int64_t sum = 0;
+
+        /* The producer pushes faster than the consumer can keep up
+         * with, so both sides have to wait for each other. */
+        thread producer([&q](thread *)
+        {
+            int values[7];
+            for (int n = 0; n < count; n += 7)
+            {
+                int k = std::min(7, count - n);
+                for (int i = 0; i < k; ++i)
+                    values[i] = n + i;
+                q.push_batch(values, k);
+            }
+        });
+
+        int values[3];
+        for (int n = 0; n < count; )
+        {
+            int k = q.pop_batch(values, 3);
+            for (int i = 0; i < k; ++i)
+            {
+                lolunit_assert_equal(n + i, values[i]);
+                sum += values[i];
+            }
+            n += k;
+        }
+
+        lolunit_assert_equal((int64_t)count * (count - 1) / 2, sum);
+    }
+
+    lolunit_declare_test(queue_benchmark)
+    {
+        int const threads = 4, count = 100000;
+        int64_t const expected = (int64_t)threads * count * (count + 1) / 2;
+
+        locked_queue<int> q1;
+        queue<int> q2;
+
+        timer t;
+        int64_t sum1 = queue_contention(q1, threads, count);
+        float t_locked = t.get();
+        int64_t sum2 = queue_contention(q2, threads, count);
+        float t_lockfree = t.get();
+
+        lolunit_assert_equal(expected, sum1);
+        lolunit_assert_equal(expected, sum2);
+
+        msg::info("queue: %d producers and consumers, %d values each, "
+                  "mutex %.3fms, lock-free %.3fms\n", threads, count,
+                  1e3f * t_locked, 1e3f * t_lockfree);
+    }
+
+    lolunit_declare_test(thread_pool_run)
+    {
+        thread_pool pool(3);
+        lolunit_assert_equal(4, pool.count());
+
+        /* Every job runs exactly once per call, and nested calls run
+         * their jobs serially instead of waiting for the pool */
+        for (int n = 0; n < 1000; ++n)
+        {
+            int const jobs = 1 + n % 9;
+            std::atomic<int> hits[9];
+            for (auto &h : hits)
+                h = 0;
+            pool.run(jobs, [&](int i)
+            {
+                pool.run(2, [&](int) { ++hits[i]; });
+            });
+            for (int i = 0; i < 9; ++i)
+                lolunit_assert_equal(i < jobs ? 2 : 0, (int)hits[i]);
+        }
+    }
+#endif
 };
 
 } /* namespace lol */